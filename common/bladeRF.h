@@ -7,6 +7,8 @@
 #define BLADE_CHECK_PROG        _IOR(BLADERF_IOCTL_BASE, 4, unsigned int)
 #define BLADE_RF_RX             _IOR(BLADERF_IOCTL_BASE, 5, unsigned int)
 #define BLADE_RF_TX             _IOR(BLADERF_IOCTL_BASE, 6, unsigned int)
+#define BLADE_RX_OVERRUNS       _IOR(BLADERF_IOCTL_BASE, 7, unsigned int)
+#define BLADE_TX_UNDERRUNS      _IOR(BLADERF_IOCTL_BASE, 8, unsigned int)
 #define BLADE_LMS_WRITE         _IOR(BLADERF_IOCTL_BASE, 20, unsigned int)
 #define BLADE_LMS_READ          _IOR(BLADERF_IOCTL_BASE, 21, unsigned int)
 #define BLADE_SI5338_WRITE      _IOR(BLADERF_IOCTL_BASE, 22, unsigned int)
@@ -26,6 +28,7 @@
 #define BLADE_USB_CMD_FLASH_READ              100
 #define BLADE_USB_CMD_FLASH_WRITE             101
 #define BLADE_USB_CMD_FLASH_ERASE             102
+#define BLADE_USB_CMD_FLASH_CRC               103
 
 #define BLADE_USB_CMD_QUERY_VERSION      0
 #define BLADE_USB_CMD_QUERY_FPGA_STATUS  1
@@ -53,6 +56,9 @@ struct bladeRF_firmware {
 #define NUM_DATA_URB    (1024)
 #define DATA_BUF_SZ     (1024*4)
 
+/* Largest FPGA bitstream chunk handed to a single bulk transfer */
+#define BLADE_FPGA_PROG_CHUNK_SZ    (64*1024)
+
 struct uart_pkt {
     unsigned char magic;
 #define UART_PKT_MAGIC          'N'
@@ -76,6 +82,17 @@ struct uart_pkt {
 #define UART_PKT_MODE_DIR_WRITE  (1<<UART_PKT_MODE_DIR_SHIFT)
 };
 
+/* GPIO device register map. Address 0 is the PIO; the rest are served by
+ * the Nios firmware. Older images ignore the address and always return the
+ * PIO, so check both magic bytes before using the other registers. */
+#define UART_GPIO_ADDR_PIO          0x00
+#define UART_GPIO_ADDR_MAGIC0       0x01    /* Reads 'B' */
+#define UART_GPIO_ADDR_MAGIC1       0x02    /* Reads 'R' */
+#define UART_GPIO_ADDR_VERSION_MAJ  0x03
+#define UART_GPIO_ADDR_VERSION_MIN  0x04
+#define UART_GPIO_ADDR_IMAGE_ID     0x10    /* Host-written image hash, LSB first */
+#define UART_GPIO_IMAGE_ID_LEN      8
+
 struct uart_cmd {
     unsigned char addr;
     unsigned char data;
@@ -773,6 +773,7 @@ CyBool_t CyFxbladeRFApplnUSBSetupCB(uint32_t setupdat0, uint32_t setupdat1)
         int retStatus;
     	char buf[10];
     	uint16_t readC;
+        uint32_t crc;
 
         isHandled = CyTrue;
 
@@ -780,7 +781,7 @@ CyBool_t CyFxbladeRFApplnUSBSetupCB(uint32_t setupdat0, uint32_t setupdat1)
         {
             case BLADE_USB_CMD_QUERY_VERSION:
                 ver.major = 0;
-                ver.minor = 2;
+                ver.minor = 3;
                 apiRetStatus = CyU3PUsbSendEP0Data(sizeof(ver), &ver);
             break;
 
@@ -871,6 +872,16 @@ CyBool_t CyFxbladeRFApplnUSBSetupCB(uint32_t setupdat0, uint32_t setupdat1)
                 CyU3PUsbSendEP0Data(sizeof(ret), &ret);
             break;
 
+            case BLADE_USB_CMD_FLASH_CRC:
+                /* wIndex = first page, wValue = number of pages */
+                apiRetStatus = CyFxSpiCrc32(wIndex, wValue, glEp0Buffer, &crc);
+                if (apiRetStatus == CY_U3P_SUCCESS) {
+                    CyU3PUsbSendEP0Data(sizeof(crc), (uint8_t *)&crc);
+                } else {
+                    CyU3PUsbStall(0, CyTrue, CyFalse);
+                }
+            break;
+
             break;
             default:
                 isHandled = CyFalse;
@@ -49,6 +49,7 @@ extern const uint8_t CyFxUSBProductDscr[];
 int FpgaBeginProgram(void);
 void NuandFirmwareStart(void);
 CyU3PReturnStatus_t CyFxSpiEraseSector(CyBool_t /* isErase */, uint8_t /* sector */);
+CyU3PReturnStatus_t CyFxSpiCrc32(uint16_t /* pageAddress */, uint16_t /* pageCount */, uint8_t * /* buffer */, uint32_t * /* crc */);
 void NuandGPIOReconfigure(CyBool_t /* fullGpif */, CyBool_t /* warm */);
 int FpgaBeginProgram(void);
 
@@ -159,15 +159,44 @@ CyU3PReturnStatus_t CyFxSpiTransfer(uint16_t pageAddress, uint16_t byteCount, ui
             }
 
             CyU3PSpiSetSsnLine(CyTrue);
+
+            CyU3PThreadSleep(15);
         }
 
         byteAddress += glSpiPageSize;
         buffer += glSpiPageSize;
         pageCount--;
+    }
+
+    return CY_U3P_SUCCESS;
+}
+
+/* CRC-32 (IEEE 802.3) over pageCount flash pages, using buffer as scratch
+ * space for one page. Lets the host verify flash contents without reading
+ * them back over EP0. */
+CyU3PReturnStatus_t CyFxSpiCrc32(uint16_t pageAddress, uint16_t pageCount, uint8_t *buffer, uint32_t *crc)
+{
+    uint32_t c = 0xFFFFFFFF;
+    uint16_t i;
+    int bit;
+    CyU3PReturnStatus_t status;
 
-        CyU3PThreadSleep(15);
+    while (pageCount != 0) {
+        status = CyFxSpiTransfer(pageAddress, glSpiPageSize, buffer, CyTrue);
+        if (status != CY_U3P_SUCCESS)
+            return status;
+
+        for (i = 0; i < glSpiPageSize; i++) {
+            c ^= buffer[i];
+            for (bit = 0; bit < 8; bit++)
+                c = (c >> 1) ^ (0xEDB88320 & -(c & 1));
+        }
+
+        pageAddress++;
+        pageCount--;
     }
 
+    *crc = ~c;
     return CY_U3P_SUCCESS;
 }
 
@@ -220,6 +220,44 @@ void lms_spi_write( uint8_t address, uint8_t val )
 	return ;
 }
 
+// GPIO device register map, keep in sync with common/bladeRF.h
+#define UART_GPIO_ADDR_PIO          0x00
+#define UART_GPIO_ADDR_MAGIC0       0x01
+#define UART_GPIO_ADDR_MAGIC1       0x02
+#define UART_GPIO_ADDR_VERSION_MAJ  0x03
+#define UART_GPIO_ADDR_VERSION_MIN  0x04
+#define UART_GPIO_ADDR_IMAGE_ID     0x10
+#define UART_GPIO_IMAGE_ID_LEN      8
+
+#define FPGA_VERSION_MAJOR  0
+#define FPGA_VERSION_MINOR  1
+
+// Written by the host after it loads a bitstream.  Lives in .bss, so it is
+// cleared whenever the FPGA is reconfigured.
+static uint8_t image_id[UART_GPIO_IMAGE_ID_LEN] ;
+
+uint8_t gpio_reg_read( uint8_t addr )
+{
+	if( addr >= UART_GPIO_ADDR_IMAGE_ID && addr < UART_GPIO_ADDR_IMAGE_ID + UART_GPIO_IMAGE_ID_LEN )
+		return image_id[addr - UART_GPIO_ADDR_IMAGE_ID] ;
+
+	switch( addr ) {
+	case UART_GPIO_ADDR_MAGIC0:			return 'B' ;
+	case UART_GPIO_ADDR_MAGIC1:			return 'R' ;
+	case UART_GPIO_ADDR_VERSION_MAJ:	return FPGA_VERSION_MAJOR ;
+	case UART_GPIO_ADDR_VERSION_MIN:	return FPGA_VERSION_MINOR ;
+	default:							return IORD_ALTERA_AVALON_PIO_DATA(PIO_0_BASE) ;
+	}
+}
+
+void gpio_reg_write( uint8_t addr, uint8_t data )
+{
+	if( addr >= UART_GPIO_ADDR_IMAGE_ID && addr < UART_GPIO_ADDR_IMAGE_ID + UART_GPIO_IMAGE_ID_LEN )
+		image_id[addr - UART_GPIO_ADDR_IMAGE_ID] = data ;
+	else if( addr == UART_GPIO_ADDR_PIO )
+		IOWR_ALTERA_AVALON_PIO_DATA(PIO_0_BASE, data) ;
+	return ;
+}
 
 const char msg[] = "bladeRF FSK example!\n" ;
 
@@ -351,14 +389,17 @@ int main()
 					  }
 				  }
 				  if ((mode & UART_PKT_MODE_DEV_MASK) == UART_PKT_DEV_GPIO) {
-					  if ((mode & UART_PKT_MODE_DIR_MASK) == UART_PKT_MODE_DIR_READ) {
-						  cmd_ptr->data = IORD_ALTERA_AVALON_PIO_DATA(PIO_0_BASE) ;
-					  } else if ((mode & UART_PKT_MODE_DIR_MASK) == UART_PKT_MODE_DIR_WRITE) {
-						  IOWR_ALTERA_AVALON_PIO_DATA(PIO_0_BASE, cmd_ptr->data);
-						  cmd_ptr->data = 0;
-					  } else {
-						  cmd_ptr->addr = 0;
-						  cmd_ptr->data = 0;
+					  for (i = 0; i < cnt; i++) {
+						  if ((mode & UART_PKT_MODE_DIR_MASK) == UART_PKT_MODE_DIR_READ) {
+							  cmd_ptr->data = gpio_reg_read(cmd_ptr->addr);
+						  } else if ((mode & UART_PKT_MODE_DIR_MASK) == UART_PKT_MODE_DIR_WRITE) {
+							  gpio_reg_write(cmd_ptr->addr, cmd_ptr->data);
+							  cmd_ptr->data = 0;
+						  } else {
+							  cmd_ptr->addr = 0;
+							  cmd_ptr->data = 0;
+						  }
+						  cmd_ptr++;
 					  }
 				  }
 
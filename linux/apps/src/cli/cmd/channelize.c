@@ -0,0 +1,221 @@
+#include "cmd.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <limits.h>
+#include <unistd.h>
+
+#define CHANNELIZE_READ_SAMPLES     (256 * 1024)
+#define CHANNELIZE_TAPS             12
+#define CHANNELIZE_STATUS_MS        500
+
+struct channelize_opts {
+    struct bladerf_channelizer_config cfg;
+    const char *prefix;
+    uint64_t num_samples;           /* 0 = until stopped */
+};
+
+/* Write out everything queued for each channel */
+static int channelize_drain(struct bladerf_channelizer *chan, FILE **files,
+                            unsigned int channels, int16_t *buf, size_t len)
+{
+    unsigned int c;
+    size_t n;
+
+    for (c = 0; c < channels; c++) {
+        while ((n = bladerf_channelizer_read(chan, c, buf, len)) > 0) {
+            if (fwrite(buf, 2 * sizeof(int16_t), n, files[c]) != n)
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int channelize_run(struct cli_state *state,
+                          const struct channelize_opts *o)
+{
+    struct bladerf *dev = state->curr_device;
+    struct bladerf_channelizer *chan = NULL;
+    const unsigned int channels = o->cfg.channels;
+    struct timespec last, now;
+    struct termios saved;
+    bool restore_term = false;
+    uint64_t total = 0;
+    int16_t **bufs = NULL, *samples, *buf = NULL;
+    FILE **files = NULL;
+    char *name = NULL;
+    size_t used, want;
+    ssize_t got;
+    unsigned int c;
+    int status, rv = CMD_RET_OK;
+
+    status = bladerf_channelizer_create(&o->cfg, &chan);
+    if (status) {
+        state->last_lib_error = status;
+        return CMD_RET_LIBBLADERF;
+    }
+
+    status = bladerf_alloc_buffers(dev, 1, CHANNELIZE_READ_SAMPLES, &bufs);
+    if (status) {
+        state->last_lib_error = status;
+        rv = CMD_RET_LIBBLADERF;
+        goto out;
+    }
+    samples = bufs[0];
+
+    buf = malloc(o->cfg.queue_len * 2 * sizeof(int16_t));
+    files = calloc(channels, sizeof(files[0]));
+    name = malloc(strlen(o->prefix) + 16);
+    if (!buf || !files || !name) {
+        rv = CMD_RET_MEM;
+        goto out;
+    }
+
+    for (c = 0; c < channels; c++) {
+        sprintf(name, "%s.%u", o->prefix, c);
+        files[c] = fopen(name, "wb");
+        if (!files[c]) {
+            printf("Failed to open %s: %s\n", name, strerror(errno));
+            rv = CMD_RET_INVPARAM;
+            goto out;
+        }
+    }
+
+    printf("Writing %u channels to %s.0 - %s.%u (press any key to stop)...\n",
+           channels, o->prefix, o->prefix, channels - 1);
+
+    restore_term = keypress_begin(&saved);
+    clock_gettime(CLOCK_MONOTONIC, &last);
+
+    while (!keypress_poll(0) && (!o->num_samples || total < o->num_samples)) {
+        /* Reads come in whole transfers, so the last may overshoot; only
+         * what was asked for is channelized */
+        want = CHANNELIZE_READ_SAMPLES;
+        if (o->num_samples && o->num_samples - total < want) {
+            want = o->num_samples - total;
+            want += BLADERF_SAMPLES_PER_XFER - 1;
+            want -= want % BLADERF_SAMPLES_PER_XFER;
+        }
+
+        got = bladerf_read_c16(dev, samples, want);
+        if (got < 0) {
+            state->last_lib_error = got;
+            rv = CMD_RET_LIBBLADERF;
+            break;
+        }
+        if (o->num_samples && (uint64_t)got > o->num_samples - total)
+            got = o->num_samples - total;
+
+        /* The queues hold a read's worth, so this normally takes one
+         * pass */
+        for (used = 0; used < (size_t)got; ) {
+            used += bladerf_channelizer_process(chan, samples + 2 * used,
+                                                got - used);
+            if (channelize_drain(chan, files, channels, buf,
+                                 o->cfg.queue_len)) {
+                printf("Failed to write: %s\n", strerror(errno));
+                rv = CMD_RET_INVPARAM;
+                goto out;
+            }
+        }
+        total += got;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if ((now.tv_sec - last.tv_sec) * 1000 +
+                (now.tv_nsec - last.tv_nsec) / 1000000 >= CHANNELIZE_STATUS_MS) {
+            last = now;
+            printf("\r  %llu samples channelized   ",
+                   (unsigned long long)total);
+            fflush(stdout);
+        }
+    }
+
+    printf("\r  %llu samples channelized, %llu per channel\n",
+           (unsigned long long)total,
+           (unsigned long long)(total / channels));
+
+out:
+    if (restore_term)
+        keypress_end(&saved);
+    if (files) {
+        for (c = 0; c < channels; c++)
+            if (files[c])
+                fclose(files[c]);
+    }
+    free(files);
+    free(name);
+    free(buf);
+    bladerf_free_buffers(dev, bufs);
+    bladerf_channelizer_destroy(chan);
+
+    return rv;
+}
+
+int cmd_channelize(struct cli_state *state, int argc, char **argv)
+{
+    /* Valid commands:
+        channelize <channels> <prefix> [--taps <n>] [--samples <n>]
+                   [--threads <n>]
+    */
+    struct channelize_opts o;
+    bool ok;
+    int i;
+
+    if (!state->curr_device) {
+        return CMD_RET_NODEV;
+    }
+
+    if (argc < 3) {
+        return CMD_RET_INVPARAM;
+    }
+
+    memset(&o, 0, sizeof(o));
+    o.cfg.taps = CHANNELIZE_TAPS;
+    o.cfg.threads = sysconf(_SC_NPROCESSORS_ONLN) > 1 ?
+                    sysconf(_SC_NPROCESSORS_ONLN) - 1 : 1;
+
+    o.cfg.channels = str2uint( argv[1], BLADERF_CHANNELIZER_MIN_CHANNELS,
+                               BLADERF_CHANNELIZER_MAX_CHANNELS, &ok );
+    if (!ok || (o.cfg.channels & (o.cfg.channels - 1))) {
+        printf( "%s: Channels must be a power of two from %d to %d\n",
+                argv[0], BLADERF_CHANNELIZER_MIN_CHANNELS,
+                BLADERF_CHANNELIZER_MAX_CHANNELS );
+        return CMD_RET_INVPARAM;
+    }
+    o.cfg.queue_len = CHANNELIZE_READ_SAMPLES / o.cfg.channels + 1;
+    o.prefix = argv[2];
+
+    for (i = 3; i < argc; i++) {
+        if (i + 1 >= argc) {
+            printf( "%s: Missing or invalid option: %s\n", argv[0], argv[i] );
+            return CMD_RET_INVPARAM;
+        } else if (!strcmp(argv[i], "--taps")) {
+            o.cfg.taps = str2uint( argv[++i], 1,
+                                   BLADERF_CHANNELIZER_MAX_TAPS, &ok );
+            if (!ok) {
+                printf( "%s: %s is an invalid tap count\n", argv[0], argv[i] );
+                return CMD_RET_INVPARAM;
+            }
+        } else if (!strcmp(argv[i], "--samples")) {
+            o.num_samples = str2uint( argv[++i], 1, UINT_MAX, &ok );
+            if (!ok) {
+                printf( "%s: %s is an invalid sample count\n", argv[0], argv[i] );
+                return CMD_RET_INVPARAM;
+            }
+        } else if (!strcmp(argv[i], "--threads")) {
+            o.cfg.threads = str2uint( argv[++i], 1, 64, &ok );
+            if (!ok) {
+                printf( "%s: %s is an invalid thread count\n", argv[0], argv[i] );
+                return CMD_RET_INVPARAM;
+            }
+        } else {
+            printf( "%s: Unknown option: %s\n", argv[0], argv[i] );
+            return CMD_RET_INVPARAM;
+        }
+    }
+
+    return channelize_run(state, &o);
+}
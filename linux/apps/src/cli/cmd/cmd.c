@@ -5,6 +5,7 @@
 #include "cmd.h"
 
 #define DEFINE_CMD(x) int cmd_##x (struct cli_state *, int, char **)
+DEFINE_CMD(channelize);
 DEFINE_CMD(help);
 DEFINE_CMD(load);
 DEFINE_CMD(peek);
@@ -12,6 +13,8 @@ DEFINE_CMD(poke);
 DEFINE_CMD(print);
 DEFINE_CMD(rx);
 DEFINE_CMD(set);
+DEFINE_CMD(spectrum);
+DEFINE_CMD(sweep);
 DEFINE_CMD(tx);
 DEFINE_CMD(version);
 DEFINE_CMD(open);
@@ -130,20 +133,114 @@ static const struct cmd cmd_table[] = {
         .exec = cmd_rx,
         .desc = "Receive IQ samples",
         .help =
-            " rx <filename> [format] [# samples]\n"
+            "rx <filename> <ascii|binary|capture> [# samples]\n"
+            "rx <filename> ring <pre samples> <post samples>\n"
+            "   [level <dBFS>|above <dB>]\n"
             "\n"
             "Receive IQ samples and write them to the specified file.\n"
-            "TODO\n"
+            "If the number of samples is omitted, reception continues\n"
+            "until a key is pressed.\n"
+            "\n"
+            "binary writes interleaved 16-bit I/Q pairs in host byte order,\n"
+            "bypassing the page cache (O_DIRECT) where supported. ascii\n"
+            "writes one \"I, Q\" pair per line. capture writes binary\n"
+            "blocks behind a header holding the radio configuration, and\n"
+            "appends a per-block index of timestamps and overruns that\n"
+            "lets tools seek by time (see FN_CAPTURE in libbladeRF.h); it\n"
+            "needs the RX sample rate, see \"set samplerate\".\n"
+            "\n"
+            "ring keeps the most recent samples in memory and, each time a\n"
+            "key is pressed or SIGUSR1 is received, saves the given number\n"
+            "of samples before and after that point to <filename>.<n> in\n"
+            "binary format. Press q to stop. With level or above, a trigger\n"
+            "also fires when the average power of a 1024-sample block\n"
+            "reaches the given level, or the given margin above the noise\n"
+            "floor; it re-arms once the power drops 3 dB below that.\n"
+            "\n"
+            "On completion the sustained sample rate, device overruns and\n"
+            "buffer pool stalls (disk not keeping up) are reported.\n"
     },
     {
         .name = "tx",
         .exec = cmd_tx,
         .desc = "Transmit IQ samples",
         .help =
-            " tx <filename> TODO\n"
+            "tx <filename> [--repeat <n>|--loop] [--gap <samples>]\n"
+            "   [--format <ascii|binary>]\n"
             "\n"
-            "Receive IQ samples and write them to the specified file.\n"
-            "TODO\n"
+            "Transmit the IQ samples in the specified file. The file is\n"
+            "played once unless --repeat or --loop is given; --loop runs\n"
+            "until a key is pressed. --gap inserts the given number of\n"
+            "zero samples between repetitions.\n"
+            "\n"
+            "binary (the default) is interleaved 16-bit I/Q pairs in host\n"
+            "byte order and is streamed directly from a memory mapping of\n"
+            "the file. ascii is one \"I, Q\" pair per line, as written by rx.\n"
+            "\n"
+            "On completion the sustained sample rate and device underruns\n"
+            "are reported.\n"
+    },
+    {
+        .name = "spectrum",
+        .exec = cmd_spectrum,
+        .desc = "Display the received spectrum",
+        .help =
+            "spectrum [--size <n>] [--max] [--threads <n>] [--out <file>]\n"
+            "\n"
+            "Stream RX samples through a Hann-windowed FFT of the given size\n"
+            "(a power of two, default 1024) and display the averaged power\n"
+            "spectrum until a key is pressed. The display refreshes twice a\n"
+            "second; each column shows the strongest bin it covers.\n"
+            "\n"
+            "Frames are exponentially averaged unless --max selects\n"
+            "max-hold. FFTs are spread over all but one CPU unless --threads\n"
+            "is given. With --out, each refresh instead appends the averaged\n"
+            "spectrum to the file as <size> float32 dBFS values, from -fs/2\n"
+            "to +fs/2.\n"
+    },
+    {
+        .name = "sweep",
+        .exec = cmd_sweep,
+        .desc = "Survey a frequency range wider than the sample rate",
+        .help =
+            "sweep <start> <stop> <step> [--rate <hz>] [--size <n>]\n"
+            "      [--frames <n>] [--out <file>]\n"
+            "\n"
+            "Step the RX LO from <start> to <stop> Hz, <step> Hz at a time,\n"
+            "average --frames (default 16) FFTs of --size points (default\n"
+            "1024) at each step and stitch the middle <step> Hz of each\n"
+            "spectrum into one wideband spectrum. Sweeps repeat until a key\n"
+            "is pressed.\n"
+            "\n"
+            "The sweep sets the RX sample rate to --rate (default 10 MHz),\n"
+            "which <step> may not exceed, and the RX bandwidth to the\n"
+            "narrowest setting covering one step. VCOCAP values found on the\n"
+            "first sweep are reused, so later sweeps retune faster. The last\n"
+            "step is centered up to half a step past <stop>, which must stay\n"
+            "within the tunable range.\n"
+            "\n"
+            "With --out, each sweep is appended to the file as float32 dBFS\n"
+            "values in ascending frequency order, instead of being drawn.\n"
+    },
+    {
+        .name = "channelize",
+        .exec = cmd_channelize,
+        .desc = "Split RX into equally spaced channels",
+        .help =
+            "channelize <channels> <prefix> [--taps <n>] [--samples <n>]\n"
+            "           [--threads <n>]\n"
+            "\n"
+            "Split the RX stream into <channels> (a power of two) channels,\n"
+            "each fs / <channels> wide and sampled at that rate, with a\n"
+            "polyphase filterbank, and write channel c to <prefix>.<c> as\n"
+            "interleaved 16-bit I/Q pairs. Channel <channels> / 2 is centered\n"
+            "on the RX frequency, and each channel up is fs / <channels>\n"
+            "higher.\n"
+            "\n"
+            "Runs until a key is pressed or --samples RX samples have been\n"
+            "read. --taps (default 12) sets the prototype filter's taps per\n"
+            "channel; more give sharper channel edges. Work is spread over\n"
+            "all but one CPU unless --threads is given.\n"
     },
     {
         .name = "set",
@@ -167,7 +264,7 @@ static const struct cmd cmd_table[] = {
             "   refclk          Reference clock settings\n"
             "   rxvga1          Gain setting of RXVGA1 in dB (range: )\n"
             "   rxvga2          Gain setting of RXVGA2 in dB (range: )\n"
-            "   samplerate      Samplerate settings\n"
+            "   samplerate      Sample rate: samplerate <rx|tx> <Hz>\n"
             "   trimdac         VCTCXO Trim DAC settings\n"
             "   txvga1          Gain setting of TXVGA1 in dB (range: )\n"
             "   txvga2          Gain setting of TXVGA2 in dB (range: )\n"
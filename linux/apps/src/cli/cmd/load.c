@@ -1,6 +1,15 @@
 #include "cmd.h"
 #include <stdio.h>
 
+static void load_progress(size_t done, size_t total, void *arg)
+{
+    printf("\r  %3u%% (%zu/%zu bytes)",
+           total ? (unsigned int)(done * 100 / total) : 100, done, total);
+    if (done == total)
+        putchar('\n');
+    fflush(stdout);
+}
+
 int cmd_load(struct cli_state *state, int argc, char **argv)
 {
     /* Valid commands:
@@ -18,11 +27,14 @@ int cmd_load(struct cli_state *state, int argc, char **argv)
     if( argc == 3 ) {
         if( strcasecmp( argv[1], "fpga" ) == 0 ) {
             printf("Loading fpga...\n");
-            librv = bladerf_load_fpga(state->curr_device, argv[2]);
+            librv = bladerf_load_fpga_progress(state->curr_device, argv[2],
+                                               load_progress, NULL);
 
             if (librv < 0) {
                 state->last_lib_error = librv;
                 rv = CMD_RET_LIBBLADERF;
+            } else if (librv == 1) {
+                printf("FPGA is already running this image.\n");
             } else {
                 printf("Done.\n");
             }
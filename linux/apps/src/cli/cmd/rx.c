@@ -1,32 +1,852 @@
 #include "cmd.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <signal.h>
+#include "iq_text.h"
 
+/* Capture pipeline: a reader thread fills buffers from the device and a
+ * writer thread drains them to the file, so a slow disk write never holds
+ * up bladerf_read_c16(). */
+#define RX_BUF_SAMPLES      (1024 * 1024)   /* 4 MiB per buffer */
+#define RX_NUM_BUFS         32
+#define RX_BUF_ALIGN        4096            /* Satisfies O_DIRECT */
+#define RX_STATUS_MS        500
+#define RX_STOP_GRACE_MS    1000            /* Before abandoning a blocked read */
+#define RX_TEXT_CHUNK       (64 * 1024)     /* Samples formatted per write() */
 
+typedef enum {
+    RX_FMT_BINARY,
+    RX_FMT_ASCII,
+    RX_FMT_CAPTURE                          /* Indexed, see FN_CAPTURE */
+} rx_fmt;
+
+struct rx_buf {
+    int16_t *samples;
+    size_t n;                               /* Samples (I/Q pairs) held */
+    uint64_t timestamp_ns;                  /* When the first read returned,
+                                               CLOCK_MONOTONIC */
+    bool overrun;                           /* Device overran while filling */
+};
+
+/* Blocking FIFO of buffer pointers */
+struct rx_queue {
+    struct rx_buf *items[RX_NUM_BUFS];
+    size_t head, count;
+    bool closed;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+struct rx_ctx {
+    struct bladerf *dev;
+    int fd;
+    rx_fmt fmt;
+    char *text;                             /* ASCII formatting buffer */
+    struct bladerf_capture_block *index;    /* Capture index, one per block */
+    size_t index_len, index_cap;
+    uint64_t num_samples;                   /* 0 = until stopped */
+
+    struct rx_queue free_q, full_q;
+    struct rx_buf bufs[RX_NUM_BUFS];
+    int16_t **samples;                      /* From bladerf_alloc_buffers() */
+
+    volatile bool stop;
+    volatile bool reader_done, writer_done;
+    uint64_t samples_read, samples_written;
+    unsigned int pool_stalls;
+    int read_error;
+    int write_error;
+};
+
+static void queue_init(struct rx_queue *q)
+{
+    memset(q, 0, sizeof(*q));
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->cond, NULL);
+}
+
+static void queue_deinit(struct rx_queue *q)
+{
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->cond);
+}
+
+static void queue_push(struct rx_queue *q, struct rx_buf *b)
+{
+    pthread_mutex_lock(&q->lock);
+    q->items[(q->head + q->count) % RX_NUM_BUFS] = b;
+    q->count++;
+    pthread_cond_signal(&q->cond);
+    pthread_mutex_unlock(&q->lock);
+}
+
+/* Returns NULL once the queue is closed and empty. If stalled is non-NULL,
+ * it is set when the caller had to wait. */
+static struct rx_buf *queue_pop(struct rx_queue *q, bool *stalled)
+{
+    struct rx_buf *b = NULL;
+
+    pthread_mutex_lock(&q->lock);
+    if (stalled)
+        *stalled = (q->count == 0 && !q->closed);
+    while (q->count == 0 && !q->closed)
+        pthread_cond_wait(&q->cond, &q->lock);
+    if (q->count) {
+        b = q->items[q->head];
+        q->head = (q->head + 1) % RX_NUM_BUFS;
+        q->count--;
+    }
+    pthread_mutex_unlock(&q->lock);
+
+    return b;
+}
+
+static void queue_close(struct rx_queue *q)
+{
+    pthread_mutex_lock(&q->lock);
+    q->closed = true;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->lock);
+}
+
+static void *rx_reader(void *arg)
+{
+    struct rx_ctx *ctx = arg;
+    struct rx_buf *b;
+    ssize_t n;
+    size_t want;
+    uint64_t total = 0, overruns = 0;
+    struct bladerf_stats stats;
+    struct timespec ts;
+    bool stalled;
+
+    /* Only a read blocked on the device may be cancelled, never a queue
+     * operation holding a lock the writer needs */
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+    while (!ctx->stop && (!ctx->num_samples || total < ctx->num_samples)) {
+        b = queue_pop(&ctx->free_q, &stalled);
+        if (!b)
+            break;
+        if (stalled)
+            __sync_fetch_and_add(&ctx->pool_stalls, 1);
+
+        /* Don't wait on more than the remaining samples, in whole
+         * transfers */
+        want = RX_BUF_SAMPLES;
+        if (ctx->num_samples && ctx->num_samples - total < want) {
+            want = ctx->num_samples - total;
+            want = (want + BLADERF_SAMPLES_PER_XFER - 1) /
+                   BLADERF_SAMPLES_PER_XFER * BLADERF_SAMPLES_PER_XFER;
+        }
+
+        b->n = 0;
+        while (b->n < want && !ctx->stop) {
+            pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+            n = bladerf_read_c16(ctx->dev, b->samples + 2 * b->n,
+                                 want - b->n);
+            pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+            if (n < 0) {
+                ctx->read_error = n;
+                ctx->stop = true;
+                break;
+            }
+            if (b->n == 0) {
+                clock_gettime(CLOCK_MONOTONIC, &ts);
+                b->timestamp_ns = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+            }
+            b->n += n;
+        }
+
+        if (ctx->fmt == RX_FMT_CAPTURE &&
+                bladerf_stats(ctx->dev, &stats) == 0) {
+            b->overrun = (total && stats.rx_overruns != overruns);
+            overruns = stats.rx_overruns;
+        }
+
+        if (ctx->num_samples && total + b->n > ctx->num_samples)
+            b->n = ctx->num_samples - total;
+
+        total += b->n;
+        __sync_fetch_and_add(&ctx->samples_read, b->n);
+        queue_push(&ctx->full_q, b);
+    }
+
+    queue_close(&ctx->full_q);
+    ctx->reader_done = true;
+    return NULL;
+}
+
+static int write_all(int fd, const char *p, size_t len)
+{
+    ssize_t ret;
+
+    while (len) {
+        ret = write(fd, p, len);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += ret;
+        len -= ret;
+    }
+
+    return 0;
+}
+
+static int write_binary(struct rx_ctx *ctx, const struct rx_buf *b)
+{
+    const char *p = (const char *)b->samples;
+    size_t len = b->n * 2 * sizeof(int16_t);
+    size_t aligned = len - (len % RX_BUF_ALIGN);
+    ssize_t ret;
+    int flags;
+
+    /* A short final buffer can't go through O_DIRECT in its entirety, so
+     * write the aligned part, then the tail with O_DIRECT cleared */
+    while (len) {
+        if (aligned == 0) {
+            flags = fcntl(ctx->fd, F_GETFL);
+            if (flags >= 0 && (flags & O_DIRECT))
+                fcntl(ctx->fd, F_SETFL, flags & ~O_DIRECT);
+            aligned = len;
+        }
+
+        ret = write(ctx->fd, p, aligned);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        p += ret;
+        len -= ret;
+        aligned -= ret;
+    }
+
+    return 0;
+}
+
+static int write_ascii(struct rx_ctx *ctx, const struct rx_buf *b)
+{
+    size_t i, n, len;
+
+    for (i = 0; i < b->n; i += n) {
+        n = b->n - i < RX_TEXT_CHUNK ? b->n - i : RX_TEXT_CHUNK;
+        len = iq_text_format(ctx->text, b->samples + 2 * i, n);
+        if (write_all(ctx->fd, ctx->text, len))
+            return -1;
+    }
+
+    return 0;
+}
+
+static int add_index(struct rx_ctx *ctx, const struct rx_buf *b)
+{
+    struct bladerf_capture_block *index;
+    size_t cap;
+
+    if (ctx->index_len == ctx->index_cap) {
+        cap = ctx->index_cap ? 2 * ctx->index_cap : 1024;
+        index = realloc(ctx->index, cap * sizeof(*index));
+        if (!index) {
+            errno = ENOMEM;
+            return -1;
+        }
+        ctx->index = index;
+        ctx->index_cap = cap;
+    }
+
+    index = &ctx->index[ctx->index_len++];
+    index->timestamp_ns = b->timestamp_ns;
+    index->samples = b->n;
+    index->flags = b->overrun ? BLADERF_CAPTURE_OVERRUN : 0;
+
+    return 0;
+}
+
+static void *rx_writer(void *arg)
+{
+    struct rx_ctx *ctx = arg;
+    struct rx_buf *b;
+    int status;
+
+    while ((b = queue_pop(&ctx->full_q, NULL))) {
+        if (!ctx->write_error) {
+            if (ctx->fmt == RX_FMT_ASCII) {
+                status = write_ascii(ctx, b);
+            } else {
+                status = b->n ? write_binary(ctx, b) : 0;
+                if (!status && b->n && ctx->fmt == RX_FMT_CAPTURE)
+                    status = add_index(ctx, b);
+            }
+            if (status) {
+                ctx->write_error = errno;
+                ctx->stop = true;
+            } else {
+                __sync_fetch_and_add(&ctx->samples_written, b->n);
+            }
+        }
+        queue_push(&ctx->free_q, b);
+    }
+
+    ctx->writer_done = true;
+    return NULL;
+}
+
+static double elapsed_sec(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* Write the capture header, placing the file offset at the first block */
+static int capture_begin(struct rx_ctx *ctx,
+                         struct bladerf_capture_header **hdr_out)
+{
+    struct bladerf_capture_header *hdr;
+    int status;
+
+    /* Goes through O_DIRECT, like the blocks that follow */
+    if (posix_memalign((void **)&hdr, RX_BUF_ALIGN, BLADERF_CAPTURE_HDR_SZ))
+        return BLADERF_ERR_MEM;
+    memset(hdr, 0, BLADERF_CAPTURE_HDR_SZ);
+
+    status = bladerf_capture_header_init(ctx->dev, hdr, RX_BUF_SAMPLES);
+    if (!status && write_all(ctx->fd, (char *)hdr, BLADERF_CAPTURE_HDR_SZ))
+        status = BLADERF_ERR_IO;
+
+    if (status)
+        free(hdr);
+    else
+        *hdr_out = hdr;
+
+    return status;
+}
+
+/* Append the index and rewrite the header to point at it */
+static int capture_finish(struct rx_ctx *ctx,
+                          struct bladerf_capture_header *hdr)
+{
+    int flags;
+
+    flags = fcntl(ctx->fd, F_GETFL);
+    if (flags >= 0 && (flags & O_DIRECT))
+        fcntl(ctx->fd, F_SETFL, flags & ~O_DIRECT);
+
+    hdr->num_samples = ctx->samples_written;
+    hdr->num_blocks = ctx->index_len;
+    hdr->index_offset = BLADERF_CAPTURE_HDR_SZ +
+                        ctx->samples_written * 2 * sizeof(int16_t);
+
+    if (write_all(ctx->fd, (char *)ctx->index,
+                  ctx->index_len * sizeof(ctx->index[0])))
+        return -1;
+
+    if (pwrite(ctx->fd, hdr, sizeof(*hdr), 0) != sizeof(*hdr))
+        return -1;
+
+    return 0;
+}
+
+static int rx_capture(struct cli_state *state, const char *filename,
+                      rx_fmt fmt, uint64_t num_samples)
+{
+    struct rx_ctx ctx;
+    pthread_t reader, writer;
+    struct timespec start;
+    struct termios saved;
+    struct bladerf_stats stats_start, stats_end;
+    struct bladerf_capture_header *hdr = NULL;
+    bool restore_term = false;
+    double secs, stop_time = 0;
+    size_t i;
+    int status, rv = CMD_RET_OK;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.dev = state->curr_device;
+    ctx.fd = -1;
+    ctx.num_samples = num_samples;
+    queue_init(&ctx.free_q);
+    queue_init(&ctx.full_q);
+
+    /* Each buffer is a multiple of RX_BUF_ALIGN, so all of them are
+     * aligned for O_DIRECT */
+    status = bladerf_alloc_buffers(ctx.dev, RX_NUM_BUFS, RX_BUF_SAMPLES,
+                                   &ctx.samples);
+    if (status) {
+        state->last_lib_error = status;
+        rv = CMD_RET_LIBBLADERF;
+        goto out;
+    }
+
+    for (i = 0; i < RX_NUM_BUFS; i++) {
+        ctx.bufs[i].samples = ctx.samples[i];
+        queue_push(&ctx.free_q, &ctx.bufs[i]);
+    }
+
+    ctx.fmt = fmt;
+    if (fmt == RX_FMT_ASCII) {
+        ctx.text = malloc(IQ_TEXT_BUF_SIZE(RX_TEXT_CHUNK));
+        if (!ctx.text) {
+            rv = CMD_RET_MEM;
+            goto out;
+        }
+        ctx.fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    } else {
+        /* Not every filesystem supports O_DIRECT */
+        ctx.fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+        if (ctx.fd < 0 && errno == EINVAL)
+            ctx.fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+
+    if (ctx.fd < 0) {
+        printf("Failed to open %s: %s\n", filename, strerror(errno));
+        rv = CMD_RET_INVPARAM;
+        goto out;
+    }
+
+    if (fmt == RX_FMT_CAPTURE) {
+        status = capture_begin(&ctx, &hdr);
+        if (status) {
+            state->last_lib_error = status;
+            rv = CMD_RET_LIBBLADERF;
+            goto out;
+        }
+    }
+
+    memset(&stats_start, 0, sizeof(stats_start));
+    bladerf_stats(ctx.dev, &stats_start);
+
+    if (num_samples)
+        printf("Receiving %llu samples (press any key to abort)...\n",
+               (unsigned long long)num_samples);
+    else
+        printf("Receiving until a key is pressed...\n");
+
+    restore_term = keypress_begin(&saved);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (pthread_create(&writer, NULL, rx_writer, &ctx)) {
+        rv = CMD_RET_MEM;
+        goto out_term;
+    }
+
+    if (pthread_create(&reader, NULL, rx_reader, &ctx)) {
+        queue_close(&ctx.full_q);
+        pthread_join(writer, NULL);
+        rv = CMD_RET_MEM;
+        goto out_term;
+    }
+
+    while (!ctx.reader_done) {
+        if (keypress_poll(RX_STATUS_MS))
+            ctx.stop = true;
+
+        secs = elapsed_sec(&start);
+
+        /* No samples arriving (e.g. FPGA not loaded): give up on the read */
+        if (ctx.stop && !stop_time) {
+            stop_time = secs;
+        } else if (ctx.stop && secs - stop_time > RX_STOP_GRACE_MS / 1000.0) {
+            pthread_cancel(reader);
+            break;
+        }
+
+        printf("\r  %llu samples written, %.3f Msps   ",
+               (unsigned long long)ctx.samples_written,
+               secs > 0 ? ctx.samples_read / secs / 1e6 : 0.0);
+        fflush(stdout);
+    }
+
+    pthread_join(reader, NULL);
+    queue_close(&ctx.full_q);
+    pthread_join(writer, NULL);
+    secs = elapsed_sec(&start);
+
+    memset(&stats_end, 0, sizeof(stats_end));
+    bladerf_stats(ctx.dev, &stats_end);
+
+    printf("\n\n  Samples written:   %llu\n"
+           "  Elapsed:           %.3f s\n"
+           "  Sustained rate:    %.3f Msps\n"
+           "  Device overruns:   %llu\n"
+           "  Buffer pool stalls: %u\n\n",
+           (unsigned long long)ctx.samples_written, secs,
+           secs > 0 ? ctx.samples_written / secs / 1e6 : 0.0,
+           (unsigned long long)(stats_end.rx_overruns - stats_start.rx_overruns),
+           ctx.pool_stalls);
+
+    if (hdr && !ctx.write_error && capture_finish(&ctx, hdr))
+        ctx.write_error = errno;
+
+    if (ctx.read_error) {
+        state->last_lib_error = ctx.read_error;
+        rv = CMD_RET_LIBBLADERF;
+    } else if (ctx.write_error) {
+        printf("Failed to write %s: %s\n", filename, strerror(ctx.write_error));
+        rv = CMD_RET_INVPARAM;
+    }
+
+out_term:
+    if (restore_term)
+        keypress_end(&saved);
+
+out:
+    free(hdr);
+    free(ctx.index);
+    free(ctx.text);
+    if (ctx.fd >= 0)
+        close(ctx.fd);
+    bladerf_free_buffers(ctx.dev, ctx.samples);
+    queue_deinit(&ctx.free_q);
+    queue_deinit(&ctx.full_q);
+
+    return rv;
+}
+
+/* Pre-trigger capture: the library keeps a ring of recent samples and each
+ * trigger saves the window around it to <filename>.<n>. Triggers that
+ * arrive while a window is being saved are queued. */
+#define RING_MAX_PENDING    16
+#define RING_READ_TIMEOUT   1000            /* ms */
+
+/* Power trigger, measured over blocks of RING_DETECT_BLOCK samples */
+#define RING_DETECT_BLOCK   1024
+#define RING_DETECT_HYST    3.0             /* dB */
+#define RING_DETECT_ALPHA   0.01            /* Noise floor averaging */
+
+struct ring_trigger {
+    uint64_t pos;
+    bool detected;                          /* By the power detector */
+    float avg_db, floor_db;
+};
+
+struct ring_ctx {
+    struct bladerf_ring *ring;
+    pthread_mutex_t lock;                   /* Protects pending queue */
+    struct ring_trigger pending[RING_MAX_PENDING];
+    size_t num_pending;
+    unsigned int triggers, dropped;
+    bool quit;
+
+    /* Attached to the device ahead of the ring, so that its sample
+     * positions are the ring's */
+    struct bladerf_detector *det;
+};
+
+static struct bladerf_ring *volatile sig_ring;
+static volatile sig_atomic_t sig_pending;
+static volatile uint64_t sig_pos;
+
+static void ring_sighandler(int sig)
+{
+    if (sig_ring && !sig_pending) {
+        sig_pos = bladerf_ring_trigger(sig_ring);
+        sig_pending = 1;
+    }
+}
+
+static void ring_queue_trigger(struct ring_ctx *ctx,
+                               const struct ring_trigger *t)
+{
+    pthread_mutex_lock(&ctx->lock);
+    ctx->triggers++;
+    if (ctx->num_pending < RING_MAX_PENDING)
+        ctx->pending[ctx->num_pending++] = *t;
+    else
+        ctx->dropped++;
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+static void ring_queue(struct ring_ctx *ctx, uint64_t pos)
+{
+    struct ring_trigger t;
+
+    memset(&t, 0, sizeof(t));
+    t.pos = pos;
+    ring_queue_trigger(ctx, &t);
+}
+
+static bool ring_dequeue(struct ring_ctx *ctx, struct ring_trigger *t)
+{
+    bool ret = false;
+
+    pthread_mutex_lock(&ctx->lock);
+    if (ctx->num_pending) {
+        *t = ctx->pending[0];
+        ctx->num_pending--;
+        memmove(ctx->pending, ctx->pending + 1,
+                ctx->num_pending * sizeof(ctx->pending[0]));
+        ret = true;
+    }
+    pthread_mutex_unlock(&ctx->lock);
+
+    return ret;
+}
+
+/* Runs on the ring's reading thread, which may be cancelled at any
+ * cancellation point, so it only queues; the main loop reports */
+static void ring_detect_cb(const struct bladerf_detector_event *ev,
+                           void *user_data)
+{
+    struct ring_ctx *ctx = user_data;
+    struct ring_trigger t;
+
+    if (ev->rising) {
+        t.pos = ev->sample;
+        t.detected = true;
+        t.avg_db = ev->avg_db;
+        t.floor_db = ev->floor_db;
+        ring_queue_trigger(ctx, &t);
+    }
+}
+
+/* Check for triggers and the quit key. Returns false once told to quit. */
+static bool ring_poll(struct ring_ctx *ctx, unsigned int timeout_ms)
+{
+    int c = keypress_read(timeout_ms);
+
+    if (sig_pending) {
+        ring_queue(ctx, sig_pos);
+        sig_pending = 0;
+    }
+
+    if (c == 'q' || c == 'Q')
+        ctx->quit = true;
+    else if (c >= 0)
+        ring_queue(ctx, bladerf_ring_trigger(ctx->ring));
+
+    return !ctx->quit;
+}
+
+static int ring_dump(struct ring_ctx *ctx, const char *filename,
+                     int16_t *buf, uint64_t start, uint64_t end)
+{
+    ssize_t n;
+    size_t chunk;
+    int fd, status = 0;
+
+    fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        printf("Failed to open %s: %s\n", filename, strerror(errno));
+        return CMD_RET_INVPARAM;
+    }
+
+    while (start < end) {
+        chunk = end - start < RX_BUF_SAMPLES ? end - start : RX_BUF_SAMPLES;
+        n = bladerf_ring_read(ctx->ring, start, buf, chunk, RING_READ_TIMEOUT);
+        if (n <= 0) {
+            printf("  %s: %s%s\n", filename, bladerf_strerror(n),
+                   n == BLADERF_ERR_RANGE ? " (disk too slow for window)" : "");
+            status = CMD_RET_LIBBLADERF;
+            break;
+        }
+
+        if (write_all(fd, (char *)buf, n * 2 * sizeof(int16_t))) {
+            printf("Failed to write %s: %s\n", filename, strerror(errno));
+            status = CMD_RET_INVPARAM;
+            break;
+        }
+
+        start += n;
+        ring_poll(ctx, 0);
+    }
+
+    close(fd);
+    return status;
+}
+
+static int rx_ring(struct cli_state *state, const char *filename,
+                   uint64_t pre, uint64_t post,
+                   const struct bladerf_detector_config *det_cfg)
+{
+    struct ring_ctx ctx;
+    struct ring_trigger trig;
+    struct sigaction sa, old_sa;
+    struct termios saved;
+    bool restore_term;
+    unsigned int dumps = 0;
+    uint64_t start;
+    char *name;
+    int16_t **buf = NULL;
+    int status, rv = CMD_RET_OK;
+
+    memset(&ctx, 0, sizeof(ctx));
+    pthread_mutex_init(&ctx.lock, NULL);
+
+    name = malloc(strlen(filename) + 16);
+    if (!name) {
+        rv = CMD_RET_MEM;
+        goto out;
+    }
+
+    status = bladerf_alloc_buffers(state->curr_device, 1, RX_BUF_SAMPLES,
+                                   &buf);
+    if (status) {
+        state->last_lib_error = status;
+        rv = CMD_RET_LIBBLADERF;
+        goto out;
+    }
+
+    if (det_cfg) {
+        status = bladerf_detector_create(det_cfg, ring_detect_cb, &ctx,
+                                         &ctx.det);
+        if (status) {
+            state->last_lib_error = status;
+            rv = CMD_RET_LIBBLADERF;
+            goto out;
+        }
+    }
+
+    if (ctx.det)
+        bladerf_detector_attach(state->curr_device, ctx.det);
+
+    status = bladerf_ring_open(state->curr_device, pre + post, &ctx.ring);
+    if (status) {
+        bladerf_detector_attach(state->curr_device, NULL);
+        state->last_lib_error = status;
+        rv = CMD_RET_LIBBLADERF;
+        goto out;
+    }
+
+    sig_ring = ctx.ring;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = ring_sighandler;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR1, &sa, &old_sa);
+
+    printf("Keeping %llu samples before and %llu after each trigger.\n"
+           "Press a key or send SIGUSR1 to pid %d to trigger, q to quit.\n",
+           (unsigned long long)pre, (unsigned long long)post, (int)getpid());
+
+    restore_term = keypress_begin(&saved);
+
+    while (ring_poll(&ctx, ctx.num_pending ? 0 : RX_STATUS_MS) ||
+           ctx.num_pending) {
+        if (ring_dequeue(&ctx, &trig)) {
+
+            if (trig.detected)
+                printf("\r  Detected %.1f dBFS (floor %.1f dBFS)\n",
+                       trig.avg_db, trig.floor_db);
+
+            /* Early triggers get whatever history exists */
+            start = trig.pos > pre ? trig.pos - pre : 0;
+            sprintf(name, "%s.%u", filename, dumps++);
+            printf("\r  Trigger at sample %llu -> %s\n",
+                   (unsigned long long)trig.pos, name);
+
+            status = ring_dump(&ctx, name, buf[0], start, trig.pos + post);
+            if (status)
+                rv = status;
+            continue;
+        }
+
+        printf("\r  Stream at sample %llu, %u triggers   ",
+               (unsigned long long)bladerf_ring_trigger(ctx.ring),
+               ctx.triggers);
+        fflush(stdout);
+    }
+
+    if (restore_term)
+        keypress_end(&saved);
+
+    sigaction(SIGUSR1, &old_sa, NULL);
+    sig_ring = NULL;
+    bladerf_ring_close(ctx.ring);
+    bladerf_detector_attach(state->curr_device, NULL);
+
+    printf("\n\n  Triggers:          %u\n"
+           "  Windows saved:     %u\n"
+           "  Triggers dropped:  %u\n\n",
+           ctx.triggers, dumps, ctx.dropped);
+
+out:
+    bladerf_detector_destroy(ctx.det);
+    pthread_mutex_destroy(&ctx.lock);
+    free(name);
+    bladerf_free_buffers(state->curr_device, buf);
+    return rv;
+}
 
 int cmd_rx(struct cli_state *state, int argc, char **argv)
 {
     /* Valid commands:
-        rx <filename> <ascii|binary> [num_samples]
+        rx <filename> <ascii|binary|capture> [num_samples]
+        rx <filename> ring <pre_samples> <post_samples> [level|above <dB>]
     */
     int rv = CMD_RET_OK;
 
-    if( argc == 3 || argc == 4 ) {
+    if (!state->curr_device) {
+        return CMD_RET_NODEV;
+    }
+
+    if( (argc == 5 || argc == 7) && strcasecmp( argv[2], "ring" ) == 0 ) {
+        struct bladerf_detector_config det_cfg;
+        unsigned int pre, post;
+        bool ok;
+
+        pre = str2uint( argv[3], 0, 1000000000, &ok );
+        if( ok ) {
+            post = str2uint( argv[4], 0, 1000000000, &ok );
+        }
+        if( !ok || pre + post == 0 ) {
+            printf( "%s: Invalid window\n", argv[0] );
+            rv = CMD_RET_INVPARAM;
+            goto done;
+        }
+
+        if( argc == 7 ) {
+            memset( &det_cfg, 0, sizeof(det_cfg) );
+            det_cfg.block_samples = RING_DETECT_BLOCK;
+            det_cfg.hysteresis_db = RING_DETECT_HYST;
+            det_cfg.floor_alpha = RING_DETECT_ALPHA;
+            det_cfg.threshold_db = str2double( argv[6], -200, 200, &ok );
+
+            if( strcasecmp( argv[5], "above" ) == 0 ) {
+                det_cfg.relative = true;
+            } else if( strcasecmp( argv[5], "level" ) != 0 ) {
+                ok = false;
+            }
+
+            if( !ok ) {
+                printf( "%s: Invalid trigger: %s %s\n", argv[0], argv[5], argv[6] );
+                rv = CMD_RET_INVPARAM;
+                goto done;
+            }
+        }
+
+        rv = rx_ring(state, argv[1], pre, post, argc == 7 ? &det_cfg : NULL);
+    } else if( argc == 3 || argc == 4 ) {
         unsigned int num_samples = 0;
         bool ok;
+        rx_fmt fmt;
         /* Check format */
         if( strcasecmp( argv[2], "ascii" ) == 0 ) {
-
+            fmt = RX_FMT_ASCII;
         } else if( strcasecmp( argv[2], "binary" ) == 0 ) {
-
+            fmt = RX_FMT_BINARY;
+        } else if( strcasecmp( argv[2], "capture" ) == 0 ) {
+            fmt = RX_FMT_CAPTURE;
         } else {
             printf( "%s: %s is an invalid format\n", argv[0], argv[2] );
             rv = CMD_RET_INVPARAM;
+            goto done;
         }
 
         /* Validate num_samples */
         if( argc == 4 ) {
-            num_samples = str2uint( argv[3], 0, 1000000000, &ok );
+            num_samples = str2uint( argv[3], 1, 1000000000, &ok );
             if( !ok ) {
+                printf( "%s: %s is an invalid number of samples\n", argv[0], argv[3] );
                 rv = CMD_RET_INVPARAM;
                 goto done;
             }
@@ -35,16 +855,10 @@ int cmd_rx(struct cli_state *state, int argc, char **argv)
             num_samples = 0;
         }
 
-        /* TODO: Validate filename */
-
         /* Read samples from the device until either:
             num_samples has been reached ... or
             if num_samples has not been supplied, the user hits a key */
-        if( num_samples > 0 ) {
-            /* TODO: Write num_samples worth of data to the file in the appropriate format */
-        } else {
-            /* TODO: Indefinite reception until keypress */
-        }
+        rv = rx_capture(state, argv[1], fmt, num_samples);
     } else {
         printf( "%s: Invalid number of parameters (%d)\n", argv[0], argc );
         rv = CMD_RET_INVPARAM;
@@ -53,4 +867,3 @@ int cmd_rx(struct cli_state *state, int argc, char **argv)
 done:
     return rv;
 }
-
@@ -1,10 +1,56 @@
 #include <stdio.h>
+#include <string.h>
+#include <limits.h>
 #include "cmd.h"
 
+/* set samplerate <rx|tx> <rate in Hz> */
+static int set_samplerate(struct cli_state *state, int argc, char **argv)
+{
+    bladerf_module module;
+    unsigned int rate, actual;
+    bool ok;
+    int status;
+
+    if (argc != 4) {
+        return CMD_RET_INVPARAM;
+    }
+
+    if (strcasecmp(argv[2], "rx") == 0) {
+        module = RX;
+    } else if (strcasecmp(argv[2], "tx") == 0) {
+        module = TX;
+    } else {
+        printf("%s %s: %s is not rx or tx\n", argv[0], argv[1], argv[2]);
+        return CMD_RET_INVPARAM;
+    }
+
+    rate = str2uint(argv[3], 1, UINT_MAX, &ok);
+    if (!ok) {
+        printf("%s %s: %s is not a valid sample rate\n",
+               argv[0], argv[1], argv[3]);
+        return CMD_RET_INVPARAM;
+    }
+
+    status = bladerf_set_sample_rate(state->curr_device, module, rate, &actual);
+    if (status) {
+        state->last_lib_error = status;
+        return CMD_RET_LIBBLADERF;
+    }
+
+    return CMD_RET_OK;
+}
+
 int cmd_set(struct cli_state *state, int argc, char **argv)
 {
     int rv = CMD_RET_OK;
+
+    if (argc >= 2 && strcasecmp(argv[1], "samplerate") == 0) {
+        if (!state->curr_device) {
+            return CMD_RET_NODEV;
+        }
+        return set_samplerate(state, argc, argv);
+    }
+
     printf( "Inside set!\n" );
     return rv;
 }
-
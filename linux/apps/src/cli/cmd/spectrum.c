@@ -0,0 +1,213 @@
+#include "cmd.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SPECTRUM_READ_SAMPLES   (256 * 1024)
+#define SPECTRUM_UPDATE_MS      500
+#define SPECTRUM_ALPHA          0.05
+#define SPECTRUM_COLS           64      /* Display width, in columns */
+#define SPECTRUM_ROWS           20
+#define SPECTRUM_DB_PER_ROW     5
+
+struct spectrum_opts {
+    struct bladerf_psd_config psd;
+    const char *out;
+};
+
+/* Each column shows the strongest bin it covers, so narrow signals don't
+ * disappear when the FFT is wider than the display */
+static void spectrum_draw(const float *db, unsigned int n, unsigned int freq,
+                          uint64_t frames, bool max_hold)
+{
+    float col[SPECTRUM_COLS], top = -1000;
+    unsigned int c, i, r, per = n / SPECTRUM_COLS;
+    int ceiling;
+
+    for (c = 0; c < SPECTRUM_COLS; c++) {
+        col[c] = db[c * per];
+        for (i = 1; i < per; i++)
+            if (db[c * per + i] > col[c])
+                col[c] = db[c * per + i];
+        if (col[c] > top)
+            top = col[c];
+    }
+
+    /* Put the strongest signal in the top row */
+    ceiling = SPECTRUM_DB_PER_ROW * (int)ceil(top / SPECTRUM_DB_PER_ROW);
+
+    printf("\033[H\033[2J");
+    printf("Center %u Hz, %u-point FFT, %s, %llu frames "
+           "(press any key to stop)\n\n",
+           freq, n, max_hold ? "max-hold" : "averaged",
+           (unsigned long long)frames);
+
+    for (r = 0; r < SPECTRUM_ROWS; r++) {
+        int level = ceiling - (int)r * SPECTRUM_DB_PER_ROW;
+        printf("%5d dBFS |", level);
+        for (c = 0; c < SPECTRUM_COLS; c++)
+            putchar(col[c] >= level ? '#' : ' ');
+        putchar('\n');
+    }
+
+    printf("           +");
+    for (c = 0; c < SPECTRUM_COLS; c++)
+        putchar(c == SPECTRUM_COLS / 2 ? '|' : '-');
+    printf("\n           -fs/2%*s%*s\n", SPECTRUM_COLS / 2 - 2, "DC",
+           SPECTRUM_COLS / 2 - 2, "+fs/2");
+    fflush(stdout);
+}
+
+static int spectrum_run(struct cli_state *state, const struct spectrum_opts *o)
+{
+    struct bladerf *dev = state->curr_device;
+    struct bladerf_psd *psd = NULL;
+    struct timespec last, now;
+    struct termios saved;
+    bool restore_term = false;
+    unsigned int freq = 0, n = o->psd.fft_size;
+    uint64_t frames = 0, written = 0;
+    int16_t **bufs = NULL, *samples;
+    float *db = NULL;
+    FILE *out = NULL;
+    ssize_t got;
+    int status, rv = CMD_RET_OK;
+
+    status = bladerf_psd_create(&o->psd, &psd);
+    if (status) {
+        state->last_lib_error = status;
+        return CMD_RET_LIBBLADERF;
+    }
+
+    status = bladerf_alloc_buffers(dev, 1, SPECTRUM_READ_SAMPLES, &bufs);
+    if (status) {
+        state->last_lib_error = status;
+        rv = CMD_RET_LIBBLADERF;
+        goto out;
+    }
+    samples = bufs[0];
+
+    db = malloc(n * sizeof(float));
+    if (!db) {
+        rv = CMD_RET_MEM;
+        goto out;
+    }
+
+    if (o->out) {
+        out = fopen(o->out, "wb");
+        if (!out) {
+            printf("Failed to open %s: %s\n", o->out, strerror(errno));
+            rv = CMD_RET_INVPARAM;
+            goto out;
+        }
+        printf("Writing %u-bin float32 dBFS frames to %s every %d ms "
+               "(press any key to stop)...\n", n, o->out, SPECTRUM_UPDATE_MS);
+    }
+
+    bladerf_get_frequency(dev, RX, &freq);
+
+    restore_term = keypress_begin(&saved);
+    clock_gettime(CLOCK_MONOTONIC, &last);
+
+    while (!keypress_poll(0)) {
+        got = bladerf_read_c16(dev, samples, SPECTRUM_READ_SAMPLES);
+        if (got < 0) {
+            state->last_lib_error = got;
+            rv = CMD_RET_LIBBLADERF;
+            break;
+        }
+
+        frames += bladerf_psd_process(psd, samples, got);
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if ((now.tv_sec - last.tv_sec) * 1000 +
+                (now.tv_nsec - last.tv_nsec) / 1000000 < SPECTRUM_UPDATE_MS)
+            continue;
+        last = now;
+
+        if (bladerf_psd_get(psd, db))
+            continue;
+
+        if (out) {
+            if (fwrite(db, sizeof(float), n, out) != n) {
+                printf("Failed to write %s: %s\n", o->out, strerror(errno));
+                rv = CMD_RET_INVPARAM;
+                break;
+            }
+            written++;
+            printf("\r  %llu frames written   ", (unsigned long long)written);
+            fflush(stdout);
+        } else {
+            spectrum_draw(db, n, freq, frames,
+                          o->psd.avg == BLADERF_PSD_AVG_MAX);
+        }
+    }
+
+    printf("\n");
+
+out:
+    if (restore_term)
+        keypress_end(&saved);
+    if (out)
+        fclose(out);
+    free(db);
+    bladerf_free_buffers(dev, bufs);
+    bladerf_psd_destroy(psd);
+
+    return rv;
+}
+
+int cmd_spectrum(struct cli_state *state, int argc, char **argv)
+{
+    /* Valid commands:
+        spectrum [--size <n>] [--max] [--threads <n>] [--out <file>]
+    */
+    struct spectrum_opts o;
+    bool ok;
+    int i;
+
+    if (!state->curr_device) {
+        return CMD_RET_NODEV;
+    }
+
+    memset(&o, 0, sizeof(o));
+    o.psd.fft_size = 1024;
+    o.psd.avg = BLADERF_PSD_AVG_EXP;
+    o.psd.alpha = SPECTRUM_ALPHA;
+    o.psd.threads = sysconf(_SC_NPROCESSORS_ONLN) > 1 ?
+                    sysconf(_SC_NPROCESSORS_ONLN) - 1 : 1;
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--max")) {
+            o.psd.avg = BLADERF_PSD_AVG_MAX;
+        } else if (i + 1 >= argc) {
+            printf( "%s: Missing or invalid option: %s\n", argv[0], argv[i] );
+            return CMD_RET_INVPARAM;
+        } else if (!strcmp(argv[i], "--size")) {
+            o.psd.fft_size = str2uint( argv[++i], SPECTRUM_COLS,
+                                       BLADERF_PSD_MAX_SIZE, &ok );
+            if (!ok || (o.psd.fft_size & (o.psd.fft_size - 1))) {
+                printf( "%s: FFT size must be a power of two from %d to %d\n",
+                        argv[0], SPECTRUM_COLS, BLADERF_PSD_MAX_SIZE );
+                return CMD_RET_INVPARAM;
+            }
+        } else if (!strcmp(argv[i], "--threads")) {
+            o.psd.threads = str2uint( argv[++i], 1, 64, &ok );
+            if (!ok) {
+                printf( "%s: %s is an invalid thread count\n", argv[0], argv[i] );
+                return CMD_RET_INVPARAM;
+            }
+        } else if (!strcmp(argv[i], "--out")) {
+            o.out = argv[++i];
+        } else {
+            printf( "%s: Unknown option: %s\n", argv[0], argv[i] );
+            return CMD_RET_INVPARAM;
+        }
+    }
+
+    return spectrum_run(state, &o);
+}
@@ -0,0 +1,235 @@
+#include "cmd.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <limits.h>
+#include <unistd.h>
+
+#define SWEEP_RATE              10000000
+#define SWEEP_FRAMES            16
+#define SWEEP_SETTLE            4096
+#define SWEEP_COLS              64      /* Display width, in columns */
+#define SWEEP_ROWS              20
+#define SWEEP_DB_PER_ROW        5
+
+struct sweep_opts {
+    struct bladerf_sweep_config cfg;
+    const char *out;
+};
+
+/* Each column shows the strongest bin it covers */
+static void sweep_draw(const struct bladerf_sweep_config *cfg,
+                       const float *db, size_t n, unsigned int passes,
+                       double pass_ms)
+{
+    float col[SWEEP_COLS], top = -1000;
+    size_t c, i, first, last;
+    unsigned int r;
+    int ceiling;
+
+    for (c = 0; c < SWEEP_COLS; c++) {
+        first = c * n / SWEEP_COLS;
+        last = (c + 1) * n / SWEEP_COLS;
+        col[c] = -1000;
+        for (i = first; i < last; i++)
+            if (db[i] > col[c])
+                col[c] = db[i];
+        if (col[c] > top)
+            top = col[c];
+    }
+
+    ceiling = SWEEP_DB_PER_ROW * (int)ceil(top / SWEEP_DB_PER_ROW);
+
+    printf("\033[H\033[2J");
+    printf("Sweep %u - %u Hz, %zu bins, pass %u took %.0f ms "
+           "(press any key to stop)\n\n",
+           cfg->start, cfg->stop, n, passes, pass_ms);
+
+    for (r = 0; r < SWEEP_ROWS; r++) {
+        int level = ceiling - (int)r * SWEEP_DB_PER_ROW;
+        printf("%5d dBFS |", level);
+        for (c = 0; c < SWEEP_COLS; c++)
+            putchar(col[c] >= level ? '#' : ' ');
+        putchar('\n');
+    }
+
+    printf("           +");
+    for (c = 0; c < SWEEP_COLS; c++)
+        putchar('-');
+    printf("\n           %-*.1f%*.1f MHz\n", SWEEP_COLS / 2,
+           cfg->start / 1e6, SWEEP_COLS / 2, cfg->stop / 1e6);
+    fflush(stdout);
+}
+
+static int sweep_run(struct cli_state *state, const struct sweep_opts *o)
+{
+    struct bladerf_sweep *sweep = NULL;
+    struct timespec begin, end;
+    struct termios saved;
+    bool restore_term = false;
+    unsigned int passes = 0;
+    double bin_hz, pass_ms;
+    float *db = NULL;
+    FILE *out = NULL;
+    size_t n;
+    int status, rv = CMD_RET_OK;
+
+    status = bladerf_sweep_create(state->curr_device, &o->cfg, &sweep);
+    if (status) {
+        state->last_lib_error = status;
+        return CMD_RET_LIBBLADERF;
+    }
+
+    n = bladerf_sweep_get_bins(sweep, &bin_hz);
+    db = malloc(n * sizeof(float));
+    if (!db) {
+        rv = CMD_RET_MEM;
+        goto out;
+    }
+
+    if (o->out) {
+        out = fopen(o->out, "wb");
+        if (!out) {
+            printf("Failed to open %s: %s\n", o->out, strerror(errno));
+            rv = CMD_RET_INVPARAM;
+            goto out;
+        }
+        printf("Writing %zu-bin float32 dBFS sweeps, %.1f Hz apart from "
+               "%u Hz, to %s (press any key to stop)...\n",
+               n, bin_hz, o->cfg.start, o->out);
+    }
+
+    restore_term = keypress_begin(&saved);
+
+    while (!keypress_poll(0)) {
+        clock_gettime(CLOCK_MONOTONIC, &begin);
+        status = bladerf_sweep_run(sweep, db);
+        if (status) {
+            state->last_lib_error = status;
+            rv = CMD_RET_LIBBLADERF;
+            break;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        passes++;
+        pass_ms = (end.tv_sec - begin.tv_sec) * 1000.0 +
+                  (end.tv_nsec - begin.tv_nsec) / 1e6;
+
+        if (out) {
+            if (fwrite(db, sizeof(float), n, out) != n) {
+                printf("Failed to write %s: %s\n", o->out, strerror(errno));
+                rv = CMD_RET_INVPARAM;
+                break;
+            }
+            printf("\r  %u sweeps written, last took %.0f ms   ",
+                   passes, pass_ms);
+            fflush(stdout);
+        } else {
+            sweep_draw(&o->cfg, db, n, passes, pass_ms);
+        }
+    }
+
+    printf("\n");
+
+out:
+    if (restore_term)
+        keypress_end(&saved);
+    if (out)
+        fclose(out);
+    free(db);
+    bladerf_sweep_destroy(sweep);
+
+    return rv;
+}
+
+int cmd_sweep(struct cli_state *state, int argc, char **argv)
+{
+    /* Valid commands:
+        sweep <start> <stop> <step> [--rate <hz>] [--size <n>]
+              [--frames <n>] [--out <file>]
+    */
+    struct sweep_opts o;
+    bool ok;
+    int i;
+
+    if (!state->curr_device) {
+        return CMD_RET_NODEV;
+    }
+
+    if (argc < 4) {
+        return CMD_RET_INVPARAM;
+    }
+
+    memset(&o, 0, sizeof(o));
+    o.cfg.samplerate = SWEEP_RATE;
+    o.cfg.fft_size = 1024;
+    o.cfg.frames = SWEEP_FRAMES;
+    o.cfg.settle_samples = SWEEP_SETTLE;
+    o.cfg.threads = sysconf(_SC_NPROCESSORS_ONLN) > 2 ?
+                    sysconf(_SC_NPROCESSORS_ONLN) - 2 : 1;
+
+    o.cfg.start = str2uint( argv[1], LMS_FREQ_MIN, LMS_FREQ_MAX, &ok );
+    if (ok)
+        o.cfg.stop = str2uint( argv[2], o.cfg.start + 1, LMS_FREQ_MAX, &ok );
+    if (!ok) {
+        printf( "%s: Start and stop must be within %u - %u Hz, "
+                "start first\n", argv[0], LMS_FREQ_MIN, LMS_FREQ_MAX );
+        return CMD_RET_INVPARAM;
+    }
+
+    o.cfg.step = str2uint( argv[3], 1, UINT_MAX, &ok );
+    if (!ok) {
+        printf( "%s: %s is an invalid step\n", argv[0], argv[3] );
+        return CMD_RET_INVPARAM;
+    }
+
+    for (i = 4; i < argc; i++) {
+        if (i + 1 >= argc) {
+            printf( "%s: Missing or invalid option: %s\n", argv[0], argv[i] );
+            return CMD_RET_INVPARAM;
+        } else if (!strcmp(argv[i], "--rate")) {
+            o.cfg.samplerate = str2uint( argv[++i], 1, UINT_MAX, &ok );
+            if (!ok) {
+                printf( "%s: %s is an invalid sample rate\n", argv[0], argv[i] );
+                return CMD_RET_INVPARAM;
+            }
+        } else if (!strcmp(argv[i], "--size")) {
+            o.cfg.fft_size = str2uint( argv[++i], BLADERF_PSD_MIN_SIZE,
+                                       BLADERF_PSD_MAX_SIZE, &ok );
+            if (!ok || (o.cfg.fft_size & (o.cfg.fft_size - 1))) {
+                printf( "%s: FFT size must be a power of two from %d to %d\n",
+                        argv[0], BLADERF_PSD_MIN_SIZE, BLADERF_PSD_MAX_SIZE );
+                return CMD_RET_INVPARAM;
+            }
+        } else if (!strcmp(argv[i], "--frames")) {
+            o.cfg.frames = str2uint( argv[++i], 1, 65536, &ok );
+            if (!ok) {
+                printf( "%s: %s is an invalid frame count\n", argv[0], argv[i] );
+                return CMD_RET_INVPARAM;
+            }
+        } else if (!strcmp(argv[i], "--out")) {
+            o.out = argv[++i];
+        } else {
+            printf( "%s: Unknown option: %s\n", argv[0], argv[i] );
+            return CMD_RET_INVPARAM;
+        }
+    }
+
+    if (o.cfg.step > o.cfg.samplerate) {
+        printf( "%s: The step may not exceed the sample rate (%u Hz)\n",
+                argv[0], o.cfg.samplerate );
+        return CMD_RET_INVPARAM;
+    }
+
+    /* The last step is centered up to half a step past stop */
+    if ((uint64_t)o.cfg.stop + o.cfg.step / 2 > LMS_FREQ_MAX) {
+        printf( "%s: Stop plus half a step may not exceed %u Hz\n",
+                argv[0], LMS_FREQ_MAX );
+        return CMD_RET_INVPARAM;
+    }
+
+    return sweep_run(state, &o);
+}
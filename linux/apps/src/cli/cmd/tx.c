@@ -1,9 +1,378 @@
 #include "cmd.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "iq_text.h"
 
-int cmd_tx(struct cli_state *state, int argc, char **argv)
+/* Playback streams straight out of a mapping of the waveform: whole
+ * transfers are handed to bladerf_send_c16() from the mapped pages and only
+ * the pieces straddling a repetition boundary are staged in a small bounce
+ * buffer. Looping reuses the same pages, so a cached file is never re-read. */
+#define TX_CHUNK_SAMPLES    (256 * 1024)    /* Max samples per send call */
+#define TX_STATUS_MS        500
+
+struct tx_ctx {
+    struct bladerf *dev;
+    const int16_t *zeros;                   /* TX_CHUNK_SAMPLES of silence */
+
+    int16_t bounce[2 * BLADERF_SAMPLES_PER_XFER];
+    size_t bounce_n;
+
+    bool stop;
+    int error;
+    bool counting;
+    uint64_t samples_sent;
+    uint64_t gap_underruns;                 /* Booked while sending --gap */
+    struct bladerf_stats stats_start;
+    struct timespec start, last_status;
+};
+
+static double elapsed_sec(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* Send n samples, n being a multiple of BLADERF_SAMPLES_PER_XFER */
+static void tx_send(struct tx_ctx *ctx, const int16_t *samples, size_t n)
+{
+    ssize_t ret;
+    double secs;
+
+    while (n && !ctx->stop) {
+        ret = bladerf_send_c16(ctx->dev, (int16_t *)samples, n);
+        if (ret < 0) {
+            ctx->error = ret;
+            ctx->stop = true;
+            return;
+        }
+
+        /* A drain at the end of any earlier transmission is booked by the
+         * driver against our first write, so only count from here on */
+        if (!ctx->counting) {
+            bladerf_stats(ctx->dev, &ctx->stats_start);
+            ctx->counting = true;
+        }
+
+        samples += 2 * ret;
+        n -= ret;
+        ctx->samples_sent += ret;
+
+        secs = elapsed_sec(&ctx->last_status);
+        if (secs * 1000 >= TX_STATUS_MS) {
+            if (keypress_poll(0))
+                ctx->stop = true;
+
+            clock_gettime(CLOCK_MONOTONIC, &ctx->last_status);
+            secs = elapsed_sec(&ctx->start);
+            printf("\r  %llu samples sent, %.3f Msps   ",
+                   (unsigned long long)ctx->samples_sent,
+                   secs > 0 ? ctx->samples_sent / secs / 1e6 : 0.0);
+            fflush(stdout);
+        }
+    }
+}
+
+/* Append n samples to the outgoing stream */
+static void tx_emit(struct tx_ctx *ctx, const int16_t *samples, size_t n)
+{
+    size_t take;
+
+    while (n && !ctx->stop) {
+        if (ctx->bounce_n || n < BLADERF_SAMPLES_PER_XFER) {
+            take = BLADERF_SAMPLES_PER_XFER - ctx->bounce_n;
+            if (take > n)
+                take = n;
+
+            memcpy(ctx->bounce + 2 * ctx->bounce_n, samples,
+                   take * 2 * sizeof(int16_t));
+            ctx->bounce_n += take;
+            samples += 2 * take;
+            n -= take;
+
+            if (ctx->bounce_n == BLADERF_SAMPLES_PER_XFER) {
+                tx_send(ctx, ctx->bounce, BLADERF_SAMPLES_PER_XFER);
+                ctx->bounce_n = 0;
+            }
+        } else {
+            take = n < TX_CHUNK_SAMPLES ? n : TX_CHUNK_SAMPLES;
+            take -= take % BLADERF_SAMPLES_PER_XFER;
+            tx_send(ctx, samples, take);
+            samples += 2 * take;
+            n -= take;
+        }
+    }
+}
+
+/* Underruns booked by the driver so far, 0 if they can't be read */
+static uint64_t tx_underruns(struct tx_ctx *ctx)
+{
+    struct bladerf_stats stats;
+
+    if (!ctx->counting || bladerf_stats(ctx->dev, &stats))
+        return 0;
+
+    return stats.tx_underruns;
+}
+
+/* The silence is intended, so underruns booked while sending it are kept
+ * out of the reported total */
+static void tx_emit_gap(struct tx_ctx *ctx, uint64_t n)
+{
+    bool counting = ctx->counting;
+    uint64_t before = tx_underruns(ctx);
+    size_t take;
+
+    while (n && !ctx->stop) {
+        take = n < TX_CHUNK_SAMPLES ? n : TX_CHUNK_SAMPLES;
+        tx_emit(ctx, ctx->zeros, take);
+        n -= take;
+    }
+
+    if (counting)
+        ctx->gap_underruns += tx_underruns(ctx) - before;
+}
+
+/* Pad the last partial transfer with silence */
+static void tx_flush(struct tx_ctx *ctx)
+{
+    if (ctx->bounce_n && !ctx->stop) {
+        memset(ctx->bounce + 2 * ctx->bounce_n, 0,
+               (BLADERF_SAMPLES_PER_XFER - ctx->bounce_n) * 2 * sizeof(int16_t));
+        tx_send(ctx, ctx->bounce, BLADERF_SAMPLES_PER_XFER);
+        ctx->bounce_n = 0;
+    }
+}
+
+/* Parse an ASCII waveform into an anonymous mapping of map_len bytes.
+ * Returns the number of samples, or -1 on failure. */
+static ssize_t load_ascii(const char *filename, const char *text, size_t len,
+                          int16_t **samples, size_t *map_len)
 {
-    printf( "Inside tx\n" );
-    return CMD_RET_OK;
+    size_t max = len / 4 + 1;               /* Shortest line is "0 0\n" */
+    size_t consumed, line, i;
+    ssize_t n;
+    int16_t *buf;
+
+    buf = mmap(NULL, max * 2 * sizeof(int16_t), PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buf == MAP_FAILED) {
+        printf("Failed to allocate memory for %s\n", filename);
+        return -1;
+    }
+
+    n = iq_text_parse(text, len, 1, buf, max, &consumed);
+    if (n < 0) {
+        for (i = 0, line = 1; i < consumed; i++)
+            line += (text[i] == '\n');
+        printf("%s:%zu: Invalid sample\n", filename, line);
+        munmap(buf, max * 2 * sizeof(int16_t));
+        return -1;
+    }
+
+    /* Hand the unused tail back */
+    *map_len = max * 2 * sizeof(int16_t);
+    i = (n * 2 * sizeof(int16_t) + 4095) & ~(size_t)4095;
+    if (i && i < *map_len) {
+        munmap((char *)buf + i, *map_len - i);
+        *map_len = i;
+    }
+
+    *samples = buf;
+    return n;
+}
+
+static int tx_playback(struct cli_state *state, const char *filename,
+                       bool ascii, unsigned int repeat, uint64_t gap)
+{
+    struct tx_ctx ctx;
+    struct termios saved;
+    struct stat st;
+    bool restore_term;
+    void *map = MAP_FAILED;
+    size_t map_len = 0, parsed_len = 0, n = 0;
+    const int16_t *samples = NULL;
+    int16_t *parsed = NULL;
+    unsigned int reps = 0;
+    uint64_t underruns;
+    double secs;
+    ssize_t ret;
+    int fd, rv = CMD_RET_OK;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.dev = state->curr_device;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st)) {
+        printf("Failed to open %s: %s\n", filename, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return CMD_RET_INVPARAM;
+    }
+
+    map_len = st.st_size;
+    if (map_len)
+        map = mmap(NULL, map_len, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED) {
+        printf("Failed to map %s: %s\n", filename,
+               map_len ? strerror(errno) : "File is empty");
+        return CMD_RET_INVPARAM;
+    }
+
+    if (ascii) {
+        madvise(map, map_len, MADV_SEQUENTIAL);
+        ret = load_ascii(filename, map, map_len, &parsed, &parsed_len);
+        munmap(map, map_len);
+        map = MAP_FAILED;
+        if (ret < 0)
+            return CMD_RET_INVPARAM;
+
+        samples = parsed;
+        n = ret;
+    } else {
+        if (map_len % (2 * sizeof(int16_t)))
+            printf("Warning: ignoring trailing partial sample in %s\n",
+                   filename);
+
+        /* A single pass should not evict the rest of the page cache; when
+         * looping, the whole waveform is about to be reused */
+        madvise(map, map_len, repeat == 1 ? MADV_SEQUENTIAL : MADV_WILLNEED);
+        samples = map;
+        n = map_len / (2 * sizeof(int16_t));
+    }
+
+    if (n == 0) {
+        printf("%s contains no samples\n", filename);
+        rv = CMD_RET_INVPARAM;
+        goto out;
+    }
+
+    if (gap) {
+        ctx.zeros = calloc(TX_CHUNK_SAMPLES, 2 * sizeof(int16_t));
+        if (!ctx.zeros) {
+            rv = CMD_RET_MEM;
+            goto out;
+        }
+    }
+
+    if (repeat)
+        printf("Transmitting %zu samples x %u (press any key to abort)...\n",
+               n, repeat);
+    else
+        printf("Transmitting %zu samples until a key is pressed...\n", n);
+
+    restore_term = keypress_begin(&saved);
+    clock_gettime(CLOCK_MONOTONIC, &ctx.start);
+    ctx.last_status = ctx.start;
+
+    while (!ctx.stop && (!repeat || reps < repeat)) {
+        tx_emit(&ctx, samples, n);
+        if (ctx.stop)
+            break;
+        reps++;
+        if (gap && (!repeat || reps < repeat))
+            tx_emit_gap(&ctx, gap);
+    }
+
+    /* Before the padded last transfer and the drain behind it */
+    underruns = 0;
+    if (ctx.counting)
+        underruns = tx_underruns(&ctx) - ctx.stats_start.tx_underruns -
+                    ctx.gap_underruns;
+    tx_flush(&ctx);
+
+    if (restore_term)
+        keypress_end(&saved);
+
+    secs = elapsed_sec(&ctx.start);
+
+    printf("\n\n  Samples sent:      %llu\n"
+           "  Repetitions:       %u\n"
+           "  Elapsed:           %.3f s\n"
+           "  Sustained rate:    %.3f Msps\n"
+           "  Device underruns:  %llu\n\n",
+           (unsigned long long)ctx.samples_sent, reps, secs,
+           secs > 0 ? ctx.samples_sent / secs / 1e6 : 0.0,
+           (unsigned long long)underruns);
+
+    if (ctx.error) {
+        state->last_lib_error = ctx.error;
+        rv = CMD_RET_LIBBLADERF;
+    }
+
+out:
+    free((void *)ctx.zeros);
+    if (parsed)
+        munmap(parsed, parsed_len);
+    if (map != MAP_FAILED)
+        munmap(map, map_len);
+
+    return rv;
 }
 
+int cmd_tx(struct cli_state *state, int argc, char **argv)
+{
+    /* Valid commands:
+        tx <filename> [--repeat <n>|--loop] [--gap <samples>]
+                      [--format <ascii|binary>]
+    */
+    unsigned int repeat = 1;
+    uint64_t gap = 0;
+    bool ok, ascii = false;
+    int i;
+
+    if (!state->curr_device) {
+        return CMD_RET_NODEV;
+    }
+
+    if (argc < 2) {
+        printf( "%s: Invalid number of parameters (%d)\n", argv[0], argc );
+        return CMD_RET_INVPARAM;
+    }
+
+    for (i = 2; i < argc; i++) {
+        if (!strcmp(argv[i], "--loop")) {
+            repeat = 0;
+        } else if (i + 1 >= argc) {
+            printf( "%s: Missing or invalid option: %s\n", argv[0], argv[i] );
+            return CMD_RET_INVPARAM;
+        } else if (!strcmp(argv[i], "--repeat")) {
+            repeat = str2uint( argv[++i], 1, UINT_MAX, &ok );
+            if (!ok) {
+                printf( "%s: %s is an invalid repeat count\n", argv[0], argv[i] );
+                return CMD_RET_INVPARAM;
+            }
+        } else if (!strcmp(argv[i], "--gap")) {
+            gap = str2uint( argv[++i], 0, UINT_MAX, &ok );
+            if (!ok) {
+                printf( "%s: %s is an invalid gap\n", argv[0], argv[i] );
+                return CMD_RET_INVPARAM;
+            }
+        } else if (!strcmp(argv[i], "--format")) {
+            i++;
+            if (!strcasecmp(argv[i], "ascii")) {
+                ascii = true;
+            } else if (!strcasecmp(argv[i], "binary")) {
+                ascii = false;
+            } else {
+                printf( "%s: %s is an invalid format\n", argv[0], argv[i] );
+                return CMD_RET_INVPARAM;
+            }
+        } else {
+            printf( "%s: Unknown option: %s\n", argv[0], argv[i] );
+            return CMD_RET_INVPARAM;
+        }
+    }
+
+    return tx_playback(state, argv[1], ascii, repeat, gap);
+}
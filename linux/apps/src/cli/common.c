@@ -1,5 +1,7 @@
 #include <stdlib.h>
 #include <errno.h>
+#include <unistd.h>
+#include <sys/select.h>
 #include "cmd.h"
 
 int str2int(const char *str, int min, int max, bool *ok)
@@ -76,3 +78,50 @@ double str2double(const char *str, double min, double max, bool *ok)
 
     return value;
 }
+
+bool keypress_begin(struct termios *saved)
+{
+    struct termios t;
+
+    if (!isatty(STDIN_FILENO) || tcgetattr(STDIN_FILENO, saved) != 0)
+        return false;
+
+    t = *saved;
+    t.c_lflag &= ~(ICANON | ECHO);
+    t.c_cc[VMIN] = 1;
+    t.c_cc[VTIME] = 0;
+
+    return tcsetattr(STDIN_FILENO, TCSANOW, &t) == 0;
+}
+
+void keypress_end(const struct termios *saved)
+{
+    tcsetattr(STDIN_FILENO, TCSANOW, saved);
+}
+
+int keypress_read(unsigned int timeout_ms)
+{
+    fd_set fds;
+    struct timeval tv;
+    unsigned char c;
+
+    FD_ZERO(&fds);
+    FD_SET(STDIN_FILENO, &fds);
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+
+    if (select(STDIN_FILENO + 1, &fds, NULL, NULL, &tv) <= 0)
+        return -1;
+
+    if (read(STDIN_FILENO, &c, 1) == 1)
+        return c;
+
+    /* stdin hit EOF (e.g. not interactive); keep the caller's pacing */
+    usleep(timeout_ms * 1000);
+    return -1;
+}
+
+bool keypress_poll(unsigned int timeout_ms)
+{
+    return keypress_read(timeout_ms) >= 0;
+}
@@ -1,6 +1,7 @@
 #ifndef COMMON_H__
 #define COMMON_H__
 #include <stdbool.h>
+#include <termios.h>
 #include <libbladeRF.h>
 
 /**
@@ -47,4 +48,47 @@ int str2int(const char *str, int min, int max, bool *ok);
  */
 unsigned int str2uint(const char *str,
                         unsigned int min, unsigned int max, bool *ok);
+
+/**
+ * String to double conversion with range and error checking
+ *
+ *  @param  str     String to convert
+ *  @param  min     Inclusive minimum allowed value
+ *  @param  max     Inclusive maximum allowed value
+ *  @param  ok      If non-NULL, this will be set to true to denote that
+ *                  the conversion succeeded. If this value is not true,
+ *                  then the return value should not be used.
+ *
+ * @return 0 on success, undefined on failure
+ */
+double str2double(const char *str, double min, double max, bool *ok);
+
+/**
+ * Put the terminal into a mode where single key presses can be detected
+ * without echo. Has no effect if stdin is not a terminal.
+ *
+ *  @param  saved   Receives the previous terminal settings
+ *
+ * @return true if the settings were changed and must be restored
+ */
+bool keypress_begin(struct termios *saved);
+
+/**
+ * Restore terminal settings saved by keypress_begin()
+ */
+void keypress_end(const struct termios *saved);
+
+/**
+ * Wait up to timeout_ms for a key press, consuming it if one occurs
+ *
+ * @return true if a key was pressed
+ */
+bool keypress_poll(unsigned int timeout_ms);
+
+/**
+ * Wait up to timeout_ms for a key press, consuming it if one occurs
+ *
+ * @return the key pressed, or -1 if none was
+ */
+int keypress_read(unsigned int timeout_ms);
 #endif
@@ -0,0 +1,149 @@
+#include <string.h>
+#include <pthread.h>
+#include "iq_text.h"
+
+/* Every int16 value pre-rendered as decimal text. Formatting a sample is
+ * then two fixed-size copies, with no division or branching per digit.
+ * 64 Ki entries * 8 bytes = 512 KiB, which stays resident in L2. */
+struct num_text {
+    char str[7];
+    uint8_t len;
+};
+
+static struct num_text num_lut[65536];
+static pthread_once_t num_lut_once = PTHREAD_ONCE_INIT;
+
+static void num_lut_init(void)
+{
+    int v, u, i, len;
+    char tmp[8];
+    struct num_text *e;
+
+    for (v = -32768; v <= 32767; v++) {
+        e = &num_lut[(uint16_t)v];
+        u = v < 0 ? -v : v;
+
+        len = 0;
+        do {
+            tmp[len++] = '0' + u % 10;
+            u /= 10;
+        } while (u);
+
+        i = 0;
+        if (v < 0)
+            e->str[i++] = '-';
+        while (len)
+            e->str[i++] = tmp[--len];
+        e->len = i;
+    }
+}
+
+size_t iq_text_format(char *out, const int16_t *samples, size_t n)
+{
+    char *p = out;
+    const struct num_text *e;
+    size_t k;
+
+    pthread_once(&num_lut_once, num_lut_init);
+
+    for (k = 0; k < 2 * n; k += 2) {
+        e = &num_lut[(uint16_t)samples[k]];
+        memcpy(p, e->str, sizeof(e->str));
+        p += e->len;
+        p[0] = ',';
+        p[1] = ' ';
+        p += 2;
+
+        e = &num_lut[(uint16_t)samples[k + 1]];
+        memcpy(p, e->str, sizeof(e->str));
+        p += e->len;
+        *p++ = '\n';
+    }
+
+    return p - out;
+}
+
+static inline int is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+/* Parse one signed decimal value, advancing *pp. Returns -1 on error. */
+static int parse_value(const char **pp, const char *end, int16_t *val)
+{
+    const char *p = *pp;
+    int neg = 0;
+    int32_t v = 0;
+    const char *digits;
+
+    if (p < end && (*p == '-' || *p == '+')) {
+        neg = (*p == '-');
+        p++;
+    }
+
+    digits = p;
+    while (p < end && *p >= '0' && *p <= '9') {
+        v = v * 10 + (*p - '0');
+        if (v > 32768)
+            return -1;
+        p++;
+    }
+
+    if (p == digits || (!neg && v > 32767))
+        return -1;
+
+    *val = neg ? -v : v;
+    *pp = p;
+    return 0;
+}
+
+ssize_t iq_text_parse(const char *in, size_t len, int final,
+                      int16_t *samples, size_t max, size_t *consumed)
+{
+    const char *p = in, *end = in + len, *line, *eol;
+    size_t n = 0;
+
+    while (p < end && n < max) {
+        line = p;
+        eol = memchr(p, '\n', end - p);
+        if (!eol) {
+            if (!final)
+                break;
+            eol = end;
+        }
+
+        while (p < eol && is_space(*p))
+            p++;
+
+        if (p < eol && *p != '#') {
+            if (parse_value(&p, eol, &samples[2 * n]))
+                goto err;
+
+            while (p < eol && is_space(*p))
+                p++;
+            if (p < eol && *p == ',')
+                p++;
+            while (p < eol && is_space(*p))
+                p++;
+
+            if (parse_value(&p, eol, &samples[2 * n + 1]))
+                goto err;
+
+            while (p < eol && is_space(*p))
+                p++;
+            if (p != eol)
+                goto err;
+
+            n++;
+        }
+
+        p = eol < end ? eol + 1 : end;
+    }
+
+    *consumed = p - in;
+    return n;
+
+err:
+    *consumed = line - in;
+    return -1;
+}
@@ -0,0 +1,51 @@
+#ifndef IQ_TEXT_H__
+#define IQ_TEXT_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * Longest line produced for one sample: "-32768, -32768\n"
+ */
+#define IQ_TEXT_MAX_LINE    15
+
+/**
+ * Bytes of output buffer needed to format n samples. Includes slack for the
+ * fixed-size stores used by the formatter.
+ */
+#define IQ_TEXT_BUF_SIZE(n) ((n) * IQ_TEXT_MAX_LINE + 8)
+
+/**
+ * Format interleaved I/Q pairs as "I, Q" text lines
+ *
+ * @param   out         Output buffer of at least IQ_TEXT_BUF_SIZE(n) bytes
+ * @param   samples     Interleaved I/Q samples
+ * @param   n           Number of I/Q pairs
+ *
+ * @return number of bytes written to out
+ */
+size_t iq_text_format(char *out, const int16_t *samples, size_t n);
+
+/**
+ * Parse "I, Q" text lines into interleaved I/Q pairs
+ *
+ * Values may be separated by a comma and/or whitespace. Blank lines and
+ * lines starting with '#' are skipped. Only complete (newline-terminated)
+ * lines are consumed, so input may be fed in arbitrary chunks; pass
+ * final = true with the last chunk to accept an unterminated last line.
+ *
+ * @param   in          Input text
+ * @param   len         Length of input
+ * @param   final       Input ends here
+ * @param   samples     Output buffer for interleaved I/Q samples
+ * @param   max         Capacity of samples, in I/Q pairs
+ * @param   consumed    Number of input bytes consumed. On error, the
+ *                      offset of the offending line.
+ *
+ * @return number of I/Q pairs parsed, or -1 on malformed input
+ */
+ssize_t iq_text_parse(const char *in, size_t len, int final,
+                      int16_t *samples, size_t max, size_t *consumed);
+
+#endif
@@ -13,15 +13,17 @@
 #include "common.h"
 #include "cmd.h"
 #include "version.h"
+#include "provision.h"
 
 
-#define OPTSTR "pd:bf:l:LVh"
+#define OPTSTR "pd:bf:l:aLVh"
 static const struct option longopts[] = {
     { "device",         required_argument,  0, 'd' },
     { "batch",          no_argument,        0, 'b' },
     { "flash-firmware", required_argument,  0, 'f' },
     { "probe",          no_argument,        0, 'p' },
     { "load-fpga",      required_argument,  0, 'l' },
+    { "all",            no_argument,        0, 'a' },
     { "lib-version",    no_argument,        0, 'L' },
     { "version",        no_argument,        0, 'V' },
     { "help",           no_argument,        0, 'h' },
@@ -33,6 +35,7 @@ struct rc_config {
     bool batch_mode;
     bool flash_fw;
     bool load_fpga;
+    bool all_devices;
     bool probe;
     bool show_help;
     bool show_version;
@@ -48,6 +51,7 @@ struct rc_config {
     .batch_mode = false, \
     .flash_fw = false, \
     .load_fpga = false, \
+    .all_devices = false, \
     .probe = false, \
     .show_version = false, \
     .show_lib_version = false, \
@@ -94,6 +98,11 @@ int get_rc_config(int argc, char *argv[], struct rc_config *rc)
                 rc->batch_mode = true;
                 break;
 
+            case 'a':
+                rc->all_devices = true;
+                rc->batch_mode = true;
+                break;
+
             case 'p':
                 rc->probe = true;
                 rc->batch_mode = true;
@@ -129,6 +138,7 @@ void usage(const char *argv0)
     printf("  -d, --device <device>            Use the specified bladeRF device.\n");
     printf("  -f, --flash-firmware <file>      Flash specified firmware file.\n");
     printf("  -l, --load-fpga <file>           Load specified FPGA bitstream.\n");
+    printf("  -a, --all                        Apply -f and/or -l to all attached devices.\n");
     printf("  -p, --probe                      Probe for devices, print results, then exit.\n");
     printf("  -b, --batch                      Batch mode - do not enter interactive mode.\n");
     printf("  -L, --lib-version                Print libbladeRF version and exit.\n");
@@ -143,6 +153,9 @@ void usage(const char *argv0)
     printf("  Batch mode is implicit for the following options:\n");
     printf("     -p, --probe               -h, --help\n");
     printf("     -L, --lib-version         -V, --version\n");
+    printf("     -a, --all\n");
+    printf("\n");
+    printf("  With -a, every attached device is programmed concurrently.\n");
     printf("\n");
 
 #ifndef INTERACTIVE
@@ -180,7 +193,22 @@ int main(int argc, char *argv[])
         status = cmd_handle(&state, "probe");
     }
 
-    if (rc.device) {
+    if (rc.all_devices) {
+        if (rc.device) {
+            fprintf(stderr, "Error: -a and -d are mutually exclusive.\n");
+            status = -1;
+        } else if (!rc.fw_file && !rc.fpga_file) {
+            fprintf(stderr, "Error: -a requires -f and/or -l.\n");
+            status = -1;
+        } else if (!status) {
+            status = provision_all(rc.fw_file, rc.fpga_file);
+        }
+
+        /* Already handled for every device */
+        free(rc.fw_file);
+        free(rc.fpga_file);
+        rc.fw_file = rc.fpga_file = NULL;
+    } else if (rc.device) {
         state.curr_device = bladerf_open(rc.device);
         if (!state.curr_device) {
             /* TODO use upcoming bladerf_strerror() here */
@@ -220,9 +248,12 @@ int main(int argc, char *argv[])
         } else {
             printf("Loading fpga...\n");
             status = bladerf_load_fpga(state.curr_device, rc.fpga_file);
-            if (status) {
-                fprintf(stderr, "Error: failed to flash firmware: %s\n",
+            if (status < 0) {
+                fprintf(stderr, "Error: failed to load FPGA: %s\n",
                         bladerf_strerror(status));
+            } else if (status == 1) {
+                printf("FPGA is already running this image.\n");
+                status = 0;
             } else {
                 printf("Done.\n");
             }
@@ -0,0 +1,275 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <libbladeRF.h>
+#include "provision.h"
+
+/* Interval between aggregate progress updates */
+#define PROVISION_POLL_US   250000
+
+struct image {
+    void *data;
+    size_t len;
+};
+
+enum stage {
+    STAGE_PENDING,
+    STAGE_FIRMWARE,
+    STAGE_FPGA,
+    STAGE_DONE
+};
+
+struct worker {
+    pthread_t thread;
+    bool started;
+    const char *path;
+    const struct image *fw;
+    const struct image *fpga;
+
+    /* Protected by lock, read by the main thread for progress output */
+    pthread_mutex_t *lock;
+    enum stage stage;
+    size_t fpga_done;
+    size_t fpga_total;
+    int status;
+    const char *failed_step;
+    bool fpga_skipped;
+};
+
+static int read_image(const char *path, struct image *img)
+{
+    FILE *f;
+    struct stat st;
+
+    f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    if (fstat(fileno(f), &st) < 0) {
+        fprintf(stderr, "Failed to stat %s: %s\n", path, strerror(errno));
+        fclose(f);
+        return -1;
+    }
+
+    img->len = st.st_size;
+    img->data = malloc(img->len ? img->len : 1);
+    if (!img->data) {
+        perror("malloc");
+        fclose(f);
+        return -1;
+    }
+
+    if (fread(img->data, 1, img->len, f) != img->len) {
+        fprintf(stderr, "Failed to read %s\n", path);
+        free(img->data);
+        img->data = NULL;
+        fclose(f);
+        return -1;
+    }
+
+    fclose(f);
+    return 0;
+}
+
+static void set_stage(struct worker *w, enum stage stage)
+{
+    pthread_mutex_lock(w->lock);
+    w->stage = stage;
+    pthread_mutex_unlock(w->lock);
+}
+
+static void fpga_progress(size_t done, size_t total, void *arg)
+{
+    struct worker *w = arg;
+
+    pthread_mutex_lock(w->lock);
+    w->fpga_done = done;
+    w->fpga_total = total;
+    pthread_mutex_unlock(w->lock);
+}
+
+static void *provision_worker(void *arg)
+{
+    struct worker *w = arg;
+    struct bladerf *dev;
+    const char *failed_step = NULL;
+    int status = 0;
+
+    dev = bladerf_open(w->path);
+    if (!dev) {
+        status = BLADERF_ERR_IO;
+        failed_step = "open";
+        goto out;
+    }
+
+    if (w->fw) {
+        set_stage(w, STAGE_FIRMWARE);
+        status = bladerf_flash_firmware_mem(dev, w->fw->data, w->fw->len);
+        if (status < 0) {
+            failed_step = "firmware";
+            goto out;
+        }
+    }
+
+    if (w->fpga) {
+        set_stage(w, STAGE_FPGA);
+        status = bladerf_load_fpga_mem(dev, w->fpga->data, w->fpga->len,
+                                       fpga_progress, w);
+        if (status < 0) {
+            failed_step = "fpga";
+            goto out;
+        }
+    }
+
+out:
+    bladerf_close(dev);
+
+    pthread_mutex_lock(w->lock);
+    w->stage = STAGE_DONE;
+    w->failed_step = failed_step;
+    w->fpga_skipped = (status == 1);
+    w->status = status < 0 ? status : 0;
+    pthread_mutex_unlock(w->lock);
+
+    return NULL;
+}
+
+/* Print one line summarizing all workers. Returns number still running. */
+static size_t print_progress(struct worker *w, size_t n,
+                             pthread_mutex_t *lock)
+{
+    size_t i, running = 0, in_fw = 0, in_fpga = 0, failed = 0;
+    unsigned long long done = 0, total = 0;
+
+    pthread_mutex_lock(lock);
+    for (i = 0; i < n; i++) {
+        switch (w[i].stage) {
+            case STAGE_PENDING:
+                running++;
+                break;
+            case STAGE_FIRMWARE:
+                running++;
+                in_fw++;
+                break;
+            case STAGE_FPGA:
+                running++;
+                in_fpga++;
+                break;
+            case STAGE_DONE:
+                if (w[i].status < 0)
+                    failed++;
+                break;
+        }
+
+        if (w[i].fpga) {
+            done += w[i].fpga_done;
+            total += w[i].fpga_total ? w[i].fpga_total : w[i].fpga->len;
+        }
+    }
+    pthread_mutex_unlock(lock);
+
+    printf("\r  %zu/%zu done, %zu failed | firmware: %zu active",
+           n - running, n, failed, in_fw);
+    if (total) {
+        printf(" | fpga: %zu active, %3llu%%", in_fpga, done * 100 / total);
+    }
+    fflush(stdout);
+
+    return running;
+}
+
+int provision_all(const char *fw_file, const char *fpga_file)
+{
+    struct bladerf_devinfo *devices = NULL;
+    struct image fw = { NULL, 0 }, fpga = { NULL, 0 };
+    struct worker *workers = NULL;
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    ssize_t n_devices = 0;
+    size_t i, n_failed = 0;
+    int status = -1;
+
+    if (fw_file && read_image(fw_file, &fw))
+        goto out;
+
+    if (fpga_file && read_image(fpga_file, &fpga))
+        goto out;
+
+    n_devices = bladerf_get_device_list(&devices);
+    if (n_devices < 0) {
+        fprintf(stderr, "Failed to probe for devices: %s\n",
+                bladerf_strerror(n_devices));
+        goto out;
+    } else if (n_devices == 0) {
+        fprintf(stderr, "No devices found.\n");
+        goto out;
+    }
+
+    workers = calloc(n_devices, sizeof(workers[0]));
+    if (!workers) {
+        perror("calloc");
+        goto out;
+    }
+
+    printf("Provisioning %zd device%s...\n", n_devices,
+           n_devices == 1 ? "" : "s");
+
+    for (i = 0; i < (size_t)n_devices; i++) {
+        workers[i].path = devices[i].path;
+        workers[i].fw = fw_file ? &fw : NULL;
+        workers[i].fpga = fpga_file ? &fpga : NULL;
+        workers[i].lock = &lock;
+        workers[i].stage = STAGE_PENDING;
+
+        if (pthread_create(&workers[i].thread, NULL,
+                           provision_worker, &workers[i])) {
+            fprintf(stderr, "Failed to start worker for %s\n",
+                    devices[i].path);
+            workers[i].stage = STAGE_DONE;
+            workers[i].status = BLADERF_ERR_UNEXPECTED;
+            workers[i].failed_step = "thread";
+        } else {
+            workers[i].started = true;
+        }
+    }
+
+    while (print_progress(workers, n_devices, &lock))
+        usleep(PROVISION_POLL_US);
+    putchar('\n');
+
+    for (i = 0; i < (size_t)n_devices; i++) {
+        if (workers[i].started)
+            pthread_join(workers[i].thread, NULL);
+    }
+
+    printf("\nResults:\n");
+    for (i = 0; i < (size_t)n_devices; i++) {
+        if (workers[i].status < 0) {
+            n_failed++;
+            printf("  %-24s FAILED (%s): %s\n", workers[i].path,
+                   workers[i].failed_step,
+                   bladerf_strerror(workers[i].status));
+        } else if (workers[i].fpga_skipped) {
+            printf("  %-24s OK (FPGA already running this image)\n",
+                   workers[i].path);
+        } else {
+            printf("  %-24s OK\n", workers[i].path);
+        }
+    }
+
+    status = n_failed ? -1 : 0;
+
+out:
+    free(workers);
+    if (devices)
+        bladerf_free_device_list(devices, n_devices);
+    free(fw.data);
+    free(fpga.data);
+    return status;
+}
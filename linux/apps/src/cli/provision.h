@@ -0,0 +1,18 @@
+#ifndef PROVISION_H__
+#define PROVISION_H__
+
+/**
+ * Flash firmware and/or load an FPGA image onto every attached device
+ *
+ * One worker thread is started per device. Each image file is read once and
+ * the in-memory copy is shared by all workers. Aggregate progress is printed
+ * while the workers run, followed by a per-device summary.
+ *
+ * @param   fw_file     Firmware file to flash, or NULL to skip
+ * @param   fpga_file   FPGA bitstream to load, or NULL to skip
+ *
+ * @return 0 if every device succeeded, -1 otherwise
+ */
+int provision_all(const char *fw_file, const char *fpga_file);
+
+#endif
@@ -7,7 +7,9 @@
 #include <linux/dma-mapping.h>
 #include <linux/sched.h>
 #include <linux/mutex.h>
+#include <linux/semaphore.h>
 #include <linux/wait.h>
+#include <linux/crc32.h>
 #include "../../common/bladeRF.h"
 
 struct data_buffer {
@@ -29,6 +31,8 @@ typedef struct {
     unsigned int          data_in_producer_idx;
     atomic_t              data_in_cnt;
     atomic_t              data_in_inflight;
+    atomic_t              data_in_stalled;
+    atomic_t              data_in_overruns;
     struct data_buffer    data_in_bufs[NUM_DATA_URB];
     struct usb_anchor     data_in_anchor;
     wait_queue_head_t     data_in_wait;
@@ -39,6 +43,8 @@ typedef struct {
     unsigned int          data_out_producer_idx;
     atomic_t              data_out_cnt;
     atomic_t              data_out_inflight;
+    atomic_t              data_out_stalled;
+    atomic_t              data_out_underruns;
     struct data_buffer    data_out_bufs[NUM_DATA_URB];
     struct usb_anchor     data_out_anchor;
     wait_queue_head_t     data_out_wait;
@@ -51,6 +57,11 @@ typedef struct {
 
 static struct usb_driver bladerf_driver;
 
+static bool full_flash;
+module_param(full_flash, bool, 0644);
+MODULE_PARM_DESC(full_flash, "Rewrite every firmware flash sector on upgrade, "
+                             "not only those that differ from the image");
+
 // USB PID-VID table
 static struct usb_device_id bladerf_table[] = {
     { USB_DEVICE(USB_NUAND_VENDOR_ID, USB_NUAND_BLADERF_PRODUCT_ID) },
@@ -58,23 +69,30 @@ static struct usb_device_id bladerf_table[] = {
 };
 MODULE_DEVICE_TABLE(usb, bladerf_table);
 
-static int __submit_rx_urb(bladerf_device_t *dev, unsigned int flags) {
+/* Submit IN URBs into whichever buffers are free. Called with data_in_lock
+ * held, so that the ring and stall accounting can't change underneath. */
+static int __submit_rx_urb(bladerf_device_t *dev) {
     struct urb *urb;
-    unsigned long irq_flags;
     int ret;
 
     ret = 0;
-    while (atomic_read(&dev->data_in_inflight) < NUM_CONCURRENT && atomic_read(&dev->data_in_cnt) < NUM_DATA_URB) {
-        spin_lock_irqsave(&dev->data_in_lock, irq_flags);
+    /* Buffers that are completed but not yet consumed, or in flight, are
+     * both owned; only submit while some buffer is actually free */
+    while (atomic_read(&dev->data_in_inflight) < NUM_CONCURRENT &&
+            atomic_read(&dev->data_in_cnt) + atomic_read(&dev->data_in_inflight) < NUM_DATA_URB) {
         urb = dev->data_in_bufs[dev->data_in_producer_idx].urb;
 
-        dev->data_in_producer_idx++;
-        dev->data_in_producer_idx &= (NUM_DATA_URB - 1);
         atomic_inc(&dev->data_in_inflight);
-
         usb_anchor_urb(urb, &dev->data_in_anchor);
-        spin_unlock_irqrestore(&dev->data_in_lock, irq_flags);
         ret = usb_submit_urb(urb, GFP_ATOMIC);
+        if (ret) {
+            usb_unanchor_urb(urb);
+            atomic_dec(&dev->data_in_inflight);
+            break;
+        }
+
+        dev->data_in_producer_idx++;
+        dev->data_in_producer_idx &= (NUM_DATA_URB - 1);
     }
 
     return ret;
@@ -83,17 +101,26 @@ static int __submit_rx_urb(bladerf_device_t *dev, unsigned int flags) {
 static void __bladeRF_write_cb(struct urb *urb);
 static void __bladeRF_read_cb(struct urb *urb) {
     bladerf_device_t *dev;
-    unsigned char *buf;
+    unsigned long flags;
 
-    buf = (unsigned char *)urb->transfer_buffer;
     dev = (bladerf_device_t *)urb->context;
     usb_unanchor_urb(urb);
+
+    spin_lock_irqsave(&dev->data_in_lock, flags);
     atomic_dec(&dev->data_in_inflight);
     dev->bytes += DATA_BUF_SZ;
     atomic_inc(&dev->data_in_cnt);
 
-    if (dev->rx_en)
-        __submit_rx_urb(dev, GFP_ATOMIC);
+    if (dev->rx_en) {
+        __submit_rx_urb(dev);
+
+        /* Ring is full and nothing is in flight: the device is no longer
+         * being drained, so samples will be dropped until userspace reads */
+        if (!atomic_read(&dev->data_in_inflight))
+            atomic_set(&dev->data_in_stalled, 1);
+    }
+    spin_unlock_irqrestore(&dev->data_in_lock, flags);
+
     wake_up_interruptible(&dev->data_in_wait);
 }
 
@@ -191,6 +218,7 @@ static int disable_tx(bladerf_device_t *dev) {
     dev->tx_en = 0;
 
     usb_kill_anchored_urbs(&dev->data_out_anchor);
+    atomic_set(&dev->data_out_stalled, 0);
 
     ret = __bladerf_snd_cmd(dev, BLADE_USB_CMD_RF_TX, &val, sizeof(val));
     if (ret < 0)
@@ -223,13 +251,16 @@ err_out:
 
 static int disable_rx(bladerf_device_t *dev) {
     int ret;
+    unsigned long flags;
     unsigned int val;
     val = 0;
 
     if (dev->intnum != 1)
         return -1;
 
+    spin_lock_irqsave(&dev->data_in_lock, flags);
     dev->rx_en = 0;
+    spin_unlock_irqrestore(&dev->data_in_lock, flags);
 
     usb_kill_anchored_urbs(&dev->data_in_anchor);
 
@@ -248,7 +279,7 @@ err_out:
 
 static int enable_rx(bladerf_device_t *dev) {
     int ret;
-    int i;
+    unsigned long flags;
     unsigned int val;
     val = 1;
 
@@ -259,15 +290,16 @@ static int enable_rx(bladerf_device_t *dev) {
     if (ret < 0)
         goto err_out;
 
-    ret = 0;
+    /* A stall left over from the previous stream is not this one's; clear
+     * it so that this stream's first gap is the first one counted */
+    spin_lock_irqsave(&dev->data_in_lock, flags);
+    atomic_set(&dev->data_in_stalled, 0);
     dev->rx_en = 1;
+    ret = __submit_rx_urb(dev);
+    spin_unlock_irqrestore(&dev->data_in_lock, flags);
 
-    for (i = 0; i < NUM_CONCURRENT; i++) {
-        if ((ret = __submit_rx_urb(dev, 0)) < 0) {
-            dev_err(&dev->interface->dev, "Error submitting initial RX URBs (%d/%d), error=%d\n", i, NUM_CONCURRENT, ret);
-            break;
-        }
-    }
+    if (ret < 0)
+        dev_err(&dev->interface->dev, "Error submitting initial RX URBs, error=%d\n", ret);
 
 err_out:
     return ret;
@@ -278,80 +310,92 @@ static ssize_t bladerf_read(struct file *file, char __user *buf, size_t count, l
     ssize_t ret = 0;
     bladerf_device_t *dev;
     unsigned long flags;
-    int read;
+    unsigned int idx;
+    size_t read;
 
     dev = (bladerf_device_t *)file->private_data;
     if (dev->intnum != 1) {
         return -1;
     }
 
+    /* Data is handed out in whole DATA_BUF_SZ buffers */
+    if (count < DATA_BUF_SZ)
+        return -EINVAL;
+
     if (!dev->rx_en) {
         if (enable_rx(dev)) {
             return -EINVAL;
         }
     }
-    read = 0;
-
-    while (!read) {
-        int reread;
-        reread = atomic_read(&dev->data_in_cnt);
-
-        if (reread) {
-            unsigned int idx;
 
-            spin_lock_irqsave(&dev->data_in_lock, flags);
-            atomic_dec(&dev->data_in_cnt);
-            idx = dev->data_in_consumer_idx++;
-            dev->data_in_consumer_idx &= (NUM_DATA_URB - 1);
+    /* Copy out as many completed buffers as fit, blocking only until the
+     * first one is available */
+    read = 0;
+    while (count - read >= DATA_BUF_SZ) {
+        if (!atomic_read(&dev->data_in_cnt)) {
+            if (read)
+                break;
 
-            spin_unlock_irqrestore(&dev->data_in_lock, flags);
+            ret = wait_event_interruptible(dev->data_in_wait, atomic_read(&dev->data_in_cnt));
+            if (ret < 0)
+                return ret;
+            continue;
+        }
 
-            ret = copy_to_user(buf, dev->data_in_bufs[idx].addr, DATA_BUF_SZ);
+        /* The buffer stays counted in data_in_cnt until it has been copied,
+         * so it can't be resubmitted underneath us */
+        spin_lock_irqsave(&dev->data_in_lock, flags);
+        idx = dev->data_in_consumer_idx;
+        spin_unlock_irqrestore(&dev->data_in_lock, flags);
 
-            if (!ret)
-                ret = DATA_BUF_SZ;
+        if (copy_to_user(buf + read, dev->data_in_bufs[idx].addr, DATA_BUF_SZ))
+            return read ? read : -EFAULT;
 
-            break;
+        spin_lock_irqsave(&dev->data_in_lock, flags);
+        dev->data_in_consumer_idx = (idx + 1) & (NUM_DATA_URB - 1);
+        atomic_dec(&dev->data_in_cnt);
+        spin_unlock_irqrestore(&dev->data_in_lock, flags);
 
-        } else {
-            ret = wait_event_interruptible(dev->data_in_wait, atomic_read(&dev->data_in_cnt));
-            if (ret < 0)
-                break;
+        read += DATA_BUF_SZ;
+    }
 
-        }
+    spin_lock_irqsave(&dev->data_in_lock, flags);
+    if (atomic_xchg(&dev->data_in_stalled, 0)) {
+        atomic_inc(&dev->data_in_overruns);
+        if (dev->rx_en)
+            __submit_rx_urb(dev);
     }
+    spin_unlock_irqrestore(&dev->data_in_lock, flags);
 
-    return ret;
+    return read;
 }
 
 static int __submit_tx_urb(bladerf_device_t *dev) {
     struct urb *urb;
-    struct data_buffer *db;
     unsigned long flags;
 
     int ret = 0;
 
+    spin_lock_irqsave(&dev->data_out_lock, flags);
     while (atomic_read(&dev->data_out_inflight) < NUM_CONCURRENT && atomic_read(&dev->data_out_cnt)) {
-        spin_lock_irqsave(&dev->data_out_lock, flags);
-        db = &dev->data_out_bufs[dev->data_out_consumer_idx];
-        urb = db->urb;
-
-        if (!db->valid)
-            break;
+        urb = dev->data_out_bufs[dev->data_out_consumer_idx].urb;
 
         dev->data_out_consumer_idx++;
         dev->data_out_consumer_idx &= (NUM_DATA_URB - 1);
 
+        /* Count the URB as in flight before it can possibly complete */
         atomic_dec(&dev->data_out_cnt);
+        atomic_inc(&dev->data_out_inflight);
 
         usb_anchor_urb(urb, &dev->data_out_anchor);
-        spin_unlock_irqrestore(&dev->data_out_lock, flags);
         ret = usb_submit_urb(urb, GFP_ATOMIC);
-        if (!ret)
-            atomic_inc(&dev->data_out_inflight);
-        else
+        if (ret) {
+            usb_unanchor_urb(urb);
+            atomic_dec(&dev->data_out_inflight);
             break;
+        }
     }
+    spin_unlock_irqrestore(&dev->data_out_lock, flags);
 
     return ret;
 }
@@ -367,6 +411,12 @@ static void __bladeRF_write_cb(struct urb *urb)
     atomic_dec(&dev->data_out_inflight);
     __submit_tx_urb(dev);
     dev->bytes += DATA_BUF_SZ;
+
+    /* Nothing left to send; this only counts as an underrun if userspace
+     * turns out to have more data for us (see bladerf_write()) */
+    if (dev->tx_en && !atomic_read(&dev->data_out_inflight))
+        atomic_set(&dev->data_out_stalled, 1);
+
     wake_up_interruptible(&dev->data_out_wait);
 }
 
@@ -375,55 +425,80 @@ static ssize_t bladerf_write(struct file *file, const char *user_buf, size_t cou
     bladerf_device_t *dev;
     unsigned long flags;
     char *buf = NULL;
-    struct data_buffer *db = NULL;
     unsigned int idx;
-    int reread;
+    size_t written;
+    int ret;
 
     dev = (bladerf_device_t *)file->private_data;
 
     if (dev->intnum == 0) {
-        int ret, llen;
-        buf = (char *)kmalloc(count, GFP_KERNEL);
-        if (copy_from_user(buf, user_buf, count)) {
-            ret = -EFAULT;
-            goto err_out;
+        int llen;
+        size_t chunk;
+
+        ret = 0;
+        written = 0;
+
+        /* FPGA programming: each chunk goes out with a synchronous bulk
+         * transfer, so write() returns only once the FX3 has taken the data
+         * and userspace needs no pacing of its own */
+        buf = (char *)kmalloc(min_t(size_t, count, BLADE_FPGA_PROG_CHUNK_SZ), GFP_KERNEL);
+        if (!buf)
+            return -ENOMEM;
+
+        while (written < count) {
+            chunk = min_t(size_t, count - written, BLADE_FPGA_PROG_CHUNK_SZ);
+            if (copy_from_user(buf, user_buf + written, chunk)) {
+                ret = -EFAULT;
+                break;
+            }
+            ret = usb_bulk_msg(dev->udev, usb_sndbulkpipe(dev->udev, 2), buf, chunk, &llen, BLADE_USB_TIMEOUT_MS);
+            if (ret < 0)
+                break;
+            written += llen;
+            if (llen != chunk)
+                break;
         }
-        ret = usb_bulk_msg(dev->udev, usb_sndbulkpipe(dev->udev, 2), buf, count, &llen, BLADE_USB_TIMEOUT_MS);
-err_out:
         kfree(buf);
 
-        if (ret < 0)
-            return ret;
-        else
-            return llen;
+        if (written)
+            return written;
+        return ret;
     }
 
-    reread = atomic_read(&dev->data_out_cnt);
-    if (reread >= NUM_DATA_URB) {
-         wait_event_interruptible(dev->data_out_wait, atomic_read(&dev->data_out_cnt) < NUM_DATA_URB);
-	    reread = atomic_read(&dev->data_out_cnt);
-    }
+    /* Samples are queued in whole DATA_BUF_SZ buffers */
+    if (count < DATA_BUF_SZ)
+        return -EINVAL;
 
-    spin_lock_irqsave(&dev->data_out_lock, flags);
+    if (atomic_xchg(&dev->data_out_stalled, 0))
+        atomic_inc(&dev->data_out_underruns);
 
-    idx = dev->data_out_producer_idx++;
-    dev->data_out_producer_idx &= (NUM_DATA_URB - 1);
-    db = &dev->data_out_bufs[idx];
-    atomic_inc(&dev->data_out_cnt);
+    /* Queue as many whole buffers as were passed in, blocking while the
+     * ring is full. A single writer is assumed, so the producer index is
+     * only advanced once the buffer has been filled. */
+    written = 0;
+    while (count - written >= DATA_BUF_SZ) {
+        ret = wait_event_interruptible(dev->data_out_wait,
+                atomic_read(&dev->data_out_cnt) + atomic_read(&dev->data_out_inflight) < NUM_DATA_URB);
+        if (ret < 0)
+            return written ? written : ret;
 
-    spin_unlock_irqrestore(&dev->data_out_lock, flags);
+        idx = dev->data_out_producer_idx;
+        if (copy_from_user(dev->data_out_bufs[idx].addr, user_buf + written, DATA_BUF_SZ))
+            return written ? written : -EFAULT;
 
-    if (copy_from_user(db->addr, user_buf, count)) {
-        return -EFAULT;
-    }
+        spin_lock_irqsave(&dev->data_out_lock, flags);
+        dev->data_out_producer_idx = (idx + 1) & (NUM_DATA_URB - 1);
+        atomic_inc(&dev->data_out_cnt);
+        spin_unlock_irqrestore(&dev->data_out_lock, flags);
 
-    db->valid = 1;
+        __submit_tx_urb(dev);
+        if (!dev->tx_en)
+            enable_tx(dev);
 
-    __submit_tx_urb(dev);
-    if (!dev->tx_en)
-        enable_tx(dev);
+        written += DATA_BUF_SZ;
+    }
 
-    return count;
+    return written;
 }
 
 
@@ -506,6 +581,168 @@ err_out:
     return retval;
 }
 
+#define FLASH_PAGE_SZ           256
+#define FLASH_SECTOR_SZ         0x10000
+#define FLASH_PAGES_PER_SECTOR  (FLASH_SECTOR_SZ / FLASH_PAGE_SZ)
+
+/* EP0 transfer size used to move a flash page */
+static int __bladerf_flash_xfer_sz(bladerf_device_t *dev) {
+    return dev->udev->speed == USB_SPEED_SUPER ? 256 : 64;
+}
+
+static int __bladerf_flash_read_page(bladerf_device_t *dev, int page, unsigned char *buf) {
+    int sz = __bladerf_flash_xfer_sz(dev);
+    int nread, retval;
+
+    for (nread = 0; nread < FLASH_PAGE_SZ; nread += sz) {
+        retval = usb_control_msg(dev->udev, usb_rcvctrlpipe(dev->udev, 0),
+                BLADE_USB_CMD_FLASH_READ, BLADE_USB_TYPE_IN, 0x0000, page,
+                &buf[nread], sz, BLADE_USB_TIMEOUT_MS);
+        if (retval != sz)
+            return retval < 0 ? retval : -EIO;
+    }
+
+    return 0;
+}
+
+static int __bladerf_flash_write_page(bladerf_device_t *dev, int page, unsigned char *buf) {
+    int sz = __bladerf_flash_xfer_sz(dev);
+    int nwrite, retval;
+
+    for (nwrite = 0; nwrite < FLASH_PAGE_SZ; nwrite += sz) {
+        retval = usb_control_msg(dev->udev, usb_sndctrlpipe(dev->udev, 0),
+                BLADE_USB_CMD_FLASH_WRITE, BLADE_USB_TYPE_OUT, 0x0000, page,
+                &buf[nwrite], sz, BLADE_USB_TIMEOUT_MS);
+        if (retval != sz)
+            return retval < 0 ? retval : -EIO;
+    }
+
+    return 0;
+}
+
+static int __bladerf_flash_erase_sector(bladerf_device_t *dev, int sector, unsigned char *buf) {
+    int retval;
+
+    retval = usb_control_msg(dev->udev, usb_rcvctrlpipe(dev->udev, 0),
+            BLADE_USB_CMD_FLASH_ERASE, BLADE_USB_TYPE_IN, 0x0000, sector,
+            buf, 4, BLADE_USB_TIMEOUT_MS * 100);
+    if (retval != 4)
+        return retval < 0 ? retval : -EIO;
+
+    if (le32_to_cpu(*(__le32 *)buf) != 1) {
+        printk("Unable to erase sector %d\n", sector);
+        return -EIO;
+    }
+
+    return 0;
+}
+
+/* Device-side CRC-32 of a page range; fails on firmware without it */
+static int __bladerf_flash_crc(bladerf_device_t *dev, int page, int npages, unsigned char *buf, u32 *crc) {
+    int retval;
+
+    retval = usb_control_msg(dev->udev, usb_rcvctrlpipe(dev->udev, 0),
+            BLADE_USB_CMD_FLASH_CRC, BLADE_USB_TYPE_IN, npages, page,
+            buf, 4, BLADE_USB_TIMEOUT_MS * 10);
+    if (retval != 4)
+        return retval < 0 ? retval : -EIO;
+
+    *crc = le32_to_cpu(*(__le32 *)buf);
+    return 0;
+}
+
+/* Returns 1 if flash already holds data[] at page..page+npages, 0 if it
+ * differs. Uses the device-side CRC when available, otherwise reads the
+ * pages back and compares them. */
+static int __bladerf_flash_matches(bladerf_device_t *dev, int page, int npages,
+                                   const unsigned char *data, int use_crc, unsigned char *buf) {
+    u32 crc, expected;
+    int i, retval;
+
+    if (use_crc) {
+        retval = __bladerf_flash_crc(dev, page, npages, buf, &crc);
+        if (retval)
+            return retval;
+        expected = crc32_le(~0, data, npages * FLASH_PAGE_SZ) ^ ~0;
+        return crc == expected;
+    }
+
+    for (i = 0; i < npages; i++) {
+        retval = __bladerf_flash_read_page(dev, page + i, buf);
+        if (retval)
+            return retval;
+        if (memcmp(buf, &data[i * FLASH_PAGE_SZ], FLASH_PAGE_SZ))
+            return 0;
+    }
+
+    return 1;
+}
+
+/* Differential firmware update: only sectors whose contents differ from the
+ * new image are erased, rewritten and verified, unless full_flash is set.
+ * Sectors are processed from the end of the image so that page 0 is still
+ * written last. */
+static int __bladerf_flash_fw(bladerf_device_t *dev, unsigned char *fw, int len) {
+    unsigned char *buf;
+    int use_crc, sector, nsectors, npages, page, first_page;
+    int retval, changed = 0;
+    u32 crc;
+
+    buf = kmalloc(FLASH_PAGE_SZ, GFP_KERNEL);
+    if (!buf)
+        return -ENOMEM;
+
+    use_crc = !__bladerf_flash_crc(dev, 0, 1, buf, &crc);
+    dev_dbg(&dev->interface->dev, "Flash CRC %ssupported by firmware\n",
+            use_crc ? "" : "not ");
+
+    nsectors = (len + FLASH_SECTOR_SZ - 1) / FLASH_SECTOR_SZ;
+    for (sector = nsectors - 1; sector >= 0; sector--) {
+        first_page = sector * FLASH_PAGES_PER_SECTOR;
+        npages = min_t(int, FLASH_PAGES_PER_SECTOR, len / FLASH_PAGE_SZ - first_page);
+
+        if (!full_flash) {
+            retval = __bladerf_flash_matches(dev, first_page, npages,
+                    &fw[first_page * FLASH_PAGE_SZ], use_crc, buf);
+            if (retval < 0)
+                goto out;
+            if (retval == 1)
+                continue;
+        }
+
+        dev_dbg(&dev->interface->dev, "Rewriting sector %d\n", sector);
+        changed++;
+
+        retval = __bladerf_flash_erase_sector(dev, sector, buf);
+        if (retval)
+            goto out;
+
+        for (page = first_page + npages - 1; page >= first_page; page--) {
+            memcpy(buf, &fw[page * FLASH_PAGE_SZ], FLASH_PAGE_SZ);
+            retval = __bladerf_flash_write_page(dev, page, buf);
+            if (retval)
+                goto out;
+        }
+
+        retval = __bladerf_flash_matches(dev, first_page, npages,
+                &fw[first_page * FLASH_PAGE_SZ], use_crc, buf);
+        if (retval < 0)
+            goto out;
+        if (retval == 0) {
+            printk("ERROR: bladeRF firmware verification failed in sector %d\n", sector);
+            retval = -EIO;
+            goto out;
+        }
+    }
+
+    retval = 0;
+    printk("SUCCESSFULLY VERIFIED (%d of %d sectors rewritten)\n", changed, nsectors);
+
+out:
+    kfree(buf);
+    return retval;
+}
+
 long bladerf_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
     bladerf_device_t *dev;
@@ -513,12 +750,8 @@ long bladerf_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
     struct bladeRF_version ver;
     int ret;
     int retval = -EINVAL;
-    int sz, nread, nwrite;
+    int nread;
     struct uart_cmd spi_reg;
-    int sectors_to_wipe, sector_idx;
-    int pages_to_write, page_idx;
-    int pages_to_read;
-    int check_idx, check_error;
     int count, tries;
     int targetdev;
 
@@ -578,84 +811,38 @@ long bladerf_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
                 return -EFAULT;
             }
 
-            brf_fw.len = ((brf_fw.len + 255) / 256) * 256;
-
-            fw_buf = kzalloc(brf_fw.len, GFP_KERNEL);
-            if (!fw_buf)
-                goto leave_fw;
+            /* Pad the image out to a whole flash page with erased bytes */
+            fw_buf = kmalloc(((brf_fw.len + FLASH_PAGE_SZ - 1) / FLASH_PAGE_SZ) * FLASH_PAGE_SZ, GFP_KERNEL);
+            if (!fw_buf) {
+                retval = -ENOMEM;
+                break;
+            }
 
             if (copy_from_user(fw_buf, brf_fw.ptr, brf_fw.len)) {
                 retval = -EFAULT;
                 goto leave_fw;
             }
 
-            retval = -ENODEV;
+            count = brf_fw.len;
+            brf_fw.len = ((brf_fw.len + FLASH_PAGE_SZ - 1) / FLASH_PAGE_SZ) * FLASH_PAGE_SZ;
+            memset(&fw_buf[count], 0xff, brf_fw.len - count);
 
-            sectors_to_wipe = (brf_fw.len + 0xffff) / 0x10000;
-            printk("Going to wipe %d sectors\n", sectors_to_wipe);
-            for (sector_idx = 0; sector_idx < sectors_to_wipe; sector_idx++) {
-                printk("Erasing sector %d... ", sector_idx);
-                retval = usb_control_msg(dev->udev, usb_rcvctrlpipe(dev->udev, 0),
-                        BLADE_USB_CMD_FLASH_ERASE, BLADE_USB_TYPE_IN, 0x0000, sector_idx,
-                        &ret, 4, BLADE_USB_TIMEOUT_MS * 100);
-                printk("- erased\n");
-
-                if (retval != 4) {
-                    goto leave_fw;
-                }
-                ret = le32_to_cpu(ret);
-                if (ret != 1) {
-                    printk("Unable to erase previous sector, quitting\n");
-                    goto leave_fw;
-                }
-            }
-
-            sz = 0;
-            if (dev->udev->speed == USB_SPEED_HIGH) {
-                sz = 64;
-            } else if (dev->udev->speed == USB_SPEED_SUPER) {
-                sz = 256;
-            }
-
-            pages_to_write = (brf_fw.len + 255) / 0x100;
-            for (page_idx = pages_to_write - 1; page_idx >= 0; page_idx--) {
-                nwrite = 0;
-                do {
-                    retval = usb_control_msg(dev->udev, usb_rcvctrlpipe(dev->udev, 0),
-                            BLADE_USB_CMD_FLASH_WRITE, BLADE_USB_TYPE_OUT, 0x0000, page_idx,
-                            &fw_buf[page_idx * 256 + nwrite], sz, BLADE_USB_TIMEOUT_MS);
-                    nwrite += sz;
-                } while (nwrite != 256);
-            }
-
-            pages_to_read = (brf_fw.len + 255) / 0x100;
-
-            check_error = 0;
-            for (page_idx = 0; page_idx < pages_to_read; page_idx++) {
-                nread = 0;
-                do {
-                    retval = usb_control_msg(dev->udev, usb_rcvctrlpipe(dev->udev, 0),
-                            BLADE_USB_CMD_FLASH_READ, BLADE_USB_TYPE_IN, 0x0000, page_idx,
-                            &buf[nread], sz, BLADE_USB_TIMEOUT_MS);
-                    nread += sz;
-                } while (nread != 256);
-
-                for (check_idx = 0; check_idx < 256; check_idx++) {
-                    if (buf[check_idx] != fw_buf[page_idx * 256 + check_idx]) {
-                        printk("ERROR: bladeRF firmware verification detected a mismatch at byte offset 0x%.8x\n", page_idx * 256 + check_idx);
-                        printk("ERROR: expected byte 0x%.2X, got 0x%.2X\n", fw_buf[page_idx * 256 + check_idx], buf[check_idx]);
-                        check_error = 1;
-                        goto leave_fw;
-                    }
-                }
-            }
-            retval = 0;
-            printk("SUCCESSFULLY VERIFIED\n");
+            retval = __bladerf_flash_fw(dev, fw_buf, brf_fw.len);
 
 leave_fw:
             kfree(fw_buf);
             break;
 
+        case BLADE_RX_OVERRUNS:
+            ret = atomic_read(&dev->data_in_overruns);
+            retval = copy_to_user(data, &ret, sizeof(ret)) ? -EFAULT : 0;
+            break;
+
+        case BLADE_TX_UNDERRUNS:
+            ret = atomic_read(&dev->data_out_underruns);
+            retval = copy_to_user(data, &ret, sizeof(ret)) ? -EFAULT : 0;
+            break;
+
         case BLADE_CHECK_PROG:
             retval = 0;
             printk("ok %d\n", dev->intnum);
@@ -707,6 +894,13 @@ leave_fw:
                 break;
             }
 
+            /* Request and response must be paired on the UART bridge,
+             * so only one register transaction may be in flight */
+            if (down_interruptible(&dev->config_sem)) {
+                retval = -ERESTARTSYS;
+                break;
+            }
+
             nread = count = 16;
             memset(buf, 0, 20);
             buf[0] = 'N';
@@ -732,15 +926,29 @@ leave_fw:
             retval = usb_bulk_msg(dev->udev, usb_sndbulkpipe(dev->udev, 2), buf, count, &nread, BLADE_USB_TIMEOUT_MS);
             memset(buf, 0, 20);
 
-            tries = 3;
-            do {
-                retval = usb_bulk_msg(dev->udev, usb_rcvbulkpipe(dev->udev, 0x82), buf, count, &nread, 1);
-            } while(retval == -ETIMEDOUT && tries--);
+            /* Without the request there is no response to wait for */
+            if (retval >= 0) {
+                tries = 3;
+                do {
+                    retval = usb_bulk_msg(dev->udev, usb_rcvbulkpipe(dev->udev, 0x82), buf, count, &nread, 1);
+                } while(retval == -ETIMEDOUT && tries--);
+            }
 
             spi_reg.addr = buf[2];
             spi_reg.data = buf[3];
+            up(&dev->config_sem);
 
-            retval = copy_to_user((void __user *)arg, &spi_reg, count);
+            /* A failed transaction must not look like a successful one, or
+             * a write that never happened goes unnoticed */
+            if (retval < 0) {
+                dev_err(&dev->interface->dev, "Register transaction 0x%02x failed, error=%d\n", spi_reg.addr, retval);
+                break;
+            }
+
+            if (copy_to_user((void __user *)arg, &spi_reg, sizeof(struct uart_cmd)))
+                retval = -EFAULT;
+            else
+                retval = 0;
             break;
 
     }
@@ -826,6 +1034,7 @@ static int bladerf_probe(struct usb_interface *interface,
 
     spin_lock_init(&dev->data_in_lock);
     spin_lock_init(&dev->data_out_lock);
+    sema_init(&dev->config_sem, 1);
     dev->udev = usb_get_dev(interface_to_usbdev(interface));
     dev->interface = interface;
     dev->intnum = 0;
@@ -833,7 +1042,11 @@ static int bladerf_probe(struct usb_interface *interface,
     dev->debug = 0;
 
     atomic_set(&dev->data_in_inflight, 0);
+    atomic_set(&dev->data_in_stalled, 0);
+    atomic_set(&dev->data_in_overruns, 0);
     atomic_set(&dev->data_out_inflight, 0);
+    atomic_set(&dev->data_out_stalled, 0);
+    atomic_set(&dev->data_out_underruns, 0);
 
     init_usb_anchor(&dev->data_in_anchor);
     init_waitqueue_head(&dev->data_in_wait);
@@ -168,6 +168,10 @@ void bladerf_close(struct bladerf *device);
 /**
  * @defgroup FN_CTRL    Device control and configuration
  *
+ * Control and configuration calls on a device handle are serialized
+ * internally, so they may be issued from any thread. Each call completes as
+ * a whole before another control call on the same handle begins.
+ *
  * @{
  */
 
@@ -231,6 +235,8 @@ int bladerf_set_rational_sample_rate(struct bladerf *dev, bladerf_module module,
 /**
  * Read the device's sample rate in Hz
  *
+ * This is the rate last set with bladerf_set_sample_rate(), or 0 if it has
+ * not been set through this handle.
  *
  * @param[in]   dev         Device handle
  * @param[in]   module      Module to query
@@ -390,9 +396,18 @@ int bladerf_get_frequency(struct bladerf *dev,
 /**
  * @defgroup FN_DATA    Data transmission and reception
  *
+ * These calls do not contend with control calls, so samples may be
+ * streamed on one thread while another retunes the device. A single stream
+ * direction should only be driven by one thread at a time.
+ *
  * @{
  */
 
+/**
+ * Granularity, in samples, of the data interface
+ */
+#define BLADERF_SAMPLES_PER_XFER    1024
+
 /**
  * Send complex, packed 12-bit signed samples
  *
@@ -407,9 +422,18 @@ ssize_t bladerf_send_c12(struct bladerf *dev, int16_t *samples, size_t n);
 /**
  * Send complex, 16-bit signed samples
  *
+ * Samples are interleaved I/Q pairs and are queued in multiples of
+ * BLADERF_SAMPLES_PER_XFER; any remainder is left to the caller. The call
+ * blocks while the driver's transmit ring is full.
+ *
+ * With a resampler attached (see bladerf_resampler_attach()), all n
+ * samples are taken, of any number, and the resampled samples that don't
+ * fill a transfer are held for the next call.
+ *
  * @param       dev         Device handle
  * @param       samples     Array of samples
- * @param       n           Size of samples array, in elements
+ * @param       n           Number of samples (I/Q pairs) in the array. Must
+ *                          be at least BLADERF_SAMPLES_PER_XFER.
  *
  * @return number of samples sent on success,
  *          value from \ref RETCODES list on failure
@@ -419,188 +443,1692 @@ ssize_t bladerf_send_c16(struct bladerf *dev, int16_t *samples, size_t n);
 /**
  * Read 16-bit signed samples
  *
+ * Samples are returned as interleaved I/Q pairs, in multiples of
+ * BLADERF_SAMPLES_PER_XFER. The call blocks until at least that many are
+ * available, then returns as many as are ready and fit in the buffer.
+ *
+ * With a resampler attached (see bladerf_resampler_attach()), whole
+ * transfers are read and resampled into the buffer, so the count returned
+ * follows the resampling ratio. max_samples must then leave room for the
+ * output of at least one transfer.
+ *
  * @param       dev         Device handle
  * @param       samples     Buffer to store samples in
- * @param       max_samples Max number of sample to read
+ * @param       max_samples Max number of sample to read. Must be at least
+ *                          BLADERF_SAMPLES_PER_XFER.
  *
  * @return number of samples read or value from \ref RETCODES list on failure
  */
 ssize_t bladerf_read_c16(struct bladerf *dev,
                             int16_t *samples, size_t max_samples);
 
-/** @} (End of FN_DATA) */
-
+/**
+ * Read 16-bit signed samples into separate I and Q arrays
+ *
+ * As bladerf_read_c16(), with the samples split as they are copied out of
+ * a small staging buffer, while they are still in cache. Reads are made in
+ * chunks, and the call returns once a chunk comes back short of what was
+ * asked for, or max_samples have been read.
+ *
+ * @param       dev         Device handle
+ * @param       i           Buffer to store the I components in
+ * @param       q           Buffer to store the Q components in
+ * @param       max_samples Max number of samples to read. Must be at least
+ *                          BLADERF_SAMPLES_PER_XFER.
+ *
+ * @return number of samples read or value from \ref RETCODES list on failure
+ */
+ssize_t bladerf_read_planar_s16(struct bladerf *dev, int16_t *i, int16_t *q,
+                                size_t max_samples);
 
+/**
+ * Read samples into separate I and Q arrays of floats
+ *
+ * As bladerf_read_planar_s16(), with the components scaled by 1/32768.
+ *
+ * @param       dev         Device handle
+ * @param       i           Buffer to store the I components in
+ * @param       q           Buffer to store the Q components in
+ * @param       max_samples Max number of samples to read. Must be at least
+ *                          BLADERF_SAMPLES_PER_XFER.
+ *
+ * @return number of samples read or value from \ref RETCODES list on failure
+ */
+ssize_t bladerf_read_planar_f32(struct bladerf *dev, float *i, float *q,
+                                size_t max_samples);
 
+/** @} (End of FN_DATA) */
 
 /**
- * @defgroup FN_INFO    Device info
+ * @defgroup FN_CAPTURE    Capture files
+ *
+ * Indexed container for recorded samples. A capture file consists of:
+ *
+ *  - A header of BLADERF_CAPTURE_HDR_SZ bytes, starting with a
+ *    bladerf_capture_header and zero-padded.
+ *  - Data blocks of header.block_samples interleaved 16-bit I/Q pairs. All
+ *    blocks but the last are full, so the samples form one contiguous run.
+ *  - An index of header.num_blocks bladerf_capture_block entries at
+ *    header.index_offset, written when the capture is finalized.
+ *
+ * All fields are in host byte order. A capture that was never finalized
+ * has an index_offset of 0; it can still be opened, but block timestamps
+ * are then derived from the sample rate and overruns are not marked.
  *
  * @{
  */
 
+#define BLADERF_CAPTURE_MAGIC   "bladeRFc"  /**< header.magic, 8 bytes */
+#define BLADERF_CAPTURE_VERSION 2           /**< header.version */
+#define BLADERF_CAPTURE_HDR_SZ  4096        /**< Offset of the first block */
+
+/** The device reported an overrun while this block was being received */
+#define BLADERF_CAPTURE_OVERRUN (1 << 0)
+
+/**
+ * Capture file header
+ */
+struct bladerf_capture_header {
+    char magic[8];              /**< BLADERF_CAPTURE_MAGIC */
+    uint32_t version;           /**< BLADERF_CAPTURE_VERSION */
+    uint32_t block_samples;     /**< Samples per full block; a multiple of
+                                     BLADERF_SAMPLES_PER_XFER */
+    uint64_t start_ns;          /**< Capture start, CLOCK_MONOTONIC ns. Only
+                                     meaningful against block timestamps. */
+    uint64_t num_samples;       /**< Total samples in the file */
+    uint64_t num_blocks;        /**< Number of data blocks */
+    uint64_t index_offset;      /**< File offset of the index, 0 if absent */
+    uint32_t samplerate;        /**< RX sample rate in Hz, never 0 */
+    uint32_t frequency;         /**< RX frequency in Hz */
+    uint32_t bandwidth;         /**< RX LPF bandwidth in Hz */
+    int32_t lna_gain;           /**< bladerf_lna_gain setting */
+    int32_t rxvga1;             /**< RXVGA1 gain */
+    int32_t rxvga2;             /**< RXVGA2 gain in dB */
+    uint64_t start_realtime_ns; /**< Wall-clock time at start_ns, ns since
+                                     the Unix epoch, for display */
+};
+
 /**
- * Query a device's serial number
+ * Capture index entry
+ */
+struct bladerf_capture_block {
+    uint64_t timestamp_ns;      /**< CLOCK_MONOTONIC time the block's first
+                                     transfer was received, in ns. Never
+                                     steps, so it only increases. */
+    uint32_t samples;           /**< Samples in this block */
+    uint32_t flags;             /**< BLADERF_CAPTURE_* flags */
+};
+
+/**
+ * A mapped range of samples. See bladerf_capture_map().
+ */
+struct bladerf_capture_range {
+    const int16_t *samples;     /**< Interleaved I/Q pairs */
+    size_t count;               /**< Number of samples mapped */
+    void *base;                 /**< Internal: start of the mapping */
+    size_t len;                 /**< Internal: length of the mapping */
+};
+
+struct bladerf_capture;
+
+/**
+ * Fill in a capture header from the device's current RX configuration.
+ * The capture is marked as started now, with no samples or index.
  *
- * @param[in]   dev     Device handle
- * @param[out]  serial  Will be updated with serial number. If an error occurs,
- *                      no data will be written to this pointer.
+ * @param       dev             Device handle
+ * @param[out]  hdr             Header to initialize
+ * @param       block_samples   Samples per block. Must be a non-zero
+ *                              multiple of BLADERF_SAMPLES_PER_XFER.
  *
- * @return 0 on success, value from \ref RETCODES list on failure
+ * @return 0 on success, BLADERF_ERR_INVAL if the RX sample rate has not
+ *         been set, value from \ref RETCODES list on other failures
  */
-int bladerf_get_serial(struct bladerf *dev, uint64_t *serial);
+int bladerf_capture_header_init(struct bladerf *dev,
+                                struct bladerf_capture_header *hdr,
+                                unsigned int block_samples);
 
 /**
- * Query firmware version
+ * Open a capture file for reading. Captures without a sample rate are
+ * rejected, as samples could not be located by time in them.
  *
- * @param[in]   dev     Device handle
- * @param[out]  major   Firmware major version
- * @param[out]  minor   Firmware minor version
+ * @param       path    Path to the capture file
+ * @param[out]  cap     Handle to the opened capture
  *
  * @return 0 on success, value from \ref RETCODES list on failure
  */
-int bladerf_get_fw_version(struct bladerf *dev,
-                            unsigned int *major, unsigned int *minor);
+int bladerf_capture_open(const char *path, struct bladerf_capture **cap);
 
 /**
- * Check FPGA configuration status
+ * Close a capture opened with bladerf_capture_open(). Ranges mapped from it
+ * remain valid until unmapped.
+ */
+void bladerf_capture_close(struct bladerf_capture *cap);
+
+/**
+ * Get the header of an open capture
+ */
+const struct bladerf_capture_header *
+bladerf_capture_get_header(struct bladerf_capture *cap);
+
+/**
+ * Get the index entry for a block
  *
- * @param   dev     Device handle
+ * @param       cap     Capture handle
+ * @param       block   Block number, less than header.num_blocks
+ * @param[out]  info    Index entry
  *
- * @return  1 if FPGA is configured,
- *          0 if it is not,
- *          and value from \ref RETCODES list on failure
+ * @return 0 on success, BLADERF_ERR_RANGE if block is out of range
  */
-int bladerf_is_fpga_configured(struct bladerf *dev);
+int bladerf_capture_get_block(struct bladerf_capture *cap, uint64_t block,
+                              struct bladerf_capture_block *info);
 
 /**
- * Query FPGA version
+ * Find the sample received at a given time into the capture
  *
- * @param[in]   dev     Device handle
- * @param[out]  major   FPGA major version
- * @param[out]  minor   FPGA minor version
+ * The block is located directly from the sample rate (or, if that is
+ * unknown, the average rate over the capture) and then corrected against
+ * the index timestamps, so the cost does not depend on the capture length.
+ *
+ * @param       cap     Capture handle
+ * @param       ns      Time since header.start_ns, in nanoseconds
+ * @param[out]  sample  Sample index. Times past the end yield
+ *                      header.num_samples.
  *
  * @return 0 on success, value from \ref RETCODES list on failure
  */
-int bladerf_get_fpga_version(struct bladerf *dev,
-                                unsigned int *major, unsigned int *minor);
+int bladerf_capture_seek(struct bladerf_capture *cap, uint64_t ns,
+                         uint64_t *sample);
 
 /**
- * Obtain device statistics
+ * Map a range of samples into memory, read-only
  *
- * @param[in]   dev     Device handle
- * @param[out]  stats   Current device statistics
+ * @param       cap     Capture handle
+ * @param       start   First sample to map
+ * @param       count   Number of samples. Clamped to the end of the capture.
+ * @param[out]  range   Mapped range; release with bladerf_capture_unmap()
  *
  * @return 0 on success, value from \ref RETCODES list on failure
  */
-int bladerf_stats(struct bladerf *dev, struct bladerf_stats *stats);
+int bladerf_capture_map(struct bladerf_capture *cap, uint64_t start,
+                        size_t count, struct bladerf_capture_range *range);
 
-/** @} (End FN_INFO) */
+/**
+ * Release a range mapped with bladerf_capture_map()
+ */
+void bladerf_capture_unmap(struct bladerf_capture_range *range);
 
+/** @} (End of FN_CAPTURE) */
 
 /**
- * @defgroup FN_PROG    Device programming
+ * @defgroup FN_RING    Pre-trigger ring capture
+ *
+ * A ring keeps the most recent samples received from the device in memory,
+ * so the samples leading up to an event can be saved once the event is
+ * noticed. A producer thread streams into the ring at the device's rate,
+ * bypassing any resampler attached to RX; while a ring is open, no other
+ * thread may read samples from the device.
+ *
+ * Samples are addressed by their position in the stream since the ring was
+ * opened. Positions older than the ring's capacity have been overwritten.
  *
  * @{
  */
 
+struct bladerf_ring;
+
 /**
- * Flash firmware onto the device
+ * Allocate a ring and start filling it from the device
  *
- * @note This will require a power cycle to take effect
+ * The ring comes from the device's buffer pool (see \ref FN_BUFFERS), and
+ * is faulted in up front, so the producer neither page-faults nor takes
+ * locks.
  *
- * @param   dev         Device handle
- * @param   firmware    Full path to firmware file
+ * @param       dev         Device handle
+ * @param       samples     Capacity, in samples, that must remain readable
+ *                          behind the stream position
+ * @param[out]  ring        Handle to the new ring
  *
  * @return 0 on success, value from \ref RETCODES list on failure
  */
-int bladerf_flash_firmware(struct bladerf *dev, const char *firmware);
+int bladerf_ring_open(struct bladerf *dev, uint64_t samples,
+                      struct bladerf_ring **ring);
 
 /**
- * Load device's FPGA
+ * Stop streaming and free a ring
+ */
+void bladerf_ring_close(struct bladerf_ring *ring);
+
+/**
+ * Get the current stream position, i.e., the position of the next sample to
+ * be received. This only performs an atomic load and may be called from a
+ * signal handler.
  *
- * @param   dev         Device handle
- * @param   fpga        Full path to FPGA bitstream
+ * @param       ring        Ring handle
  *
- * @return 0 upon successfully,
- *         1 if FPGA is already loaded,
- *         or a value from \ref RETCODES list on failure
+ * @return Stream position, in samples
  */
-int bladerf_load_fpga(struct bladerf *dev, const char *fpga);
+uint64_t bladerf_ring_trigger(struct bladerf_ring *ring);
 
+/**
+ * Copy samples out of the ring, waiting for any that have not been
+ * received yet
+ *
+ * @param       ring        Ring handle
+ * @param       start       Stream position of the first sample to copy
+ * @param[out]  samples     Buffer of n interleaved I/Q pairs
+ * @param       n           Number of samples to copy
+ * @param       timeout_ms  Max time to wait for samples to arrive
+ *
+ * @return Number of samples copied, which is only less than n if the ring
+ *         stopped, timed out, or was overrun partway through.
+ *         BLADERF_ERR_RANGE if start has already been overwritten,
+ *         BLADERF_ERR_TIMEOUT if no samples arrived in time, or the error
+ *         that stopped the producer.
+ */
+ssize_t bladerf_ring_read(struct bladerf_ring *ring, uint64_t start,
+                          int16_t *samples, size_t n, unsigned int timeout_ms);
 
-/* @} (End of FN_PROG) */
+/** @} (End of FN_RING) */
 
 /**
- * @defgroup FN_MISC Miscellaneous
+ * @defgroup FN_DETECT  Power detector
+ *
+ * Streaming energy detector for interleaved 16-bit I/Q samples. Samples are
+ * grouped into fixed-size blocks. The average or peak power of each block
+ * is compared against a threshold, and an event is emitted when the level
+ * rises above it and when it falls back below it by the hysteresis margin.
+ *
+ * Power is expressed in dB relative to full scale, so a full-scale
+ * sinusoid reads about 0 dBFS. The threshold may be absolute, or relative
+ * to a noise floor tracked as an exponential average of the block power
+ * while no signal is detected. The first block seeds the floor, so a
+ * relative threshold only arms from the second block on, and the floor is
+ * never taken below one LSB (about -90 dBFS).
+ *
+ * A detector can be fed explicitly, or attached to a device so that it
+ * sees every sample the device's reads receive, at the device's rate and
+ * before any resampler.
+ *
  * @{
  */
 
 /**
- * Obtain a textual description of a value from the \ref RETCODES list
+ * Detector configuration
+ */
+struct bladerf_detector_config {
+    unsigned int block_samples; /**< Samples per power measurement */
+    bool use_peak;              /**< Compare peak rather than average power */
+    bool relative;              /**< threshold_db is relative to the noise
+                                     floor rather than to full scale */
+    float threshold_db;         /**< Level at which a detection begins */
+    float hysteresis_db;        /**< Drop below the threshold at which a
+                                     detection ends */
+    float floor_alpha;          /**< Noise floor averaging weight given to
+                                     each new block, 0 to 1 */
+};
+
+/**
+ * Detector event
+ */
+struct bladerf_detector_event {
+    uint64_t sample;            /**< Position of the first sample of the
+                                     block that caused the event, counting
+                                     all samples passed to the detector */
+    bool rising;                /**< true when a detection begins, false
+                                     when it ends */
+    float avg_db;               /**< Block average power, dBFS */
+    float peak_db;              /**< Block peak power, dBFS */
+    float floor_db;             /**< Current noise floor, dBFS */
+};
+
+/**
+ * Event callback. It is called from within bladerf_detector_process().
+ */
+typedef void (*bladerf_detector_cb)(const struct bladerf_detector_event *ev,
+                                    void *user_data);
+
+struct bladerf_detector;
+
+/**
+ * Create a detector
  *
- * @warning Do not attempt to modify the returned string.
+ * @param       config      Detector configuration
+ * @param       cb          Event callback
+ * @param       user_data   Passed to cb
+ * @param[out]  det         Handle to the new detector
  *
- * @param   error   Error value to look up
- * @return  Error string
+ * @return 0 on success, value from \ref RETCODES list on failure
  */
-const char * bladerf_strerror(int error);
+int bladerf_detector_create(const struct bladerf_detector_config *config,
+                            bladerf_detector_cb cb, void *user_data,
+                            struct bladerf_detector **det);
 
-/** @} (End of FN_MISC) */
+/**
+ * Free a detector
+ */
+void bladerf_detector_destroy(struct bladerf_detector *det);
 
 /**
- * @defgroup SI5338_CTL Si5338 register read/write functions
+ * Run samples through a detector. Blocks may span calls.
+ *
+ * @param       det         Detector handle
+ * @param       samples     Interleaved I/Q pairs
+ * @param       n           Number of samples
+ */
+void bladerf_detector_process(struct bladerf_detector *det,
+                              const int16_t *samples, size_t n);
+
+/**
+ * Feed every sample read from a device, through bladerf_read_c16() and the
+ * reads built on it, to a detector. Its callback then runs on the reading
+ * thread. Only one detector is attached at a time.
+ *
+ * Attach and detach only while no read is in progress, and detach before
+ * destroying the detector.
+ *
+ * @param       dev         Device handle
+ * @param       det         Detector, or NULL to detach
+ */
+void bladerf_detector_attach(struct bladerf *dev, struct bladerf_detector *det);
+
+/** @} (End of FN_DETECT) */
+
+/**
+ * @defgroup FN_PSD     Power spectral density
+ *
+ * Averaged power spectrum of interleaved 16-bit I/Q samples, computed with
+ * a Hann-windowed FFT. Frames are spread across a pool of worker threads,
+ * started with the estimator and kept until it is destroyed, and each
+ * batch is folded into either an exponential average or a max-hold.
+ *
+ * Bins are in dB relative to full scale, normalized so a full-scale tone
+ * centered in a bin reads 0 dBFS, and ordered from -fs/2 to fs/2, with DC
+ * at bin fft_size / 2.
  *
  * @{
  */
 
+#define BLADERF_PSD_MIN_SIZE    16      /**< Smallest FFT size */
+#define BLADERF_PSD_MAX_SIZE    65536   /**< Largest FFT size */
+
 /**
- * Read a Si5338 register
+ * PSD averaging mode
+ */
+typedef enum {
+    BLADERF_PSD_AVG_EXP,        /**< Exponential average */
+    BLADERF_PSD_AVG_MAX         /**< Max-hold */
+} bladerf_psd_avg;
+
+/**
+ * PSD configuration
+ */
+struct bladerf_psd_config {
+    unsigned int fft_size;      /**< Power of two, between
+                                     BLADERF_PSD_MIN_SIZE and
+                                     BLADERF_PSD_MAX_SIZE */
+    bladerf_psd_avg avg;        /**< Averaging mode */
+    float alpha;                /**< Weight given to each new frame with
+                                     BLADERF_PSD_AVG_EXP, (0, 1] */
+    unsigned int threads;       /**< Worker threads; 0 or 1 for none */
+};
+
+struct bladerf_psd;
+
+/**
+ * Create a PSD estimator
  *
- * @param   dev         Device handle
- * @param   address     Si5338 register offset
- * @param   val         Pointer to variable the data should be read into
+ * @param       config      Configuration
+ * @param[out]  psd         Handle to the new estimator
  *
  * @return 0 on success, value from \ref RETCODES list on failure
  */
-int si5338_i2c_read(struct bladerf *dev, uint8_t address, uint8_t *val);
+int bladerf_psd_create(const struct bladerf_psd_config *config,
+                       struct bladerf_psd **psd);
 
 /**
- * Write a Si5338 register
+ * Free a PSD estimator
+ */
+void bladerf_psd_destroy(struct bladerf_psd *psd);
+
+/**
+ * Discard the average, e.g., after retuning
+ */
+void bladerf_psd_reset(struct bladerf_psd *psd);
+
+/**
+ * Add samples to the average. Frames may span calls.
  *
- * @param   dev         Device handle
- * @param   address     Si5338 register offset
- * @param   val         Data to write to register
+ * @param       psd         PSD handle
+ * @param       samples     Interleaved I/Q pairs
+ * @param       n           Number of samples
  *
- * @return 0 on success, value from \ref RETCODES list on failure
+ * @return Number of frames completed by this call
  */
-int si5338_i2c_write(struct bladerf *dev, uint8_t address, uint8_t val);
+uint64_t bladerf_psd_process(struct bladerf_psd *psd,
+                             const int16_t *samples, size_t n);
 
 /**
- * Set frequency for TX clocks
+ * Get the current averaged spectrum
  *
- * @param   dev         Device handle
- * @param   freq        Desired TX frequency in Hz
+ * @param       psd         PSD handle
+ * @param[out]  psd_db      fft_size bins, dBFS
+ *
+ * @return 0 on success, BLADERF_ERR_INVAL if no frame has completed
+ */
+int bladerf_psd_get(struct bladerf_psd *psd, float *psd_db);
+
+/** @} (End of FN_PSD) */
+
+/**
+ * @defgroup FN_SWEEP   Frequency sweep
+ *
+ * Survey a range wider than the sample rate by stepping the RX LO across
+ * it. Each step's frames are averaged into a PSD (see \ref FN_PSD) and the
+ * middle of each spectrum, one step wide, is stitched into a single
+ * wideband PSD.
+ *
+ * The retune to step k+1 and the reads that follow it overlap with the
+ * FFTs of step k, which run on another thread. PLL settings for every step
+ * are computed up front, and each step's VCOCAP setting is remembered from
+ * the first pass, so later passes skip the VCOCAP search.
+ *
+ * While a sweep is running, no other thread may read RX samples or tune
+ * RX.
+ *
+ * @{
+ */
+
+/**
+ * Sweep configuration
+ */
+struct bladerf_sweep_config {
+    unsigned int start;         /**< Lowest frequency, Hz */
+    unsigned int stop;          /**< Highest frequency, Hz */
+    unsigned int step;          /**< LO step, Hz. Rounded down to a whole
+                                     number of FFT bins; at most
+                                     samplerate. */
+    unsigned int samplerate;    /**< RX sample rate, Hz. The sweep
+                                     programs this rate. */
+    unsigned int fft_size;      /**< As for bladerf_psd_config */
+    unsigned int frames;        /**< FFT frames averaged per step */
+    unsigned int settle_samples;/**< Samples discarded after each retune,
+                                     once samples received during the
+                                     retune have been flushed */
+    unsigned int threads;       /**< FFT worker threads; 0 or 1 for none */
+};
+
+struct bladerf_sweep;
+
+/**
+ * Prepare a sweep and configure RX for it
+ *
+ * The RX sample rate is set to config->samplerate and the RX bandwidth to
+ * the smallest setting that covers one step.
+ *
+ * @param       dev         Device handle
+ * @param       config      Sweep configuration
+ * @param[out]  sweep       Handle to the new sweep
+ *
+ * @return 0 on success, BLADERF_ERR_RANGE if the LO would leave the
+ *         tunable range, or another value from \ref RETCODES on failure
+ */
+int bladerf_sweep_create(struct bladerf *dev,
+                         const struct bladerf_sweep_config *config,
+                         struct bladerf_sweep **sweep);
+
+/**
+ * Free a sweep. The device is left tuned to the last step.
+ */
+void bladerf_sweep_destroy(struct bladerf_sweep *sweep);
+
+/**
+ * Get the size of a sweep's output
+ *
+ * Bin i is centered on config->start + i * bin_hz. The last step may
+ * extend past config->stop.
+ *
+ * @param       sweep       Sweep handle
+ * @param[out]  bin_hz      Bin spacing, Hz. May be NULL.
+ *
+ * @return Number of bins bladerf_sweep_run() writes
+ */
+size_t bladerf_sweep_get_bins(struct bladerf_sweep *sweep, double *bin_hz);
+
+/**
+ * Sweep the range once
+ *
+ * @param       sweep       Sweep handle
+ * @param[out]  psd_db      bladerf_sweep_get_bins() bins, dBFS
  *
  * @return 0 on success, value from \ref RETCODES list on failure
  */
-int si5338_set_tx_freq(struct bladerf *dev, unsigned freq);
+int bladerf_sweep_run(struct bladerf_sweep *sweep, float *psd_db);
+
+/** @} (End of FN_SWEEP) */
 
 /**
- * Set frequency for RX clocks
+ * @defgroup FN_NCO     Numerically controlled oscillator
  *
- * @param   dev         Device handle
- * @param   freq        Desired RX frequency in Hz
+ * Host counterpart of the FPGA's nco.vhd, for shifting received or
+ * transmitted samples in frequency without retuning the LMS6002D.
+ *
+ * The phase accumulator is 32 bits wide. An increment set in the VHDL's
+ * units, with BLADERF_NCO_PI representing pi, gives the FPGA's phase
+ * sequence in the top 13 bits, and bladerf_nco_generate() then reproduces
+ * the FPGA's output bit for bit. bladerf_nco_set_frequency() uses the full
+ * width, for a resolution of samplerate / 2^32.
+ *
+ * The mixers do not go through the CORDIC. They interpolate a table of
+ * unit-amplitude sines at the full phase, so their error is around 5e-6 of
+ * full scale rather than the CORDIC's 11 bits.
+ *
+ * @{
+ */
+
+#define BLADERF_NCO_PI  4096    /**< Phase increment of half a cycle */
+
+struct bladerf_nco;
+
+/**
+ * Create an NCO, with its phase at 0
+ *
+ * @param       dphase      Phase increment per sample, from -BLADERF_NCO_PI
+ *                          to BLADERF_NCO_PI. A shift of f Hz at a sample
+ *                          rate of fs is round(f / fs * 2 * BLADERF_NCO_PI).
+ * @param[out]  nco         Handle to the new NCO
  *
  * @return 0 on success, value from \ref RETCODES list on failure
  */
-int si5338_set_rx_freq(struct bladerf *dev, unsigned freq);
+int bladerf_nco_create(int16_t dphase, struct bladerf_nco **nco);
 
+/**
+ * Free an NCO
+ */
+void bladerf_nco_destroy(struct bladerf_nco *nco);
 
-/* @} (End of SI5338_CTL) */
+/**
+ * Change the phase increment. The phase carries on from where it was.
+ *
+ * @return 0 on success, BLADERF_ERR_RANGE if dphase is out of range
+ */
+int bladerf_nco_set_dphase(struct bladerf_nco *nco, int16_t dphase);
 
 /**
- * @defgroup LMS_CTL    LMS register read/write functions
+ * Set the phase increment with 32 bits of resolution
+ *
+ * bladerf_nco_generate() uses only the top 13 bits of the phase, so it no
+ * longer matches nco.vhd unless the increment is a multiple of
+ * 1 / (2 * BLADERF_NCO_PI) cycles.
+ *
+ * @param       nco         NCO handle
+ * @param       ratio       Frequency as a fraction of the sample rate, from
+ *                          -0.5 to 0.5
+ *
+ * @return 0 on success, BLADERF_ERR_RANGE if ratio is out of range
+ */
+int bladerf_nco_set_frequency(struct bladerf_nco *nco, double ratio);
+
+/**
+ * Return the phase to 0
+ */
+void bladerf_nco_reset(struct bladerf_nco *nco);
+
+/**
+ * Generate the NCO's output, as nco.vhd would with the same increments
+ *
+ * @param       nco         NCO handle
+ * @param[out]  out         n interleaved I/Q pairs, with an amplitude of
+ *                          about 2032
+ * @param       n           Number of samples
+ */
+void bladerf_nco_generate(struct bladerf_nco *nco, int16_t *out, size_t n);
+
+/**
+ * Multiply 16-bit samples, in place, by the NCO's output
+ *
+ * @param       nco         NCO handle
+ * @param       samples     Interleaved I/Q pairs
+ * @param       n           Number of samples
+ */
+void bladerf_nco_mix_c16(struct bladerf_nco *nco, int16_t *samples, size_t n);
+
+/**
+ * Multiply float samples, in place, by the NCO's output
+ *
+ * @param       nco         NCO handle
+ * @param       samples     Interleaved I/Q pairs
+ * @param       n           Number of samples
+ */
+void bladerf_nco_mix_cf32(struct bladerf_nco *nco, float *samples, size_t n);
+
+/** @} (End of FN_NCO) */
+
+/**
+ * @defgroup FN_FSK     FSK demodulation
+ *
+ * Host counterpart of the FPGA's fsk_demodulator.vhd. Each sample's angle
+ * is found with the same CORDIC as the FPGA, eight samples at a time where
+ * SSE2 is available. The difference from the previous angle is unwrapped
+ * and fed through the leaky integrator out = out - out / 16 + delta. The
+ * output matches the VHDL bit for bit.
+ *
+ * Angles use 4096 = pi, so a tone at f Hz at a sample rate of fs settles at
+ * about 16 * 8192 * f / fs. For the FPGA's modulator, a '0' gives a
+ * positive output and a '1' a negative one.
+ *
+ * Demodulators are independent, so channels may be demodulated in
+ * parallel on separate threads.
+ *
+ * @{
+ */
+
+struct bladerf_fsk_demod;
+
+/**
+ * Create a demodulator, in the VHDL's reset state
+ *
+ * @param[out]  demod       Handle to the new demodulator
+ *
+ * @return 0 on success, value from \ref RETCODES list on failure
+ */
+int bladerf_fsk_demod_create(struct bladerf_fsk_demod **demod);
+
+/**
+ * Free a demodulator
+ */
+void bladerf_fsk_demod_destroy(struct bladerf_fsk_demod *demod);
+
+/**
+ * Return a demodulator to its reset state
+ */
+void bladerf_fsk_demod_reset(struct bladerf_fsk_demod *demod);
+
+/**
+ * Demodulate samples. The stream may be split across calls at any point.
+ *
+ * @param       demod       Demodulator handle
+ * @param       samples     Interleaved I/Q pairs
+ * @param[out]  out         One soft symbol per input sample
+ * @param       n           Number of samples
+ */
+void bladerf_fsk_demod_process(struct bladerf_fsk_demod *demod,
+                               const int16_t *samples, int16_t *out, size_t n);
+
+/** @} (End of FN_FSK) */
+
+/**
+ * @defgroup FN_MOD     Modulation
+ *
+ * Turn bit streams into pulse-shaped baseband samples for transmission.
+ * Bits are mapped onto a Gray-coded constellation and interpolated with a
+ * root raised cosine filter, run as one polyphase branch per output sample
+ * of the symbol period.
+ *
+ * Output is interleaved 16-bit I/Q, so it may be written straight into the
+ * buffer handed to bladerf_send_c16().
+ *
+ * @{
+ */
+
+/**
+ * Constellations. Bits are taken most significant first, and the first bit
+ * of a symbol is the most significant bit of its value.
+ */
+typedef enum {
+    BLADERF_MOD_BPSK,           /**< 1 bit per symbol */
+    BLADERF_MOD_QPSK,           /**< 2 bits per symbol: I, Q */
+    BLADERF_MOD_8PSK,           /**< 3 bits per symbol */
+    BLADERF_MOD_16QAM           /**< 4 bits per symbol: 2 for I, 2 for Q */
+} bladerf_modulation;
+
+/**
+ * Modulator configuration
+ */
+struct bladerf_mod_config {
+    bladerf_modulation modulation;  /**< Constellation */
+    unsigned int sps;               /**< Samples per symbol, 2 to 64 */
+    unsigned int span;              /**< Pulse length in symbols, 1 to 64 */
+    float rolloff;                  /**< Excess bandwidth, (0, 1] */
+    float amplitude;                /**< Output level, (0, 1]. At 1.0, the
+                                         largest possible sample is just
+                                         below full scale. */
+};
+
+struct bladerf_mod;
+
+/**
+ * Create a modulator
+ *
+ * @param       config      Modulator configuration
+ * @param[out]  mod         Handle to the new modulator
+ *
+ * @return 0 on success, value from \ref RETCODES list on failure
+ */
+int bladerf_mod_create(const struct bladerf_mod_config *config,
+                       struct bladerf_mod **mod);
+
+/**
+ * Free a modulator
+ */
+void bladerf_mod_destroy(struct bladerf_mod *mod);
+
+/**
+ * Clear the filter and any partial symbol
+ */
+void bladerf_mod_reset(struct bladerf_mod *mod);
+
+/**
+ * Modulate bits. Bits left over from a partial symbol are kept for the
+ * next call.
+ *
+ * @param       mod         Modulator handle
+ * @param       bits        Packed bits, most significant bit first
+ * @param       nbits       Number of bits
+ * @param[out]  out         Interleaved I/Q pairs. Room is needed for
+ *                          sps samples per symbol completed, i.e., at most
+ *                          sps * (nbits / bits per symbol + 1).
+ *
+ * @return Number of samples written
+ */
+size_t bladerf_mod_process(struct bladerf_mod *mod, const uint8_t *bits,
+                           size_t nbits, int16_t *out);
+
+/**
+ * Run the filter out after the last symbol, and discard any partial
+ * symbol
+ *
+ * @param       mod         Modulator handle
+ * @param[out]  out         Room for span * sps interleaved I/Q pairs
+ *
+ * @return Number of samples written, span * sps
+ */
+size_t bladerf_mod_flush(struct bladerf_mod *mod, int16_t *out);
+
+/** @} (End of FN_MOD) */
+
+/**
+ * @defgroup FN_RESAMPLE    Rational resampling
+ *
+ * Change the sample rate of a stream by interp / decim with a polyphase
+ * FIR, for instance to run the device at a rate the Si5338 can produce
+ * exactly, or one that suits the LMS6002D's filters, and deliver another
+ * rate to the application. Only the filter branches for the samples that
+ * are kept are computed.
+ *
+ * A resampler may run standalone, or be attached to a device's RX or TX
+ * stream so that bladerf_read_c16() and bladerf_send_c16(), and the reads
+ * built on them, work at the resampled rate. Rings, sweeps and the burst
+ * scheduler always run at the device's rate.
+ *
+ * The prototype is a Kaiser-windowed sinc with about 80 dB of stopband.
+ * Its gain is unity, and it is shared by the 16-bit and float paths. A
+ * resampler instance should only be used with one of the two paths.
+ *
+ * @{
+ */
+
+/**
+ * Resampler configuration
+ */
+struct bladerf_resampler_config {
+    unsigned int interp;        /**< Interpolation factor */
+    unsigned int decim;         /**< Decimation factor. The ratio is reduced
+                                     to lowest terms, each of which may be
+                                     at most 1024. */
+    unsigned int taps;          /**< Taps per polyphase branch, 1 to 256;
+                                     more give a sharper transition */
+    float cutoff;               /**< -6 dB point, as a fraction of the lower
+                                     of the input and output Nyquist
+                                     frequencies, (0, 1] */
+};
+
+struct bladerf_resampler;
+
+/**
+ * Create a resampler
+ *
+ * @param       config      Resampler configuration
+ * @param[out]  rs          Handle to the new resampler
+ *
+ * @return 0 on success, value from \ref RETCODES list on failure
+ */
+int bladerf_resampler_create(const struct bladerf_resampler_config *config,
+                             struct bladerf_resampler **rs);
+
+/**
+ * Free a resampler
+ */
+void bladerf_resampler_destroy(struct bladerf_resampler *rs);
+
+/**
+ * Clear the filter history
+ */
+void bladerf_resampler_reset(struct bladerf_resampler *rs);
+
+/**
+ * Get the most samples that n input samples can produce
+ */
+size_t bladerf_resampler_max_output(struct bladerf_resampler *rs, size_t n);
+
+/**
+ * Resample 16-bit samples. The stream may be split across calls at any
+ * point.
+ *
+ * @param       rs          Resampler handle
+ * @param       in          Interleaved I/Q pairs
+ * @param       n           Number of input samples
+ * @param[out]  out         Room for bladerf_resampler_max_output(rs, n)
+ *                          interleaved I/Q pairs. May not overlap in.
+ *
+ * @return Number of samples written
+ */
+size_t bladerf_resample_c16(struct bladerf_resampler *rs,
+                            const int16_t *in, size_t n, int16_t *out);
+
+/**
+ * Resample float samples. As bladerf_resample_c16().
+ */
+size_t bladerf_resample_cf32(struct bladerf_resampler *rs,
+                             const float *in, size_t n, float *out);
+
+/**
+ * Resample everything read from or sent to a device, with the 16-bit path.
+ * The resampler's interp / decim is the application's rate over the
+ * device's on RX, and the device's over the application's on TX.
+ *
+ * Attach and detach only while the stream is idle, and detach before
+ * destroying the resampler; bladerf_close() detaches both. Detaching from
+ * TX sends the samples still held, padded with zeros to a transfer.
+ *
+ * @param       dev         Device handle
+ * @param       module      RX or TX
+ * @param       rs          Resampler, or NULL to detach
+ *
+ * @return 0 on success, value from \ref RETCODES list on failure
+ */
+int bladerf_resampler_attach(struct bladerf *dev, bladerf_module module,
+                             struct bladerf_resampler *rs);
+
+/** @} (End of FN_RESAMPLE) */
+
+
+
+
+/**
+ * @defgroup FN_IQCORR    DC offset and IQ imbalance correction
+ *
+ * Remove the DC offset and IQ gain and phase imbalance that remain after
+ * the LMS6002D's one-shot calibration, in place, as samples are received.
+ * The estimates are running averages of per-block statistics, and the
+ * statistics of a block are gathered in the same pass that corrects it.
+ * A block is corrected with the estimates from the blocks before it.
+ *
+ * Optionally, when the DC offset drifts past a bound, the corrector steps
+ * the LMS6002D's RX front end DC offset DACs one code towards zero, so the
+ * offset stays small relative to the ADC's range. It learns which way the
+ * DACs move the offset from the effect of each step.
+ *
+ * @{
+ */
+
+/**
+ * Corrector configuration
+ */
+struct bladerf_iqcorr_config {
+    unsigned int block;         /**< Samples per estimate update, 64 to
+                                     65536 */
+    float alpha;                /**< Weight of each block in the running
+                                     averages, (0, 1] */
+    bool correct_iq;            /**< Correct gain and phase as well as DC */
+    struct bladerf *dev;        /**< Device whose RX DC offset DACs to adjust,
+                                     or NULL to correct in software only */
+    unsigned int dc_bound;      /**< DC, in ADC counts, past which the DACs
+                                     are stepped. Should exceed the offset of
+                                     one DAC code. */
+};
+
+/**
+ * Current estimates
+ */
+struct bladerf_iqcorr_stats {
+    float dc_i;                 /**< I offset in ADC counts */
+    float dc_q;                 /**< Q offset in ADC counts */
+    float gain;                 /**< Q amplitude relative to I */
+    float phase;                /**< Q phase error in degrees */
+    int lms_dc_i;               /**< I DC offset DAC code, or 0 without a
+                                     device */
+    int lms_dc_q;               /**< Q DC offset DAC code */
+};
+
+struct bladerf_iqcorr;
+
+/**
+ * Create a corrector. With a device, its DC offset DACs are read back as
+ * the starting point.
+ *
+ * @param       config      Corrector configuration
+ * @param[out]  corr        Handle to the new corrector
+ *
+ * @return 0 on success, value from \ref RETCODES list on failure
+ */
+int bladerf_iqcorr_create(const struct bladerf_iqcorr_config *config,
+                          struct bladerf_iqcorr **corr);
+
+/**
+ * Free a corrector. The DACs are left as they are.
+ */
+void bladerf_iqcorr_destroy(struct bladerf_iqcorr *corr);
+
+/**
+ * Discard the estimates, e.g., after retuning
+ */
+void bladerf_iqcorr_reset(struct bladerf_iqcorr *corr);
+
+/**
+ * Correct samples in place. The stream may be split across calls at any
+ * point.
+ *
+ * @param       corr        Corrector handle
+ * @param       samples     Interleaved I/Q pairs
+ * @param       n           Number of samples
+ */
+void bladerf_iqcorr_process(struct bladerf_iqcorr *corr, int16_t *samples,
+                            size_t n);
+
+/**
+ * Get the current estimates
+ */
+void bladerf_iqcorr_get_stats(struct bladerf_iqcorr *corr,
+                              struct bladerf_iqcorr_stats *stats);
+
+/** @} (End of FN_IQCORR) */
+
+
+
+
+
+/**
+ * @defgroup FN_CHANNELIZE    Polyphase filterbank channelizer
+ *
+ * Split a wideband stream into equally spaced channels, each one channel
+ * wide and decimated by the number of channels. A polyphase FIR followed
+ * by one FFT per input block does the work of a mixer, filter and
+ * decimator for every channel at once.
+ *
+ * Blocks are shared out to a pool of worker threads. Each channel's output
+ * goes to its own queue, to be drained with bladerf_channelizer_read().
+ *
+ * Channel c is centered at (c - channels / 2) * fs / channels, so channel
+ * channels / 2 is at DC, as in \ref FN_PSD. Channels are sampled at their
+ * own width, so signals within the transition band at a channel's edges
+ * also alias into its neighbour.
+ *
+ * @{
+ */
+
+#define BLADERF_CHANNELIZER_MIN_CHANNELS    4       /**< Fewest channels */
+#define BLADERF_CHANNELIZER_MAX_CHANNELS    4096    /**< Most channels */
+#define BLADERF_CHANNELIZER_MAX_TAPS        64      /**< Most taps per
+                                                         channel */
+
+/**
+ * Channelizer configuration
+ */
+struct bladerf_channelizer_config {
+    unsigned int channels;      /**< Power of two, between
+                                     BLADERF_CHANNELIZER_MIN_CHANNELS and
+                                     BLADERF_CHANNELIZER_MAX_CHANNELS */
+    unsigned int taps;          /**< Prototype filter taps per channel; more
+                                     give sharper channel edges */
+    unsigned int threads;       /**< Worker threads; 0 or 1 for none */
+    size_t queue_len;           /**< Samples each channel's queue holds */
+};
+
+struct bladerf_channelizer;
+
+/**
+ * Create a channelizer
+ *
+ * @param       config      Channelizer configuration
+ * @param[out]  chan        Handle to the new channelizer
+ *
+ * @return 0 on success, value from \ref RETCODES list on failure
+ */
+int bladerf_channelizer_create(const struct bladerf_channelizer_config *config,
+                               struct bladerf_channelizer **chan);
+
+/**
+ * Stop the workers and free a channelizer
+ */
+void bladerf_channelizer_destroy(struct bladerf_channelizer *chan);
+
+/**
+ * Clear the filter history and empty the queues
+ */
+void bladerf_channelizer_reset(struct bladerf_channelizer *chan);
+
+/**
+ * Channelize samples. Each channels input samples make one sample in each
+ * channel's queue; a partial block is kept for the next call. Processing
+ * stops early when the queues are full.
+ *
+ * @param       chan        Channelizer handle
+ * @param       samples     Interleaved I/Q pairs
+ * @param       n           Number of samples
+ *
+ * @return Number of samples consumed
+ */
+size_t bladerf_channelizer_process(struct bladerf_channelizer *chan,
+                                   const int16_t *samples, size_t n);
+
+/**
+ * Take samples from a channel's queue. Must not be called while
+ * bladerf_channelizer_process() is running.
+ *
+ * @param       chan        Channelizer handle
+ * @param       channel     Channel number
+ * @param[out]  out         Interleaved I/Q pairs
+ * @param       max         Most samples to take
+ *
+ * @return Number of samples taken
+ */
+size_t bladerf_channelizer_read(struct bladerf_channelizer *chan,
+                                unsigned int channel, int16_t *out,
+                                size_t max);
+
+/** @} (End of FN_CHANNELIZE) */
+
+
+
+
+
+/**
+ * @defgroup FN_AGC    Automatic gain control
+ *
+ * Closed-loop RX gain control. The power of each block of received samples
+ * is compared with a target, and the LNA, RXVGA1 and RXVGA2 are moved
+ * together along a table of gain settings to close the gap.
+ *
+ * bladerf_agc_process() only measures and decides, and never blocks. The
+ * gain writes are made by a control thread owned by the AGC. Each change
+ * is tagged with the stream position at which it took effect, so that
+ * consumers can account for it. Blocks received before a change takes
+ * effect are not measured, and changes are at least min_interval samples
+ * apart. A change whose writes fail is rolled back and not reported, and
+ * the AGC stays on its previous step for min_interval samples.
+ *
+ * @{
+ */
+
+/**
+ * One gain setting
+ */
+struct bladerf_agc_step {
+    bladerf_lna_gain lna;       /**< LNA gain */
+    int rxvga1;                 /**< As for bladerf_set_rxvga1() */
+    int rxvga2;                 /**< As for bladerf_set_rxvga2() */
+    float gain_db;              /**< Total gain of the three, dB. Only
+                                     differences between steps matter. */
+};
+
+/**
+ * AGC configuration
+ */
+struct bladerf_agc_config {
+    const struct bladerf_agc_step *table;   /**< Steps in ascending order of
+                                                 gain, or NULL for a built-in
+                                                 table that keeps the front
+                                                 end gain up as long as
+                                                 possible */
+    unsigned int table_len;     /**< Number of steps in table */
+    unsigned int block_samples; /**< Samples per power measurement */
+    float target_db;            /**< Block average power to aim for, in
+                                     dBFS as for \ref FN_DETECT */
+    float deadband_db;          /**< Error tolerated without a change */
+    unsigned int clip_level;    /**< I or Q magnitude taken as clipping, or
+                                     0 to not check. A block that clips
+                                     drops the gain by at least
+                                     clip_backoff_db. */
+    float clip_backoff_db;      /**< See clip_level */
+    uint64_t min_interval;      /**< Fewest samples between one change
+                                     taking effect and the next */
+    uint64_t latency_samples;   /**< Samples already in flight when a gain
+                                     write completes, added to its tag */
+};
+
+/**
+ * Gain change
+ */
+struct bladerf_agc_change {
+    uint64_t sample;            /**< First sample at the new gain, counting
+                                     all samples passed to
+                                     bladerf_agc_process() */
+    unsigned int step;          /**< Index into the table */
+    float gain_db;              /**< The step's gain */
+};
+
+struct bladerf_agc;
+
+/**
+ * Create an AGC and apply its first step. This call blocks on the gain
+ * writes; later ones are made by the control thread.
+ *
+ * @param       dev         Device handle
+ * @param       config      AGC configuration
+ * @param       step        Table index to start from
+ * @param[out]  agc         Handle to the new AGC
+ *
+ * @return 0 on success, value from \ref RETCODES list on failure
+ */
+int bladerf_agc_create(struct bladerf *dev,
+                       const struct bladerf_agc_config *config,
+                       unsigned int step, struct bladerf_agc **agc);
+
+/**
+ * Stop the control thread and free an AGC. The gains are left as they
+ * are.
+ */
+void bladerf_agc_destroy(struct bladerf_agc *agc);
+
+/**
+ * Measure received samples, and request a gain change if they call for
+ * one. Blocks may span calls. Does not block.
+ *
+ * @param       agc         AGC handle
+ * @param       samples     Interleaved I/Q pairs, in stream order
+ * @param       n           Number of samples
+ */
+void bladerf_agc_process(struct bladerf_agc *agc, const int16_t *samples,
+                         size_t n);
+
+/**
+ * Take the oldest gain change not yet taken, starting with the first step.
+ * Changes are kept until taken, up to a limit, after which new ones are
+ * dropped. Does not block.
+ *
+ * @param       agc         AGC handle
+ * @param[out]  change      The change
+ *
+ * @return true if there was a change to take
+ */
+bool bladerf_agc_get_change(struct bladerf_agc *agc,
+                            struct bladerf_agc_change *change);
+
+/** @} (End of FN_AGC) */
+
+
+
+
+/**
+ * @defgroup FN_DCCAL    DC calibration cache
+ *
+ * The LMS6002D's DC offset calibration takes many register transactions
+ * per run, and its results depend on the RX band, the LPF bandwidths and
+ * the RX gains. With the cache enabled, results are kept per combination
+ * of these, and are loaded back in place of a new calibration whenever the
+ * RX frequency, a bandwidth or an RX gain is changed, writing only the
+ * values that differ from those already loaded. A calibration is only run
+ * for a combination not yet seen, or when asked for. With the AGC, that
+ * happens on its control thread the first time it reaches each step.
+ *
+ * The cache is kept in a file per device serial, \<dir\>/dccal-\<serial\>.bin,
+ * which is updated as entries are added. Devices do not report a serial
+ * yet (bladerf_get_serial() gives 0), and until they do, the cache is kept
+ * in memory only and lasts until it is disabled or the device is closed.
+ *
+ * @{
+ */
+
+/**
+ * Enable the cache, load it from its file if the device has a serial, and
+ * apply it to the current settings
+ *
+ * @param       dev         Device handle
+ * @param       dir         Directory for the cache file, or NULL for
+ *                          $XDG_CACHE_HOME/bladeRF, falling back to
+ *                          ~/.cache/bladeRF. Unused without a serial.
+ *
+ * @return 0 on success, value from \ref RETCODES list on failure
+ */
+int bladerf_dc_cal_cache_enable(struct bladerf *dev, const char *dir);
+
+/**
+ * Disable the cache. The calibration values loaded are left as they are.
+ */
+void bladerf_dc_cal_cache_disable(struct bladerf *dev);
+
+/**
+ * Load the cached calibration for the current settings, or run and cache
+ * one if there is none
+ *
+ * @param       dev         Device handle
+ *
+ * @return 0 on success, BLADERF_ERR_INVAL if the cache is not enabled,
+ *         or another value from \ref RETCODES list on failure
+ */
+int bladerf_dc_cal_apply(struct bladerf *dev);
+
+/**
+ * Run the DC offset calibration, replacing any cached results for the
+ * current settings
+ *
+ * @param       dev         Device handle
+ *
+ * @return 0 on success, value from \ref RETCODES list on failure
+ */
+int bladerf_dc_cal_run(struct bladerf *dev);
+
+/** @} (End of FN_DCCAL) */
+
+
+
+
+/**
+ * @defgroup FN_BURST    Timed TX bursts
+ *
+ * Bursts transmitted at given positions in the RX stream, as for TDMA.
+ *
+ * While started, a scheduler thread owns the TX stream and keeps the
+ * driver's ring full, sending zeros between bursts and splicing each burst
+ * in at its sample position. Burst timing thus does not depend on when
+ * the caller's thread runs, only on the burst being queued before the
+ * scheduler reaches it. As this is as many samples ahead as the ring
+ * holds, bursts need to be queued at least that far in advance; see
+ * bladerf_burst_earliest().
+ *
+ * RX and TX share the sample clock, so once started, the alignment
+ * between the two streams is fixed. Where it lies depends on what the
+ * driver and device hold on both sides at the moment of starting, which is
+ * seen from the host only as the count of samples read so far, and which
+ * varies from one start to the next. The offset given to
+ * bladerf_burst_start() is therefore only an estimate; measure the actual
+ * alignment after every start with bladerf_burst_align(). A TX underrun
+ * or RX overrun breaks the alignment, after which queued bursts are
+ * dropped and new ones refused.
+ *
+ * bladerf_send_c16() must not be used while the scheduler is running.
+ *
+ * @{
+ */
+
+/**
+ * Start the TX scheduler
+ *
+ * @param       dev         Device handle
+ * @param       offset      Estimate of the RX sample, relative to the
+ *                          number read so far, alongside which the first
+ *                          TX sample goes out
+ *
+ * @return 0 on success, value from \ref RETCODES list on failure
+ */
+int bladerf_burst_start(struct bladerf *dev, int64_t offset);
+
+/**
+ * Stop the TX scheduler, dropping any bursts not yet sent. Blocks until
+ * the transfer being sent, if any, is queued with the driver.
+ */
+void bladerf_burst_stop(struct bladerf *dev);
+
+/**
+ * Queue a burst. The samples are copied, and zeros are sent until the
+ * burst's start.
+ *
+ * @param       dev             Device handle
+ * @param       samples         Interleaved I/Q pairs
+ * @param       n               Number of samples
+ * @param       start_sample    RX sample, counting all samples read, that
+ *                              the first sample goes out alongside
+ *
+ * @return 0 on success, BLADERF_ERR_RANGE if start_sample is too soon,
+ *         BLADERF_ERR_INVAL if the burst overlaps a queued one, or the
+ *         error that broke the TX stream's alignment
+ */
+int bladerf_send_burst(struct bladerf *dev, const int16_t *samples, size_t n,
+                       uint64_t start_sample);
+
+/**
+ * Measure the alignment between the streams and correct the scheduler's
+ *
+ * A marker burst is sent at the earliest position available, and RX
+ * samples are read until it is found by correlation. The difference from
+ * where it was expected is applied to every later burst.
+ *
+ * TX must reach RX, for instance through bladerf_set_loopback(). Call this
+ * right after bladerf_burst_start(), with no bursts queued and no other
+ * thread reading RX samples.
+ *
+ * @param       dev             Device handle
+ * @param       max_samples     RX samples to search, counting from the
+ *                              next one read. Rounded down to a multiple
+ *                              of BLADERF_SAMPLES_PER_XFER.
+ * @param[out]  correction      If not NULL, the samples by which the
+ *                              estimate was out
+ *
+ * @return 0 on success, BLADERF_ERR_INVAL if bursts are queued,
+ *         BLADERF_ERR_TIMEOUT if the marker was not found, or another
+ *         value from \ref RETCODES list on failure
+ */
+int bladerf_burst_align(struct bladerf *dev, size_t max_samples,
+                        int64_t *correction);
+
+/**
+ * Get the earliest start_sample bladerf_send_burst() currently accepts
+ *
+ * @param       dev             Device handle
+ * @param[out]  start_sample    The sample
+ *
+ * @return 0 on success, value from \ref RETCODES list on failure
+ */
+int bladerf_burst_earliest(struct bladerf *dev, uint64_t *start_sample);
+
+/** @} (End of FN_BURST) */
+
+
+
+
+/**
+ * @defgroup FN_BUFFERS    Sample buffers
+ *
+ * Memory for sample buffers, as used by the library's own streaming, for
+ * applications to stream from and to.
+ *
+ * Buffers are backed by 2 MiB hugepages where any are reserved, and by
+ * transparent hugepages otherwise, to keep TLB misses down. On NUMA hosts,
+ * they are placed on the node of the device's USB host controller. They
+ * are faulted in when allocated. Freed buffers are kept by the device for
+ * reuse by the next allocation of the same size, until it is closed.
+ *
+ * Closing a device with buffers still allocated does not pull them from
+ * under their users: the memory stays valid, and goes back to the system
+ * as each set is freed.
+ *
+ * @{
+ */
+
+/**
+ * Alignment of each buffer, in bytes, enough for any SIMD loads
+ */
+#define BLADERF_BUFFER_ALIGN    64
+
+/**
+ * Allocate a set of sample buffers. They are contiguous, each starting on
+ * a BLADERF_BUFFER_ALIGN boundary. Their contents are undefined.
+ *
+ * @param       dev                 Device handle
+ * @param       num_buffers         Number of buffers
+ * @param       samples_per_buffer  Samples (I/Q pairs) in each
+ * @param[out]  buffers             Array of num_buffers buffers
+ *
+ * @return 0 on success, value from \ref RETCODES list on failure
+ */
+int bladerf_alloc_buffers(struct bladerf *dev, size_t num_buffers,
+                          size_t samples_per_buffer, int16_t ***buffers);
+
+/**
+ * Free a set of buffers from bladerf_alloc_buffers(). This may be done
+ * after the device is closed, in which case dev is not used.
+ *
+ * @param       dev         Device handle
+ * @param       buffers     Array from bladerf_alloc_buffers(), or NULL
+ */
+void bladerf_free_buffers(struct bladerf *dev, int16_t **buffers);
+
+/** @} (End of FN_BUFFERS) */
+
+
+
+
+/**
+ * @defgroup FN_INFO    Device info
+ *
+ * @{
+ */
+
+/**
+ * Query a device's serial number
+ *
+ * @param[in]   dev     Device handle
+ * @param[out]  serial  Will be updated with serial number. If an error occurs,
+ *                      no data will be written to this pointer.
+ *
+ * @return 0 on success, value from \ref RETCODES list on failure
+ */
+int bladerf_get_serial(struct bladerf *dev, uint64_t *serial);
+
+/**
+ * Query firmware version
+ *
+ * @param[in]   dev     Device handle
+ * @param[out]  major   Firmware major version
+ * @param[out]  minor   Firmware minor version
+ *
+ * @return 0 on success, value from \ref RETCODES list on failure
+ */
+int bladerf_get_fw_version(struct bladerf *dev,
+                            unsigned int *major, unsigned int *minor);
+
+/**
+ * Check FPGA configuration status
+ *
+ * @param   dev     Device handle
+ *
+ * @return  1 if FPGA is configured,
+ *          0 if it is not,
+ *          and value from \ref RETCODES list on failure
+ */
+int bladerf_is_fpga_configured(struct bladerf *dev);
+
+/**
+ * Query FPGA version
+ *
+ * Reports 0.0 if the FPGA is not configured or the loaded image predates
+ * version reporting.
+ *
+ * @param[in]   dev     Device handle
+ * @param[out]  major   FPGA major version
+ * @param[out]  minor   FPGA minor version
+ *
+ * @return 0 on success, value from \ref RETCODES list on failure
+ */
+int bladerf_get_fpga_version(struct bladerf *dev,
+                                unsigned int *major, unsigned int *minor);
+
+/**
+ * Obtain device statistics
+ *
+ * @param[in]   dev     Device handle
+ * @param[out]  stats   Current device statistics
+ *
+ * @return 0 on success, value from \ref RETCODES list on failure
+ */
+int bladerf_stats(struct bladerf *dev, struct bladerf_stats *stats);
+
+/** @} (End FN_INFO) */
+
+
+/**
+ * @defgroup FN_PROG    Device programming
+ *
+ * @{
+ */
+
+/**
+ * Flash firmware onto the device
+ *
+ * Only the 64 KiB flash sectors whose contents differ from the new image are
+ * erased and rewritten, so reflashing a mostly unchanged image is fast.
+ * Loading the driver with full_flash=1 rewrites every sector instead.
+ *
+ * @note This will require a power cycle to take effect
+ *
+ * @param   dev         Device handle
+ * @param   firmware    Full path to firmware file
+ *
+ * @return 0 on success, value from \ref RETCODES list on failure
+ */
+int bladerf_flash_firmware(struct bladerf *dev, const char *firmware);
+
+/**
+ * Flash firmware image held in memory onto the device
+ *
+ * This behaves like bladerf_flash_firmware(), but lets a single copy of the
+ * image be shared when provisioning several devices. The buffer is only
+ * read, so it may be used by multiple threads concurrently.
+ *
+ * @param   dev         Device handle
+ * @param   image       Firmware image
+ * @param   len         Length of image, in bytes
+ *
+ * @return 0 on success, value from \ref RETCODES list on failure
+ */
+int bladerf_flash_firmware_mem(struct bladerf *dev, const void *image,
+                               size_t len);
+
+/**
+ * Load device's FPGA
+ *
+ * The bitstream may be a raw .rbf or gzip-compressed; compression is
+ * detected from the file's magic bytes and the image is inflated as it is
+ * written to the device. A gzip image is first inflated in full, checking
+ * its CRCs, so that a corrupt one is rejected before configuration starts.
+ *
+ * If the FPGA is already configured, the file's hash is compared against the
+ * image id recorded on the device by a previous load. The load is skipped
+ * only when they match; any other configured image is replaced.
+ *
+ * @param   dev         Device handle
+ * @param   fpga        Full path to FPGA bitstream
+ *
+ * @return 0 upon successfully,
+ *         1 if the FPGA is already running this image,
+ *         or a value from \ref RETCODES list on failure
+ */
+int bladerf_load_fpga(struct bladerf *dev, const char *fpga);
+
+/**
+ * Progress callback for long-running programming operations
+ *
+ * @param   bytes_done  Number of bytes transferred so far
+ * @param   bytes_total Total number of bytes to transfer
+ * @param   user_data   Pointer provided by the caller
+ */
+typedef void (*bladerf_progress_cb)(size_t bytes_done, size_t bytes_total,
+                                    void *user_data);
+
+/**
+ * Load device's FPGA, reporting progress as the bitstream is written
+ *
+ * The callback is invoked once before the first chunk and again after each
+ * chunk has been accepted by the device.
+ *
+ * @param   dev         Device handle
+ * @param   fpga        Full path to FPGA bitstream
+ * @param   cb          Progress callback. May be NULL.
+ * @param   user_data   Passed through to cb
+ *
+ * @return 0 upon successfully,
+ *         1 if the FPGA is already running this image,
+ *         or a value from \ref RETCODES list on failure
+ */
+int bladerf_load_fpga_progress(struct bladerf *dev, const char *fpga,
+                               bladerf_progress_cb cb, void *user_data);
+
+/**
+ * Load device's FPGA from a bitstream held in memory
+ *
+ * This behaves like bladerf_load_fpga_progress(). The buffer may hold a raw
+ * or gzip-compressed image and is only read, so a single copy may be shared
+ * by threads loading several devices.
+ *
+ * @param   dev         Device handle
+ * @param   image       FPGA bitstream
+ * @param   len         Length of image, in bytes
+ * @param   cb          Progress callback. May be NULL.
+ * @param   user_data   Passed through to cb
+ *
+ * @return 0 upon successfully,
+ *         1 if the FPGA is already running this image,
+ *         or a value from \ref RETCODES list on failure
+ */
+int bladerf_load_fpga_mem(struct bladerf *dev, const void *image, size_t len,
+                          bladerf_progress_cb cb, void *user_data);
+
+
+/* @} (End of FN_PROG) */
+
+/**
+ * @defgroup FN_MISC Miscellaneous
+ * @{
+ */
+
+/**
+ * Obtain a textual description of a value from the \ref RETCODES list
+ *
+ * @warning Do not attempt to modify the returned string.
+ *
+ * @param   error   Error value to look up
+ * @return  Error string
+ */
+const char * bladerf_strerror(int error);
+
+/** @} (End of FN_MISC) */
+
+/**
+ * @defgroup SI5338_CTL Si5338 register read/write functions
+ *
+ * @{
+ */
+
+/**
+ * Read a Si5338 register
+ *
+ * @param   dev         Device handle
+ * @param   address     Si5338 register offset
+ * @param   val         Pointer to variable the data should be read into
+ *
+ * @return 0 on success, value from \ref RETCODES list on failure
+ */
+int si5338_i2c_read(struct bladerf *dev, uint8_t address, uint8_t *val);
+
+/**
+ * Write a Si5338 register
+ *
+ * @param   dev         Device handle
+ * @param   address     Si5338 register offset
+ * @param   val         Data to write to register
+ *
+ * @return 0 on success, value from \ref RETCODES list on failure
+ */
+int si5338_i2c_write(struct bladerf *dev, uint8_t address, uint8_t val);
+
+/**
+ * Set frequency for TX clocks
+ *
+ * @param   dev         Device handle
+ * @param   freq        Desired TX frequency in Hz
+ *
+ * @return 0 on success, value from \ref RETCODES list on failure
+ */
+int si5338_set_tx_freq(struct bladerf *dev, unsigned freq);
+
+/**
+ * Set frequency for RX clocks
+ *
+ * @param   dev         Device handle
+ * @param   freq        Desired RX frequency in Hz
+ *
+ * @return 0 on success, value from \ref RETCODES list on failure
+ */
+int si5338_set_rx_freq(struct bladerf *dev, unsigned freq);
+
+
+/* @} (End of SI5338_CTL) */
+
+/**
+ * @defgroup LMS_CTL    LMS register read/write functions
+ *
+ * Each register access is atomic, but a read-modify-write built from these
+ * calls is not. Use the FN_CTRL functions when that matters.
  *
  * @{
  */
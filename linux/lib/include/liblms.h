@@ -28,6 +28,23 @@ struct lms_freq {
     uint32_t    nfrac ;         /**< Fractional portion of f_LO given nint and f_REF */
     uint8_t     freqsel ;       /**< Choice of VCO and dision ratio */
     uint32_t    reference ;     /**< Reference frequency going to the LMS6002D */
+    uint8_t     vcocap ;        /**< VCO capacitor setting, or LMS_VCOCAP_UNKNOWN */
+    uint32_t    freq ;          /**< Frequency in Hz these settings tune to */
+} ;
+
+#define LMS_VCOCAP_UNKNOWN  0xff        /**< VCOCAP has yet to be searched for */
+
+#define LMS_FREQ_MIN        232500000u  /**< Lowest tunable LO frequency, Hz */
+#define LMS_FREQ_MAX        3720000000u /**< Highest tunable LO frequency, Hz */
+
+/**
+ * DC offset calibration results (6-bit DC_REGVAL values)
+ */
+struct lms_dc_cals {
+    uint8_t     rx_lpf[2] ;     /**< RX LPF I and Q */
+    uint8_t     rxvga2[5] ;     /**< RXVGA2 DC reference, VGA2A I and Q,
+                                     VGA2B I and Q */
+    uint8_t     tx_lpf[2] ;     /**< TX LPF I and Q */
 } ;
 
 /**
@@ -515,6 +532,29 @@ void lms_get_frequency( struct bladerf *dev, lms_module_t mod, struct lms_freq *
  */
 void lms_set_frequency( struct bladerf *dev, lms_module_t mod, uint32_t freq );
 
+/**
+ * Calculate the PLL settings for a frequency without accessing the device.
+ * The VCOCAP setting is left as LMS_VCOCAP_UNKNOWN.
+ *
+ * @param[in]   freq    Frequency in Hz
+ * @param[out]  f       LMS frequency structure
+ */
+void lms_calculate_tuning_params( uint32_t freq, struct lms_freq *f );
+
+/**
+ * Tune a module to settings from lms_calculate_tuning_params()
+ *
+ * If f->vcocap holds the result of an earlier tune, it is tried first and
+ * the VCOCAP search is skipped when VTUNE is in range. On return, f->vcocap
+ * holds the value in use, so keeping f around makes the next tune to the
+ * same frequency cheaper.
+ *
+ * @param[in]       dev     Device handle
+ * @param[in]       mod     Module to change
+ * @param[in,out]   f       LMS frequency structure
+ */
+void lms_set_precalculated_frequency( struct bladerf *dev, lms_module_t mod, struct lms_freq *f );
+
 /**
  * Read back every register from the LMS6002D device.
  *
@@ -532,6 +572,45 @@ void lms_dump_registers( struct bladerf *dev );
  */
 void lms_calibrate_dc( struct bladerf *dev );
 
+/**
+ * Read back the results of the DC offset calibration.
+ *
+ * @param[in]   dev     Device handle
+ * @param[out]  cals    Calibration values
+ */
+void lms_get_dc_cals( struct bladerf *dev, struct lms_dc_cals *cals );
+
+/**
+ * Load DC offset calibration values, e.g., from an earlier
+ * lms_get_dc_cals(), in place of running the calibration.
+ *
+ * @param[in]   dev     Device handle
+ * @param[in]   cals    Calibration values
+ * @param[in]   prev    Values known to be loaded already, so that only the
+ *                      ones that differ are written, or NULL to write all
+ */
+void lms_set_dc_cals( struct bladerf *dev, const struct lms_dc_cals *cals,
+                      const struct lms_dc_cals *prev );
+
+/**
+ * Get the RX front end DC offset cancellation DAC settings.
+ *
+ * @param[in]   dev     Device handle
+ * @param[out]  i       I channel offset code (range: -63 to 63)
+ * @param[out]  q       Q channel offset code (range: -63 to 63)
+ */
+void lms_rxfe_get_dc_offset( struct bladerf *dev, int8_t *i, int8_t *q );
+
+/**
+ * Set the RX front end DC offset cancellation DACs. Codes outside the
+ * range are clamped.
+ *
+ * @param[in]   dev     Device handle
+ * @param[in]   i       I channel offset code (range: -63 to 63)
+ * @param[in]   q       Q channel offset code (range: -63 to 63)
+ */
+void lms_rxfe_set_dc_offset( struct bladerf *dev, int8_t i, int8_t q );
+
 /**
  * Initialize and calibrate the low pass filters
  *
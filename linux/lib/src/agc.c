@@ -0,0 +1,392 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "libbladeRF.h"
+#include "power.h"
+#include "debug.h"
+
+#define AGC_MAX_CHANGES     64      /* Untaken changes kept */
+
+/* Nominal gains for the built-in table. The LMS6002D only specifies the
+ * LNA's mid setting relative to max. */
+#define AGC_LNA_MAX_DB      30.0
+#define AGC_LNA_MID_DB      (AGC_LNA_MAX_DB - 6.0)
+#define AGC_LNA_BYPASS_DB   0.0
+#define AGC_RXVGA1_MAX_DB   30.0
+#define AGC_RXVGA1_MIN_DB   6.0
+#define AGC_RXVGA2_STEPS    10      /* Of 3 dB */
+
+/*
+ * The streaming thread owns the measurement and 'requested'; the control
+ * thread owns 'applied', 'hold_until' and the writes. A request is
+ * outstanding while the two differ, and the streaming thread only reads
+ * hold_until once applied has caught up. If the writes fail, the control
+ * thread hands the request back by setting 'requested' to 'applied'.
+ */
+struct bladerf_agc {
+    struct bladerf *dev;
+    struct bladerf_agc_config cfg;
+    struct bladerf_agc_step *table;
+
+    /* Current block */
+    uint64_t sum;
+    uint32_t peak;
+    size_t count;
+    uint64_t block_start;
+
+    uint64_t position;              /* Samples processed, updated atomically */
+    volatile unsigned int requested;
+    volatile unsigned int applied;
+    volatile uint64_t hold_until;   /* No measurements before this sample */
+
+    /* Single producer, single consumer */
+    struct bladerf_agc_change changes[AGC_MAX_CHANGES];
+    volatile unsigned int change_head, change_tail;
+
+    sem_t wake;
+    bool have_sem;
+    pthread_t thread;
+    bool started;
+    volatile bool quit;
+};
+
+/* RXVGA1 (RFB_TIA_RXFE) code to nominal gain and back */
+static double rxvga1_db(int code)
+{
+    return 5.0 + 20.0 * log10(127.0 / (127 - code));
+}
+
+static int rxvga1_code(double db)
+{
+    return (int)lrint(127.0 - 127.0 / pow(10.0, (db - 5.0) / 20.0));
+}
+
+/* Cut RXVGA2 first, then RXVGA1, then the LNA, so the front end keeps its
+ * gain, and the noise figure its value, for as long as possible */
+static int default_table(struct bladerf_agc *agc)
+{
+    struct bladerf_agc_step *t;
+    unsigned int n = 0, i;
+    double db;
+    int v2;
+
+    t = calloc(AGC_RXVGA2_STEPS + 1 +
+               (AGC_RXVGA1_MAX_DB - AGC_RXVGA1_MIN_DB) / 3 + 2, sizeof(*t));
+    if (!t)
+        return BLADERF_ERR_MEM;
+
+    /* Built from the top down, then reversed */
+    for (v2 = AGC_RXVGA2_STEPS; v2 >= 0; v2--) {
+        t[n].lna = LNA_MAX;
+        t[n].rxvga1 = rxvga1_code(AGC_RXVGA1_MAX_DB);
+        t[n].rxvga2 = v2;
+        t[n].gain_db = AGC_LNA_MAX_DB + rxvga1_db(t[n].rxvga1) + 3 * v2;
+        n++;
+    }
+
+    for (db = AGC_RXVGA1_MAX_DB - 3; db >= AGC_RXVGA1_MIN_DB; db -= 3) {
+        t[n].lna = LNA_MAX;
+        t[n].rxvga1 = rxvga1_code(db);
+        t[n].gain_db = AGC_LNA_MAX_DB + rxvga1_db(t[n].rxvga1);
+        n++;
+    }
+
+    t[n].lna = LNA_MID;
+    t[n].rxvga1 = rxvga1_code(AGC_RXVGA1_MIN_DB);
+    t[n].gain_db = AGC_LNA_MID_DB + rxvga1_db(t[n].rxvga1);
+    n++;
+
+    t[n].lna = LNA_BYPASS;
+    t[n].rxvga1 = rxvga1_code(AGC_RXVGA1_MIN_DB);
+    t[n].gain_db = AGC_LNA_BYPASS_DB + rxvga1_db(t[n].rxvga1);
+    n++;
+
+    for (i = 0; i < n / 2; i++) {
+        struct bladerf_agc_step tmp = t[i];
+        t[i] = t[n - 1 - i];
+        t[n - 1 - i] = tmp;
+    }
+
+    agc->table = t;
+    agc->cfg.table_len = n;
+    return 0;
+}
+
+/* Write the stages that differ from 'from', or all of them */
+static int agc_write(struct bladerf_agc *agc,
+                     const struct bladerf_agc_step *from,
+                     const struct bladerf_agc_step *to)
+{
+    int status = 0;
+
+    if (!from || from->lna != to->lna)
+        status = bladerf_set_lna_gain(agc->dev, to->lna);
+    if (!status && (!from || from->rxvga1 != to->rxvga1))
+        status = bladerf_set_rxvga1(agc->dev, to->rxvga1);
+    if (!status && (!from || from->rxvga2 != to->rxvga2))
+        status = bladerf_set_rxvga2(agc->dev, to->rxvga2);
+
+    return status;
+}
+
+/* Tag and publish a change whose writes have completed */
+static void agc_applied(struct bladerf_agc *agc, unsigned int step)
+{
+    struct bladerf_agc_change *c;
+    uint64_t tag;
+
+    tag = __sync_fetch_and_add(&agc->position, 0) + agc->cfg.latency_samples;
+
+    if (agc->change_tail - agc->change_head < AGC_MAX_CHANGES) {
+        c = &agc->changes[agc->change_tail % AGC_MAX_CHANGES];
+        c->sample = tag;
+        c->step = step;
+        c->gain_db = agc->table[step].gain_db;
+        __sync_synchronize();
+        agc->change_tail++;
+    } else {
+        dbg_printf("agc: change to step %u at %llu dropped\n",
+                   step, (unsigned long long)tag);
+    }
+
+    agc->hold_until = tag + agc->cfg.min_interval;
+    __sync_synchronize();
+    agc->applied = step;
+}
+
+/* Undo what a failed change may have written, and return 'requested' to
+ * the streaming thread. The usual hold applies, so that a failing write is
+ * not retried every block. */
+static void agc_rejected(struct bladerf_agc *agc, unsigned int step)
+{
+    const unsigned int cur = agc->applied;
+    int status;
+
+    status = agc_write(agc, &agc->table[step], &agc->table[cur]);
+    if (status)
+        dbg_printf("agc: failed to restore step %u: %d\n", cur, status);
+
+    agc->hold_until = __sync_fetch_and_add(&agc->position, 0) +
+                      agc->cfg.min_interval;
+    __sync_synchronize();
+    agc->requested = cur;
+}
+
+static void *agc_control(void *arg)
+{
+    struct bladerf_agc *agc = arg;
+    unsigned int step;
+    int status;
+
+    for (;;) {
+        while (sem_wait(&agc->wake) && errno == EINTR)
+            ;
+        if (agc->quit)
+            break;
+
+        step = agc->requested;
+        if (step == agc->applied)
+            continue;
+
+        status = agc_write(agc, &agc->table[agc->applied], &agc->table[step]);
+        if (status) {
+            dbg_printf("agc: gain write failed: %d\n", status);
+            agc_rejected(agc, step);
+            continue;
+        }
+
+        agc_applied(agc, step);
+    }
+
+    return NULL;
+}
+
+int bladerf_agc_create(struct bladerf *dev,
+                       const struct bladerf_agc_config *cfg,
+                       unsigned int step, struct bladerf_agc **agc_out)
+{
+    struct bladerf_agc *agc;
+    unsigned int i;
+    int status;
+
+    if (!dev || !cfg || cfg->block_samples == 0 || cfg->deadband_db < 0 ||
+            cfg->clip_backoff_db < 0 || (cfg->table && cfg->table_len == 0))
+        return BLADERF_ERR_INVAL;
+
+    agc = calloc(1, sizeof(*agc));
+    if (!agc)
+        return BLADERF_ERR_MEM;
+
+    agc->dev = dev;
+    agc->cfg = *cfg;
+
+    if (cfg->table) {
+        agc->table = malloc(cfg->table_len * sizeof(agc->table[0]));
+        if (!agc->table) {
+            status = BLADERF_ERR_MEM;
+            goto error;
+        }
+        memcpy(agc->table, cfg->table, cfg->table_len * sizeof(agc->table[0]));
+    } else {
+        status = default_table(agc);
+        if (status)
+            goto error;
+    }
+    agc->cfg.table = agc->table;
+
+    for (i = 1; i < agc->cfg.table_len; i++) {
+        if (agc->table[i].gain_db < agc->table[i - 1].gain_db) {
+            status = BLADERF_ERR_INVAL;
+            goto error;
+        }
+    }
+
+    if (step >= agc->cfg.table_len) {
+        status = BLADERF_ERR_INVAL;
+        goto error;
+    }
+
+    status = agc_write(agc, NULL, &agc->table[step]);
+    if (status)
+        goto error;
+
+    agc->requested = step;
+    agc_applied(agc, step);
+
+    if (sem_init(&agc->wake, 0, 0)) {
+        status = BLADERF_ERR_UNEXPECTED;
+        goto error;
+    }
+    agc->have_sem = true;
+
+    if (pthread_create(&agc->thread, NULL, agc_control, agc)) {
+        status = BLADERF_ERR_UNEXPECTED;
+        goto error;
+    }
+    agc->started = true;
+
+    *agc_out = agc;
+    return 0;
+
+error:
+    bladerf_agc_destroy(agc);
+    return status;
+}
+
+void bladerf_agc_destroy(struct bladerf_agc *agc)
+{
+    if (!agc)
+        return;
+
+    if (agc->started) {
+        agc->quit = true;
+        sem_post(&agc->wake);
+        pthread_join(agc->thread, NULL);
+    }
+
+    if (agc->have_sem)
+        sem_destroy(&agc->wake);
+
+    free(agc->table);
+    free(agc);
+}
+
+/* Step whose gain is nearest want, or if 'below', the highest at or under
+ * it */
+static unsigned int agc_pick(const struct bladerf_agc *agc, double want,
+                             bool below)
+{
+    unsigned int i, best = 0;
+
+    for (i = 1; i < agc->cfg.table_len; i++) {
+        if (below) {
+            if (agc->table[i].gain_db <= want)
+                best = i;
+        } else if (fabs(agc->table[i].gain_db - want) <
+                   fabs(agc->table[best].gain_db - want)) {
+            best = i;
+        }
+    }
+
+    return best;
+}
+
+static void end_block(struct bladerf_agc *agc)
+{
+    const struct bladerf_agc_config *cfg = &agc->cfg;
+    uint64_t start = agc->block_start;
+    double err, gain;
+    unsigned int cur, next;
+    bool clipped;
+
+    err = power_to_db((double)agc->sum / agc->count) - cfg->target_db;
+    clipped = cfg->clip_level &&
+              agc->peak >= (uint32_t)cfg->clip_level * cfg->clip_level;
+
+    agc->block_start += agc->count;
+    agc->sum = 0;
+    agc->peak = 0;
+    agc->count = 0;
+
+    /* Wait for the last change to be applied, take effect and settle */
+    cur = agc->applied;
+    if (cur != agc->requested)
+        return;
+    __sync_synchronize();
+    if (start < agc->hold_until)
+        return;
+
+    gain = agc->table[cur].gain_db;
+
+    if (clipped)
+        next = agc_pick(agc, gain - fmax(err, cfg->clip_backoff_db), true);
+    else if (fabs(err) > cfg->deadband_db)
+        next = agc_pick(agc, gain - err, false);
+    else
+        return;
+
+    if (next != cur) {
+        agc->requested = next;
+        sem_post(&agc->wake);
+    }
+}
+
+void bladerf_agc_process(struct bladerf_agc *agc, const int16_t *samples,
+                         size_t n)
+{
+    size_t take;
+
+    while (n) {
+        take = agc->cfg.block_samples - agc->count;
+        if (take > n)
+            take = n;
+
+        power_accumulate(samples, take, &agc->sum, &agc->peak);
+        agc->count += take;
+        samples += 2 * take;
+        n -= take;
+
+        __sync_fetch_and_add(&agc->position, take);
+
+        if (agc->count == agc->cfg.block_samples)
+            end_block(agc);
+    }
+}
+
+bool bladerf_agc_get_change(struct bladerf_agc *agc,
+                            struct bladerf_agc_change *change)
+{
+    if (agc->change_head == agc->change_tail)
+        return false;
+
+    __sync_synchronize();
+    *change = agc->changes[agc->change_head % AGC_MAX_CHANGES];
+    __sync_synchronize();
+    agc->change_head++;
+
+    return true;
+}
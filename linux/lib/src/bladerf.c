@@ -16,6 +16,7 @@
 #include "bladeRF.h"        /* Driver interface */
 #include "libbladeRF.h"     /* API */
 #include "bladerf_priv.h"   /* Implementation-specific items ("private") */
+#include "fpga_image.h"
 #include "debug.h"
 
 #ifndef BLADERF_DEV_DIR
@@ -78,17 +79,30 @@ struct bladerf * _bladerf_open_info(const char *dev_path,
                                     struct bladerf_devinfo *i)
 {
     struct bladerf *ret;
+    pthread_mutexattr_t attr;
 
-    ret = malloc(sizeof(*ret));
+    ret = calloc(1, sizeof(*ret));
     if (!ret)
         return NULL;
 
     /* TODO -- spit out error/warning message to assist in debugging
      * device node permissions issues?
      */
-    if ((ret->fd = open(dev_path, O_RDWR)) < 0)
+    if ((ret->fd = open(dev_path, O_RDWR)) < 0) {
+        free(ret);
+        return NULL;
+    }
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&ret->ctrl_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    if (buf_pool_create(ret))
         goto bladerf_open__err;
 
+    clock_gettime(CLOCK_MONOTONIC, &ret->stats_start);
+
     /* TODO -- spit our errors/warning here depending on library verbosity? */
     if (i) {
         if (bladerf_get_serial(ret, &i->serial) < 0)
@@ -109,7 +123,7 @@ struct bladerf * _bladerf_open_info(const char *dev_path,
     return ret;
 
 bladerf_open__err:
-    free(ret);
+    bladerf_close(ret);
     return NULL;
 }
 
@@ -185,14 +199,23 @@ struct bladerf * bladerf_open(const char *dev_path)
 void bladerf_close(struct bladerf *dev)
 {
     if (dev) {
+        bladerf_burst_stop(dev);
+        bladerf_resampler_attach(dev, TX, NULL);
+        bladerf_resampler_attach(dev, RX, NULL);
+        bladerf_dc_cal_cache_disable(dev);
+        buf_pool_put(dev, dev->rx_stage, dev->rx_stage_len);
+        buf_pool_destroy(dev);
         close(dev->fd);
+        pthread_mutex_destroy(&dev->ctrl_lock);
         free(dev);
     }
 }
 
 int bladerf_set_loopback(struct bladerf *dev, bladerf_loopback l)
 {
+    ctrl_lock(dev);
     lms_loopback_enable( dev, l ) ;
+    ctrl_unlock(dev);
     return 0;
 }
 
@@ -201,11 +224,19 @@ int bladerf_set_sample_rate(struct bladerf *dev, bladerf_module module, unsigned
     /* TODO: Program the Si5338 to be 2x the desired sample rate */
     int ret = -1;
     /* TODO: Use module to pick the correct clock output to change */
+    ctrl_lock(dev);
     if( module == TX ) {
         ret = si5338_set_tx_freq(dev, rate);
     } else {
         ret = si5338_set_rx_freq(dev, rate);
     }
+    if (!ret) {
+        if (module == TX)
+            dev->tx_rate = rate;
+        else
+            dev->rx_rate = rate;
+    }
+    ctrl_unlock(dev);
     *actual = rate;
     return ret;
 }
@@ -219,6 +250,9 @@ int bladerf_set_rational_sample_rate(struct bladerf *dev, bladerf_module module,
 int bladerf_get_sample_rate( struct bladerf *dev, bladerf_module module, unsigned int *rate)
 {
     /* TODO: Read the Si5338 and figure out the sample rate */
+    ctrl_lock(dev);
+    *rate = module == TX ? dev->tx_rate : dev->rx_rate;
+    ctrl_unlock(dev);
     return 0 ;
 }
 
@@ -239,7 +273,9 @@ int bladerf_set_txvga2(struct bladerf *dev, int gain)
         gain = 0 ;
     }
     /* TODO: Make return values for lms call and return it for failure */
+    ctrl_lock(dev);
     lms_txvga2_set_gain( dev, gain ) ;
+    ctrl_unlock(dev);
     return 0;
 }
 
@@ -247,7 +283,9 @@ int bladerf_get_txvga2(struct bladerf *dev, int *gain)
 {
     *gain = 0 ;
     /* TODO: Make return values for lms call and return it for failure */
+    ctrl_lock(dev);
     lms_txvga2_get_gain( dev, (uint8_t *)gain ) ;
+    ctrl_unlock(dev);
     return 0;
 }
 
@@ -262,7 +300,9 @@ int bladerf_set_txvga1(struct bladerf *dev, int gain)
         gain = -4 ;
     }
     /* TODO: Make return values for lms call and return it for failure */
+    ctrl_lock(dev);
     lms_txvga1_set_gain( dev, gain ) ;
+    ctrl_unlock(dev);
     return 0;
 }
 
@@ -270,28 +310,42 @@ int bladerf_get_txvga1(struct bladerf *dev, int *gain)
 {
     *gain = 0 ;
     /* TODO: Make return values for lms call and return it for failure */
+    ctrl_lock(dev);
     lms_txvga1_get_gain( dev, (int8_t *)gain ) ;
+    ctrl_unlock(dev);
     return 0;
 }
 
 int bladerf_set_lna_gain(struct bladerf *dev, bladerf_lna_gain gain)
 {
     /* TODO: Make return values for lms call and return it for failure */
+    ctrl_lock(dev);
     lms_lna_set_gain( dev, gain ) ;
+    if (dev->dc_cal)
+        dc_cal_apply(dev);
+    ctrl_unlock(dev);
+    dc_cal_flush(dev);
     return 0;
 }
 
 int bladerf_get_lna_gain(struct bladerf *dev, bladerf_lna_gain *gain)
 {
     /* TODO: Make return values for lms call and return it for failure */
+    ctrl_lock(dev);
     lms_lna_get_gain( dev, gain ) ;
+    ctrl_unlock(dev);
     return 0 ;
 }
 
 int bladerf_set_rxvga1(struct bladerf *dev, int gain)
 {
     /* TODO: Make return values for lms call and return it for failure */
+    ctrl_lock(dev);
     lms_rxvga1_set_gain( dev, (uint8_t)gain ) ;
+    if (dev->dc_cal)
+        dc_cal_apply(dev);
+    ctrl_unlock(dev);
+    dc_cal_flush(dev);
     return 0;
 }
 
@@ -299,14 +353,21 @@ int bladerf_get_rxvga1(struct bladerf *dev, int *gain)
 {
     *gain = 0 ;
     /* TODO: Make return values for lms call and return it for failure */
+    ctrl_lock(dev);
     lms_rxvga1_get_gain( dev, (uint8_t *)gain ) ;
+    ctrl_unlock(dev);
     return 0 ;
 }
 
 int bladerf_set_rxvga2(struct bladerf *dev, int gain)
 {
     /* TODO: Make return values for lms call and return it for failure */
+    ctrl_lock(dev);
     lms_rxvga2_set_gain( dev, (uint8_t)gain ) ;
+    if (dev->dc_cal)
+        dc_cal_apply(dev);
+    ctrl_unlock(dev);
+    dc_cal_flush(dev);
     return 0;
 }
 
@@ -314,7 +375,9 @@ int bladerf_get_rxvga2(struct bladerf *dev, int *gain)
 {
     *gain = 0 ;
     /* TODO: Make return values for lms call and return it for failure */
+    ctrl_lock(dev);
     lms_rxvga2_get_gain( dev, (uint8_t *)gain ) ;
+    ctrl_unlock(dev);
     return 0 ;
 }
 
@@ -324,7 +387,12 @@ int bladerf_set_bandwidth(struct bladerf *dev, bladerf_module module,
 {
     /* TODO: Make return values for lms call and return it for failure */
     lms_bw_t bw = lms_uint2bw(bandwidth) ;
+    ctrl_lock(dev);
     lms_lpf_enable( dev, module, bw ) ;
+    if (dev->dc_cal)
+        dc_cal_apply(dev);
+    ctrl_unlock(dev);
+    dc_cal_flush(dev);
     *actual = lms_bw2uint(bw) ;
     return 0;
 }
@@ -333,7 +401,10 @@ int bladerf_get_bandwidth(struct bladerf *dev, bladerf_module module,
                             unsigned int *bandwidth )
 {
     /* TODO: Make return values for lms call and return it for failure */
-    lms_bw_t bw = lms_get_bandwidth( dev, module ) ;
+    lms_bw_t bw;
+    ctrl_lock(dev);
+    bw = lms_get_bandwidth( dev, module ) ;
+    ctrl_unlock(dev);
     *bandwidth = lms_bw2uint(bw) ;
     return 0 ;
 }
@@ -342,7 +413,12 @@ int bladerf_set_frequency(struct bladerf *dev,
                             bladerf_module module, unsigned int frequency)
 {
     /* TODO: Make return values for lms call and return it for failure */
+    ctrl_lock(dev);
     lms_set_frequency( dev, module, frequency ) ;
+    if (dev->dc_cal && module == RX)
+        dc_cal_apply(dev);
+    ctrl_unlock(dev);
+    dc_cal_flush(dev);
     return 0;
 }
 
@@ -351,7 +427,9 @@ int bladerf_get_frequency(struct bladerf *dev,
 {
     /* TODO: Make return values for lms call and return it for failure */
     struct lms_freq f ;
+    ctrl_lock(dev);
     lms_get_frequency( dev, module, &f ) ;
+    ctrl_unlock(dev);
     *frequency = (unsigned int)(((uint64_t)((f.nint<<23) + f.nfrac)) * (f.reference/f.x) >>23) ;
     return 0 ;
 }
@@ -364,15 +442,80 @@ ssize_t bladerf_send_c12(struct bladerf *dev, int16_t *samples, size_t n)
     return 0;
 }
 
+ssize_t stream_write(struct bladerf *dev, const int16_t *samples, size_t n)
+{
+    ssize_t ret;
+    size_t bytes;
+
+    /* The driver only queues whole transfer buffers */
+    bytes = n * 2 * sizeof(int16_t);
+    bytes -= bytes % DATA_BUF_SZ;
+    if (bytes == 0)
+        return BLADERF_ERR_INVAL;
+
+    ret = write( dev->fd, samples, bytes ) ;
+    if (ret < 0) {
+        dbg_printf("Failed to send samples: %s\n", strerror(errno));
+        return BLADERF_ERR_IO;
+    }
+
+    ret /= 2 * sizeof(int16_t);
+    stats_add(&dev->tx_samples, ret);
+
+    return ret;
+}
+
 ssize_t bladerf_send_c16(struct bladerf *dev, int16_t *samples, size_t n)
 {
-    return 0;
+    struct stream_resampler *rs;
+
+    rs = __atomic_load_n(&dev->tx_resampler, __ATOMIC_ACQUIRE);
+    if (rs)
+        return resampler_write(dev, rs, samples, n);
+
+    return stream_write(dev, samples, n);
+}
+
+ssize_t stream_read(struct bladerf *dev, int16_t *samples, size_t max_samples)
+{
+    struct bladerf_detector *det;
+    ssize_t ret;
+    size_t bytes;
+
+    /* The driver hands out whole transfer buffers only */
+    bytes = max_samples * 2 * sizeof(int16_t);
+    bytes -= bytes % DATA_BUF_SZ;
+    if (bytes == 0)
+        return BLADERF_ERR_INVAL;
+
+    /* Streaming goes straight to the data interface and never takes the
+     * control lock, so a retune on another thread cannot stall it */
+    ret = read( dev->fd, samples, bytes ) ;
+    if (ret < 0) {
+        dbg_printf("Failed to read samples: %s\n", strerror(errno));
+        return BLADERF_ERR_IO;
+    }
+
+    ret /= 2 * sizeof(int16_t);
+    stats_add(&dev->rx_samples, ret);
+
+    det = __atomic_load_n(&dev->rx_detector, __ATOMIC_ACQUIRE);
+    if (det)
+        bladerf_detector_process(det, samples, ret);
+
+    return ret;
 }
 
 ssize_t bladerf_read_c16(struct bladerf *dev,
                             int16_t *samples, size_t max_samples)
 {
-    return read( dev->fd, samples, max_samples ) ;
+    struct stream_resampler *rs;
+
+    rs = __atomic_load_n(&dev->rx_resampler, __ATOMIC_ACQUIRE);
+    if (rs)
+        return resampler_read(dev, rs, samples, max_samples);
+
+    return stream_read(dev, samples, max_samples);
 }
 
 /*******************************************************************************
@@ -395,7 +538,9 @@ int bladerf_is_fpga_configured(struct bladerf *dev)
 
     assert(dev);
 
+    ctrl_lock(dev);
     status = ioctl(dev->fd, BLADE_QUERY_FPGA_STATUS, &configured);
+    ctrl_unlock(dev);
 
     if (status || configured < 0 || configured > 1)
         configured = BLADERF_ERR_IO;
@@ -403,16 +548,80 @@ int bladerf_is_fpga_configured(struct bladerf *dev)
     return configured;
 }
 
-/* TODO Not yet supported */
+/* Images that predate the identity registers ignore the GPIO address and
+ * return the PIO for every read, so both magic bytes can't match there */
+static bool fpga_has_id_regs(struct bladerf *dev)
+{
+    uint8_t magic0, magic1;
+
+    if (gpio_reg_read(dev, UART_GPIO_ADDR_MAGIC0, &magic0) ||
+            gpio_reg_read(dev, UART_GPIO_ADDR_MAGIC1, &magic1))
+        return false;
+
+    return magic0 == 'B' && magic1 == 'R';
+}
+
+static int fpga_read_image_id(struct bladerf *dev, uint64_t *id)
+{
+    int i;
+    uint8_t val;
+
+    if (!fpga_has_id_regs(dev))
+        return BLADERF_ERR_INVAL;
+
+    *id = 0;
+    for (i = 0; i < UART_GPIO_IMAGE_ID_LEN; i++) {
+        if (gpio_reg_read(dev, UART_GPIO_ADDR_IMAGE_ID + i, &val))
+            return BLADERF_ERR_IO;
+        *id |= (uint64_t)val << (8 * i);
+    }
+
+    return 0;
+}
+
+static int fpga_write_image_id(struct bladerf *dev, uint64_t id)
+{
+    int i;
+
+    if (!fpga_has_id_regs(dev))
+        return BLADERF_ERR_INVAL;
+
+    for (i = 0; i < UART_GPIO_IMAGE_ID_LEN; i++) {
+        if (gpio_reg_write(dev, UART_GPIO_ADDR_IMAGE_ID + i, (id >> (8 * i)) & 0xff))
+            return BLADERF_ERR_IO;
+    }
+
+    return 0;
+}
+
 int bladerf_get_fpga_version(struct bladerf *dev,
                                 unsigned int *major, unsigned int *minor)
 {
+    int status;
+    uint8_t maj, min;
+
     assert(dev && major && minor);
 
     *major = 0;
     *minor = 0;
 
-    return 0;
+    status = bladerf_is_fpga_configured(dev);
+    if (status <= 0)
+        return status;
+
+    ctrl_lock(dev);
+    if (fpga_has_id_regs(dev)) {
+        if (gpio_reg_read(dev, UART_GPIO_ADDR_VERSION_MAJ, &maj) ||
+                gpio_reg_read(dev, UART_GPIO_ADDR_VERSION_MIN, &min)) {
+            status = BLADERF_ERR_IO;
+        } else {
+            *major = maj;
+            *minor = min;
+        }
+    }
+    ctrl_unlock(dev);
+
+    return status;
 }
 
 int bladerf_get_fw_version(struct bladerf *dev,
@@ -423,7 +632,9 @@ int bladerf_get_fw_version(struct bladerf *dev,
 
     assert(dev && major && minor);
 
+    ctrl_lock(dev);
     status = ioctl(dev->fd, BLADE_QUERY_VERSION, &ver);
+    ctrl_unlock(dev);
     if (!status) {
         *major = ver.major;
         *minor = ver.minor;
@@ -434,6 +645,34 @@ int bladerf_get_fw_version(struct bladerf *dev,
     return BLADERF_ERR_IO;
 }
 
+int bladerf_stats(struct bladerf *dev, struct bladerf_stats *stats)
+{
+    struct timespec now;
+    uint64_t elapsed_ms;
+    unsigned int overruns, underruns;
+
+    assert(dev && stats);
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    elapsed_ms = (now.tv_sec - dev->stats_start.tv_sec) * 1000 +
+                 (now.tv_nsec - dev->stats_start.tv_nsec) / 1000000;
+    if (elapsed_ms == 0)
+        elapsed_ms = 1;
+
+    if (ioctl(dev->fd, BLADE_RX_OVERRUNS, &overruns) == 0)
+        stats->rx_overruns = overruns;
+    else
+        stats->rx_overruns = stats_get(&dev->stats.rx_overruns);
+    if (ioctl(dev->fd, BLADE_TX_UNDERRUNS, &underruns) == 0)
+        stats->tx_underruns = underruns;
+    else
+        stats->tx_underruns = stats_get(&dev->stats.tx_underruns);
+    stats->rx_throughput = stats_get(&dev->rx_samples) * 1000 / elapsed_ms;
+    stats->tx_throughput = stats_get(&dev->tx_samples) * 1000 / elapsed_ms;
+
+    return 0;
+}
+
 /*------------------------------------------------------------------------------
  * Misc.
  *----------------------------------------------------------------------------*/
@@ -464,12 +703,47 @@ const char * bladerf_strerror(int error)
  * Device programming
  *----------------------------------------------------------------------------*/
 
-/* TODO Unimplemented: flashing FX3 firmware */
+int bladerf_flash_firmware_mem(struct bladerf *dev, const void *image,
+                               size_t len)
+{
+    int upgrade_status, ret;
+    struct bladeRF_firmware fw_param;
+
+    assert(dev && image);
+
+    /* Quick sanity check: We know the firmware file is roughly 100K
+     * Env var is a quick opt-out of this check - can it ever get this large?
+     *
+     * TODO: Query max flash size for upper bound?
+     */
+    if (!getenv("BLADERF_SKIP_FW_SIZE_CHECK") &&
+            (len < (50 * 1024) || len > (1 * 1024 * 1024))) {
+        dbg_printf("Detected potentially invalid firmware file. Aborting!\n");
+        return BLADERF_ERR_INVAL;
+    }
+
+    /* The driver only reads from this buffer */
+    fw_param.len = len;
+    fw_param.ptr = (unsigned char *)image;
+
+    ret = 0;
+    ctrl_lock(dev);
+    upgrade_status = ioctl(dev->fd, BLADE_UPGRADE_FW, &fw_param);
+    ctrl_unlock(dev);
+    if (upgrade_status < 0) {
+        dbg_printf("Firmware upgrade failed: %s\n", strerror(errno));
+        ret = BLADERF_ERR_UNEXPECTED;
+    }
+
+    return ret;
+}
+
 int bladerf_flash_firmware(struct bladerf *dev, const char *firmware)
 {
-    int fw_fd, upgrade_status, ret;
+    int fw_fd, ret;
     struct stat fw_stat;
-    struct bladeRF_firmware fw_param;
+    unsigned char *buf;
+    size_t len;
     ssize_t n_read, read_status;
 
     assert(dev && firmware);
@@ -486,22 +760,17 @@ int bladerf_flash_firmware(struct bladerf *dev, const char *firmware)
         return BLADERF_ERR_IO;
     }
 
-    fw_param.len = fw_stat.st_size;
+    len = fw_stat.st_size;
 
-    /* Quick sanity check: We know the firmware file is roughly 100K
-     * Env var is a quick opt-out of this check - can it ever get this large?
-     *
-     * TODO: Query max flash size for upper bound?
-     */
-    if (!getenv("BLADERF_SKIP_FW_SIZE_CHECK") &&
-            (fw_param.len < (50 * 1024) || fw_param.len > (1 * 1024 * 1024))) {
+    /* Bail out before reading something absurdly large into memory */
+    if (!getenv("BLADERF_SKIP_FW_SIZE_CHECK") && len > (1 * 1024 * 1024)) {
         dbg_printf("Detected potentially invalid firmware file. Aborting!\n");
         close(fw_fd);
         return BLADERF_ERR_INVAL;
     }
 
-    fw_param.ptr = malloc(fw_param.len);
-    if (!fw_param.ptr) {
+    buf = malloc(len);
+    if (!buf) {
         dbg_printf("Failed to allocate firmware buffer: %s\n", strerror(errno));
         close(fw_fd);
         return BLADERF_ERR_MEM;
@@ -509,29 +778,22 @@ int bladerf_flash_firmware(struct bladerf *dev, const char *firmware)
 
     n_read = 0;
     do {
-        read_status = read(fw_fd, fw_param.ptr + n_read, fw_param.len - n_read);
-        if (read_status < 0) {
-            dbg_printf("Failed to read firmware file: %s\n", strerror(errno));
-            free(fw_param.ptr);
+        read_status = read(fw_fd, buf + n_read, len - n_read);
+        if (read_status <= 0) {
+            dbg_printf("Failed to read firmware file: %s\n",
+                        read_status < 0 ? strerror(errno) : "Unexpected EOF");
+            free(buf);
             close(fw_fd);
             return BLADERF_ERR_IO;
         } else {
             n_read += read_status;
         }
-    } while(n_read < fw_param.len);
+    } while((size_t)n_read < len);
     close(fw_fd);
 
-    /* Bug catcher */
-    assert(n_read == fw_param.len);
+    ret = bladerf_flash_firmware_mem(dev, buf, len);
 
-    ret = 0;
-    upgrade_status = ioctl(dev->fd, BLADE_UPGRADE_FW, &fw_param);
-    if (upgrade_status < 0) {
-        dbg_printf("Firmware upgrade failed: %s\n", strerror(errno));
-        ret = BLADERF_ERR_UNEXPECTED;
-    }
-
-    free(fw_param.ptr);
+    free(buf);
     return ret;
 }
 
@@ -545,19 +807,17 @@ static bool time_past(struct timeval ref, struct timeval now) {
     return false;
 }
 
-#define STACK_BUFFER_SZ 1024
-int bladerf_load_fpga(struct bladerf *dev, const char *fpga)
+static int load_fpga(struct bladerf *dev, struct fpga_image *img,
+                     bladerf_progress_cb cb, void *user_data)
 {
-    int ret, fpga_status, fpga_fd;
+    int ret, fpga_status;
     ssize_t nread, written, write_tmp;
-    size_t bytes;
-    struct stat stat;
-    char buf[STACK_BUFFER_SZ];
+    size_t bytes, total;
+    uint64_t hash, loaded_id;
+    char *buf;
     struct timeval end_time, curr_time;
     bool timed_out;
 
-    assert(dev && fpga);
-
     /* TODO Check FPGA on the board versus size of image */
 
     if (ioctl(dev->fd, BLADE_QUERY_FPGA_STATUS, &fpga_status) < 0) {
@@ -566,39 +826,60 @@ int bladerf_load_fpga(struct bladerf *dev, const char *fpga)
         return BLADERF_ERR_UNEXPECTED;
     }
 
-    /* FPGA is already programmed */
-    if (fpga_status)
-        return 1;
+    /* Only skip the load if the running image is the one requested. An
+     * image without an id (or a mismatching one) is always replaced. */
+    if (fpga_status) {
+        ret = fpga_image_hash(img, &hash);
+        if (ret < 0)
+            return ret;
 
-    fpga_fd = open(fpga, 0);
-    if (fpga_fd < 0) {
-        dbg_printf("Failed to open device (%s): %s\n", fpga, strerror(errno));
-        return BLADERF_ERR_IO;
+        if (!fpga_read_image_id(dev, &loaded_id) && loaded_id == hash)
+            return 1;
+
+        dbg_printf("Loaded FPGA image differs, reloading\n");
     }
 
-    if (fstat(fpga_fd, &stat) < 0) {
-        dbg_printf("Failed to stat fpga file (%s): %s\n", fpga, strerror(errno));
-        close(fpga_fd);
-        return BLADERF_ERR_IO;
+    buf = malloc(BLADE_FPGA_PROG_CHUNK_SZ);
+    if (!buf) {
+        dbg_printf("Failed to allocate FPGA buffer: %s\n", strerror(errno));
+        return BLADERF_ERR_MEM;
     }
 
     if (ioctl(dev->fd, BLADE_BEGIN_PROG, &fpga_status)) {
         dbg_printf("ioctl(BLADE_BEGIN_PROG) failed: %s\n", strerror(errno));
-        close(fpga_fd);
+        free(buf);
         return BLADERF_ERR_UNEXPECTED;
     }
 
-    for (bytes = stat.st_size; bytes;) {
-        nread = read(fpga_fd, buf, min_sz(STACK_BUFFER_SZ, bytes));
+    /* Compressed images are inflated chunk by chunk as they are written.
+     * They were inflated once already when opened, so the size is exact and
+     * the CRCs are known to match. */
+    total = img->size;
+    hash = FPGA_IMAGE_HASH_INIT;
+    if (cb)
+        cb(0, total, user_data);
+
+    /* The driver blocks each write until the FX3 has accepted the data, so
+     * chunks can be pushed back to back */
+    for (bytes = total; bytes;) {
+        nread = fpga_image_read(img, buf, min_sz(BLADE_FPGA_PROG_CHUNK_SZ, bytes));
+        if (nread <= 0) {
+            ioctl(dev->fd, BLADE_END_PROG, &ret);
+            dbg_printf("Failed to read fpga image\n");
+            free(buf);
+            return nread < 0 ? nread : BLADERF_ERR_IO;
+        }
 
         written = 0;
         do {
             write_tmp = write(dev->fd, buf + written, nread - written);
-            if (write_tmp < 0) {
-                /* Failing out...at least attempt to "finish" programming */
+            if (write_tmp <= 0) {
+                /* Failing out...at least attempt to "finish" programming.
+                 * A write that takes nothing would otherwise spin here. */
                 ioctl(dev->fd, BLADE_END_PROG, &ret);
-                dbg_printf("Write failure: %s\n", strerror(errno));
-                close(fpga_fd);
+                dbg_printf("Write failure: %s\n",
+                           write_tmp ? strerror(errno) : "no data taken");
+                free(buf);
                 return BLADERF_ERR_IO;
             } else {
                 written += write_tmp;
@@ -606,12 +887,20 @@ int bladerf_load_fpga(struct bladerf *dev, const char *fpga)
         } while(written < nread);
 
         bytes -= nread;
+        hash = fpga_image_hash_update(hash, buf, nread);
 
-        /* FIXME? Perhaps it would be better if the driver blocked on the
-         * write call, rather than sleeping in userspace? */
-        usleep(4000);
+        if (cb)
+            cb(total - bytes, total, user_data);
+    }
+    /* The image must end where it was measured to, which also takes a
+     * compressed one through its final CRC check */
+    nread = fpga_image_read(img, buf, 1);
+    free(buf);
+    if (nread != 0) {
+        ioctl(dev->fd, BLADE_END_PROG, &ret);
+        dbg_printf("FPGA image changed while loading\n");
+        return nread < 0 ? nread : BLADERF_ERR_IO;
     }
-    close(fpga_fd);
 
     /* Debug mode bug catcher */
     assert(bytes == 0);
@@ -639,19 +928,83 @@ int bladerf_load_fpga(struct bladerf *dev, const char *fpga)
             ret = BLADERF_ERR_UNEXPECTED;
     }
 
+    /* Tag the running image so an identical reload can be skipped. An image
+     * without id registers just gets reloaded next time, but a failed
+     * write is reported, as it may leave a partial id behind. */
+    if (!ret && fpga_status) {
+        ret = fpga_write_image_id(dev, fpga_image_hash_final(hash));
+        if (ret == BLADERF_ERR_INVAL) {
+            dbg_printf("FPGA image does not support an image id\n");
+            ret = 0;
+        } else if (ret < 0) {
+            dbg_printf("Failed to write FPGA image id\n");
+        }
+    }
+
+    return ret;
+}
+
+int bladerf_load_fpga_progress(struct bladerf *dev, const char *fpga,
+                               bladerf_progress_cb cb, void *user_data)
+{
+    int ret;
+    struct fpga_image img;
+
+    assert(dev && fpga);
+
+    ret = fpga_image_open(&img, fpga);
+    if (ret < 0)
+        return ret;
+
+    /* Hold the control lock for the whole sequence so no register
+     * transaction is issued while the FPGA is being reconfigured */
+    ctrl_lock(dev);
+    ret = load_fpga(dev, &img, cb, user_data);
+    ctrl_unlock(dev);
+
+    fpga_image_close(&img);
     return ret;
 }
 
+int bladerf_load_fpga_mem(struct bladerf *dev, const void *image, size_t len,
+                          bladerf_progress_cb cb, void *user_data)
+{
+    int ret;
+    struct fpga_image img;
+
+    assert(dev && image);
+
+    ret = fpga_image_open_mem(&img, image, len);
+    if (ret < 0)
+        return ret;
+
+    ctrl_lock(dev);
+    ret = load_fpga(dev, &img, cb, user_data);
+    ctrl_unlock(dev);
+
+    fpga_image_close(&img);
+    return ret;
+}
+
+int bladerf_load_fpga(struct bladerf *dev, const char *fpga)
+{
+    return bladerf_load_fpga_progress(dev, fpga, NULL, NULL);
+}
+
 /*------------------------------------------------------------------------------
  * Si5338 register read / write functions
  */
 
 int si5338_i2c_write(struct bladerf *dev, uint8_t address, uint8_t val)
 {
+    int ret;
     struct uart_cmd uc;
     uc.addr = address;
     uc.data = val;
-    return ioctl(dev->fd, BLADE_SI5338_WRITE, &uc);
+    ctrl_lock(dev);
+    ret = ioctl(dev->fd, BLADE_SI5338_WRITE, &uc);
+    ctrl_unlock(dev);
+    return ret;
 }
 
 /*------------------------------------------------------------------------------
@@ -665,37 +1018,63 @@ int lms_spi_read(struct bladerf *dev, uint8_t address, uint8_t *val)
     address &= 0x7f;
     uc.addr = address;
     uc.data = 0xff;
+    ctrl_lock(dev);
     ret = ioctl(dev->fd, BLADE_LMS_READ, &uc);
+    ctrl_unlock(dev);
     *val = uc.data;
     return ret;
 }
 
 int lms_spi_write(struct bladerf *dev, uint8_t address, uint8_t val)
 {
+    int ret;
     struct uart_cmd uc;
     uc.addr = address;
     uc.data = val;
-    return ioctl(dev->fd, BLADE_LMS_WRITE, &uc);
+    ctrl_lock(dev);
+    ret = ioctl(dev->fd, BLADE_LMS_WRITE, &uc);
+    ctrl_unlock(dev);
+    return ret;
 }
 
 /*------------------------------------------------------------------------------
  * GPIO register read / write functions
  */
-int gpio_read(struct bladerf *dev, uint32_t *val)
+int gpio_reg_read(struct bladerf *dev, uint8_t addr, uint8_t *val)
 {
     int ret;
     struct uart_cmd uc;
-    uc.addr = 0;
+    uc.addr = addr;
     uc.data = 0xff;
+    ctrl_lock(dev);
     ret = ioctl(dev->fd, BLADE_GPIO_READ, &uc);
+    ctrl_unlock(dev);
     *val = uc.data;
     return ret;
 }
 
-int gpio_write(struct bladerf *dev, uint32_t val)
+int gpio_reg_write(struct bladerf *dev, uint8_t addr, uint8_t val)
 {
+    int ret;
     struct uart_cmd uc;
-    uc.addr = 0;
+    uc.addr = addr;
     uc.data = val;
-    return ioctl(dev->fd, BLADE_GPIO_WRITE, &uc);
+    ctrl_lock(dev);
+    ret = ioctl(dev->fd, BLADE_GPIO_WRITE, &uc);
+    ctrl_unlock(dev);
+    return ret;
+}
+
+int gpio_read(struct bladerf *dev, uint32_t *val)
+{
+    int ret;
+    uint8_t data;
+    ret = gpio_reg_read(dev, UART_GPIO_ADDR_PIO, &data);
+    *val = data;
+    return ret;
+}
+
+int gpio_write(struct bladerf *dev, uint32_t val)
+{
+    return gpio_reg_write(dev, UART_GPIO_ADDR_PIO, val);
 }
@@ -4,11 +4,90 @@
 #ifndef BLADERF_PRIV_H_
 #define BLADERF_PRIV_H_
 
-/* TODO Should there be a "big-lock" wrapped around accesses to a device */
+#include <pthread.h>
+#include <time.h>
+
+/* Concurrency model:
+ *
+ *  - ctrl_lock serializes control transactions (LMS/Si5338/GPIO register
+ *    accesses, FPGA/firmware programming ioctls). It is recursive so that
+ *    API calls may hold it across an entire read-modify-write sequence while
+ *    the underlying register accessors also acquire it.
+ *
+ *  - The sample stream paths (read/write on the fd) never take ctrl_lock.
+ *    Anything they touch in this structure must be updated atomically.
+ */
 struct bladerf {
     int fd;   /* File descriptor to associated driver device node */
+
+    pthread_mutex_t ctrl_lock;
+
+    /* Sample rates as last set, 0 if never; the Si5338 is not read back */
+    unsigned int rx_rate, tx_rate;
+
+    /* Stream counters. Only access these via the stats_* helpers below */
     struct bladerf_stats stats;
+    uint64_t rx_samples;
+    uint64_t tx_samples;
+    struct timespec stats_start;
+    int16_t *rx_stage;              /* For the planar reads, see planar.c */
+    size_t rx_stage_len;            /* Bytes, as mapped by buf_pool_get() */
+
+    struct dc_cal_cache *dc_cal;    /* DC calibration cache, if enabled */
+    struct burst_sched *burst;      /* Timed TX scheduler, if started */
+    struct bladerf_detector *rx_detector;   /* Fed by stream_read() */
+    struct stream_resampler *rx_resampler;  /* Attached resamplers, */
+    struct stream_resampler *tx_resampler;  /* see resample.c */
+
+    struct buf_pool *pool;          /* Sample buffers, see buffers.c */
 };
 
-#endif
+static inline void ctrl_lock(struct bladerf *dev)
+{
+    pthread_mutex_lock(&dev->ctrl_lock);
+}
+
+static inline void ctrl_unlock(struct bladerf *dev)
+{
+    pthread_mutex_unlock(&dev->ctrl_lock);
+}
 
+static inline void stats_add(uint64_t *counter, uint64_t n)
+{
+    __sync_fetch_and_add(counter, n);
+}
+
+static inline uint64_t stats_get(uint64_t *counter)
+{
+    return __sync_fetch_and_add(counter, 0);
+}
+
+/* Whole transfers to and from the driver at the device's rate, bypassing
+ * any attached resampler. stream_read() feeds the attached detector. */
+ssize_t stream_read(struct bladerf *dev, int16_t *samples, size_t max_samples);
+ssize_t stream_write(struct bladerf *dev, const int16_t *samples, size_t n);
+
+/* The streams through an attached resampler, see resample.c */
+ssize_t resampler_read(struct bladerf *dev, struct stream_resampler *rs,
+                       int16_t *samples, size_t max_samples);
+ssize_t resampler_write(struct bladerf *dev, struct stream_resampler *rs,
+                        const int16_t *samples, size_t n);
+
+/* Access to the Nios-served GPIO registers by address (UART_GPIO_ADDR_*) */
+int gpio_reg_read(struct bladerf *dev, uint8_t addr, uint8_t *val);
+int gpio_reg_write(struct bladerf *dev, uint8_t addr, uint8_t val);
+
+/* Sample buffer memory. buf_pool_get() rounds len up to what it maps;
+ * pass the same len back to buf_pool_put(). */
+int buf_pool_create(struct bladerf *dev);
+void buf_pool_destroy(struct bladerf *dev);
+void *buf_pool_get(struct bladerf *dev, size_t *len);
+void buf_pool_put(struct bladerf *dev, void *p, size_t len);
+
+/* DC calibration cache. dc_cal_apply() is bladerf_dc_cal_apply() for
+ * callers already holding ctrl_lock; it leaves new entries for
+ * dc_cal_flush() to write out once ctrl_lock is released. */
+int dc_cal_apply(struct bladerf *dev);
+int dc_cal_flush(struct bladerf *dev);
+
+#endif
@@ -0,0 +1,285 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+
+#include "libbladeRF.h"
+#include "bladerf_priv.h"
+#include "debug.h"
+
+#define HUGEPAGE_SZ         (2 * 1024 * 1024)
+#define POOL_MAX_FREE       8       /* Regions kept for reuse */
+#define POOL_NODE_UNKNOWN   (-2)
+
+#ifndef MPOL_PREFERRED
+#   define MPOL_PREFERRED   1
+#endif
+
+struct buf_region {
+    void *base;
+    size_t len;
+    struct buf_region *next;
+};
+
+/*
+ * A pool outlives its device while regions are still out: bladerf_close()
+ * only marks it closed, and the last region returned frees it.
+ */
+struct buf_pool {
+    pthread_mutex_t lock;
+    struct buf_region *free;        /* Unmapped regions waiting for reuse */
+    unsigned int num_free;
+    unsigned int outstanding;       /* Regions handed out */
+    bool closed;
+    int node;                       /* -1 if none, or POOL_NODE_UNKNOWN */
+};
+
+/* What bladerf_alloc_buffers() hands out points at 'buf'. It keeps the
+ * pool rather than the device, so it can be freed after the device is
+ * closed. */
+struct buf_set {
+    struct buf_pool *pool;
+    void *base;
+    size_t len;
+    int16_t *buf[];
+};
+
+/* The NUMA node of the device's USB host controller, found by walking up
+ * from the device node's sysfs entry to the first ancestor that has one */
+static int pool_find_node(struct bladerf *dev)
+{
+    char link[64], path[PATH_MAX + 16], *slash;
+    struct stat st;
+    FILE *f;
+    int node = -1;
+
+    if (fstat(dev->fd, &st) || !S_ISCHR(st.st_mode))
+        return -1;
+
+    snprintf(link, sizeof(link), "/sys/dev/char/%u:%u",
+             major(st.st_rdev), minor(st.st_rdev));
+    if (!realpath(link, path))
+        return -1;
+
+    while ((slash = strrchr(path, '/')) && slash != path) {
+        strcpy(slash, "/numa_node");
+        f = fopen(path, "r");
+        if (f) {
+            if (fscanf(f, "%d", &node) != 1)
+                node = -1;
+            fclose(f);
+            break;
+        }
+        *slash = '\0';
+    }
+
+    dbg_printf("Device is on NUMA node %d\n", node);
+    return node;
+}
+
+/* Prefer explicit hugepages, then transparent ones, then whatever we get.
+ * The region is bound to the device's node before it is faulted in, and
+ * it is faulted in up front so that its users never are. */
+static void *pool_map(struct buf_pool *pool, size_t len)
+{
+    unsigned long mask;
+    void *p;
+
+    p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p == MAP_FAILED) {
+        p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            return NULL;
+
+        dbg_printf("No hugepages reserved; using transparent hugepages\n");
+        madvise(p, len, MADV_HUGEPAGE);
+    }
+
+    if (pool->node >= 0 && pool->node < (int)(8 * sizeof(mask))) {
+        mask = 1UL << pool->node;
+        if (syscall(SYS_mbind, p, len, MPOL_PREFERRED, &mask,
+                    8 * sizeof(mask), 0))
+            dbg_printf("Failed to bind buffers to node %d\n", pool->node);
+    }
+
+    memset(p, 0, len);
+    return p;
+}
+
+int buf_pool_create(struct bladerf *dev)
+{
+    struct buf_pool *pool;
+
+    pool = calloc(1, sizeof(*pool));
+    if (!pool)
+        return BLADERF_ERR_MEM;
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pool->node = POOL_NODE_UNKNOWN;
+
+    dev->pool = pool;
+    return 0;
+}
+
+/* Called with the lock held, which it releases */
+static void pool_release(struct buf_pool *pool)
+{
+    struct buf_region *r;
+    bool done;
+
+    while ((r = pool->free)) {
+        pool->free = r->next;
+        munmap(r->base, r->len);
+        free(r);
+    }
+    pool->num_free = 0;
+
+    done = pool->closed && pool->outstanding == 0;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (done) {
+        pthread_mutex_destroy(&pool->lock);
+        free(pool);
+    }
+}
+
+void buf_pool_destroy(struct bladerf *dev)
+{
+    struct buf_pool *pool = dev->pool;
+
+    if (!pool)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->closed = true;
+    if (pool->outstanding)
+        dbg_printf("Keeping the buffer pool until %u regions are freed\n",
+                   pool->outstanding);
+    pool_release(pool);
+
+    dev->pool = NULL;
+}
+
+void *buf_pool_get(struct bladerf *dev, size_t *len)
+{
+    struct buf_pool *pool = dev->pool;
+    struct buf_region *r, **link;
+    void *p = NULL;
+
+    *len = (*len + HUGEPAGE_SZ - 1) & ~((size_t)HUGEPAGE_SZ - 1);
+
+    pthread_mutex_lock(&pool->lock);
+
+    for (link = &pool->free; (r = *link); link = &r->next) {
+        if (r->len == *len) {
+            *link = r->next;
+            pool->num_free--;
+            p = r->base;
+            free(r);
+            break;
+        }
+    }
+
+    if (!p) {
+        if (pool->node == POOL_NODE_UNKNOWN)
+            pool->node = pool_find_node(dev);
+        p = pool_map(pool, *len);
+    }
+
+    if (p)
+        pool->outstanding++;
+
+    pthread_mutex_unlock(&pool->lock);
+    return p;
+}
+
+static void pool_put(struct buf_pool *pool, void *p, size_t len)
+{
+    struct buf_region *r = NULL;
+
+    if (!p)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->outstanding--;
+
+    if (pool->closed) {
+        munmap(p, len);
+        pool_release(pool);
+        return;
+    }
+
+    if (pool->num_free < POOL_MAX_FREE)
+        r = malloc(sizeof(*r));
+
+    if (r) {
+        r->base = p;
+        r->len = len;
+        r->next = pool->free;
+        pool->free = r;
+        pool->num_free++;
+    } else {
+        munmap(p, len);
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void buf_pool_put(struct bladerf *dev, void *p, size_t len)
+{
+    pool_put(dev->pool, p, len);
+}
+
+int bladerf_alloc_buffers(struct bladerf *dev, size_t num_buffers,
+                          size_t samples_per_buffer, int16_t ***buffers)
+{
+    struct buf_set *set;
+    size_t stride, i;
+    char *base;
+
+    if (num_buffers == 0 || samples_per_buffer == 0)
+        return BLADERF_ERR_INVAL;
+
+    stride = samples_per_buffer * 2 * sizeof(int16_t);
+    stride = (stride + BLADERF_BUFFER_ALIGN - 1) &
+             ~((size_t)BLADERF_BUFFER_ALIGN - 1);
+
+    set = malloc(sizeof(*set) + num_buffers * sizeof(set->buf[0]));
+    if (!set)
+        return BLADERF_ERR_MEM;
+
+    set->pool = dev->pool;
+    set->len = num_buffers * stride;
+    set->base = buf_pool_get(dev, &set->len);
+    if (!set->base) {
+        free(set);
+        return BLADERF_ERR_MEM;
+    }
+
+    base = set->base;
+    for (i = 0; i < num_buffers; i++)
+        set->buf[i] = (int16_t *)(base + i * stride);
+
+    *buffers = set->buf;
+    return 0;
+}
+
+void bladerf_free_buffers(struct bladerf *dev, int16_t **buffers)
+{
+    struct buf_set *set;
+
+    if (buffers) {
+        set = (struct buf_set *)((char *)buffers - offsetof(struct buf_set, buf));
+        pool_put(set->pool, set->base, set->len);
+        free(set);
+    }
+}
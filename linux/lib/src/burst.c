@@ -0,0 +1,415 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+
+#include "bladeRF.h"
+#include "libbladeRF.h"
+#include "bladerf_priv.h"
+#include "debug.h"
+
+#define BURST_XFER  BLADERF_SAMPLES_PER_XFER
+
+/* Marker sent by bladerf_burst_align() */
+#define BURST_MARKER_LEN    256
+#define BURST_MARKER_AMP    1024
+#define BURST_MARKER_MIN    0.25    /* Normalized correlation to accept */
+
+struct burst {
+    uint64_t start;                 /* TX stream position */
+    size_t n;
+    struct burst *next;
+    int16_t samples[];
+};
+
+/*
+ * TX stream position p goes out alongside RX sample origin + p. The origin
+ * starts out as the host's RX count at start plus the caller's offset,
+ * which is only an estimate: what the driver and device have buffered on
+ * either side differs from one start to the next. bladerf_burst_align()
+ * measures the error and moves the origin by it.
+ *
+ * The scheduler thread fills each transfer under 'lock' and advances 'pos'
+ * before handing it to the driver, so a burst starting at or after 'pos'
+ * is always in time to be spliced in whole.
+ *
+ * TX is kept streaming zeros between bursts rather than gated off with
+ * GPIO_TX_EN: the only way to drive it, BLADE_USB_CMD_RF_TX, also pulses
+ * GPIO_SYS_RST, which resets the FPGA's sample path and so loses the
+ * alignment with the RX stream.
+ */
+struct burst_sched {
+    struct bladerf *dev;
+    int64_t origin;
+
+    pthread_mutex_t lock;
+    struct burst *queue;            /* Sorted by start, non-overlapping */
+    uint64_t pos;                   /* Next position to be filled */
+    int status;                     /* First error; alignment is lost */
+    bool quit;
+
+    pthread_t thread;
+};
+
+static void burst_drop_all(struct burst_sched *s)
+{
+    struct burst *b;
+
+    while ((b = s->queue)) {
+        s->queue = b->next;
+        free(b);
+    }
+}
+
+/* Copy the part of each burst that falls in [pos, pos + n), dropping those
+ * that end there */
+static void burst_fill(struct burst_sched *s, int16_t *buf, size_t n)
+{
+    struct burst *b;
+    uint64_t from, to;
+
+    memset(buf, 0, n * 2 * sizeof(int16_t));
+
+    while ((b = s->queue) && b->start < s->pos + n) {
+        from = b->start > s->pos ? b->start : s->pos;
+        to = b->start + b->n < s->pos + n ? b->start + b->n : s->pos + n;
+
+        memcpy(buf + 2 * (from - s->pos), b->samples + 2 * (from - b->start),
+               (to - from) * 2 * sizeof(int16_t));
+
+        if (b->start + b->n > s->pos + n)
+            break;
+
+        s->queue = b->next;
+        free(b);
+    }
+
+    s->pos += n;
+}
+
+/* Sum of the driver's TX underrun and RX overrun counts. Either leaves a
+ * gap in its stream, so that TX positions no longer line up with RX
+ * samples. */
+static int burst_gaps(struct bladerf *dev, uint64_t *gaps)
+{
+    unsigned int underruns, overruns;
+
+    if (ioctl(dev->fd, BLADE_TX_UNDERRUNS, &underruns) ||
+            ioctl(dev->fd, BLADE_RX_OVERRUNS, &overruns))
+        return BLADERF_ERR_IO;
+
+    *gaps = (uint64_t)underruns + overruns;
+    return 0;
+}
+
+static void *burst_thread(void *arg)
+{
+    struct burst_sched *s = arg;
+    int16_t buf[2 * BURST_XFER];
+    uint64_t gaps = 0, now = 0;
+    bool check;
+    ssize_t ret;
+    int status;
+
+    check = burst_gaps(s->dev, &gaps) == 0;
+
+    for (;;) {
+        pthread_mutex_lock(&s->lock);
+        if (s->quit) {
+            pthread_mutex_unlock(&s->lock);
+            break;
+        }
+        burst_fill(s, buf, BURST_XFER);
+        pthread_mutex_unlock(&s->lock);
+
+        /* Blocks while the driver's ring is full, which paces us */
+        ret = stream_write(s->dev, buf, BURST_XFER);
+
+        if (ret < 0)
+            status = ret;
+        else if (ret != BURST_XFER)
+            status = BLADERF_ERR_IO;
+        else if (check && !burst_gaps(s->dev, &now) && now != gaps)
+            status = BLADERF_ERR_IO;
+        else
+            continue;
+
+        pthread_mutex_lock(&s->lock);
+        if (!s->status) {
+            dbg_printf("burst: streams out of alignment at %llu\n",
+                       (unsigned long long)s->pos);
+            s->status = status;
+        }
+        /* Anything still queued would go out at the wrong time */
+        burst_drop_all(s);
+        pthread_mutex_unlock(&s->lock);
+
+        if (ret < 0)
+            break;
+        gaps = now;
+    }
+
+    return NULL;
+}
+
+int bladerf_burst_start(struct bladerf *dev, int64_t offset)
+{
+    struct burst_sched *s;
+
+    if (dev->burst)
+        return BLADERF_ERR_INVAL;
+
+    s = calloc(1, sizeof(*s));
+    if (!s)
+        return BLADERF_ERR_MEM;
+
+    s->dev = dev;
+    s->origin = (int64_t)stats_get(&dev->rx_samples) + offset;
+    pthread_mutex_init(&s->lock, NULL);
+
+    if (pthread_create(&s->thread, NULL, burst_thread, s)) {
+        pthread_mutex_destroy(&s->lock);
+        free(s);
+        return BLADERF_ERR_UNEXPECTED;
+    }
+
+    dev->burst = s;
+    return 0;
+}
+
+void bladerf_burst_stop(struct bladerf *dev)
+{
+    struct burst_sched *s = dev->burst;
+
+    if (!s)
+        return;
+
+    pthread_mutex_lock(&s->lock);
+    s->quit = true;
+    pthread_mutex_unlock(&s->lock);
+    pthread_join(s->thread, NULL);
+
+    burst_drop_all(s);
+
+    pthread_mutex_destroy(&s->lock);
+    free(s);
+    dev->burst = NULL;
+}
+
+int bladerf_send_burst(struct bladerf *dev, const int16_t *samples, size_t n,
+                       uint64_t start_sample)
+{
+    struct burst_sched *s = dev->burst;
+    struct burst *b, *prev, *next;
+    int64_t start;
+    int status = 0;
+
+    if (!s || n == 0)
+        return BLADERF_ERR_INVAL;
+
+    start = (int64_t)start_sample - s->origin;
+
+    b = malloc(sizeof(*b) + n * 2 * sizeof(int16_t));
+    if (!b)
+        return BLADERF_ERR_MEM;
+    b->start = start;
+    b->n = n;
+    memcpy(b->samples, samples, n * 2 * sizeof(int16_t));
+
+    pthread_mutex_lock(&s->lock);
+
+    if (s->status) {
+        status = s->status;
+        goto out;
+    }
+
+    if (start < 0 || (uint64_t)start < s->pos) {
+        status = BLADERF_ERR_RANGE;
+        goto out;
+    }
+
+    for (prev = NULL, next = s->queue; next && next->start < b->start;
+            prev = next, next = next->next)
+        ;
+
+    if ((prev && prev->start + prev->n > b->start) ||
+            (next && b->start + b->n > next->start)) {
+        status = BLADERF_ERR_INVAL;
+        goto out;
+    }
+
+    b->next = next;
+    if (prev)
+        prev->next = b;
+    else
+        s->queue = b;
+    b = NULL;
+
+out:
+    pthread_mutex_unlock(&s->lock);
+    free(b);
+    return status;
+}
+
+int bladerf_burst_earliest(struct bladerf *dev, uint64_t *start_sample)
+{
+    struct burst_sched *s = dev->burst;
+
+    if (!s)
+        return BLADERF_ERR_INVAL;
+
+    pthread_mutex_lock(&s->lock);
+    *start_sample = s->origin + s->pos;
+    pthread_mutex_unlock(&s->lock);
+
+    return 0;
+}
+
+/* Pseudo-random QPSK, which only correlates strongly with itself at lag 0 */
+static void burst_marker(int16_t *m)
+{
+    uint32_t x = 1;
+    size_t k;
+
+    for (k = 0; k < BURST_MARKER_LEN; k++) {
+        x = x * 1103515245 + 12345;
+        m[2 * k] = x & (1 << 16) ? BURST_MARKER_AMP : -BURST_MARKER_AMP;
+        m[2 * k + 1] = x & (1 << 17) ? BURST_MARKER_AMP : -BURST_MARKER_AMP;
+    }
+}
+
+static double burst_energy(const int16_t *x)
+{
+    return (double)x[0] * x[0] + (double)x[1] * x[1];
+}
+
+/* Lag in rx at which the marker correlates best, relative to the energy
+ * of both, or -1 if nowhere reaches BURST_MARKER_MIN */
+static ssize_t burst_find(const int16_t *rx, size_t n, const int16_t *m)
+{
+    double cr, ci, e = 0, em = 0, metric, best = BURST_MARKER_MIN;
+    ssize_t at = -1;
+    size_t lag, k;
+
+    if (n < BURST_MARKER_LEN)
+        return -1;
+
+    for (k = 0; k < BURST_MARKER_LEN; k++) {
+        em += burst_energy(m + 2 * k);
+        e += burst_energy(rx + 2 * k);
+    }
+
+    for (lag = 0; ; lag++) {
+        cr = ci = 0;
+        for (k = 0; k < BURST_MARKER_LEN; k++) {
+            cr += rx[2 * (lag + k)] * m[2 * k] +
+                  rx[2 * (lag + k) + 1] * m[2 * k + 1];
+            ci += rx[2 * (lag + k) + 1] * m[2 * k] -
+                  rx[2 * (lag + k)] * m[2 * k + 1];
+        }
+
+        metric = e > 0 ? (cr * cr + ci * ci) / (e * em) : 0;
+        if (metric > best) {
+            best = metric;
+            at = lag;
+        }
+
+        if (lag + BURST_MARKER_LEN == n)
+            break;
+
+        /* Slide the energy window along by one */
+        e += burst_energy(rx + 2 * (lag + BURST_MARKER_LEN));
+        e -= burst_energy(rx + 2 * lag);
+    }
+
+    return at;
+}
+
+int bladerf_burst_align(struct bladerf *dev, size_t max_samples,
+                        int64_t *correction)
+{
+    struct burst_sched *s = dev->burst;
+    int16_t marker[2 * BURST_MARKER_LEN], *rx;
+    struct burst *b;
+    uint64_t start, first;
+    size_t len, got = 0;
+    ssize_t ret, at;
+    int64_t err;
+    int status = 0;
+
+    if (!s)
+        return BLADERF_ERR_INVAL;
+
+    max_samples -= max_samples % BURST_XFER;
+    if (max_samples < BURST_MARKER_LEN)
+        return BLADERF_ERR_INVAL;
+
+    len = max_samples * 2 * sizeof(int16_t);
+    rx = buf_pool_get(dev, &len);
+    if (!rx)
+        return BLADERF_ERR_MEM;
+
+    /* Anything else queued was placed with the old origin */
+    pthread_mutex_lock(&s->lock);
+    if (s->queue)
+        status = BLADERF_ERR_INVAL;
+    start = s->origin + s->pos;
+    pthread_mutex_unlock(&s->lock);
+    if (status)
+        goto out;
+
+    burst_marker(marker);
+    status = bladerf_send_burst(dev, marker, BURST_MARKER_LEN, start);
+    if (status)
+        goto out;
+
+    first = stats_get(&dev->rx_samples);
+    while (got < max_samples) {
+        ret = stream_read(dev, rx + 2 * got, max_samples - got);
+        if (ret < 0) {
+            status = ret;
+            goto out;
+        }
+        got += ret;
+    }
+
+    pthread_mutex_lock(&s->lock);
+    status = s->status;
+    pthread_mutex_unlock(&s->lock);
+    if (status)
+        goto out;
+
+    at = burst_find(rx, got, marker);
+    if (at < 0) {
+        dbg_printf("burst: marker not found in %zu samples\n", got);
+        status = BLADERF_ERR_TIMEOUT;
+        goto out;
+    }
+
+    err = (int64_t)(first + at) - (int64_t)start;
+    dbg_printf("burst: marker %lld samples from where expected\n",
+               (long long)err);
+
+    pthread_mutex_lock(&s->lock);
+    s->origin += err;
+    pthread_mutex_unlock(&s->lock);
+
+    if (correction)
+        *correction = err;
+
+out:
+    /* Take back the marker if it is still queued, so that a retry can
+     * queue it again */
+    if (status && status != BLADERF_ERR_INVAL) {
+        pthread_mutex_lock(&s->lock);
+        if ((b = s->queue) && b->start == start - s->origin) {
+            s->queue = b->next;
+            free(b);
+        }
+        pthread_mutex_unlock(&s->lock);
+    }
+
+    buf_pool_put(dev, rx, len);
+    return status;
+}
@@ -0,0 +1,289 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "libbladeRF.h"
+#include "debug.h"
+
+#define SAMPLE_SZ   (2 * sizeof(int16_t))
+
+struct bladerf_capture {
+    int fd;
+    struct bladerf_capture_header hdr;
+    struct bladerf_capture_block *index;
+};
+
+int bladerf_capture_header_init(struct bladerf *dev,
+                                struct bladerf_capture_header *hdr,
+                                unsigned int block_samples)
+{
+    struct timespec now, wall;
+    bladerf_lna_gain lna = 0;
+    unsigned int rate = 0, freq = 0, bw = 0;
+    int vga1 = 0, vga2 = 0;
+    int status;
+
+    if (block_samples == 0 || block_samples % BLADERF_SAMPLES_PER_XFER)
+        return BLADERF_ERR_INVAL;
+
+    status = bladerf_get_sample_rate(dev, RX, &rate);
+    if (!status)
+        status = bladerf_get_frequency(dev, RX, &freq);
+    if (!status)
+        status = bladerf_get_bandwidth(dev, RX, &bw);
+    if (!status)
+        status = bladerf_get_lna_gain(dev, &lna);
+    if (!status)
+        status = bladerf_get_rxvga1(dev, &vga1);
+    if (!status)
+        status = bladerf_get_rxvga2(dev, &vga2);
+    if (status)
+        return status;
+
+    /* Readers reject a capture they cannot seek by time in */
+    if (rate == 0) {
+        dbg_printf("RX sample rate unknown; set it before capturing\n");
+        return BLADERF_ERR_INVAL;
+    }
+
+    /* Block timestamps share the monotonic clock, which a wall-clock step
+     * during the capture can't reorder */
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    clock_gettime(CLOCK_REALTIME, &wall);
+
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(hdr->magic, BLADERF_CAPTURE_MAGIC, sizeof(hdr->magic));
+    hdr->version = BLADERF_CAPTURE_VERSION;
+    hdr->block_samples = block_samples;
+    hdr->start_ns = now.tv_sec * 1000000000ULL + now.tv_nsec;
+    hdr->start_realtime_ns = wall.tv_sec * 1000000000ULL + wall.tv_nsec;
+    hdr->samplerate = rate;
+    hdr->frequency = freq;
+    hdr->bandwidth = bw;
+    hdr->lna_gain = lna;
+    hdr->rxvga1 = vga1;
+    hdr->rxvga2 = vga2;
+
+    return 0;
+}
+
+/* Reconstruct the index of a capture that was never finalized */
+static int synth_index(struct bladerf_capture *cap, uint64_t file_size)
+{
+    struct bladerf_capture_header *hdr = &cap->hdr;
+    uint64_t b, remaining;
+
+    hdr->num_samples = (file_size - BLADERF_CAPTURE_HDR_SZ) / SAMPLE_SZ;
+    hdr->num_blocks = (hdr->num_samples + hdr->block_samples - 1) /
+                      hdr->block_samples;
+
+    cap->index = calloc(hdr->num_blocks ? hdr->num_blocks : 1,
+                        sizeof(cap->index[0]));
+    if (!cap->index)
+        return BLADERF_ERR_MEM;
+
+    remaining = hdr->num_samples;
+    for (b = 0; b < hdr->num_blocks; b++) {
+        cap->index[b].samples = remaining < hdr->block_samples ?
+                                remaining : hdr->block_samples;
+        remaining -= cap->index[b].samples;
+
+        cap->index[b].timestamp_ns = hdr->start_ns + b * hdr->block_samples *
+                                     1000000000ULL / hdr->samplerate;
+    }
+
+    return 0;
+}
+
+static int read_index(struct bladerf_capture *cap, uint64_t file_size)
+{
+    struct bladerf_capture_header *hdr = &cap->hdr;
+    size_t len;
+    ssize_t n;
+
+    if (hdr->num_blocks != (hdr->num_samples + hdr->block_samples - 1) /
+                           hdr->block_samples ||
+            hdr->index_offset < BLADERF_CAPTURE_HDR_SZ +
+                                hdr->num_samples * SAMPLE_SZ ||
+            hdr->index_offset > file_size ||
+            hdr->num_blocks > (file_size - hdr->index_offset) /
+                              sizeof(cap->index[0])) {
+        dbg_printf("Capture index is inconsistent with header\n");
+        return BLADERF_ERR_INVAL;
+    }
+
+    len = hdr->num_blocks * sizeof(cap->index[0]);
+    cap->index = malloc(len ? len : 1);
+    if (!cap->index)
+        return BLADERF_ERR_MEM;
+
+    n = pread(cap->fd, cap->index, len, hdr->index_offset);
+    if (n != (ssize_t)len) {
+        dbg_printf("Failed to read capture index: %s\n",
+                   n < 0 ? strerror(errno) : "Short read");
+        return BLADERF_ERR_IO;
+    }
+
+    return 0;
+}
+
+int bladerf_capture_open(const char *path, struct bladerf_capture **cap_out)
+{
+    struct bladerf_capture *cap;
+    struct stat st;
+    ssize_t n;
+    int status;
+
+    cap = calloc(1, sizeof(*cap));
+    if (!cap)
+        return BLADERF_ERR_MEM;
+
+    cap->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (cap->fd < 0 || fstat(cap->fd, &st)) {
+        dbg_printf("Failed to open %s: %s\n", path, strerror(errno));
+        status = BLADERF_ERR_IO;
+        goto error;
+    }
+
+    n = pread(cap->fd, &cap->hdr, sizeof(cap->hdr), 0);
+    if (n != sizeof(cap->hdr) || st.st_size < BLADERF_CAPTURE_HDR_SZ ||
+            memcmp(cap->hdr.magic, BLADERF_CAPTURE_MAGIC,
+                   sizeof(cap->hdr.magic)) ||
+            cap->hdr.version != BLADERF_CAPTURE_VERSION ||
+            cap->hdr.block_samples == 0 ||
+            cap->hdr.block_samples % BLADERF_SAMPLES_PER_XFER) {
+        dbg_printf("%s is not a bladeRF capture\n", path);
+        status = BLADERF_ERR_INVAL;
+        goto error;
+    }
+
+    if (cap->hdr.samplerate == 0) {
+        dbg_printf("%s has no sample rate\n", path);
+        status = BLADERF_ERR_INVAL;
+        goto error;
+    }
+
+    if (cap->hdr.index_offset)
+        status = read_index(cap, st.st_size);
+    else
+        status = synth_index(cap, st.st_size);
+
+    if (status)
+        goto error;
+
+    *cap_out = cap;
+    return 0;
+
+error:
+    bladerf_capture_close(cap);
+    return status;
+}
+
+void bladerf_capture_close(struct bladerf_capture *cap)
+{
+    if (cap) {
+        if (cap->fd >= 0)
+            close(cap->fd);
+        free(cap->index);
+        free(cap);
+    }
+}
+
+const struct bladerf_capture_header *
+bladerf_capture_get_header(struct bladerf_capture *cap)
+{
+    return &cap->hdr;
+}
+
+int bladerf_capture_get_block(struct bladerf_capture *cap, uint64_t block,
+                              struct bladerf_capture_block *info)
+{
+    if (block >= cap->hdr.num_blocks)
+        return BLADERF_ERR_RANGE;
+
+    *info = cap->index[block];
+    return 0;
+}
+
+int bladerf_capture_seek(struct bladerf_capture *cap, uint64_t ns,
+                         uint64_t *sample)
+{
+    const struct bladerf_capture_header *hdr = &cap->hdr;
+    const struct bladerf_capture_block *idx = cap->index;
+    uint64_t t, b, off, last;
+    double rate;
+
+    if (hdr->num_blocks == 0) {
+        *sample = 0;
+        return 0;
+    }
+
+    last = hdr->num_blocks - 1;
+    rate = hdr->samplerate;         /* Non-zero, see bladerf_capture_open() */
+
+    /* Jump straight to the block the rate puts us in. Samples lost to
+     * overruns only put the estimate late, by about as many blocks as were
+     * lost, and the index timestamps walk it back */
+    b = rate * (ns / 1e9) / hdr->block_samples;
+    if (b > last)
+        b = last;
+
+    t = hdr->start_ns + ns;
+    while (b > 0 && idx[b].timestamp_ns > t)
+        b--;
+    while (b < last && idx[b + 1].timestamp_ns <= t)
+        b++;
+
+    off = 0;
+    if (t > idx[b].timestamp_ns)
+        off = (t - idx[b].timestamp_ns) / 1e9 * rate;
+    if (off > idx[b].samples)
+        off = idx[b].samples;
+
+    *sample = b * hdr->block_samples + off;
+    return 0;
+}
+
+int bladerf_capture_map(struct bladerf_capture *cap, uint64_t start,
+                        size_t count, struct bladerf_capture_range *range)
+{
+    uint64_t off, base_off;
+    size_t page;
+    void *base;
+
+    if (start >= cap->hdr.num_samples || count == 0)
+        return BLADERF_ERR_RANGE;
+
+    if (count > cap->hdr.num_samples - start)
+        count = cap->hdr.num_samples - start;
+
+    page = sysconf(_SC_PAGESIZE);
+    off = BLADERF_CAPTURE_HDR_SZ + start * SAMPLE_SZ;
+    base_off = off - off % page;
+
+    range->len = off - base_off + count * SAMPLE_SZ;
+    base = mmap(NULL, range->len, PROT_READ, MAP_SHARED, cap->fd, base_off);
+    if (base == MAP_FAILED) {
+        dbg_printf("Failed to map capture range: %s\n", strerror(errno));
+        return BLADERF_ERR_IO;
+    }
+
+    range->base = base;
+    range->samples = (const int16_t *)((char *)base + (off - base_off));
+    range->count = count;
+
+    return 0;
+}
+
+void bladerf_capture_unmap(struct bladerf_capture_range *range)
+{
+    if (range->base) {
+        munmap(range->base, range->len);
+        range->base = NULL;
+    }
+}
@@ -0,0 +1,460 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#include "libbladeRF.h"
+#include "filter.h"
+#include "fft.h"
+#include "debug.h"
+
+#define CHAN_MAX_THREADS    64
+#define CHAN_MIN_BLOCKS     4           /* Per thread, to be worth waking it */
+#define CHAN_PASS_SAMPLES   (64 * 1024) /* Input per pass through the pool */
+#define CHAN_KAISER_BETA    8.0
+
+/*
+ * For M channels, each block of M inputs yields one output per channel:
+ *
+ *   v[m] = sum over p of h[p * M + m] * x[(n - p) * M - m]
+ *   y[k] = sum over m of v[m] * e^(2 pi j k m / M) = FFT(v)[-k mod M]
+ *
+ * where x[n * M] is the newest input of block n. Blocks are stored with
+ * branch m's input at bitrev[m] and the taps are permuted to match, so the
+ * branch sums come out in the order the FFT takes them, and the filter is
+ * a straight multiply-accumulate over contiguous floats.
+ */
+struct chan_queue {
+    int16_t *buf;
+    size_t head, count;
+};
+
+struct chan_worker {
+    struct bladerf_channelizer *chan;
+    pthread_t thread;
+    size_t first, blocks;       /* Blocks of the current pass */
+    float *re, *im;             /* FFT scratch */
+};
+
+struct bladerf_channelizer {
+    struct bladerf_channelizer_config cfg;
+    size_t m;                   /* Channels, i.e., FFT size */
+    struct fft *fft;
+    unsigned int *perm;         /* Storage index of each input in a block */
+    unsigned int *bin;          /* FFT bin of each channel */
+    float *coef;                /* taps rows of m, newest block first */
+
+    float *xr, *xi;             /* taps - 1 blocks of history, then a pass */
+    size_t pass_blocks;
+
+    int16_t *partial;           /* Input of an incomplete block */
+    size_t partial_n;
+
+    struct chan_queue *queues;
+
+    /* Pool. The calling thread runs workers[0]; threads run the rest. */
+    struct chan_worker *workers;
+    unsigned int num_workers;
+    unsigned int num_threads;   /* Started, for workers[1 .. num_threads] */
+    pthread_mutex_t lock;
+    pthread_cond_t start, done;
+    unsigned int generation, pending;
+    bool quit;
+};
+
+static int16_t to_int16(float v)
+{
+    long s = lrintf(v);
+    return s > INT16_MAX ? INT16_MAX : (s < INT16_MIN ? INT16_MIN : s);
+}
+
+/* Filter, transform and queue blocks [first, first + blocks) of the pass */
+static void chan_work(struct chan_worker *w)
+{
+    const struct bladerf_channelizer *chan = w->chan;
+    const size_t m = chan->m, taps = chan->cfg.taps;
+    const size_t cap = chan->cfg.queue_len;
+    const float *c, *br, *bi;
+    struct chan_queue *q;
+    size_t b, p, j, pos;
+
+    for (b = w->first; b < w->first + w->blocks; b++) {
+        memset(w->re, 0, m * sizeof(float));
+        memset(w->im, 0, m * sizeof(float));
+
+        for (p = 0; p < taps; p++) {
+            c = chan->coef + p * m;
+            br = chan->xr + (taps - 1 + b - p) * m;
+            bi = chan->xi + (taps - 1 + b - p) * m;
+
+#ifdef __SSE__
+            for (j = 0; j < m; j += 4) {
+                __m128 vc = _mm_load_ps(c + j);
+                _mm_store_ps(w->re + j, _mm_add_ps(_mm_load_ps(w->re + j),
+                             _mm_mul_ps(vc, _mm_load_ps(br + j))));
+                _mm_store_ps(w->im + j, _mm_add_ps(_mm_load_ps(w->im + j),
+                             _mm_mul_ps(vc, _mm_load_ps(bi + j))));
+            }
+#else
+            for (j = 0; j < m; j++) {
+                w->re[j] += c[j] * br[j];
+                w->im[j] += c[j] * bi[j];
+            }
+#endif
+        }
+
+        fft_execute(chan->fft, w->re, w->im);
+
+        /* Queues only grow once the pass is over, so every block's slot
+         * is known up front */
+        for (j = 0; j < m; j++) {
+            q = &chan->queues[j];
+            pos = (q->head + q->count + b) % cap;
+            q->buf[2 * pos] = to_int16(w->re[chan->bin[j]]);
+            q->buf[2 * pos + 1] = to_int16(w->im[chan->bin[j]]);
+        }
+    }
+}
+
+static void *chan_thread(void *arg)
+{
+    struct chan_worker *w = arg;
+    struct bladerf_channelizer *chan = w->chan;
+    unsigned int seen = 0;
+
+    pthread_mutex_lock(&chan->lock);
+    for (;;) {
+        while (chan->generation == seen && !chan->quit)
+            pthread_cond_wait(&chan->start, &chan->lock);
+        if (chan->quit)
+            break;
+        seen = chan->generation;
+        pthread_mutex_unlock(&chan->lock);
+
+        chan_work(w);
+
+        pthread_mutex_lock(&chan->lock);
+        if (--chan->pending == 0)
+            pthread_cond_signal(&chan->done);
+    }
+    pthread_mutex_unlock(&chan->lock);
+
+    return NULL;
+}
+
+/* Run a pass of blocks through the pool */
+static void chan_pass(struct bladerf_channelizer *chan, size_t blocks)
+{
+    size_t per;
+    unsigned int t, nt;
+
+    nt = blocks / CHAN_MIN_BLOCKS;
+    if (nt > chan->num_workers)
+        nt = chan->num_workers;
+    if (nt == 0)
+        nt = 1;
+
+    per = (blocks + nt - 1) / nt;
+    for (t = 0; t < chan->num_workers; t++) {
+        struct chan_worker *w = &chan->workers[t];
+
+        w->first = t * per;
+        w->blocks = t >= nt || t * per >= blocks ? 0 :
+                    (blocks - t * per < per ? blocks - t * per : per);
+    }
+
+    if (nt > 1) {
+        pthread_mutex_lock(&chan->lock);
+        chan->pending = chan->num_workers - 1;
+        chan->generation++;
+        pthread_cond_broadcast(&chan->start);
+        pthread_mutex_unlock(&chan->lock);
+    }
+
+    chan_work(&chan->workers[0]);
+
+    if (nt > 1) {
+        pthread_mutex_lock(&chan->lock);
+        while (chan->pending)
+            pthread_cond_wait(&chan->done, &chan->lock);
+        pthread_mutex_unlock(&chan->lock);
+    }
+}
+
+/* Unity gain at each channel's center, -6 dB at its edges */
+static int design(struct bladerf_channelizer *chan)
+{
+    const size_t m = chan->m, len = m * chan->cfg.taps;
+    double *h, sum;
+    size_t k;
+
+    h = malloc(len * sizeof(h[0]));
+    if (!h)
+        return BLADERF_ERR_MEM;
+
+    sum = filter_kaiser_sinc(h, len, 0.5 / m, CHAN_KAISER_BETA);
+
+    for (k = 0; k < len; k++)
+        chan->coef[k / m * m + chan->fft->bitrev[k % m]] = h[k] / sum;
+
+    free(h);
+    return 0;
+}
+
+int bladerf_channelizer_create(const struct bladerf_channelizer_config *cfg,
+                               struct bladerf_channelizer **chan_out)
+{
+    struct bladerf_channelizer *chan;
+    size_t m, k, blocks;
+    unsigned int t;
+    int status;
+
+    if (!cfg || cfg->channels < BLADERF_CHANNELIZER_MIN_CHANNELS ||
+            cfg->channels > BLADERF_CHANNELIZER_MAX_CHANNELS ||
+            (cfg->channels & (cfg->channels - 1)) ||
+            cfg->taps == 0 || cfg->taps > BLADERF_CHANNELIZER_MAX_TAPS ||
+            cfg->queue_len == 0)
+        return BLADERF_ERR_INVAL;
+
+    chan = calloc(1, sizeof(*chan));
+    if (!chan)
+        return BLADERF_ERR_MEM;
+
+    pthread_mutex_init(&chan->lock, NULL);
+    pthread_cond_init(&chan->start, NULL);
+    pthread_cond_init(&chan->done, NULL);
+
+    chan->cfg = *cfg;
+    chan->m = m = cfg->channels;
+    chan->num_workers = cfg->threads > 1 ? cfg->threads : 1;
+    if (chan->num_workers > CHAN_MAX_THREADS)
+        chan->num_workers = CHAN_MAX_THREADS;
+    chan->pass_blocks = CHAN_PASS_SAMPLES / m > CHAN_MIN_BLOCKS ?
+                        CHAN_PASS_SAMPLES / m : CHAN_MIN_BLOCKS;
+    blocks = cfg->taps - 1 + chan->pass_blocks;
+
+    chan->fft = fft_create(m);
+    chan->perm = malloc(m * sizeof(chan->perm[0]));
+    chan->bin = malloc(m * sizeof(chan->bin[0]));
+    chan->partial = malloc(2 * m * sizeof(int16_t));
+    chan->queues = calloc(m, sizeof(chan->queues[0]));
+    chan->workers = calloc(chan->num_workers, sizeof(chan->workers[0]));
+    if (!chan->fft || !chan->perm || !chan->bin || !chan->partial ||
+            !chan->queues || !chan->workers ||
+            posix_memalign((void **)&chan->coef, 16,
+                           cfg->taps * m * sizeof(float)) ||
+            posix_memalign((void **)&chan->xr, 16, blocks * m * sizeof(float)) ||
+            posix_memalign((void **)&chan->xi, 16, blocks * m * sizeof(float))) {
+        status = BLADERF_ERR_MEM;
+        goto error;
+    }
+
+    /* Input i of a block is x[n * M - (M - 1 - i)], i.e., branch M - 1 - i.
+     * Channel c is at (c - M / 2) * fs / M, so it is k = c + M / 2. */
+    for (k = 0; k < m; k++) {
+        chan->perm[k] = chan->fft->bitrev[m - 1 - k];
+        chan->bin[k] = (m - (k + m / 2) % m) % m;
+    }
+
+    for (k = 0; k < m; k++) {
+        chan->queues[k].buf = malloc(2 * cfg->queue_len * sizeof(int16_t));
+        if (!chan->queues[k].buf) {
+            status = BLADERF_ERR_MEM;
+            goto error;
+        }
+    }
+
+    status = design(chan);
+    if (status)
+        goto error;
+
+    for (t = 0; t < chan->num_workers; t++) {
+        chan->workers[t].chan = chan;
+        if (posix_memalign((void **)&chan->workers[t].re, 16,
+                           m * sizeof(float)) ||
+                posix_memalign((void **)&chan->workers[t].im, 16,
+                               m * sizeof(float))) {
+            status = BLADERF_ERR_MEM;
+            goto error;
+        }
+    }
+
+    bladerf_channelizer_reset(chan);
+
+    /* Carry on with fewer workers if a thread can't be started */
+    for (t = 1; t < chan->num_workers; t++) {
+        if (pthread_create(&chan->workers[t].thread, NULL, chan_thread,
+                           &chan->workers[t]))
+            break;
+        chan->num_threads++;
+    }
+
+    if (chan->num_threads + 1 < chan->num_workers) {
+        dbg_printf("channelizer: only %u of %u threads started\n",
+                   chan->num_threads, chan->num_workers - 1);
+        for (t = chan->num_threads + 1; t < chan->num_workers; t++) {
+            free(chan->workers[t].re);
+            free(chan->workers[t].im);
+        }
+        chan->num_workers = chan->num_threads + 1;
+    }
+
+    *chan_out = chan;
+    return 0;
+
+error:
+    bladerf_channelizer_destroy(chan);
+    return status;
+}
+
+void bladerf_channelizer_destroy(struct bladerf_channelizer *chan)
+{
+    unsigned int t;
+    size_t k;
+
+    if (!chan)
+        return;
+
+    pthread_mutex_lock(&chan->lock);
+    chan->quit = true;
+    pthread_cond_broadcast(&chan->start);
+    pthread_mutex_unlock(&chan->lock);
+
+    for (t = 1; t <= chan->num_threads; t++)
+        pthread_join(chan->workers[t].thread, NULL);
+
+    if (chan->workers) {
+        for (t = 0; t < chan->num_workers; t++) {
+            free(chan->workers[t].re);
+            free(chan->workers[t].im);
+        }
+    }
+
+    if (chan->queues) {
+        for (k = 0; k < chan->m; k++)
+            free(chan->queues[k].buf);
+    }
+
+    pthread_mutex_destroy(&chan->lock);
+    pthread_cond_destroy(&chan->start);
+    pthread_cond_destroy(&chan->done);
+
+    fft_destroy(chan->fft);
+    free(chan->perm);
+    free(chan->bin);
+    free(chan->coef);
+    free(chan->xr);
+    free(chan->xi);
+    free(chan->partial);
+    free(chan->queues);
+    free(chan->workers);
+    free(chan);
+}
+
+void bladerf_channelizer_reset(struct bladerf_channelizer *chan)
+{
+    size_t k;
+
+    memset(chan->xr, 0, (chan->cfg.taps - 1) * chan->m * sizeof(float));
+    memset(chan->xi, 0, (chan->cfg.taps - 1) * chan->m * sizeof(float));
+    chan->partial_n = 0;
+
+    for (k = 0; k < chan->m; k++)
+        chan->queues[k].head = chan->queues[k].count = 0;
+}
+
+/* Store a block of interleaved samples in filter order */
+static void chan_load(struct bladerf_channelizer *chan, size_t block,
+                      const int16_t *s)
+{
+    float *re = chan->xr + block * chan->m, *im = chan->xi + block * chan->m;
+    size_t i;
+
+    for (i = 0; i < chan->m; i++) {
+        re[chan->perm[i]] = s[2 * i];
+        im[chan->perm[i]] = s[2 * i + 1];
+    }
+}
+
+size_t bladerf_channelizer_process(struct bladerf_channelizer *chan,
+                                   const int16_t *samples, size_t n)
+{
+    const size_t m = chan->m, hist = chan->cfg.taps - 1;
+    size_t used = 0, blocks, room, b, k, fill;
+
+    for (;;) {
+        blocks = (chan->partial_n + n - used) / m;
+        if (blocks > chan->pass_blocks)
+            blocks = chan->pass_blocks;
+
+        /* Every queue gets the same number of samples, but they are
+         * drained separately */
+        for (k = 0; k < m; k++) {
+            room = chan->cfg.queue_len - chan->queues[k].count;
+            if (blocks > room)
+                blocks = room;
+        }
+
+        if (blocks == 0)
+            break;
+
+        for (b = 0; b < blocks; b++) {
+            if (chan->partial_n) {
+                fill = m - chan->partial_n;
+                memcpy(chan->partial + 2 * chan->partial_n,
+                       samples + 2 * used, 2 * fill * sizeof(int16_t));
+                chan_load(chan, hist + b, chan->partial);
+                chan->partial_n = 0;
+                used += fill;
+            } else {
+                chan_load(chan, hist + b, samples + 2 * used);
+                used += m;
+            }
+        }
+
+        chan_pass(chan, blocks);
+
+        for (k = 0; k < m; k++)
+            chan->queues[k].count += blocks;
+
+        memmove(chan->xr, chan->xr + blocks * m, hist * m * sizeof(float));
+        memmove(chan->xi, chan->xi + blocks * m, hist * m * sizeof(float));
+    }
+
+    /* Keep the start of an incomplete block unless the queues filled up */
+    if (chan->partial_n + n - used < m) {
+        memcpy(chan->partial + 2 * chan->partial_n, samples + 2 * used,
+               2 * (n - used) * sizeof(int16_t));
+        chan->partial_n += n - used;
+        used = n;
+    }
+
+    return used;
+}
+
+size_t bladerf_channelizer_read(struct bladerf_channelizer *chan,
+                                unsigned int channel, int16_t *out,
+                                size_t max)
+{
+    const size_t cap = chan->cfg.queue_len;
+    struct chan_queue *q;
+    size_t n, first;
+
+    if (channel >= chan->m)
+        return 0;
+
+    q = &chan->queues[channel];
+    n = max < q->count ? max : q->count;
+
+    first = cap - q->head < n ? cap - q->head : n;
+    memcpy(out, q->buf + 2 * q->head, 2 * first * sizeof(int16_t));
+    memcpy(out + 2 * first, q->buf, 2 * (n - first) * sizeof(int16_t));
+
+    q->head = (q->head + n) % cap;
+    q->count -= n;
+    return n;
+}
@@ -0,0 +1,76 @@
+#include "cordic.h"
+
+/* round(2^CORDIC_STAGES * atan(2^-i) / pi), as computed by the VHDL */
+const int16_t cordic_table[CORDIC_STAGES] = {
+    1024, 605, 319, 162, 81, 41, 20, 10, 5, 3, 1, 1
+};
+
+void cordic_rotate(struct cordic_xyz *v)
+{
+    int16_t x = v->x, y = v->y, z = v->z, dx, dy;
+    int i;
+
+    /* Only rotate within -pi/2 to pi/2 */
+    if (z > CORDIC_PI / 2) {
+        x = -x;
+        y = -y;
+        z -= CORDIC_PI;
+    } else if (z < -(CORDIC_PI / 2)) {
+        x = -x;
+        y = -y;
+        z += CORDIC_PI;
+    }
+
+    for (i = 0; i < CORDIC_STAGES - 1; i++) {
+        dx = y >> i;
+        dy = x >> i;
+        if (z < 0) {
+            x += dx;
+            y -= dy;
+            z += cordic_table[i];
+        } else {
+            x -= dx;
+            y += dy;
+            z -= cordic_table[i];
+        }
+    }
+
+    v->x = x;
+    v->y = y;
+    v->z = z;
+}
+
+void cordic_vector(struct cordic_xyz *v)
+{
+    int16_t x = v->x, y = v->y, z = v->z, dx, dy;
+    int i;
+
+    /* Move the vector into the 1st or 4th quadrant */
+    if (x < 0 && y < 0) {
+        x = -x;
+        y = -y;
+        z -= CORDIC_PI;
+    } else if (x < 0) {
+        x = -x;
+        y = -y;
+        z += CORDIC_PI;
+    }
+
+    for (i = 0; i < CORDIC_STAGES - 1; i++) {
+        dx = y >> i;
+        dy = x >> i;
+        if (y < 0) {
+            x -= dx;
+            y += dy;
+            z -= cordic_table[i];
+        } else {
+            x += dx;
+            y -= dy;
+            z += cordic_table[i];
+        }
+    }
+
+    v->x = x;
+    v->y = y;
+    v->z = z;
+}
@@ -0,0 +1,29 @@
+#ifndef CORDIC_H_
+#define CORDIC_H_
+
+#include <stdint.h>
+
+/*
+ * Bit-exact models of the FPGA's cordic.vhd (hdl/fpga/ip/nuand/synthesis).
+ *
+ * Angles are 16-bit signed with 4096 = pi, as in the VHDL, and all
+ * arithmetic wraps at 16 bits. The first stage folds the input into the
+ * right half-plane and the remaining CORDIC_STAGES - 1 stages iterate, so
+ * the gain is about 1.6468.
+ */
+#define CORDIC_STAGES   12
+#define CORDIC_PI       (1 << CORDIC_STAGES)
+
+struct cordic_xyz {
+    int16_t x, y, z;
+};
+
+extern const int16_t cordic_table[CORDIC_STAGES];
+
+/* Rotate (x, y) by z, driving z to 0 */
+void cordic_rotate(struct cordic_xyz *v);
+
+/* Rotate (x, y) onto the positive x axis, adding its angle to z */
+void cordic_vector(struct cordic_xyz *v);
+
+#endif
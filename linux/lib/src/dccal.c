@@ -0,0 +1,385 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "libbladeRF.h"
+#include "bladerf_priv.h"
+#include "debug.h"
+
+#define DC_CAL_MAGIC        "BRFDCC01"
+#define DC_CAL_MAX_ENTRIES  4096
+
+/* Everything the calibration results depend on */
+struct dc_cal_key {
+    uint8_t rx_freqsel;
+    uint8_t rx_bw, tx_bw;
+    uint8_t lna, rxvga1, rxvga2;
+};
+
+struct dc_cal_entry {
+    struct dc_cal_key key;
+    struct lms_dc_cals cals;
+};
+
+struct dc_cal_file_header {
+    char magic[8];
+    uint32_t count;
+    uint32_t entry_size;            /* Catches layout changes */
+};
+
+struct dc_cal_cache {
+    char *path;                     /* NULL if kept in memory only */
+    struct dc_cal_entry *entries;
+    unsigned int count, alloc;
+    bool dirty;                     /* Entries not yet written out */
+
+    /* What the LMS holds, as last loaded or read back by us */
+    struct lms_dc_cals loaded;
+    bool have_loaded;
+};
+
+static void dc_cal_key_get(struct bladerf *dev, struct dc_cal_key *key)
+{
+    struct lms_freq f;
+    lms_lna_gain_t lna;
+    uint8_t vga1, vga2;
+
+    lms_get_frequency(dev, RX, &f);
+    lms_lna_get_gain(dev, &lna);
+    lms_rxvga1_get_gain(dev, &vga1);
+    lms_rxvga2_get_gain(dev, &vga2);
+
+    memset(key, 0, sizeof(*key));
+    key->rx_freqsel = f.freqsel;
+    key->rx_bw = lms_get_bandwidth(dev, RX);
+    key->tx_bw = lms_get_bandwidth(dev, TX);
+    key->lna = lna;
+    key->rxvga1 = vga1;
+    key->rxvga2 = vga2;
+}
+
+static struct dc_cal_entry *dc_cal_find(struct dc_cal_cache *c,
+                                        const struct dc_cal_key *key)
+{
+    unsigned int i;
+
+    for (i = 0; i < c->count; i++) {
+        if (!memcmp(&c->entries[i].key, key, sizeof(*key)))
+            return &c->entries[i];
+    }
+
+    return NULL;
+}
+
+static struct dc_cal_entry *dc_cal_add(struct dc_cal_cache *c,
+                                       const struct dc_cal_key *key)
+{
+    struct dc_cal_entry *e;
+    unsigned int alloc;
+
+    if (c->count == c->alloc) {
+        alloc = c->alloc ? 2 * c->alloc : 16;
+        e = realloc(c->entries, alloc * sizeof(e[0]));
+        if (!e)
+            return NULL;
+        c->entries = e;
+        c->alloc = alloc;
+    }
+
+    e = &c->entries[c->count++];
+    e->key = *key;
+    return e;
+}
+
+/* A missing or unreadable file just leaves the cache empty */
+static void dc_cal_load(struct dc_cal_cache *c)
+{
+    struct dc_cal_file_header hdr;
+    struct dc_cal_entry e, *d;
+    FILE *f;
+    uint32_t i;
+
+    f = fopen(c->path, "rb");
+    if (!f) {
+        if (errno != ENOENT)
+            dbg_printf("dccal: failed to open %s: %s\n", c->path,
+                       strerror(errno));
+        return;
+    }
+
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+            memcmp(hdr.magic, DC_CAL_MAGIC, sizeof(hdr.magic)) ||
+            hdr.entry_size != sizeof(e) || hdr.count > DC_CAL_MAX_ENTRIES) {
+        dbg_printf("dccal: ignoring invalid %s\n", c->path);
+        goto out;
+    }
+
+    for (i = 0; i < hdr.count; i++) {
+        if (fread(&e, sizeof(e), 1, f) != 1) {
+            dbg_printf("dccal: %s is truncated\n", c->path);
+            break;
+        }
+        d = dc_cal_find(c, &e.key);
+        if (!d && !(d = dc_cal_add(c, &e.key)))
+            break;
+        d->cals = e.cals;
+    }
+
+out:
+    fclose(f);
+}
+
+/* Write a new file and rename it over the old one, so that a reader never
+ * sees a partial one */
+static int dc_cal_save(const char *path, const struct dc_cal_entry *entries,
+                       unsigned int count)
+{
+    struct dc_cal_file_header hdr;
+    char *tmp;
+    FILE *f;
+    int status = 0;
+
+    tmp = malloc(strlen(path) + 5);
+    if (!tmp)
+        return BLADERF_ERR_MEM;
+    sprintf(tmp, "%s.tmp", path);
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, DC_CAL_MAGIC, sizeof(hdr.magic));
+    hdr.count = count;
+    hdr.entry_size = sizeof(entries[0]);
+
+    f = fopen(tmp, "wb");
+    if (!f) {
+        status = BLADERF_ERR_IO;
+    } else {
+        if (fwrite(&hdr, sizeof(hdr), 1, f) != 1 ||
+                fwrite(entries, sizeof(entries[0]), count, f) != count)
+            status = BLADERF_ERR_IO;
+        if (fclose(f))
+            status = BLADERF_ERR_IO;
+    }
+
+    if (!status && rename(tmp, path))
+        status = BLADERF_ERR_IO;
+
+    if (status) {
+        dbg_printf("dccal: failed to write %s: %s\n", path, strerror(errno));
+        remove(tmp);
+    }
+
+    free(tmp);
+    return status;
+}
+
+/* <dir>/dccal-<serial>.bin, with dir defaulting to the user's cache
+ * directory. The last component of dir is created if need be. */
+static char *dc_cal_path(const char *dir, uint64_t serial)
+{
+    char *base = NULL, *path;
+    const char *env;
+
+    if (!dir) {
+        if ((env = getenv("XDG_CACHE_HOME")) && *env) {
+            base = malloc(strlen(env) + 16);
+            if (base)
+                sprintf(base, "%s/bladeRF", env);
+        } else if ((env = getenv("HOME")) && *env) {
+            base = malloc(strlen(env) + 16);
+            if (base) {
+                sprintf(base, "%s/.cache", env);
+                mkdir(base, 0755);
+                strcat(base, "/bladeRF");
+            }
+        }
+        if (!base)
+            return NULL;
+        dir = base;
+    }
+
+    if (mkdir(dir, 0755) && errno != EEXIST)
+        dbg_printf("dccal: failed to create %s: %s\n", dir, strerror(errno));
+
+    path = malloc(strlen(dir) + 32);
+    if (path)
+        sprintf(path, "%s/dccal-%016llx.bin", dir, (unsigned long long)serial);
+
+    free(base);
+    return path;
+}
+
+/* Calibrate, read the results back and store them under key, leaving the
+ * file to dc_cal_flush() */
+static int dc_cal_calibrate(struct bladerf *dev, const struct dc_cal_key *key)
+{
+    struct dc_cal_cache *c = dev->dc_cal;
+    struct dc_cal_entry *e;
+
+    lms_calibrate_dc(dev);
+    lms_get_dc_cals(dev, &c->loaded);
+    c->have_loaded = true;
+
+    e = dc_cal_find(c, key);
+    if (!e)
+        e = dc_cal_add(c, key);
+    if (!e)
+        return BLADERF_ERR_MEM;
+    e->cals = c->loaded;
+    c->dirty = true;
+
+    return 0;
+}
+
+static void dc_cal_free(struct dc_cal_cache *c)
+{
+    if (c) {
+        free(c->entries);
+        free(c->path);
+        free(c);
+    }
+}
+
+int bladerf_dc_cal_cache_enable(struct bladerf *dev, const char *dir)
+{
+    struct dc_cal_cache *c;
+    uint64_t serial;
+    int status, flushed;
+
+    c = calloc(1, sizeof(*c));
+    if (!c)
+        return BLADERF_ERR_MEM;
+
+    /* Until devices report a serial, every board would share one file, so
+     * the cache is only persisted for a nonzero serial */
+    if (bladerf_get_serial(dev, &serial) == 0 && serial != 0) {
+        c->path = dc_cal_path(dir, serial);
+        if (!c->path) {
+            dc_cal_free(c);
+            return BLADERF_ERR_INVAL;
+        }
+
+        dc_cal_load(c);
+        dbg_printf("dccal: %u entries from %s\n", c->count, c->path);
+    } else {
+        dbg_printf("dccal: no device serial, keeping the cache in memory\n");
+    }
+
+    ctrl_lock(dev);
+    dc_cal_free(dev->dc_cal);
+    dev->dc_cal = c;
+    status = dc_cal_apply(dev);
+    ctrl_unlock(dev);
+
+    flushed = dc_cal_flush(dev);
+    return status ? status : flushed;
+}
+
+void bladerf_dc_cal_cache_disable(struct bladerf *dev)
+{
+    ctrl_lock(dev);
+    dc_cal_free(dev->dc_cal);
+    dev->dc_cal = NULL;
+    ctrl_unlock(dev);
+}
+
+/* Serializes dc_cal_flush(), so that an older snapshot of a cache never
+ * lands on top of a newer one */
+static pthread_mutex_t dc_cal_flush_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int dc_cal_flush(struct bladerf *dev)
+{
+    struct dc_cal_cache *c;
+    struct dc_cal_entry *entries = NULL;
+    unsigned int count = 0;
+    char *path = NULL;
+    int status = 0;
+
+    pthread_mutex_lock(&dc_cal_flush_lock);
+
+    /* Snapshot what needs writing, so the file I/O can run unlocked */
+    ctrl_lock(dev);
+    c = dev->dc_cal;
+    if (c && c->dirty && c->path) {
+        path = strdup(c->path);
+        entries = malloc(c->count * sizeof(entries[0]));
+        if (path && entries) {
+            memcpy(entries, c->entries, c->count * sizeof(entries[0]));
+            count = c->count;
+            c->dirty = false;
+        } else {
+            status = BLADERF_ERR_MEM;
+        }
+    }
+    ctrl_unlock(dev);
+
+    if (count)
+        status = dc_cal_save(path, entries, count);
+
+    /* Try again next time, unless the cache has since been replaced */
+    if (count && status) {
+        ctrl_lock(dev);
+        if (dev->dc_cal == c)
+            c->dirty = true;
+        ctrl_unlock(dev);
+    }
+
+    pthread_mutex_unlock(&dc_cal_flush_lock);
+
+    free(entries);
+    free(path);
+    return status;
+}
+
+int dc_cal_apply(struct bladerf *dev)
+{
+    struct dc_cal_cache *c = dev->dc_cal;
+    struct dc_cal_entry *e;
+    struct dc_cal_key key;
+
+    if (!c)
+        return BLADERF_ERR_INVAL;
+
+    dc_cal_key_get(dev, &key);
+    e = dc_cal_find(c, &key);
+    if (!e)
+        return dc_cal_calibrate(dev, &key);
+
+    lms_set_dc_cals(dev, &e->cals, c->have_loaded ? &c->loaded : NULL);
+    c->loaded = e->cals;
+    c->have_loaded = true;
+    return 0;
+}
+
+int bladerf_dc_cal_apply(struct bladerf *dev)
+{
+    int status, flushed;
+
+    ctrl_lock(dev);
+    status = dc_cal_apply(dev);
+    ctrl_unlock(dev);
+
+    flushed = dc_cal_flush(dev);
+    return status ? status : flushed;
+}
+
+int bladerf_dc_cal_run(struct bladerf *dev)
+{
+    struct dc_cal_key key;
+    int status, flushed;
+
+    ctrl_lock(dev);
+    if (dev->dc_cal) {
+        dc_cal_key_get(dev, &key);
+        status = dc_cal_calibrate(dev, &key);
+    } else {
+        lms_calibrate_dc(dev);
+        status = 0;
+    }
+    ctrl_unlock(dev);
+
+    flushed = dc_cal_flush(dev);
+    return status ? status : flushed;
+}
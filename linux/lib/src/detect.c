@@ -0,0 +1,131 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "libbladeRF.h"
+#include "bladerf_priv.h"
+#include "power.h"
+#include "debug.h"
+
+/* Lowest noise floor used for relative thresholds: one LSB of I^2 + Q^2,
+ * about -90 dBFS. Digital silence would otherwise put the threshold at
+ * -200 dBFS, which every sample clears. */
+#define DETECT_FLOOR_MIN    1.0
+
+struct bladerf_detector {
+    struct bladerf_detector_config cfg;
+    bladerf_detector_cb cb;
+    void *user_data;
+
+    /* Current block */
+    uint64_t sum;
+    uint32_t peak;
+    size_t count;
+
+    uint64_t position;      /* Stream position of the current block */
+    double floor;           /* Noise floor, linear */
+    bool seeded;            /* floor holds an estimate */
+    bool active;
+};
+
+static void end_block(struct bladerf_detector *det)
+{
+    const struct bladerf_detector_config *cfg = &det->cfg;
+    struct bladerf_detector_event ev;
+    double avg, level, threshold, floor;
+    bool armed = true;
+
+    avg = (double)det->sum / det->count;
+
+    /* The first block only seeds the floor a relative threshold needs */
+    if (!det->seeded) {
+        det->floor = avg;
+        det->seeded = true;
+        armed = !cfg->relative;
+    }
+
+    floor = det->floor > DETECT_FLOOR_MIN ? det->floor : DETECT_FLOOR_MIN;
+
+    level = power_to_db(cfg->use_peak ? det->peak : avg);
+    threshold = cfg->threshold_db;
+    if (cfg->relative)
+        threshold += power_to_db(floor);
+
+    ev.sample = det->position;
+    ev.avg_db = power_to_db(avg);
+    ev.peak_db = power_to_db(det->peak);
+    ev.floor_db = power_to_db(floor);
+
+    if (!armed) {
+        /* Seeding block */
+    } else if (!det->active && level >= threshold) {
+        det->active = true;
+        ev.rising = true;
+        det->cb(&ev, det->user_data);
+    } else if (det->active && level < threshold - cfg->hysteresis_db) {
+        det->active = false;
+        ev.rising = false;
+        det->cb(&ev, det->user_data);
+    }
+
+    /* Don't let the signal being detected raise the floor */
+    if (!det->active)
+        det->floor += cfg->floor_alpha * (avg - det->floor);
+
+    det->position += det->count;
+    det->sum = 0;
+    det->peak = 0;
+    det->count = 0;
+}
+
+int bladerf_detector_create(const struct bladerf_detector_config *cfg,
+                            bladerf_detector_cb cb, void *user_data,
+                            struct bladerf_detector **det_out)
+{
+    struct bladerf_detector *det;
+
+    if (!cfg || !cb || cfg->block_samples == 0 || cfg->hysteresis_db < 0 ||
+            cfg->floor_alpha < 0 || cfg->floor_alpha > 1)
+        return BLADERF_ERR_INVAL;
+
+    det = calloc(1, sizeof(*det));
+    if (!det)
+        return BLADERF_ERR_MEM;
+
+    det->cfg = *cfg;
+    det->cb = cb;
+    det->user_data = user_data;
+
+    *det_out = det;
+    return 0;
+}
+
+void bladerf_detector_destroy(struct bladerf_detector *det)
+{
+    free(det);
+}
+
+void bladerf_detector_attach(struct bladerf *dev, struct bladerf_detector *det)
+{
+    __atomic_store_n(&dev->rx_detector, det, __ATOMIC_RELEASE);
+}
+
+void bladerf_detector_process(struct bladerf_detector *det,
+                              const int16_t *samples, size_t n)
+{
+    size_t take;
+
+    while (n) {
+        take = det->cfg.block_samples - det->count;
+        if (take > n)
+            take = n;
+
+        power_accumulate(samples, take, &det->sum, &det->peak);
+        det->count += take;
+        samples += 2 * take;
+        n -= take;
+
+        if (det->count == det->cfg.block_samples)
+            end_block(det);
+    }
+}
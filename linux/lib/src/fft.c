@@ -0,0 +1,154 @@
+#include <stdlib.h>
+#include <math.h>
+
+#include "fft.h"
+
+/* Points whose real and imaginary parts fit comfortably in L1/L2 */
+#define FFT_CACHE_POINTS    4096
+
+static unsigned int log2_exact(size_t n)
+{
+    unsigned int l = 0;
+
+    while (((size_t)1 << l) < n)
+        l++;
+
+    return l;
+}
+
+struct fft *fft_create(size_t n)
+{
+    struct fft *f;
+    unsigned int bits, i, b, r;
+    size_t L, k, tw_len = 0;
+    float *tw;
+    double theta;
+
+    if (n < 4 || (n & (n - 1)))
+        return NULL;
+
+    bits = log2_exact(n);
+
+    f = calloc(1, sizeof(*f));
+    if (!f)
+        return NULL;
+    f->n = n;
+
+    for (L = (bits & 1) ? 2 : 1; L < n; L *= 4)
+        tw_len += 6 * L;
+
+    f->bitrev = malloc(n * sizeof(f->bitrev[0]));
+    f->tw = malloc(tw_len * sizeof(f->tw[0]));
+    if (!f->bitrev || !f->tw) {
+        fft_destroy(f);
+        return NULL;
+    }
+
+    for (i = 0; i < n; i++) {
+        for (b = 0, r = 0; b < bits; b++)
+            r |= ((i >> b) & 1) << (bits - 1 - b);
+        f->bitrev[i] = r;
+    }
+
+    /* Each radix-4 pass that builds DFTs of size 4L from size L reads
+     * w^k, w^2k and w^3k for k < L, stored as six arrays of L:
+     * re1, im1, re2, im2, re3, im3 */
+    tw = f->tw;
+    for (L = (bits & 1) ? 2 : 1; L < n; L *= 4) {
+        for (k = 0; k < L; k++) {
+            theta = -2.0 * M_PI * k / (4 * L);
+            tw[k]         = cos(theta);
+            tw[L + k]     = sin(theta);
+            tw[2 * L + k] = cos(2 * theta);
+            tw[3 * L + k] = sin(2 * theta);
+            tw[4 * L + k] = cos(3 * theta);
+            tw[5 * L + k] = sin(3 * theta);
+        }
+        tw += 6 * L;
+    }
+
+    return f;
+}
+
+void fft_destroy(struct fft *f)
+{
+    if (f) {
+        free(f->bitrev);
+        free(f->tw);
+        free(f);
+    }
+}
+
+/* One radix-4 pass over a block of 4L points. With bit-reversed input, the
+ * sub-DFTs over indices = 0, 2, 1, 3 (mod 4) sit at offsets 0, L, 2L, 3L. */
+static void radix4_block(float *restrict re, float *restrict im, size_t L,
+                         const float *restrict tw)
+{
+    float *ar = re, *cr = re + L, *br = re + 2 * L, *dr = re + 3 * L;
+    float *ai = im, *ci = im + L, *bi = im + 2 * L, *di = im + 3 * L;
+    const float *w1r = tw, *w1i = tw + L, *w2r = tw + 2 * L;
+    const float *w2i = tw + 3 * L, *w3r = tw + 4 * L, *w3i = tw + 5 * L;
+    float b_r, b_i, c_r, c_i, d_r, d_i;
+    float t0r, t0i, t1r, t1i, t2r, t2i, t3r, t3i;
+    size_t k;
+
+    for (k = 0; k < L; k++) {
+        b_r = br[k] * w1r[k] - bi[k] * w1i[k];
+        b_i = br[k] * w1i[k] + bi[k] * w1r[k];
+        c_r = cr[k] * w2r[k] - ci[k] * w2i[k];
+        c_i = cr[k] * w2i[k] + ci[k] * w2r[k];
+        d_r = dr[k] * w3r[k] - di[k] * w3i[k];
+        d_i = dr[k] * w3i[k] + di[k] * w3r[k];
+
+        t0r = ar[k] + c_r;  t0i = ai[k] + c_i;
+        t1r = ar[k] - c_r;  t1i = ai[k] - c_i;
+        t2r = b_r + d_r;    t2i = b_i + d_i;
+        t3r = b_r - d_r;    t3i = b_i - d_i;
+
+        ar[k] = t0r + t2r;  ai[k] = t0i + t2i;
+        br[k] = t0r - t2r;  bi[k] = t0i - t2i;
+        cr[k] = t1r + t3i;  ci[k] = t1i - t3r;      /* t1 - j*t3 */
+        dr[k] = t1r - t3i;  di[k] = t1i + t3r;      /* t1 + j*t3 */
+    }
+}
+
+void fft_execute(const struct fft *f, float *re, float *im)
+{
+    const float *tw;
+    size_t n = f->n, L0 = 1, L, i, base, chunk;
+    float r, m;
+
+    if (log2_exact(n) & 1) {
+        for (i = 0; i < n; i += 2) {
+            r = re[i + 1];
+            m = im[i + 1];
+            re[i + 1] = re[i] - r;
+            im[i + 1] = im[i] - m;
+            re[i] += r;
+            im[i] += m;
+        }
+        L0 = 2;
+    }
+
+    /* Passes whose blocks fit in cache are run back to back on one chunk
+     * before moving to the next, rather than each streaming over all n */
+    chunk = n < FFT_CACHE_POINTS ? n : FFT_CACHE_POINTS;
+    for (i = 0; i < n; i += chunk) {
+        tw = f->tw;
+        for (L = L0; 4 * L <= chunk; L *= 4) {
+            for (base = i; base < i + chunk; base += 4 * L)
+                radix4_block(re + base, im + base, L, tw);
+            tw += 6 * L;
+        }
+    }
+
+    tw = f->tw;
+    for (L = L0; 4 * L <= chunk; L *= 4)
+        tw += 6 * L;
+
+    for (; L < n; L *= 4) {
+        for (base = 0; base < n; base += 4 * L)
+            radix4_block(re + base, im + base, L, tw);
+        tw += 6 * L;
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef FFT_H_
+#define FFT_H_
+
+#include <stddef.h>
+
+/*
+ * In-place forward complex FFT for power-of-two sizes.
+ *
+ * Data is split into separate real and imaginary arrays so each butterfly
+ * pass is a straight run over contiguous memory that the compiler can
+ * vectorize. The first pass is radix-2 when log2(n) is odd; the rest are
+ * radix-4. Twiddles for every pass are precomputed in the order they are
+ * consumed.
+ */
+struct fft {
+    size_t n;
+    unsigned int *bitrev;   /* Input permutation */
+    float *tw;              /* Per-pass twiddles, see fft_create() */
+};
+
+/* Returns NULL if n is not a power of two >= 4, or on allocation failure */
+struct fft *fft_create(size_t n);
+
+void fft_destroy(struct fft *f);
+
+/* Transform re/im, which must already be in bit-reversed order (see
+ * fft->bitrev: input sample i belongs at index bitrev[i]) */
+void fft_execute(const struct fft *f, float *re, float *im);
+
+#endif
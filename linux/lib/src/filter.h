@@ -0,0 +1,146 @@
+#ifndef FILTER_H_
+#define FILTER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+ * FIR design and inner loops shared by the modulator, resampler and
+ * channelizer.
+ *
+ * Samples are interleaved I/Q. For floats, each real coefficient is stored
+ * twice, (c0, c0, c1, c1, ...), so one pass over 2 * taps floats yields
+ * both the I and Q sums. For int16, coefficients are Q14 in groups of four
+ * taps laid out (c0, c1, c0, c1, c2, c3, c2, c3) to suit pmaddwd once each
+ * pair of samples is rearranged to (I0, I1, Q0, Q1).
+ *
+ * taps must be a multiple of FILTER_TAP_ALIGN, and the coefficient arrays
+ * must be 16-byte aligned.
+ */
+/* Zeroth-order modified Bessel function of the first kind */
+static inline double filter_bessel_i0(double x)
+{
+    double sum = 1, term = 1;
+    int k;
+
+    for (k = 1; k < 50; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+
+    return sum;
+}
+
+/* Kaiser-windowed sinc lowpass with its -6 dB point at fc cycles per
+ * sample. Returns the sum of the taps, for normalizing the gain. */
+static inline double filter_kaiser_sinc(double *h, size_t len, double fc,
+                                        double beta)
+{
+    double t, w, sum = 0;
+    size_t k;
+
+    for (k = 0; k < len; k++) {
+        t = k - (len - 1) / 2.0;
+        w = len > 1 ? 2.0 * k / (len - 1) - 1.0 : 0;
+        h[k] = (t == 0 ? 2 * fc : sin(2 * M_PI * fc * t) / (M_PI * t)) *
+               filter_bessel_i0(beta * sqrt(1 - w * w)) /
+               filter_bessel_i0(beta);
+        sum += h[k];
+    }
+
+    return sum;
+}
+
+#define FILTER_TAP_ALIGN    4
+
+static inline size_t filter_align_taps(size_t taps)
+{
+    return (taps + FILTER_TAP_ALIGN - 1) & ~(size_t)(FILTER_TAP_ALIGN - 1);
+}
+
+static inline void filter_dot_cf32(const float *x, const float *coef,
+                                   size_t taps, float *re, float *im)
+{
+    size_t i;
+
+#ifdef __SSE__
+    __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+    float sum[4];
+
+    for (i = 0; i < 2 * taps; i += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(x + i),
+                                           _mm_load_ps(coef + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(x + i + 4),
+                                           _mm_load_ps(coef + i + 4)));
+    }
+
+    _mm_storeu_ps(sum, _mm_add_ps(acc0, acc1));
+    *re = sum[0] + sum[2];
+    *im = sum[1] + sum[3];
+#else
+    float r = 0, q = 0;
+
+    for (i = 0; i < 2 * taps; i += 2) {
+        r += x[i] * coef[i];
+        q += x[i + 1] * coef[i + 1];
+    }
+
+    *re = r;
+    *im = q;
+#endif
+}
+
+#define FILTER_Q    14
+
+/* Store coefficient c of a filter_dot_c16() filter */
+static inline void filter_set_c16(int16_t *coef, size_t tap, int16_t c)
+{
+    size_t g = tap / 4 * 8, k = tap % 4;
+
+    coef[g + (k & 2) * 2 + (k & 1)] = c;
+    coef[g + (k & 2) * 2 + (k & 1) + 2] = c;
+}
+
+static inline void filter_dot_c16(const int16_t *x, const int16_t *coef,
+                                  size_t taps, int32_t *re, int32_t *im)
+{
+    size_t i;
+
+#ifdef __SSE2__
+    __m128i acc = _mm_setzero_si128(), v;
+    int32_t sum[4];
+
+    for (i = 0; i < 2 * taps; i += 8) {
+        v = _mm_loadu_si128((const __m128i *)(x + i));
+        v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(3, 1, 2, 0));
+        v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(3, 1, 2, 0));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(v,
+                    _mm_load_si128((const __m128i *)(coef + i))));
+    }
+
+    _mm_storeu_si128((__m128i *)sum, acc);
+    *re = sum[0] + sum[2];
+    *im = sum[1] + sum[3];
+#else
+    int32_t r = 0, q = 0;
+
+    for (i = 0; i < 2 * taps; i += 4) {
+        r += x[i] * coef[i] + x[i + 2] * coef[i + 1];
+        q += x[i + 1] * coef[i + 2] + x[i + 3] * coef[i + 3];
+    }
+
+    *re = r;
+    *im = q;
+#endif
+}
+
+#endif
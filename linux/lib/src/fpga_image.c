@@ -0,0 +1,375 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include "libbladeRF.h"
+#include "fpga_image.h"
+#include "debug.h"
+
+static const uint8_t gzip_magic[] = { 0x1f, 0x8b };
+static const uint8_t lz4_magic[]  = { 0x04, 0x22, 0x4d, 0x18 };
+
+static fpga_image_fmt detect_fmt(const uint8_t *hdr, size_t len)
+{
+    if (len >= sizeof(gzip_magic) &&
+            !memcmp(hdr, gzip_magic, sizeof(gzip_magic)))
+        return FPGA_IMAGE_GZIP;
+
+    if (len >= sizeof(lz4_magic) &&
+            !memcmp(hdr, lz4_magic, sizeof(lz4_magic)))
+        return FPGA_IMAGE_LZ4;
+
+    return FPGA_IMAGE_RAW;
+}
+
+/* Copy len bytes at offset off of the underlying (possibly compressed) data */
+static ssize_t src_pread(struct fpga_image *img, void *buf, size_t len,
+                         size_t off)
+{
+    ssize_t n;
+
+    if (img->fd < 0) {
+        if (off >= img->mem_len)
+            return 0;
+        if (len > img->mem_len - off)
+            len = img->mem_len - off;
+        memcpy(buf, img->mem + off, len);
+        return len;
+    }
+
+    n = pread(img->fd, buf, len, off);
+    if (n < 0) {
+        dbg_printf("Failed to read image: %s\n", strerror(errno));
+        return BLADERF_ERR_IO;
+    }
+
+    return n;
+}
+
+#ifdef ENABLE_ZLIB
+static ssize_t gzip_read(struct fpga_image *img, void *buf, size_t len);
+
+/* Inflate the whole image, which has zlib check each member's CRC32 and
+ * length, and count its size */
+static int gzip_measure(struct fpga_image *img, size_t src_size)
+{
+    uint8_t *buf, isize[4];
+    uint32_t trailer;
+    ssize_t n;
+    int status;
+
+    if (src_pread(img, isize, sizeof(isize), src_size - 4) != 4)
+        return BLADERF_ERR_IO;
+    trailer = isize[0] | (isize[1] << 8) | (isize[2] << 16) |
+              ((uint32_t)isize[3] << 24);
+
+    buf = malloc(FPGA_IMAGE_INBUF_SZ);
+    if (!buf)
+        return BLADERF_ERR_MEM;
+
+    img->size = 0;
+    while ((n = gzip_read(img, buf, FPGA_IMAGE_INBUF_SZ)) > 0)
+        img->size += n;
+    free(buf);
+
+    if (n < 0)
+        return n;
+
+    /* The trailer holds the last member's length, mod 2^32 */
+    if ((uint32_t)img->member_len != trailer) {
+        dbg_printf("gzip image size does not match its trailer\n");
+        return BLADERF_ERR_INVAL;
+    }
+
+    status = fpga_image_rewind(img);
+    if (status < 0)
+        return status;
+
+    return 0;
+}
+
+static int gzip_open(struct fpga_image *img, size_t src_size)
+{
+    int status;
+
+    if (src_size < 18) {
+        dbg_printf("Truncated gzip image\n");
+        return BLADERF_ERR_INVAL;
+    }
+
+    /* In-memory images are inflated straight from the caller's buffer */
+    if (img->fd >= 0) {
+        img->inbuf = malloc(FPGA_IMAGE_INBUF_SZ);
+        if (!img->inbuf)
+            return BLADERF_ERR_MEM;
+    }
+
+    memset(&img->zs, 0, sizeof(img->zs));
+    if (inflateInit2(&img->zs, 16 + MAX_WBITS) != Z_OK) {
+        dbg_printf("inflateInit2 failed\n");
+        free(img->inbuf);
+        img->inbuf = NULL;
+        return BLADERF_ERR_UNEXPECTED;
+    }
+
+    status = gzip_measure(img, src_size);
+    if (status < 0) {
+        inflateEnd(&img->zs);
+        free(img->inbuf);
+        img->inbuf = NULL;
+    }
+
+    return status;
+}
+
+static int gzip_refill(struct fpga_image *img)
+{
+    ssize_t n;
+    size_t remaining;
+
+    if (img->fd < 0) {
+        remaining = img->mem_len - img->mem_pos;
+        if (remaining > UINT_MAX)
+            remaining = UINT_MAX;
+        img->zs.next_in = (Bytef *)img->mem + img->mem_pos;
+        img->zs.avail_in = remaining;
+        img->mem_pos += remaining;
+        img->eof = (remaining == 0);
+        return 0;
+    }
+
+    n = read(img->fd, img->inbuf, FPGA_IMAGE_INBUF_SZ);
+    if (n < 0) {
+        dbg_printf("Failed to read image: %s\n", strerror(errno));
+        return BLADERF_ERR_IO;
+    }
+    img->eof = (n == 0);
+    img->zs.next_in = img->inbuf;
+    img->zs.avail_in = n;
+    return 0;
+}
+
+static ssize_t gzip_read(struct fpga_image *img, void *buf, size_t len)
+{
+    int status;
+
+    img->zs.next_out = buf;
+    img->zs.avail_out = len;
+
+    while (img->zs.avail_out && !img->done) {
+        if (img->zs.avail_in == 0 && !img->eof) {
+            status = gzip_refill(img);
+            if (status < 0)
+                return status;
+        }
+
+        status = inflate(&img->zs, Z_NO_FLUSH);
+        if (status == Z_STREAM_END) {
+            /* The member's CRC32 and length have been checked. Another
+             * member may follow, as in concatenated .gz files. */
+            img->member_len = img->zs.total_out;
+            if (img->zs.avail_in == 0 && !img->eof) {
+                status = gzip_refill(img);
+                if (status < 0)
+                    return status;
+            }
+            if (img->zs.avail_in == 0)
+                img->done = true;
+            else if (inflateReset(&img->zs) != Z_OK)
+                return BLADERF_ERR_UNEXPECTED;
+        } else if (status == Z_BUF_ERROR && img->eof) {
+            dbg_printf("Compressed image ended unexpectedly\n");
+            return BLADERF_ERR_IO;
+        } else if (status != Z_OK && status != Z_BUF_ERROR) {
+            dbg_printf("inflate failed: %s\n",
+                       img->zs.msg ? img->zs.msg : "unknown error");
+            return BLADERF_ERR_INVAL;
+        }
+    }
+
+    return len - img->zs.avail_out;
+}
+#endif
+
+/* Common setup once the source (file or memory) has been attached */
+static int image_init(struct fpga_image *img, size_t src_size)
+{
+    uint8_t hdr[4];
+    ssize_t n;
+
+    n = src_pread(img, hdr, sizeof(hdr), 0);
+    if (n < 0)
+        return n;
+
+    img->fmt = detect_fmt(hdr, n);
+    switch (img->fmt) {
+        case FPGA_IMAGE_RAW:
+            img->size = src_size;
+            return 0;
+
+        case FPGA_IMAGE_GZIP:
+#ifdef ENABLE_ZLIB
+            return gzip_open(img, src_size);
+#else
+            dbg_printf("gzip image, but built without zlib support\n");
+            return BLADERF_ERR_INVAL;
+#endif
+
+        default:
+            dbg_printf("Unsupported compressed image format\n");
+            return BLADERF_ERR_INVAL;
+    }
+}
+
+int fpga_image_open(struct fpga_image *img, const char *path)
+{
+    struct stat st;
+    int status;
+
+    memset(img, 0, sizeof(*img));
+
+    img->fd = open(path, O_RDONLY);
+    if (img->fd < 0) {
+        dbg_printf("Failed to open %s: %s\n", path, strerror(errno));
+        return BLADERF_ERR_IO;
+    }
+
+    if (fstat(img->fd, &st) < 0) {
+        dbg_printf("Failed to stat %s: %s\n", path, strerror(errno));
+        status = BLADERF_ERR_IO;
+    } else {
+        status = image_init(img, st.st_size);
+    }
+
+    if (status < 0) {
+        close(img->fd);
+        img->fd = -1;
+    }
+
+    return status;
+}
+
+int fpga_image_open_mem(struct fpga_image *img, const void *data, size_t len)
+{
+    memset(img, 0, sizeof(*img));
+
+    img->fd = -1;
+    img->mem = data;
+    img->mem_len = len;
+
+    return image_init(img, len);
+}
+
+ssize_t fpga_image_read(struct fpga_image *img, void *buf, size_t len)
+{
+    ssize_t n;
+
+    switch (img->fmt) {
+        case FPGA_IMAGE_RAW:
+            if (img->fd < 0) {
+                n = src_pread(img, buf, len, img->mem_pos);
+                if (n > 0)
+                    img->mem_pos += n;
+            } else {
+                n = read(img->fd, buf, len);
+                if (n < 0) {
+                    dbg_printf("Failed to read image: %s\n", strerror(errno));
+                    n = BLADERF_ERR_IO;
+                }
+            }
+            break;
+
+#ifdef ENABLE_ZLIB
+        case FPGA_IMAGE_GZIP:
+            n = gzip_read(img, buf, len);
+            break;
+#endif
+
+        default:
+            n = BLADERF_ERR_INVAL;
+            break;
+    }
+
+    if (n > 0)
+        img->consumed += n;
+
+    return n;
+}
+
+int fpga_image_rewind(struct fpga_image *img)
+{
+    if (img->fd >= 0 && lseek(img->fd, 0, SEEK_SET) < 0) {
+        dbg_printf("Failed to rewind image: %s\n", strerror(errno));
+        return BLADERF_ERR_IO;
+    }
+
+    img->mem_pos = 0;
+    img->consumed = 0;
+
+#ifdef ENABLE_ZLIB
+    if (img->fmt == FPGA_IMAGE_GZIP) {
+        if (inflateReset(&img->zs) != Z_OK)
+            return BLADERF_ERR_UNEXPECTED;
+        img->zs.avail_in = 0;
+        img->eof = false;
+        img->done = false;
+    }
+#endif
+
+    return 0;
+}
+
+void fpga_image_close(struct fpga_image *img)
+{
+#ifdef ENABLE_ZLIB
+    if (img->fmt == FPGA_IMAGE_GZIP) {
+        inflateEnd(&img->zs);
+        free(img->inbuf);
+        img->inbuf = NULL;
+    }
+#endif
+
+    if (img->fd >= 0) {
+        close(img->fd);
+        img->fd = -1;
+    }
+}
+
+uint64_t fpga_image_hash_update(uint64_t hash, const void *buf, size_t len)
+{
+    const uint8_t *p = buf;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+int fpga_image_hash(struct fpga_image *img, uint64_t *hash)
+{
+    uint8_t *buf;
+    ssize_t n;
+
+    buf = malloc(FPGA_IMAGE_INBUF_SZ);
+    if (!buf)
+        return BLADERF_ERR_MEM;
+
+    *hash = FPGA_IMAGE_HASH_INIT;
+    while ((n = fpga_image_read(img, buf, FPGA_IMAGE_INBUF_SZ)) > 0)
+        *hash = fpga_image_hash_update(*hash, buf, n);
+    *hash = fpga_image_hash_final(*hash);
+
+    free(buf);
+
+    if (n < 0)
+        return n;
+
+    return fpga_image_rewind(img);
+}
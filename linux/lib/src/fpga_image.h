@@ -0,0 +1,97 @@
+#ifndef FPGA_IMAGE_H_
+#define FPGA_IMAGE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef ENABLE_ZLIB
+#include <zlib.h>
+#endif
+
+/* Input buffer size used when inflating a compressed image */
+#define FPGA_IMAGE_INBUF_SZ (16 * 1024)
+
+typedef enum {
+    FPGA_IMAGE_RAW,
+    FPGA_IMAGE_GZIP,
+    FPGA_IMAGE_LZ4
+} fpga_image_fmt;
+
+/*
+ * Sequential reader for FPGA bitstreams, backed by either a file or a
+ * caller-owned buffer. Compressed images are inflated incrementally as they
+ * are read, so the full image is never staged.
+ */
+struct fpga_image {
+    int fd;                 /* -1 for in-memory images */
+    const uint8_t *mem;
+    size_t mem_len;
+    size_t mem_pos;
+    fpga_image_fmt fmt;
+    size_t size;            /* Uncompressed size in bytes */
+    size_t consumed;        /* Uncompressed bytes handed out so far */
+#ifdef ENABLE_ZLIB
+    z_stream zs;
+    uint8_t *inbuf;
+    bool eof;               /* Compressed input exhausted */
+    bool done;              /* Last member inflated and its CRC checked */
+    size_t member_len;      /* Uncompressed length of the last member */
+#endif
+};
+
+/**
+ * Open an FPGA image file, detecting compression by its magic bytes.
+ * Compressed images are inflated once here, to size them and check their
+ * CRCs, so that a corrupt or truncated image is rejected before any of it
+ * reaches the FPGA.
+ *
+ * @return 0 on success, BLADERF_ERR_* value on failure
+ */
+int fpga_image_open(struct fpga_image *img, const char *path);
+
+/**
+ * Open an FPGA image held in memory. The buffer is not copied and must
+ * remain valid until fpga_image_close().
+ *
+ * @return 0 on success, BLADERF_ERR_* value on failure
+ */
+int fpga_image_open_mem(struct fpga_image *img, const void *data, size_t len);
+
+/**
+ * Read up to len uncompressed bytes
+ *
+ * @return number of bytes read, 0 at end of image, BLADERF_ERR_* on failure
+ */
+ssize_t fpga_image_read(struct fpga_image *img, void *buf, size_t len);
+
+/**
+ * Restart reading from the beginning of the image
+ *
+ * @return 0 on success, BLADERF_ERR_* value on failure
+ */
+int fpga_image_rewind(struct fpga_image *img);
+
+void fpga_image_close(struct fpga_image *img);
+
+/*
+ * 64-bit FNV-1a over the uncompressed image, used to identify which
+ * bitstream is loaded. Zero is reserved to mean "no image id".
+ */
+#define FPGA_IMAGE_HASH_INIT    0xcbf29ce484222325ULL
+
+uint64_t fpga_image_hash_update(uint64_t hash, const void *buf, size_t len);
+
+static inline uint64_t fpga_image_hash_final(uint64_t hash)
+{
+    return hash ? hash : 1;
+}
+
+/**
+ * Hash an entire image and rewind it
+ *
+ * @return 0 on success, BLADERF_ERR_* value on failure
+ */
+int fpga_image_hash(struct fpga_image *img, uint64_t *hash);
+
+#endif
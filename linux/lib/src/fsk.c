@@ -0,0 +1,140 @@
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "libbladeRF.h"
+#include "cordic.h"
+#include "debug.h"
+
+#define FSK_BLOCK   256     /* Samples whose angles are computed at once */
+
+/* State of fsk_demodulator.vhd's registers between calls */
+struct bladerf_fsk_demod {
+    int16_t prev_z;
+    int16_t ssd;
+};
+
+#ifdef __SSE2__
+/* Negate the lanes of v where m is all ones */
+static inline __m128i cneg16(__m128i v, __m128i m)
+{
+    return _mm_sub_epi16(_mm_xor_si128(v, m), m);
+}
+
+#define CORDIC_STAGE(i)                                                     \
+    do {                                                                    \
+        m = _mm_cmplt_epi16(y, zero);                                       \
+        dx = cneg16(_mm_srai_epi16(y, i), m);                               \
+        dy = cneg16(_mm_srai_epi16(x, i), m);                               \
+        x = _mm_add_epi16(x, dx);                                           \
+        y = _mm_sub_epi16(y, dy);                                           \
+        z = _mm_add_epi16(z, cneg16(_mm_set1_epi16(cordic_table[i]), m));   \
+    } while (0)
+
+/* cordic_vector() on eight samples, leaving their angles in z */
+static void angles8(const int16_t *samples, int16_t *z_out)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i lo, hi, x, y, z, m, both, dx, dy;
+
+    /* Deinterleave into x = I and y = Q */
+    lo = _mm_loadu_si128((const __m128i *)samples);
+    hi = _mm_loadu_si128((const __m128i *)(samples + 8));
+    x = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(lo, 16), 16),
+                        _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16));
+    y = _mm_packs_epi32(_mm_srai_epi32(lo, 16), _mm_srai_epi32(hi, 16));
+
+    /* Fold into the right half-plane: -pi if both were negative, +pi if
+     * only x was */
+    m = _mm_cmplt_epi16(x, zero);
+    both = _mm_and_si128(m, _mm_cmplt_epi16(y, zero));
+    x = cneg16(x, m);
+    y = cneg16(y, m);
+    z = _mm_and_si128(m, _mm_set1_epi16(CORDIC_PI));
+    z = cneg16(z, both);
+
+    /* Unrolled, as the shift count must be an immediate */
+    CORDIC_STAGE(0);
+    CORDIC_STAGE(1);
+    CORDIC_STAGE(2);
+    CORDIC_STAGE(3);
+    CORDIC_STAGE(4);
+    CORDIC_STAGE(5);
+    CORDIC_STAGE(6);
+    CORDIC_STAGE(7);
+    CORDIC_STAGE(8);
+    CORDIC_STAGE(9);
+    CORDIC_STAGE(10);
+
+    _mm_storeu_si128((__m128i *)z_out, z);
+}
+#endif
+
+int bladerf_fsk_demod_create(struct bladerf_fsk_demod **demod_out)
+{
+    struct bladerf_fsk_demod *demod;
+
+    demod = calloc(1, sizeof(*demod));
+    if (!demod)
+        return BLADERF_ERR_MEM;
+
+    *demod_out = demod;
+    return 0;
+}
+
+void bladerf_fsk_demod_destroy(struct bladerf_fsk_demod *demod)
+{
+    free(demod);
+}
+
+void bladerf_fsk_demod_reset(struct bladerf_fsk_demod *demod)
+{
+    demod->prev_z = 0;
+    demod->ssd = 0;
+}
+
+void bladerf_fsk_demod_process(struct bladerf_fsk_demod *demod,
+                               const int16_t *samples, int16_t *out, size_t n)
+{
+    int16_t z[FSK_BLOCK], prev = demod->prev_z, ssd = demod->ssd, delta;
+    struct cordic_xyz v;
+    size_t i, j, len;
+
+    for (i = 0; i < n; i += len) {
+        len = n - i < FSK_BLOCK ? n - i : FSK_BLOCK;
+        j = 0;
+
+#ifdef __SSE2__
+        for (; j + 8 <= len; j += 8)
+            angles8(samples + 2 * (i + j), z + j);
+#endif
+        for (; j < len; j++) {
+            v.x = samples[2 * (i + j)];
+            v.y = samples[2 * (i + j) + 1];
+            v.z = 0;
+            cordic_vector(&v);
+            z[j] = v.z;
+        }
+
+        /* Phase difference, unwrapped, into a leaky integrator. All of it
+         * wraps at 16 bits like the VHDL. */
+        for (j = 0; j < len; j++) {
+            delta = z[j] - prev;
+            prev = z[j];
+
+            if (delta > CORDIC_PI)
+                delta -= 2 * CORDIC_PI;
+            else if (delta < -CORDIC_PI)
+                delta += 2 * CORDIC_PI;
+
+            ssd = ssd - (ssd >> 4) + delta;
+            out[i + j] = ssd;
+        }
+    }
+
+    demod->prev_z = prev;
+    demod->ssd = ssd;
+}
@@ -0,0 +1,331 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "libbladeRF.h"
+#include "liblms.h"
+#include "bladerf_priv.h"
+#include "debug.h"
+
+#define IQCORR_MIN_BLOCK    64
+#define IQCORR_MAX_BLOCK    65536
+#define IQCORR_Q            14      /* Fraction bits of the Q coefficients */
+#define IQCORR_MAX_SIN      0.5     /* Largest believable phase error */
+#define IQCORR_SETTLE       4.0     /* Time constants to wait after a step */
+
+/* Raw sums over the block so far */
+struct iqcorr_sums {
+    int64_t i, q, ii, qq, iq;
+};
+
+/*
+ * Corrected samples are I' = I - dc_i and Q' = c_i * I' + c_q * (Q - dc_q),
+ * which undoes Q = g * sin(t + phi) given I = cos(t):
+ * c_i = -tan(phi), c_q = 1 / (g * cos(phi)).
+ */
+struct bladerf_iqcorr {
+    struct bladerf_iqcorr_config cfg;
+
+    int16_t dc[2];
+    int16_t coef[2];                /* c_i, c_q in Q14 */
+
+    struct iqcorr_sums sums;
+    size_t fill;                    /* Samples in sums */
+
+    bool valid;                     /* Averages hold an estimate */
+    bool dc_stale;                  /* DACs moved; take the next DC as is */
+    double mean[2], var[2], cov;
+
+    /* DAC feedback */
+    int8_t code[2];
+    int polarity[2];                /* Change in DC per code, as a sign */
+    bool stepped[2];
+    double dc_before[2];            /* |DC| when the last step was taken */
+    unsigned int holdoff;           /* Blocks until the next step */
+};
+
+int bladerf_iqcorr_create(const struct bladerf_iqcorr_config *cfg,
+                          struct bladerf_iqcorr **corr_out)
+{
+    struct bladerf_iqcorr *corr;
+
+    if (!cfg || cfg->block < IQCORR_MIN_BLOCK ||
+            cfg->block > IQCORR_MAX_BLOCK ||
+            !(cfg->alpha > 0 && cfg->alpha <= 1))
+        return BLADERF_ERR_INVAL;
+
+    corr = calloc(1, sizeof(*corr));
+    if (!corr)
+        return BLADERF_ERR_MEM;
+
+    corr->cfg = *cfg;
+    corr->polarity[0] = corr->polarity[1] = 1;
+    bladerf_iqcorr_reset(corr);
+
+    if (cfg->dev) {
+        ctrl_lock(cfg->dev);
+        lms_rxfe_get_dc_offset(cfg->dev, &corr->code[0], &corr->code[1]);
+        ctrl_unlock(cfg->dev);
+    }
+
+    *corr_out = corr;
+    return 0;
+}
+
+void bladerf_iqcorr_destroy(struct bladerf_iqcorr *corr)
+{
+    free(corr);
+}
+
+void bladerf_iqcorr_reset(struct bladerf_iqcorr *corr)
+{
+    memset(&corr->sums, 0, sizeof(corr->sums));
+    corr->fill = 0;
+    corr->valid = false;
+    corr->dc_stale = false;
+    memset(corr->mean, 0, sizeof(corr->mean));
+    memset(corr->var, 0, sizeof(corr->var));
+    corr->cov = 0;
+    corr->dc[0] = corr->dc[1] = 0;
+    corr->coef[0] = 0;
+    corr->coef[1] = 1 << IQCORR_Q;
+    corr->stepped[0] = corr->stepped[1] = false;
+    corr->holdoff = (unsigned int)ceil(IQCORR_SETTLE / corr->cfg.alpha);
+}
+
+static int16_t sat16(int32_t v)
+{
+    return v > INT16_MAX ? INT16_MAX : (v < INT16_MIN ? INT16_MIN : v);
+}
+
+/* Gather the raw statistics of n samples and correct them, in one pass */
+static void iqcorr_pass(struct bladerf_iqcorr *corr, int16_t *s, size_t n)
+{
+    const int32_t round = 1 << (IQCORR_Q - 1);
+    struct iqcorr_sums *sums = &corr->sums;
+    int32_t xi, xq, q;
+    size_t k = 0;
+
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i mask_i = _mm_set1_epi32(0xffff);
+    const __m128i vround = _mm_set1_epi32(round);
+    const __m128i dc = _mm_set1_epi32((uint16_t)corr->dc[0] |
+                                      ((uint32_t)(uint16_t)corr->dc[1] << 16));
+    const __m128i coef = _mm_set1_epi32((uint16_t)corr->coef[0] |
+                                        ((uint32_t)(uint16_t)corr->coef[1] << 16));
+    __m128i x, lo, hi, p, sign, si = zero, sq = zero;
+    __m128i sii = zero, sqq = zero, siq = zero;
+    uint64_t acc[2];
+    int32_t acc32[4];
+
+    for (; k + 4 <= n; k += 4) {
+        x = _mm_loadu_si128((const __m128i *)(s + 2 * k));
+
+        /* Raw sums. I^2, Q^2 and IQ are single products, which each fit
+         * 32 bits, accumulated in 64. */
+        lo = _mm_and_si128(x, mask_i);
+        hi = _mm_srli_epi32(x, 16);
+        si = _mm_add_epi32(si, _mm_srai_epi32(_mm_slli_epi32(x, 16), 16));
+        sq = _mm_add_epi32(sq, _mm_srai_epi32(x, 16));
+
+        p = _mm_madd_epi16(x, lo);
+        sii = _mm_add_epi64(sii, _mm_unpacklo_epi32(p, zero));
+        sii = _mm_add_epi64(sii, _mm_unpackhi_epi32(p, zero));
+
+        p = _mm_madd_epi16(hi, hi);
+        sqq = _mm_add_epi64(sqq, _mm_unpacklo_epi32(p, zero));
+        sqq = _mm_add_epi64(sqq, _mm_unpackhi_epi32(p, zero));
+
+        p = _mm_madd_epi16(x, hi);
+        sign = _mm_srai_epi32(p, 31);
+        siq = _mm_add_epi64(siq, _mm_unpacklo_epi32(p, sign));
+        siq = _mm_add_epi64(siq, _mm_unpackhi_epi32(p, sign));
+
+        /* Correct: remove DC, then one pmaddwd gives Q' from (I', Q') */
+        x = _mm_subs_epi16(x, dc);
+        p = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(x, coef), vround),
+                           IQCORR_Q);
+        p = _mm_packs_epi32(p, p);
+        x = _mm_or_si128(_mm_and_si128(x, mask_i),
+                         _mm_unpacklo_epi16(zero, p));
+        _mm_storeu_si128((__m128i *)(s + 2 * k), x);
+    }
+
+    /* The 32-bit lanes of si and sq can't overflow within a block */
+    _mm_storeu_si128((__m128i *)acc32, si);
+    sums->i += (int64_t)acc32[0] + acc32[1] + acc32[2] + acc32[3];
+    _mm_storeu_si128((__m128i *)acc32, sq);
+    sums->q += (int64_t)acc32[0] + acc32[1] + acc32[2] + acc32[3];
+    _mm_storeu_si128((__m128i *)acc, sii);
+    sums->ii += acc[0] + acc[1];
+    _mm_storeu_si128((__m128i *)acc, sqq);
+    sums->qq += acc[0] + acc[1];
+    _mm_storeu_si128((__m128i *)acc, siq);
+    sums->iq += (int64_t)(acc[0] + acc[1]);
+#endif
+
+    for (; k < n; k++) {
+        xi = s[2 * k];
+        xq = s[2 * k + 1];
+
+        sums->i += xi;
+        sums->q += xq;
+        sums->ii += xi * xi;
+        sums->qq += xq * xq;
+        sums->iq += xi * xq;
+
+        xi = sat16(xi - corr->dc[0]);
+        xq = sat16(xq - corr->dc[1]);
+        q = (xi * corr->coef[0] + xq * corr->coef[1] + round) >> IQCORR_Q;
+
+        s[2 * k] = xi;
+        s[2 * k + 1] = sat16(q);
+    }
+}
+
+/* Step a DAC one code towards zero DC, once the last step has settled */
+static void iqcorr_feedback(struct bladerf_iqcorr *corr)
+{
+    bool step = false;
+    double dc;
+    int c, code;
+
+    if (corr->holdoff) {
+        corr->holdoff--;
+        return;
+    }
+
+    for (c = 0; c < 2; c++) {
+        dc = corr->mean[c];
+
+        /* A step that made things worse means the DAC runs the other way */
+        if (corr->stepped[c]) {
+            if (fabs(dc) > corr->dc_before[c])
+                corr->polarity[c] = -corr->polarity[c];
+            corr->stepped[c] = false;
+        }
+
+        if (fabs(dc) <= corr->cfg.dc_bound)
+            continue;
+
+        code = corr->code[c] - (dc > 0 ? corr->polarity[c] : -corr->polarity[c]);
+        if (code < -63 || code > 63)
+            continue;
+
+        corr->code[c] = code;
+        corr->stepped[c] = true;
+        corr->dc_before[c] = fabs(dc);
+        step = true;
+    }
+
+    if (step) {
+        dbg_printf("iqcorr: DC %.1f, %.1f; DACs now %d, %d\n",
+                   corr->mean[0], corr->mean[1], corr->code[0], corr->code[1]);
+
+        ctrl_lock(corr->cfg.dev);
+        lms_rxfe_set_dc_offset(corr->cfg.dev, corr->code[0], corr->code[1]);
+        ctrl_unlock(corr->cfg.dev);
+
+        corr->dc_stale = true;
+        corr->holdoff = (unsigned int)ceil(IQCORR_SETTLE / corr->cfg.alpha);
+    }
+}
+
+/* Fold a complete block into the running averages and refresh the
+ * coefficients */
+static void iqcorr_update(struct bladerf_iqcorr *corr)
+{
+    const struct iqcorr_sums *sums = &corr->sums;
+    const double n = corr->fill, a = corr->cfg.alpha;
+    double mean[2], var[2], cov, sinp, cosp, cq;
+    int c;
+
+    mean[0] = sums->i / n;
+    mean[1] = sums->q / n;
+    var[0] = sums->ii / n - mean[0] * mean[0];
+    var[1] = sums->qq / n - mean[1] * mean[1];
+    cov = sums->iq / n - mean[0] * mean[1];
+
+    if (!corr->valid) {
+        memcpy(corr->mean, mean, sizeof(mean));
+        memcpy(corr->var, var, sizeof(var));
+        corr->cov = cov;
+        corr->valid = true;
+    } else {
+        for (c = 0; c < 2; c++) {
+            if (corr->dc_stale)
+                corr->mean[c] = mean[c];
+            else
+                corr->mean[c] += a * (mean[c] - corr->mean[c]);
+            corr->var[c] += a * (var[c] - corr->var[c]);
+        }
+        corr->cov += a * (cov - corr->cov);
+    }
+    corr->dc_stale = false;
+
+    memset(&corr->sums, 0, sizeof(corr->sums));
+    corr->fill = 0;
+
+    if (corr->cfg.dev)
+        iqcorr_feedback(corr);
+
+    corr->dc[0] = sat16(lrint(corr->mean[0]));
+    corr->dc[1] = sat16(lrint(corr->mean[1]));
+
+    if (!corr->cfg.correct_iq || !(corr->var[0] > 0 && corr->var[1] > 0))
+        return;
+
+    sinp = corr->cov / sqrt(corr->var[0] * corr->var[1]);
+    if (fabs(sinp) > IQCORR_MAX_SIN)
+        return;
+
+    cosp = sqrt(1 - sinp * sinp);
+    cq = sqrt(corr->var[0] / corr->var[1]) / cosp;
+    if (cq >= 2.0)
+        return;
+
+    corr->coef[0] = (int16_t)lrint(-sinp / cosp * (1 << IQCORR_Q));
+    corr->coef[1] = (int16_t)lrint(cq * (1 << IQCORR_Q));
+}
+
+void bladerf_iqcorr_process(struct bladerf_iqcorr *corr, int16_t *samples,
+                            size_t n)
+{
+    size_t len;
+
+    while (n) {
+        len = corr->cfg.block - corr->fill;
+        if (len > n)
+            len = n;
+
+        iqcorr_pass(corr, samples, len);
+        corr->fill += len;
+        samples += 2 * len;
+        n -= len;
+
+        if (corr->fill == corr->cfg.block)
+            iqcorr_update(corr);
+    }
+}
+
+void bladerf_iqcorr_get_stats(struct bladerf_iqcorr *corr,
+                              struct bladerf_iqcorr_stats *stats)
+{
+    double sinp = 0;
+
+    if (corr->valid && corr->var[0] > 0 && corr->var[1] > 0)
+        sinp = corr->cov / sqrt(corr->var[0] * corr->var[1]);
+
+    stats->dc_i = corr->mean[0];
+    stats->dc_q = corr->mean[1];
+    stats->gain = corr->valid && corr->var[0] > 0 ?
+                  sqrt(corr->var[1] / corr->var[0]) : 1;
+    stats->phase = asin(sinp > 1 ? 1 : (sinp < -1 ? -1 : sinp)) * 180 / M_PI;
+    stats->lms_dc_i = corr->code[0];
+    stats->lms_dc_q = corr->code[1];
+}
@@ -251,10 +251,11 @@ void lms_rxvga1_set_gain(struct bladerf *dev, uint8_t gain)
         fprintf( stderr, "%s: %d being clamped to 120\n", __FUNCTION__, gain ) ;
         gain = 120 ;
     }
+    // RFB_TIA_RXFE is the 7-bit field in [6:0]
     lms_spi_read( dev, 0x76, &data ) ;
-    data &= ~(0x3f) ;
+    data &= ~(0x7f) ;
     data |= gain ;
-    lms_spi_write( dev, 0x76, gain&0x3f ) ;
+    lms_spi_write( dev, 0x76, data ) ;
     return ;
 }
 
@@ -263,7 +264,7 @@ void lms_rxvga1_get_gain(struct bladerf *dev, uint8_t *gain)
 {
     uint8_t data ;
     lms_spi_read( dev, 0x76, &data ) ;
-    *gain = data&0x3f ;
+    *gain = data&0x7f ;
     return ;
 }
 
@@ -708,31 +709,24 @@ void lms_get_frequency( struct bladerf *dev, lms_module_t mod, struct lms_freq *
     f->freqsel = (data>>2) ;
     f->x = 1 << ((f->freqsel&7)-3);
     f->reference = 38400000 ;
+    lms_spi_read( dev, base+9, &data ) ;
+    f->vcocap = data&0x3f ;
+    f->freq = (uint32_t)(((uint64_t)((f->nint<<23) + f->nfrac)) * (f->reference/f->x) >>23) ;
     return ;
 }
 
-// Set the frequency of a module
-void lms_set_frequency( struct bladerf *dev, lms_module_t mod, uint32_t freq )
+// Calculate the PLL settings for a frequency without touching the device
+void lms_calculate_tuning_params( uint32_t freq, struct lms_freq *f )
 {
-    // Select the base address based on which PLL we are configuring
-    uint8_t base = (mod == RX) ? 0x20 : 0x10 ;
     uint32_t lfreq = freq ;
     uint8_t freqsel = bands[0].value ;
     uint16_t nint ;
     uint32_t nfrac ;
-    struct lms_freq f ;
-    uint8_t data ;
     uint32_t x;
     uint32_t reference = 38400000 ;
     uint64_t vcofreq ;
     uint32_t left ;
 
-
-    // Turn on the DSMs
-    lms_spi_read( dev, 0x09, &data ) ;
-    data |= 0x05 ;
-    lms_spi_write( dev, 0x09, data ) ;
-
     // Figure out freqsel
     if( lfreq < bands[0].low )
     {
@@ -787,28 +781,59 @@ void lms_set_frequency( struct bladerf *dev, lms_module_t mod, uint32_t freq )
     }
     //nfrac = (lfreq>>2) - (lfreq>>5) - (lfreq>>12) ;
     //nfrac <<= ((freqsel&7)-3) ;
-    f.x = x ;
-    f.nint = nint ;
-    f.nfrac = nfrac ;
-    f.freqsel = freqsel ;
-    f.reference = reference ;
-    lms_print_frequency( &f ) ;
+    f->x = x ;
+    f->nint = nint ;
+    f->nfrac = nfrac ;
+    f->freqsel = freqsel ;
+    f->reference = reference ;
+    f->vcocap = LMS_VCOCAP_UNKNOWN ;
+    f->freq = freq ;
+}
+
+// Write a VCOCAP value and return the VTUNE comparator bits for it
+static uint8_t lms_try_vcocap( struct bladerf *dev, uint8_t base, uint8_t data, uint8_t vcocap )
+{
+    uint8_t vtune ;
+    data &= ~(0x3f) ;
+    data |= vcocap ;
+    lms_spi_write( dev, base+9, data ) ;
+    lms_spi_read( dev, base+10, &vtune ) ;
+    if( (vtune&0xc0) == 0xc0 )
+    {
+        lms_printf( "MESSED UP!!!!!\n" ) ;
+    }
+    return vtune & 0xc0 ;
+}
+
+// Set PLL settings from lms_calculate_tuning_params()
+void lms_set_precalculated_frequency( struct bladerf *dev, lms_module_t mod, struct lms_freq *f )
+{
+    // Select the base address based on which PLL we are configuring
+    uint8_t base = (mod == RX) ? 0x20 : 0x10 ;
+    uint8_t data ;
+
+    // Turn on the DSMs
+    lms_spi_read( dev, 0x09, &data ) ;
+    data |= 0x05 ;
+    lms_spi_write( dev, 0x09, data ) ;
+
+    lms_print_frequency( f ) ;
 
     // Program freqsel, selout (rx only), nint and nfrac
     if( mod == RX )
     {
-        lms_spi_write( dev, base+5, freqsel<<2 | (freq < 1500000000 ? 1 : 2 ) ) ;
+        lms_spi_write( dev, base+5, f->freqsel<<2 | (f->freq < 1500000000 ? 1 : 2 ) ) ;
     } else {
         //		lms_spi_write( dev, base+5, freqsel<<2 ) ;
-        lms_spi_write( dev, base+5, freqsel<<2 | (freq < 1500000000 ? 1 : 2 ) ) ;
+        lms_spi_write( dev, base+5, f->freqsel<<2 | (f->freq < 1500000000 ? 1 : 2 ) ) ;
     }
-    data = nint>>1 ;// lms_printf( "%x\n", data ) ;
+    data = f->nint>>1 ;// lms_printf( "%x\n", data ) ;
     lms_spi_write( dev, base+0, data ) ;
-    data = ((nint&1)<<7) | ((nfrac>>16)&0x7f) ;//  lms_printf( "%x\n", data ) ;
+    data = ((f->nint&1)<<7) | ((f->nfrac>>16)&0x7f) ;//  lms_printf( "%x\n", data ) ;
     lms_spi_write( dev, base+1, data ) ;
-    data = ((nfrac>>8)&0xff) ;//  lms_printf( "%x\n", data ) ;
+    data = ((f->nfrac>>8)&0xff) ;//  lms_printf( "%x\n", data ) ;
     lms_spi_write( dev, base+2, data ) ;
-    data = (nfrac&0xff) ;//  lms_printf( "%x\n", data ) ;
+    data = (f->nfrac&0xff) ;//  lms_printf( "%x\n", data ) ;
     lms_spi_write( dev, base+3, data ) ;
 
     // Set the PLL Ichp, Iup and Idn currents
@@ -825,39 +850,40 @@ void lms_set_frequency( struct bladerf *dev, lms_module_t mod, uint32_t freq )
     data &= ~(0x1f) ;
     lms_spi_write( dev, base+8, data ) ;
 
-    // Loop through the VCOCAP to figure out optimal values
     lms_spi_read( dev, base+9, &data ) ;
-    data &= ~(0x3f) ;
+
+    // A VCOCAP found by an earlier tune to this frequency is kept if VTUNE
+    // is still within its window
+    if( f->vcocap == LMS_VCOCAP_UNKNOWN || lms_try_vcocap( dev, base, data, f->vcocap ) != 0 )
     {
-        uint8_t i, vtune, low = 64, high = 0;
-        for( i = 0 ; i < 64 ; i++ )
+        // VTUNE falls as VCOCAP rises: VTUNE_H (0x80) is set below the
+        // usable window and VTUNE_L (0x40) above it. Bisect for both
+        // edges rather than stepping through all 64 values.
+        uint8_t lo, hi, mid, low, high ;
+
+        // Last VCOCAP with VTUNE_H set
+        lo = 0 ; hi = 64 ;
+        while( hi - lo > 1 )
         {
-            data &= ~(0x3f) ;
-            data |= i ;
-            lms_spi_write( dev, base+9, data ) ;
-            lms_spi_read( dev, base+10, &vtune ) ;
-            if( (vtune&0xc0) == 0xc0 )
-            {
-                lms_printf( "MESSED UP!!!!!\n" ) ;
-            }
-            if( vtune&0x80 )
-            {
-                //lms_printf( "Setting HIGH\n" ) ;
-                high = i ;
-            }
-            if( (vtune&0x40) && low == 64 )
-            {
-                low = i ;
-                break ;
-            }
+            mid = (lo + hi) >> 1 ;
+            if( lms_try_vcocap( dev, base, data, mid ) & 0x80 ) lo = mid ;
+            else hi = mid ;
+        }
+        high = lo ;
+
+        // First VCOCAP with VTUNE_L set, or 64 if there is none
+        lo = high ; hi = 64 ;
+        while( lo < hi )
+        {
+            mid = (lo + hi) >> 1 ;
+            if( lms_try_vcocap( dev, base, data, mid ) & 0x40 ) hi = mid ;
+            else lo = mid + 1 ;
         }
-        lms_printf( "LOW: %x HIGH: %x VCOCAP: %x\n", low, high, (low+high)>>1 ) ;
-        data &= ~(0x3f) ;
-        data |= ((low+high)>>1) ;
-        lms_spi_write( dev, base+9, data ) ;
-        lms_spi_write( dev, base+9, data ) ;
-        lms_spi_read( dev, base+10, &vtune ) ;
-        lms_printf( "VTUNE: %x\n", vtune&0xc0 ) ;
+        low = lo ;
+
+        f->vcocap = (low+high)>>1 ;
+        lms_printf( "LOW: %x HIGH: %x VCOCAP: %x\n", low, high, f->vcocap ) ;
+        lms_printf( "VTUNE: %x\n", lms_try_vcocap( dev, base, data, f->vcocap ) ) ;
     }
 
     // Turn off the DSMs
@@ -868,6 +894,15 @@ void lms_set_frequency( struct bladerf *dev, lms_module_t mod, uint32_t freq )
     return ;
 }
 
+// Set the frequency of a module
+void lms_set_frequency( struct bladerf *dev, lms_module_t mod, uint32_t freq )
+{
+    struct lms_freq f ;
+    lms_calculate_tuning_params( freq, &f ) ;
+    lms_set_precalculated_frequency( dev, mod, &f ) ;
+    return ;
+}
+
 void lms_dump_registers(struct bladerf *dev)
 {
     uint8_t data,i;
@@ -883,13 +918,13 @@ void lms_calibrate_dc(struct bladerf *dev)
 {
     // RX path
     lms_spi_write( dev, 0x09, 0x8c ) ; // CLK_EN[3]
-    lms_spi_write( dev, 0x43, 0x08 ) ; // I filter
-    lms_spi_write( dev, 0x43, 0x28 ) ; // Start Calibration
-    lms_spi_write( dev, 0x43, 0x08 ) ; // Stop calibration
+    lms_spi_write( dev, 0x53, 0x08 ) ; // I filter
+    lms_spi_write( dev, 0x53, 0x28 ) ; // Start Calibration
+    lms_spi_write( dev, 0x53, 0x08 ) ; // Stop calibration
 
-    lms_spi_write( dev, 0x43, 0x09 ) ; // Q Filter
-    lms_spi_write( dev, 0x43, 0x29 ) ;
-    lms_spi_write( dev, 0x43, 0x09 ) ;
+    lms_spi_write( dev, 0x53, 0x09 ) ; // Q Filter
+    lms_spi_write( dev, 0x53, 0x29 ) ;
+    lms_spi_write( dev, 0x53, 0x09 ) ;
 
     lms_spi_write( dev, 0x09, 0x84 ) ;
 
@@ -940,6 +975,107 @@ void lms_calibrate_dc(struct bladerf *dev)
     return ;
 }
 
+// DC calibration modules: base address, CLK_EN bit and number of DC_ADDRs.
+// The order matches the fields of struct lms_dc_cals.
+static const struct {
+    uint8_t base, clk_en, n ;
+} lms_dc_modules[] = {
+    { 0x50, 1<<3, 2 },  // RX LPF
+    { 0x60, 1<<4, 5 },  // RXVGA2
+    { 0x30, 1<<1, 2 },  // TX LPF
+} ;
+
+static uint8_t *lms_dc_cal_field( struct lms_dc_cals *cals, int module )
+{
+    switch( module ) {
+        case 0: return cals->rx_lpf ;
+        case 1: return cals->rxvga2 ;
+        default: return cals->tx_lpf ;
+    }
+}
+
+// Read back the DC_REGVAL of every DC calibration register
+void lms_get_dc_cals( struct bladerf *dev, struct lms_dc_cals *cals )
+{
+    uint8_t data, *vals ;
+    int m, i ;
+    for( m = 0 ; m < 3 ; m++ ) {
+        vals = lms_dc_cal_field( cals, m ) ;
+        for( i = 0 ; i < lms_dc_modules[m].n ; i++ ) {
+            // DC_SRESET stays high, select DC_ADDR and read DC_REGVAL
+            lms_spi_write( dev, lms_dc_modules[m].base + 3, 0x08 | i ) ;
+            lms_spi_read( dev, lms_dc_modules[m].base, &data ) ;
+            vals[i] = data & 0x3f ;
+        }
+    }
+    return ;
+}
+
+// Load DC calibration values through DC_CNTVAL and DC_LOAD. With prev, only
+// the values that differ from it are loaded.
+void lms_set_dc_cals( struct bladerf *dev, const struct lms_dc_cals *cals,
+                      const struct lms_dc_cals *prev )
+{
+    struct lms_dc_cals want = *cals, had ;
+    uint8_t clk, en = 0, *vals, *old ;
+    int m, i ;
+    if( prev ) had = *prev ;
+    for( m = 0 ; m < 3 ; m++ ) en |= lms_dc_modules[m].clk_en ;
+    lms_spi_read( dev, 0x09, &clk ) ;
+    lms_spi_write( dev, 0x09, clk | en ) ;
+    for( m = 0 ; m < 3 ; m++ ) {
+        vals = lms_dc_cal_field( &want, m ) ;
+        old = prev ? lms_dc_cal_field( &had, m ) : NULL ;
+        for( i = 0 ; i < lms_dc_modules[m].n ; i++ ) {
+            if( old && old[i] == vals[i] ) continue ;
+            lms_spi_write( dev, lms_dc_modules[m].base + 2, vals[i] & 0x3f ) ;
+            lms_spi_write( dev, lms_dc_modules[m].base + 3, 0x18 | i ) ;
+            lms_spi_write( dev, lms_dc_modules[m].base + 3, 0x08 | i ) ;
+        }
+    }
+    lms_spi_write( dev, 0x09, clk ) ;
+    return ;
+}
+
+// Sign-magnitude DCOFF_x_RXFE code, bit 6 being the sign
+static int8_t lms_rxfe_dc_decode( uint8_t data )
+{
+    return data&0x40 ? -(int8_t)(data&0x3f) : (int8_t)(data&0x3f) ;
+}
+
+static uint8_t lms_rxfe_dc_encode( int8_t offset )
+{
+    if( offset > 63 ) offset = 63 ;
+    if( offset < -63 ) offset = -63 ;
+    return offset < 0 ? 0x40 | (uint8_t)-offset : (uint8_t)offset ;
+}
+
+// Get the RX front end DC offset cancellation DACs
+void lms_rxfe_get_dc_offset( struct bladerf *dev, int8_t *i, int8_t *q )
+{
+    uint8_t data ;
+    lms_spi_read( dev, 0x71, &data ) ;
+    *i = lms_rxfe_dc_decode( data ) ;
+    lms_spi_read( dev, 0x72, &data ) ;
+    *q = lms_rxfe_dc_decode( data ) ;
+    return ;
+}
+
+// Set the RX front end DC offset cancellation DACs, keeping the LNA load bits
+void lms_rxfe_set_dc_offset( struct bladerf *dev, int8_t i, int8_t q )
+{
+    uint8_t data ;
+    lms_spi_read( dev, 0x71, &data ) ;
+    data &= ~(0x7f) ;
+    data |= lms_rxfe_dc_encode( i ) ;
+    lms_spi_write( dev, 0x71, data ) ;
+    lms_spi_read( dev, 0x72, &data ) ;
+    data &= ~(0x7f) ;
+    data |= lms_rxfe_dc_encode( q ) ;
+    lms_spi_write( dev, 0x72, data ) ;
+    return ;
+}
+
 void lms_lpf_init(struct bladerf *dev)
 {
     lms_spi_write( dev, 0x06, 0x0d ) ;
@@ -0,0 +1,264 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "libbladeRF.h"
+#include "filter.h"
+#include "debug.h"
+
+#define MOD_MAX_SPS     64
+#define MOD_MAX_SPAN    64
+
+struct bladerf_mod {
+    struct bladerf_mod_config cfg;
+    unsigned int bits_per_sym;
+    float points[16][2];        /* Indexed by symbol value */
+
+    size_t taps;                /* Per phase, padded to FILTER_TAP_ALIGN */
+    float *coef;                /* sps phases of 2 * taps, oldest first */
+    float *hist;                /* Symbols, written twice; 2 * 2 * taps */
+    size_t pos;
+    float scale;                /* Filter output to int16 */
+
+    uint32_t carry;             /* Bits of a partial symbol */
+    unsigned int carry_bits;
+};
+
+/* Root raised cosine at t symbol periods from the peak */
+static double rrc(double t, double beta)
+{
+    double d;
+
+    if (fabs(t) < 1e-9)
+        return 1.0 - beta + 4.0 * beta / M_PI;
+
+    if (fabs(fabs(t) - 1.0 / (4.0 * beta)) < 1e-9)
+        return beta / M_SQRT2 *
+               ((1.0 + 2.0 / M_PI) * sin(M_PI / (4.0 * beta)) +
+                (1.0 - 2.0 / M_PI) * cos(M_PI / (4.0 * beta)));
+
+    d = 4.0 * beta * t;
+    return (sin(M_PI * t * (1.0 - beta)) +
+            d * cos(M_PI * t * (1.0 + beta))) /
+           (M_PI * t * (1.0 - d * d));
+}
+
+static unsigned int gray(unsigned int i)
+{
+    return i ^ (i >> 1);
+}
+
+/* Gray-coded constellations, scaled to a peak magnitude of 1 */
+static int init_points(struct bladerf_mod *mod)
+{
+    /* 16-QAM levels for each 2-bit Gray code */
+    static const float qam16_level[4] = { -3, -1, 3, 1 };
+    unsigned int i, n;
+
+    switch (mod->cfg.modulation) {
+        case BLADERF_MOD_BPSK:
+            mod->bits_per_sym = 1;
+            mod->points[0][0] = 1;
+            mod->points[1][0] = -1;
+            break;
+
+        case BLADERF_MOD_QPSK:
+            mod->bits_per_sym = 2;
+            for (i = 0; i < 4; i++) {
+                mod->points[i][0] = (i & 2 ? -1 : 1) * M_SQRT1_2;
+                mod->points[i][1] = (i & 1 ? -1 : 1) * M_SQRT1_2;
+            }
+            break;
+
+        case BLADERF_MOD_8PSK:
+            mod->bits_per_sym = 3;
+            for (i = 0, n = 8; i < n; i++) {
+                mod->points[gray(i)][0] = cos(2.0 * M_PI * i / n);
+                mod->points[gray(i)][1] = sin(2.0 * M_PI * i / n);
+            }
+            break;
+
+        case BLADERF_MOD_16QAM:
+            mod->bits_per_sym = 4;
+            for (i = 0; i < 16; i++) {
+                mod->points[i][0] = qam16_level[i >> 2] / (3 * M_SQRT2);
+                mod->points[i][1] = qam16_level[i & 3] / (3 * M_SQRT2);
+            }
+            break;
+
+        default:
+            return BLADERF_ERR_INVAL;
+    }
+
+    return 0;
+}
+
+static int init_filter(struct bladerf_mod *mod)
+{
+    const unsigned int sps = mod->cfg.sps;
+    const size_t len = mod->cfg.span * sps + 1;
+    double *h, energy = 0, worst = 0, sum, peak;
+    size_t p, j, k;
+    float c;
+
+    h = malloc(len * sizeof(h[0]));
+    if (!h)
+        return BLADERF_ERR_MEM;
+
+    for (k = 0; k < len; k++) {
+        h[k] = rrc(((double)k - (len - 1) / 2.0) / sps, mod->cfg.rolloff);
+        energy += h[k] * h[k];
+    }
+
+    /* Interpolator phase p computes output p of each symbol period from
+     * h[p], h[p + sps], ... Taps are stored oldest symbol first and padded
+     * with leading zeros. */
+    mod->taps = filter_align_taps((len + sps - 1) / sps);
+    if (posix_memalign((void **)&mod->coef, 16,
+                       sps * 2 * mod->taps * sizeof(float))) {
+        free(h);
+        return BLADERF_ERR_MEM;
+    }
+
+    for (p = 0; p < sps; p++) {
+        for (j = 0, sum = 0; j < mod->taps; j++) {
+            k = p + (mod->taps - 1 - j) * sps;
+            c = k < len ? h[k] / sqrt(energy) : 0;
+            mod->coef[p * 2 * mod->taps + 2 * j] = c;
+            mod->coef[p * 2 * mod->taps + 2 * j + 1] = c;
+            sum += fabs(c);
+        }
+        if (sum > worst)
+            worst = sum;
+    }
+
+    /* amplitude 1.0 is the most that no symbol sequence can clip */
+    for (k = 0, peak = 0; k < (1u << mod->bits_per_sym); k++) {
+        peak = fmax(peak, fabs(mod->points[k][0]));
+        peak = fmax(peak, fabs(mod->points[k][1]));
+    }
+    mod->scale = mod->cfg.amplitude * 32767.0 / (worst * peak);
+
+    free(h);
+    return 0;
+}
+
+int bladerf_mod_create(const struct bladerf_mod_config *cfg,
+                       struct bladerf_mod **mod_out)
+{
+    struct bladerf_mod *mod;
+    int status;
+
+    if (!cfg || cfg->sps < 2 || cfg->sps > MOD_MAX_SPS ||
+            cfg->span < 1 || cfg->span > MOD_MAX_SPAN ||
+            !(cfg->rolloff > 0 && cfg->rolloff <= 1) ||
+            !(cfg->amplitude > 0 && cfg->amplitude <= 1))
+        return BLADERF_ERR_INVAL;
+
+    mod = calloc(1, sizeof(*mod));
+    if (!mod)
+        return BLADERF_ERR_MEM;
+
+    mod->cfg = *cfg;
+
+    status = init_points(mod);
+    if (status == 0)
+        status = init_filter(mod);
+    if (status)
+        goto error;
+
+    mod->hist = calloc(2 * 2 * mod->taps, sizeof(float));
+    if (!mod->hist) {
+        status = BLADERF_ERR_MEM;
+        goto error;
+    }
+
+    *mod_out = mod;
+    return 0;
+
+error:
+    bladerf_mod_destroy(mod);
+    return status;
+}
+
+void bladerf_mod_destroy(struct bladerf_mod *mod)
+{
+    if (mod) {
+        free(mod->coef);
+        free(mod->hist);
+        free(mod);
+    }
+}
+
+void bladerf_mod_reset(struct bladerf_mod *mod)
+{
+    memset(mod->hist, 0, 2 * 2 * mod->taps * sizeof(float));
+    mod->pos = 0;
+    mod->carry = 0;
+    mod->carry_bits = 0;
+}
+
+static int16_t to_int16(float v)
+{
+    long s = lrintf(v);
+    return s > INT16_MAX ? INT16_MAX : (s < INT16_MIN ? INT16_MIN : s);
+}
+
+/* Push one symbol and run every interpolator phase over the history */
+static void mod_symbol(struct bladerf_mod *mod, float re, float im,
+                       int16_t *out)
+{
+    const size_t taps = mod->taps;
+    const float *win, *coef = mod->coef;
+    unsigned int p;
+    float yr, yi;
+
+    /* Each symbol is stored in both halves so the newest taps symbols are
+     * always contiguous */
+    mod->hist[2 * mod->pos] = mod->hist[2 * (mod->pos + taps)] = re;
+    mod->hist[2 * mod->pos + 1] = mod->hist[2 * (mod->pos + taps) + 1] = im;
+    win = mod->hist + 2 * (mod->pos + 1);
+    mod->pos = mod->pos + 1 == taps ? 0 : mod->pos + 1;
+
+    for (p = 0; p < mod->cfg.sps; p++, coef += 2 * taps) {
+        filter_dot_cf32(win, coef, taps, &yr, &yi);
+        out[2 * p] = to_int16(yr * mod->scale);
+        out[2 * p + 1] = to_int16(yi * mod->scale);
+    }
+}
+
+size_t bladerf_mod_process(struct bladerf_mod *mod, const uint8_t *bits,
+                           size_t nbits, int16_t *out)
+{
+    const unsigned int bps = mod->bits_per_sym;
+    size_t b, written = 0;
+    const float *pt;
+
+    for (b = 0; b < nbits; b++) {
+        mod->carry = (mod->carry << 1) | ((bits[b >> 3] >> (7 - (b & 7))) & 1);
+        if (++mod->carry_bits < bps)
+            continue;
+
+        pt = mod->points[mod->carry];
+        mod_symbol(mod, pt[0], pt[1], out + 2 * written);
+        written += mod->cfg.sps;
+
+        mod->carry = 0;
+        mod->carry_bits = 0;
+    }
+
+    return written;
+}
+
+size_t bladerf_mod_flush(struct bladerf_mod *mod, int16_t *out)
+{
+    unsigned int i;
+
+    for (i = 0; i < mod->cfg.span; i++)
+        mod_symbol(mod, 0, 0, out + 2 * i * mod->cfg.sps);
+
+    mod->carry = 0;
+    mod->carry_bits = 0;
+
+    return mod->cfg.span * mod->cfg.sps;
+}
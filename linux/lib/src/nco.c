@@ -0,0 +1,278 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "libbladeRF.h"
+#include "cordic.h"
+#include "debug.h"
+
+#define NCO_PHASES      (2 * CORDIC_PI)     /* One cycle */
+#define NCO_MASK        (NCO_PHASES - 1)
+#define NCO_AMPLITUDE   1234                /* CORDIC input in nco.vhd */
+
+/* The accumulator is 32 bits; nco.vhd's phase is its top 13 */
+#define NCO_ACC_SHIFT   (32 - CORDIC_STAGES - 1)
+
+/* The mixers interpolate linearly between MIX_POINTS per cycle, which
+ * keeps the error around 5e-6 of full scale */
+#define MIX_BITS        10
+#define MIX_POINTS      (1 << MIX_BITS)
+#define MIX_FRAC_BITS   (32 - MIX_BITS)
+
+/*
+ * nco.vhd feeds a phase in [-pi, pi] through the CORDIC, so its output is a
+ * function of the phase alone. Tabulating it for every phase gives the
+ * same bits as the FPGA for a table lookup per sample. Both +pi and -pi
+ * fold to the same point, so the table is indexed by phase mod 2pi.
+ *
+ * The CORDIC's 13-bit phase and 11-bit angles are too coarse for mixing,
+ * so the mixers use a separate table of true sines. Each table has an
+ * extra point at the end so that interpolation never has to wrap.
+ */
+static struct {
+    int16_t raw[NCO_PHASES][2];         /* nco.vhd outputs */
+    int16_t q15[MIX_POINTS + 1][2];     /* Q15 (cos, sin) */
+    float cos_f[MIX_POINTS + 1];
+    float sin_f[MIX_POINTS + 1];
+} nco_lut;
+
+static pthread_once_t nco_lut_once = PTHREAD_ONCE_INIT;
+
+struct bladerf_nco {
+    uint32_t phase;                 /* Wraps at one cycle */
+    uint32_t dphase;
+};
+
+static uint32_t pack16(int16_t lo, int16_t hi)
+{
+    return (uint16_t)lo | ((uint32_t)(uint16_t)hi << 16);
+}
+
+static void nco_lut_init(void)
+{
+    struct cordic_xyz v;
+    double w;
+    int i;
+
+    for (i = 0; i < NCO_PHASES; i++) {
+        v.x = NCO_AMPLITUDE;
+        v.y = 0;
+        v.z = i <= CORDIC_PI ? i : i - NCO_PHASES;
+        cordic_rotate(&v);
+
+        nco_lut.raw[i][0] = v.x;
+        nco_lut.raw[i][1] = v.y;
+    }
+
+    for (i = 0; i <= MIX_POINTS; i++) {
+        w = 2 * M_PI * i / MIX_POINTS;
+        nco_lut.q15[i][0] = (int16_t)lrint(cos(w) * 32767.0);
+        nco_lut.q15[i][1] = (int16_t)lrint(sin(w) * 32767.0);
+        nco_lut.cos_f[i] = (float)cos(w);
+        nco_lut.sin_f[i] = (float)sin(w);
+    }
+}
+
+int bladerf_nco_create(int16_t dphase, struct bladerf_nco **nco_out)
+{
+    struct bladerf_nco *nco;
+
+    if (dphase > BLADERF_NCO_PI || dphase < -BLADERF_NCO_PI)
+        return BLADERF_ERR_RANGE;
+
+    if (pthread_once(&nco_lut_once, nco_lut_init))
+        return BLADERF_ERR_UNEXPECTED;
+
+    nco = calloc(1, sizeof(*nco));
+    if (!nco)
+        return BLADERF_ERR_MEM;
+
+    nco->dphase = (uint32_t)dphase << NCO_ACC_SHIFT;
+
+    *nco_out = nco;
+    return 0;
+}
+
+void bladerf_nco_destroy(struct bladerf_nco *nco)
+{
+    free(nco);
+}
+
+int bladerf_nco_set_dphase(struct bladerf_nco *nco, int16_t dphase)
+{
+    if (dphase > BLADERF_NCO_PI || dphase < -BLADERF_NCO_PI)
+        return BLADERF_ERR_RANGE;
+
+    nco->dphase = (uint32_t)dphase << NCO_ACC_SHIFT;
+    return 0;
+}
+
+int bladerf_nco_set_frequency(struct bladerf_nco *nco, double ratio)
+{
+    if (!(ratio >= -0.5 && ratio <= 0.5))
+        return BLADERF_ERR_RANGE;
+
+    nco->dphase = (uint32_t)llrint(ratio * 4294967296.0);
+    return 0;
+}
+
+void bladerf_nco_reset(struct bladerf_nco *nco)
+{
+    nco->phase = 0;
+}
+
+void bladerf_nco_generate(struct bladerf_nco *nco, int16_t *out, size_t n)
+{
+    uint32_t ph = nco->phase, d = nco->dphase, k;
+    size_t i;
+
+    /* Like the VHDL, each output uses the phase before it is advanced */
+    for (i = 0; i < n; i++, ph += d) {
+        k = ph >> NCO_ACC_SHIFT;
+        out[2 * i] = nco_lut.raw[k][0];
+        out[2 * i + 1] = nco_lut.raw[k][1];
+    }
+
+    nco->phase = ph;
+}
+
+static int16_t sat16(int32_t v)
+{
+    return v > INT16_MAX ? INT16_MAX : (v < INT16_MIN ? INT16_MIN : v);
+}
+
+/* Interpolate the Q15 table at a phase, with 16 bits of fraction */
+static void mix_q15(uint32_t ph, int32_t *c, int32_t *s)
+{
+    const int16_t *p = nco_lut.q15[ph >> MIX_FRAC_BITS];
+    int32_t f = (ph >> (MIX_FRAC_BITS - 16)) & 0xffff;
+
+    *c = p[0] + (((p[2] - p[0]) * f + (1 << 15)) >> 16);
+    *s = p[1] + (((p[3] - p[1]) * f + (1 << 15)) >> 16);
+}
+
+void bladerf_nco_mix_c16(struct bladerf_nco *nco, int16_t *samples, size_t n)
+{
+    uint32_t ph = nco->phase, d = nco->dphase;
+    int32_t c, s, re, im, xr, xi;
+    size_t i = 0;
+
+#ifdef __SSE2__
+    const __m128i round = _mm_set1_epi32(1 << 14);
+    uint32_t a[4], b[4];
+    __m128i x, vre, vim;
+    int j;
+
+    /* Four samples at a time: the oscillator is interpolated with scalar
+     * code, then pmaddwd does each complex multiply in two steps */
+    for (; i + 4 <= n; i += 4) {
+        for (j = 0; j < 4; j++, ph += d) {
+            mix_q15(ph, &c, &s);
+            a[j] = pack16(c, -s);
+            b[j] = pack16(s, c);
+        }
+
+        x = _mm_loadu_si128((const __m128i *)(samples + 2 * i));
+        vre = _mm_madd_epi16(x, _mm_loadu_si128((const __m128i *)a));
+        vim = _mm_madd_epi16(x, _mm_loadu_si128((const __m128i *)b));
+        vre = _mm_srai_epi32(_mm_add_epi32(vre, round), 15);
+        vim = _mm_srai_epi32(_mm_add_epi32(vim, round), 15);
+
+        x = _mm_packs_epi32(_mm_unpacklo_epi32(vre, vim),
+                            _mm_unpackhi_epi32(vre, vim));
+        _mm_storeu_si128((__m128i *)(samples + 2 * i), x);
+    }
+#endif
+
+    for (; i < n; i++, ph += d) {
+        mix_q15(ph, &c, &s);
+        xr = samples[2 * i];
+        xi = samples[2 * i + 1];
+
+        re = xr * c - xi * s;
+        im = xr * s + xi * c;
+
+        samples[2 * i] = sat16((re + (1 << 14)) >> 15);
+        samples[2 * i + 1] = sat16((im + (1 << 14)) >> 15);
+    }
+
+    nco->phase = ph;
+}
+
+void bladerf_nco_mix_cf32(struct bladerf_nco *nco, float *samples, size_t n)
+{
+    const float scale = 1.0f / (1 << MIX_FRAC_BITS);
+    uint32_t ph = nco->phase, d = nco->dphase, k;
+    float xr, xi, f, c, s;
+    size_t i = 0;
+
+#ifdef __SSE2__
+    uint32_t acc[4];
+    __m128 vf, c0, c1, s0, s1, vc, vs, lo, hi, re, im;
+    int j;
+
+    /* Four samples at a time: the table is gathered with scalar loads and
+     * everything else, including the interpolation, is vectorized */
+    for (; i + 4 <= n; i += 4) {
+        for (j = 0; j < 4; j++, ph += d)
+            acc[j] = ph;
+
+        c0 = _mm_set_ps(nco_lut.cos_f[acc[3] >> MIX_FRAC_BITS],
+                        nco_lut.cos_f[acc[2] >> MIX_FRAC_BITS],
+                        nco_lut.cos_f[acc[1] >> MIX_FRAC_BITS],
+                        nco_lut.cos_f[acc[0] >> MIX_FRAC_BITS]);
+        c1 = _mm_set_ps(nco_lut.cos_f[(acc[3] >> MIX_FRAC_BITS) + 1],
+                        nco_lut.cos_f[(acc[2] >> MIX_FRAC_BITS) + 1],
+                        nco_lut.cos_f[(acc[1] >> MIX_FRAC_BITS) + 1],
+                        nco_lut.cos_f[(acc[0] >> MIX_FRAC_BITS) + 1]);
+        s0 = _mm_set_ps(nco_lut.sin_f[acc[3] >> MIX_FRAC_BITS],
+                        nco_lut.sin_f[acc[2] >> MIX_FRAC_BITS],
+                        nco_lut.sin_f[acc[1] >> MIX_FRAC_BITS],
+                        nco_lut.sin_f[acc[0] >> MIX_FRAC_BITS]);
+        s1 = _mm_set_ps(nco_lut.sin_f[(acc[3] >> MIX_FRAC_BITS) + 1],
+                        nco_lut.sin_f[(acc[2] >> MIX_FRAC_BITS) + 1],
+                        nco_lut.sin_f[(acc[1] >> MIX_FRAC_BITS) + 1],
+                        nco_lut.sin_f[(acc[0] >> MIX_FRAC_BITS) + 1]);
+
+        /* The fraction fits in 22 bits, so the signed conversion is exact */
+        vf = _mm_cvtepi32_ps(_mm_and_si128(
+                    _mm_loadu_si128((const __m128i *)acc),
+                    _mm_set1_epi32((1 << MIX_FRAC_BITS) - 1)));
+        vf = _mm_mul_ps(vf, _mm_set1_ps(scale));
+
+        vc = _mm_add_ps(c0, _mm_mul_ps(_mm_sub_ps(c1, c0), vf));
+        vs = _mm_add_ps(s0, _mm_mul_ps(_mm_sub_ps(s1, s0), vf));
+
+        /* Deinterleave, multiply, and interleave again */
+        lo = _mm_loadu_ps(samples + 2 * i);
+        hi = _mm_loadu_ps(samples + 2 * i + 4);
+        re = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+        im = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+
+        lo = _mm_sub_ps(_mm_mul_ps(re, vc), _mm_mul_ps(im, vs));
+        hi = _mm_add_ps(_mm_mul_ps(re, vs), _mm_mul_ps(im, vc));
+
+        _mm_storeu_ps(samples + 2 * i, _mm_unpacklo_ps(lo, hi));
+        _mm_storeu_ps(samples + 2 * i + 4, _mm_unpackhi_ps(lo, hi));
+    }
+#endif
+
+    for (; i < n; i++, ph += d) {
+        k = ph >> MIX_FRAC_BITS;
+        f = (ph & ((1 << MIX_FRAC_BITS) - 1)) * scale;
+        c = nco_lut.cos_f[k] + (nco_lut.cos_f[k + 1] - nco_lut.cos_f[k]) * f;
+        s = nco_lut.sin_f[k] + (nco_lut.sin_f[k + 1] - nco_lut.sin_f[k]) * f;
+
+        xr = samples[2 * i];
+        xi = samples[2 * i + 1];
+        samples[2 * i] = xr * c - xi * s;
+        samples[2 * i + 1] = xr * s + xi * c;
+    }
+
+    nco->phase = ph;
+}
@@ -0,0 +1,125 @@
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "libbladeRF.h"
+#include "bladerf_priv.h"
+#include "debug.h"
+
+/* Samples per device read, small enough that the split reads them back
+ * from cache rather than from memory */
+#define PLANAR_CHUNK    (16 * 1024)
+
+#define PLANAR_SCALE    (1.0f / 32768.0f)
+
+#ifdef __SSE2__
+/* Sign-extended I (low halves) and Q (high halves) of four samples */
+static inline void split4(const int16_t *in, __m128i *i, __m128i *q)
+{
+    __m128i v = _mm_loadu_si128((const __m128i *)in);
+
+    *i = _mm_srai_epi32(_mm_slli_epi32(v, 16), 16);
+    *q = _mm_srai_epi32(v, 16);
+}
+#endif
+
+static void split_s16(const int16_t *in, int16_t *i_out, int16_t *q_out,
+                      size_t n)
+{
+    size_t k = 0;
+
+#ifdef __SSE2__
+    __m128i i0, q0, i1, q1;
+
+    for (; k + 8 <= n; k += 8) {
+        split4(in + 2 * k, &i0, &q0);
+        split4(in + 2 * k + 8, &i1, &q1);
+        _mm_storeu_si128((__m128i *)(i_out + k), _mm_packs_epi32(i0, i1));
+        _mm_storeu_si128((__m128i *)(q_out + k), _mm_packs_epi32(q0, q1));
+    }
+#endif
+
+    for (; k < n; k++) {
+        i_out[k] = in[2 * k];
+        q_out[k] = in[2 * k + 1];
+    }
+}
+
+static void split_f32(const int16_t *in, float *i_out, float *q_out, size_t n)
+{
+    size_t k = 0;
+
+#ifdef __SSE2__
+    const __m128 scale = _mm_set1_ps(PLANAR_SCALE);
+    __m128i i0, q0;
+
+    for (; k + 4 <= n; k += 4) {
+        split4(in + 2 * k, &i0, &q0);
+        _mm_storeu_ps(i_out + k, _mm_mul_ps(_mm_cvtepi32_ps(i0), scale));
+        _mm_storeu_ps(q_out + k, _mm_mul_ps(_mm_cvtepi32_ps(q0), scale));
+    }
+#endif
+
+    for (; k < n; k++) {
+        i_out[k] = in[2 * k] * PLANAR_SCALE;
+        q_out[k] = in[2 * k + 1] * PLANAR_SCALE;
+    }
+}
+
+/* Read through the staging buffer, splitting each chunk while it is still
+ * in cache. Stops early, as bladerf_read_c16() does, once fewer samples
+ * are ready than asked for. */
+static ssize_t read_planar(struct bladerf *dev, void *i, void *q,
+                           size_t max_samples, bool f32)
+{
+    size_t done = 0, want;
+    ssize_t got;
+
+    if (max_samples < BLADERF_SAMPLES_PER_XFER)
+        return BLADERF_ERR_INVAL;
+
+    /* Only one thread reads at a time, so this needs no lock */
+    if (!dev->rx_stage) {
+        dev->rx_stage_len = PLANAR_CHUNK * 2 * sizeof(int16_t);
+        dev->rx_stage = buf_pool_get(dev, &dev->rx_stage_len);
+        if (!dev->rx_stage)
+            return BLADERF_ERR_MEM;
+    }
+
+    while (max_samples - done >= BLADERF_SAMPLES_PER_XFER) {
+        want = max_samples - done;
+        if (want > PLANAR_CHUNK)
+            want = PLANAR_CHUNK;
+
+        got = bladerf_read_c16(dev, dev->rx_stage, want);
+        if (got < 0)
+            return done ? (ssize_t)done : got;
+
+        if (f32)
+            split_f32(dev->rx_stage, (float *)i + done, (float *)q + done, got);
+        else
+            split_s16(dev->rx_stage, (int16_t *)i + done, (int16_t *)q + done,
+                      got);
+
+        done += got;
+        if ((size_t)got < want)
+            break;
+    }
+
+    return done;
+}
+
+ssize_t bladerf_read_planar_s16(struct bladerf *dev, int16_t *i, int16_t *q,
+                                size_t max_samples)
+{
+    return read_planar(dev, i, q, max_samples, false);
+}
+
+ssize_t bladerf_read_planar_f32(struct bladerf *dev, float *i, float *q,
+                                size_t max_samples)
+{
+    return read_planar(dev, i, q, max_samples, true);
+}
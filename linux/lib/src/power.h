@@ -0,0 +1,73 @@
+#ifndef POWER_H_
+#define POWER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+ * Block power measurement shared by the detector and AGC
+ */
+#define POWER_FULL_SCALE    (32768.0 * 32768.0)
+
+/* Accumulate I^2 + Q^2 over n samples. Each term is computed in 32 bits,
+ * where (-32768, -32768) only fits unsigned, hence the unsigned maximum. */
+static inline void power_accumulate(const int16_t *samples, size_t n,
+                                    uint64_t *sum_out, uint32_t *peak_out)
+{
+    uint64_t sum = 0;
+    uint32_t peak = *peak_out, p;
+    size_t i = 0;
+
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi32((int)0x80000000);
+    __m128i acc = zero, vmax = bias, v, gt;
+    uint32_t lanes[4];
+    uint64_t acc_lanes[2];
+
+    for (; i + 4 <= n; i += 4) {
+        v = _mm_loadu_si128((const __m128i *)(samples + 2 * i));
+        v = _mm_madd_epi16(v, v);
+
+        acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(v, zero));
+        acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(v, zero));
+
+        /* SSE2 only has a signed compare; bias both sides */
+        v = _mm_xor_si128(v, bias);
+        gt = _mm_cmpgt_epi32(v, vmax);
+        vmax = _mm_or_si128(_mm_and_si128(gt, v), _mm_andnot_si128(gt, vmax));
+    }
+
+    _mm_storeu_si128((__m128i *)acc_lanes, acc);
+    sum = acc_lanes[0] + acc_lanes[1];
+
+    _mm_storeu_si128((__m128i *)lanes, _mm_xor_si128(vmax, bias));
+    for (p = 0; p < 4; p++)
+        if (lanes[p] > peak)
+            peak = lanes[p];
+#endif
+
+    for (; i < n; i++) {
+        p = (uint32_t)(samples[2 * i] * samples[2 * i]) +
+            (uint32_t)(samples[2 * i + 1] * samples[2 * i + 1]);
+        sum += p;
+        if (p > peak)
+            peak = p;
+    }
+
+    *sum_out += sum;
+    *peak_out = peak;
+}
+
+/* I^2 + Q^2 to dBFS */
+static inline double power_to_db(double power)
+{
+    return 10.0 * log10(power / POWER_FULL_SCALE + 1e-20);
+}
+
+#endif
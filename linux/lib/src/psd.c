@@ -0,0 +1,341 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "libbladeRF.h"
+#include "fft.h"
+#include "debug.h"
+
+#define PSD_MAX_THREADS     64
+#define PSD_MIN_FRAMES      4       /* Per thread, to be worth waking it */
+
+/* Per-thread scratch and batch result */
+struct psd_worker {
+    struct bladerf_psd *psd;
+    const int16_t *samples;
+    size_t frames;
+    float *re, *im;
+    float *acc;             /* Sum or max of |X|^2 over the batch */
+    pthread_t thread;
+};
+
+struct bladerf_psd {
+    struct bladerf_psd_config cfg;
+    struct fft *fft;
+    float *window;
+    double scale;           /* |X|^2 to fraction of full scale */
+
+    /* Pool. The calling thread runs workers[0]; threads run the rest. */
+    struct psd_worker *workers;
+    unsigned int num_workers;
+    unsigned int num_threads;   /* Started, for workers[1 .. num_threads] */
+    pthread_mutex_t lock;
+    pthread_cond_t start, done;
+    unsigned int generation, pending;
+    bool quit;
+
+    double *avg;
+    bool have_avg;
+    uint64_t frames;
+
+    int16_t *partial;       /* Samples carried over to the next call */
+    size_t partial_n;
+};
+
+static void psd_work(struct psd_worker *w)
+{
+    const struct bladerf_psd *psd = w->psd;
+    const unsigned int *bitrev = psd->fft->bitrev;
+    const float *win = psd->window;
+    const int16_t *s = w->samples;
+    size_t n = psd->cfg.fft_size, f, i;
+    bool max_hold = psd->cfg.avg == BLADERF_PSD_AVG_MAX;
+    float p;
+
+    memset(w->acc, 0, n * sizeof(w->acc[0]));
+
+    for (f = 0; f < w->frames; f++, s += 2 * n) {
+        /* Window and permute in one go */
+        for (i = 0; i < n; i++) {
+            w->re[bitrev[i]] = s[2 * i] * win[i];
+            w->im[bitrev[i]] = s[2 * i + 1] * win[i];
+        }
+
+        fft_execute(psd->fft, w->re, w->im);
+
+        if (max_hold) {
+            for (i = 0; i < n; i++) {
+                p = w->re[i] * w->re[i] + w->im[i] * w->im[i];
+                w->acc[i] = p > w->acc[i] ? p : w->acc[i];
+            }
+        } else {
+            for (i = 0; i < n; i++)
+                w->acc[i] += w->re[i] * w->re[i] + w->im[i] * w->im[i];
+        }
+    }
+}
+
+static void *psd_thread(void *arg)
+{
+    struct psd_worker *w = arg;
+    struct bladerf_psd *psd = w->psd;
+    unsigned int seen = 0;
+
+    pthread_mutex_lock(&psd->lock);
+    for (;;) {
+        while (psd->generation == seen && !psd->quit)
+            pthread_cond_wait(&psd->start, &psd->lock);
+        if (psd->quit)
+            break;
+        seen = psd->generation;
+        pthread_mutex_unlock(&psd->lock);
+
+        psd_work(w);
+
+        pthread_mutex_lock(&psd->lock);
+        if (--psd->pending == 0)
+            pthread_cond_signal(&psd->done);
+    }
+    pthread_mutex_unlock(&psd->lock);
+
+    return NULL;
+}
+
+/* Run whole frames through the workers and fold them into the average */
+static void psd_batch(struct bladerf_psd *psd, const int16_t *samples,
+                      size_t frames)
+{
+    size_t n = psd->cfg.fft_size, per, i;
+    unsigned int t, nt;
+    double decay, v;
+
+    nt = frames / PSD_MIN_FRAMES;
+    if (nt > psd->num_workers)
+        nt = psd->num_workers;
+    if (nt == 0)
+        nt = 1;
+
+    per = (frames + nt - 1) / nt;
+    for (t = 0; t < psd->num_workers; t++) {
+        struct psd_worker *w = &psd->workers[t];
+
+        w->samples = samples + 2 * n * per * t;
+        w->frames = t >= nt || t * per >= frames ? 0 :
+                    (frames - t * per < per ? frames - t * per : per);
+    }
+
+    /* The calling thread takes the first share itself */
+    if (nt > 1) {
+        pthread_mutex_lock(&psd->lock);
+        psd->pending = psd->num_workers - 1;
+        psd->generation++;
+        pthread_cond_broadcast(&psd->start);
+        pthread_mutex_unlock(&psd->lock);
+    }
+
+    psd_work(&psd->workers[0]);
+
+    if (nt > 1) {
+        pthread_mutex_lock(&psd->lock);
+        while (psd->pending)
+            pthread_cond_wait(&psd->done, &psd->lock);
+        pthread_mutex_unlock(&psd->lock);
+    }
+
+    /* Exponential averaging weighs each frame by alpha, so a batch of m
+     * frames moves the average by 1 - (1 - alpha)^m towards its mean */
+    decay = psd->have_avg ? pow(1.0 - psd->cfg.alpha, frames) : 0.0;
+
+    for (i = 0; i < n; i++) {
+        if (psd->cfg.avg == BLADERF_PSD_AVG_MAX) {
+            for (t = 0, v = psd->have_avg ? psd->avg[i] : 0; t < nt; t++)
+                if (psd->workers[t].acc[i] > v)
+                    v = psd->workers[t].acc[i];
+        } else {
+            for (t = 0, v = 0; t < nt; t++)
+                v += psd->workers[t].acc[i];
+            v = decay * psd->avg[i] + (1.0 - decay) * (v / frames);
+        }
+        psd->avg[i] = v;
+    }
+
+    psd->have_avg = true;
+    psd->frames += frames;
+}
+
+int bladerf_psd_create(const struct bladerf_psd_config *cfg,
+                       struct bladerf_psd **psd_out)
+{
+    struct bladerf_psd *psd;
+    size_t n, i;
+    double sum = 0;
+    unsigned int t;
+
+    if (!cfg || cfg->fft_size < BLADERF_PSD_MIN_SIZE ||
+            cfg->fft_size > BLADERF_PSD_MAX_SIZE ||
+            (cfg->fft_size & (cfg->fft_size - 1)) ||
+            (cfg->avg != BLADERF_PSD_AVG_EXP &&
+             cfg->avg != BLADERF_PSD_AVG_MAX) ||
+            (cfg->avg == BLADERF_PSD_AVG_EXP &&
+             (cfg->alpha <= 0 || cfg->alpha > 1)))
+        return BLADERF_ERR_INVAL;
+
+    psd = calloc(1, sizeof(*psd));
+    if (!psd)
+        return BLADERF_ERR_MEM;
+
+    pthread_mutex_init(&psd->lock, NULL);
+    pthread_cond_init(&psd->start, NULL);
+    pthread_cond_init(&psd->done, NULL);
+
+    n = cfg->fft_size;
+    psd->cfg = *cfg;
+    psd->num_workers = cfg->threads ? cfg->threads : 1;
+    if (psd->num_workers > PSD_MAX_THREADS)
+        psd->num_workers = PSD_MAX_THREADS;
+
+    psd->fft = fft_create(n);
+    psd->window = malloc(n * sizeof(psd->window[0]));
+    psd->avg = calloc(n, sizeof(psd->avg[0]));
+    psd->partial = malloc(n * 2 * sizeof(int16_t));
+    psd->workers = calloc(psd->num_workers, sizeof(psd->workers[0]));
+    if (!psd->fft || !psd->window || !psd->avg || !psd->partial ||
+            !psd->workers)
+        goto nomem;
+
+    for (t = 0; t < psd->num_workers; t++) {
+        struct psd_worker *w = &psd->workers[t];
+        w->psd = psd;
+        w->re = malloc(n * sizeof(float));
+        w->im = malloc(n * sizeof(float));
+        w->acc = malloc(n * sizeof(float));
+        if (!w->re || !w->im || !w->acc)
+            goto nomem;
+    }
+
+    /* Hann window, normalized so a full-scale tone reads 0 dBFS */
+    for (i = 0; i < n; i++) {
+        psd->window[i] = 0.5 - 0.5 * cos(2.0 * M_PI * i / n);
+        sum += psd->window[i];
+    }
+    psd->scale = 1.0 / (sum * sum * 32768.0 * 32768.0);
+
+    /* Carry on with fewer workers if a thread can't be started */
+    for (t = 1; t < psd->num_workers; t++) {
+        if (pthread_create(&psd->workers[t].thread, NULL, psd_thread,
+                           &psd->workers[t]))
+            break;
+        psd->num_threads++;
+    }
+
+    if (psd->num_threads + 1 < psd->num_workers) {
+        dbg_printf("psd: only %u of %u threads started\n",
+                   psd->num_threads, psd->num_workers - 1);
+        for (t = psd->num_threads + 1; t < psd->num_workers; t++) {
+            free(psd->workers[t].re);
+            free(psd->workers[t].im);
+            free(psd->workers[t].acc);
+        }
+        psd->num_workers = psd->num_threads + 1;
+    }
+
+    *psd_out = psd;
+    return 0;
+
+nomem:
+    bladerf_psd_destroy(psd);
+    return BLADERF_ERR_MEM;
+}
+
+void bladerf_psd_destroy(struct bladerf_psd *psd)
+{
+    unsigned int t;
+
+    if (psd) {
+        pthread_mutex_lock(&psd->lock);
+        psd->quit = true;
+        pthread_cond_broadcast(&psd->start);
+        pthread_mutex_unlock(&psd->lock);
+
+        for (t = 1; t <= psd->num_threads; t++)
+            pthread_join(psd->workers[t].thread, NULL);
+
+        if (psd->workers) {
+            for (t = 0; t < psd->num_workers; t++) {
+                free(psd->workers[t].re);
+                free(psd->workers[t].im);
+                free(psd->workers[t].acc);
+            }
+            free(psd->workers);
+        }
+        fft_destroy(psd->fft);
+        free(psd->window);
+        free(psd->avg);
+        free(psd->partial);
+        pthread_mutex_destroy(&psd->lock);
+        pthread_cond_destroy(&psd->start);
+        pthread_cond_destroy(&psd->done);
+        free(psd);
+    }
+}
+
+void bladerf_psd_reset(struct bladerf_psd *psd)
+{
+    psd->have_avg = false;
+    psd->frames = 0;
+    psd->partial_n = 0;
+}
+
+uint64_t bladerf_psd_process(struct bladerf_psd *psd,
+                             const int16_t *samples, size_t n)
+{
+    size_t size = psd->cfg.fft_size, take, frames;
+    uint64_t before = psd->frames;
+
+    if (psd->partial_n) {
+        take = size - psd->partial_n;
+        if (take > n)
+            take = n;
+
+        memcpy(psd->partial + 2 * psd->partial_n, samples,
+               take * 2 * sizeof(int16_t));
+        psd->partial_n += take;
+        samples += 2 * take;
+        n -= take;
+
+        if (psd->partial_n == size) {
+            psd_batch(psd, psd->partial, 1);
+            psd->partial_n = 0;
+        }
+    }
+
+    frames = n / size;
+    if (frames) {
+        psd_batch(psd, samples, frames);
+        samples += 2 * frames * size;
+        n -= frames * size;
+    }
+
+    if (n) {
+        memcpy(psd->partial, samples, n * 2 * sizeof(int16_t));
+        psd->partial_n = n;
+    }
+
+    return psd->frames - before;
+}
+
+int bladerf_psd_get(struct bladerf_psd *psd, float *psd_db)
+{
+    size_t n = psd->cfg.fft_size, i;
+
+    if (!psd->have_avg)
+        return BLADERF_ERR_INVAL;
+
+    /* Reorder so bin 0 is the most negative frequency */
+    for (i = 0; i < n; i++)
+        psd_db[i] = 10.0 * log10(psd->avg[(i + n / 2) % n] * psd->scale +
+                                 1e-20);
+
+    return 0;
+}
@@ -0,0 +1,343 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "libbladeRF.h"
+#include "bladerf_priv.h"
+#include "filter.h"
+#include "debug.h"
+
+#define RESAMPLER_MAX_RATIO     1024
+#define RESAMPLER_MAX_TAPS      256
+#define RESAMPLER_KAISER_BETA   8.0     /* About 80 dB of stopband */
+#define RESAMPLER_STAGE         (64 * 1024) /* Device-rate samples per read */
+
+/*
+ * Output k sits at position k * decim on the interpolated grid, i.e., at
+ * branch (k * decim) % interp of input floor(k * decim / interp). 'phase'
+ * tracks the next output's branch relative to the newest input, so each
+ * input runs the branches for every output that lands on it.
+ */
+struct bladerf_resampler {
+    unsigned int interp, decim;
+    size_t taps;                /* Per branch, padded to FILTER_TAP_ALIGN */
+    unsigned int phase;
+
+    float *coef_f;              /* interp branches of 2 * taps, oldest first */
+    int16_t *coef_s;
+    float *hist_f;              /* Inputs, written twice; 2 * 2 * taps */
+    int16_t *hist_s;
+    size_t pos;
+};
+
+static unsigned int gcd(unsigned int a, unsigned int b)
+{
+    unsigned int t;
+
+    while (b) {
+        t = a % b;
+        a = b;
+        b = t;
+    }
+
+    return a;
+}
+
+/* Kaiser-windowed sinc on the interpolated grid, with a DC gain of interp
+ * so the output level matches the input */
+static int design(struct bladerf_resampler *rs, size_t len, double cutoff)
+{
+    double *h, fc, t, sum;
+    size_t p, j, k;
+    int16_t *cs;
+    float *cf;
+
+    h = malloc(len * sizeof(h[0]));
+    if (!h)
+        return BLADERF_ERR_MEM;
+
+    fc = cutoff * 0.5 / (rs->interp > rs->decim ? rs->interp : rs->decim);
+
+    sum = filter_kaiser_sinc(h, len, fc, RESAMPLER_KAISER_BETA);
+
+    for (p = 0; p < rs->interp; p++) {
+        cf = rs->coef_f + p * 2 * rs->taps;
+        cs = rs->coef_s + p * 2 * rs->taps;
+
+        for (j = 0; j < rs->taps; j++) {
+            k = p + (rs->taps - 1 - j) * rs->interp;
+            t = k < len ? h[k] * rs->interp / sum : 0;
+
+            cf[2 * j] = cf[2 * j + 1] = t;
+            filter_set_c16(cs, j, (int16_t)lrint(t * (1 << FILTER_Q)));
+        }
+    }
+
+    free(h);
+    return 0;
+}
+
+int bladerf_resampler_create(const struct bladerf_resampler_config *cfg,
+                             struct bladerf_resampler **rs_out)
+{
+    struct bladerf_resampler *rs;
+    unsigned int g;
+    size_t hist;
+    int status;
+
+    if (!cfg || cfg->interp == 0 || cfg->decim == 0 ||
+            cfg->taps == 0 || cfg->taps > RESAMPLER_MAX_TAPS ||
+            !(cfg->cutoff > 0 && cfg->cutoff <= 1))
+        return BLADERF_ERR_INVAL;
+
+    rs = calloc(1, sizeof(*rs));
+    if (!rs)
+        return BLADERF_ERR_MEM;
+
+    g = gcd(cfg->interp, cfg->decim);
+    rs->interp = cfg->interp / g;
+    rs->decim = cfg->decim / g;
+    if (rs->interp > RESAMPLER_MAX_RATIO || rs->decim > RESAMPLER_MAX_RATIO) {
+        status = BLADERF_ERR_INVAL;
+        goto error;
+    }
+
+    rs->taps = filter_align_taps(cfg->taps);
+    hist = 2 * 2 * rs->taps;
+
+    if (posix_memalign((void **)&rs->coef_f, 16,
+                       rs->interp * 2 * rs->taps * sizeof(float)) ||
+            posix_memalign((void **)&rs->coef_s, 16,
+                           rs->interp * 2 * rs->taps * sizeof(int16_t))) {
+        status = BLADERF_ERR_MEM;
+        goto error;
+    }
+
+    rs->hist_f = calloc(hist, sizeof(float));
+    rs->hist_s = calloc(hist, sizeof(int16_t));
+    if (!rs->hist_f || !rs->hist_s) {
+        status = BLADERF_ERR_MEM;
+        goto error;
+    }
+
+    status = design(rs, cfg->taps * rs->interp, cfg->cutoff);
+    if (status)
+        goto error;
+
+    *rs_out = rs;
+    return 0;
+
+error:
+    bladerf_resampler_destroy(rs);
+    return status;
+}
+
+void bladerf_resampler_destroy(struct bladerf_resampler *rs)
+{
+    if (rs) {
+        free(rs->coef_f);
+        free(rs->coef_s);
+        free(rs->hist_f);
+        free(rs->hist_s);
+        free(rs);
+    }
+}
+
+void bladerf_resampler_reset(struct bladerf_resampler *rs)
+{
+    memset(rs->hist_f, 0, 2 * 2 * rs->taps * sizeof(float));
+    memset(rs->hist_s, 0, 2 * 2 * rs->taps * sizeof(int16_t));
+    rs->pos = 0;
+    rs->phase = 0;
+}
+
+size_t bladerf_resampler_max_output(struct bladerf_resampler *rs, size_t n)
+{
+    return ((uint64_t)n * rs->interp + rs->decim - 1) / rs->decim + 1;
+}
+
+static int16_t sat16(int32_t v)
+{
+    return v > INT16_MAX ? INT16_MAX : (v < INT16_MIN ? INT16_MIN : v);
+}
+
+size_t bladerf_resample_c16(struct bladerf_resampler *rs,
+                            const int16_t *in, size_t n, int16_t *out)
+{
+    const size_t taps = rs->taps;
+    const int32_t round = 1 << (FILTER_Q - 1);
+    const int16_t *win;
+    size_t i, written = 0;
+    unsigned int phase = rs->phase, pos = rs->pos;
+    int32_t re, im;
+
+    for (i = 0; i < n; i++) {
+        /* Each input is stored in both halves so the newest taps inputs
+         * are always contiguous */
+        rs->hist_s[2 * pos] = rs->hist_s[2 * (pos + taps)] = in[2 * i];
+        rs->hist_s[2 * pos + 1] = rs->hist_s[2 * (pos + taps) + 1] =
+            in[2 * i + 1];
+        win = rs->hist_s + 2 * (pos + 1);
+        pos = pos + 1 == taps ? 0 : pos + 1;
+
+        for (; phase < rs->interp; phase += rs->decim, written++) {
+            filter_dot_c16(win, rs->coef_s + phase * 2 * taps, taps, &re, &im);
+            out[2 * written] = sat16((re + round) >> FILTER_Q);
+            out[2 * written + 1] = sat16((im + round) >> FILTER_Q);
+        }
+        phase -= rs->interp;
+    }
+
+    rs->phase = phase;
+    rs->pos = pos;
+    return written;
+}
+
+size_t bladerf_resample_cf32(struct bladerf_resampler *rs,
+                             const float *in, size_t n, float *out)
+{
+    const size_t taps = rs->taps;
+    const float *win;
+    size_t i, written = 0;
+    unsigned int phase = rs->phase, pos = rs->pos;
+
+    for (i = 0; i < n; i++) {
+        rs->hist_f[2 * pos] = rs->hist_f[2 * (pos + taps)] = in[2 * i];
+        rs->hist_f[2 * pos + 1] = rs->hist_f[2 * (pos + taps) + 1] =
+            in[2 * i + 1];
+        win = rs->hist_f + 2 * (pos + 1);
+        pos = pos + 1 == taps ? 0 : pos + 1;
+
+        for (; phase < rs->interp; phase += rs->decim, written++)
+            filter_dot_cf32(win, rs->coef_f + phase * 2 * taps, taps,
+                            &out[2 * written], &out[2 * written + 1]);
+        phase -= rs->interp;
+    }
+
+    rs->phase = phase;
+    rs->pos = pos;
+    return written;
+}
+
+/*
+ * A resampler attached to a stream. buf holds samples at the device's
+ * rate: on RX, one read's worth; on TX, resampled samples that don't yet
+ * fill a transfer, held for the next send.
+ */
+struct stream_resampler {
+    struct bladerf_resampler *rs;
+    int16_t *buf;
+    size_t len;                 /* Bytes mapped, for buf_pool_put() */
+    size_t held;
+};
+
+/* The most input samples whose output is sure to fit in room */
+static size_t input_for(struct bladerf_resampler *rs, size_t room)
+{
+    return room < 2 ? 0 : (uint64_t)(room - 2) * rs->decim / rs->interp;
+}
+
+ssize_t resampler_read(struct bladerf *dev, struct stream_resampler *s,
+                       int16_t *samples, size_t max_samples)
+{
+    size_t n = input_for(s->rs, max_samples);
+    ssize_t got;
+
+    if (n > RESAMPLER_STAGE)
+        n = RESAMPLER_STAGE;
+
+    n -= n % BLADERF_SAMPLES_PER_XFER;
+    if (n == 0)
+        return BLADERF_ERR_INVAL;
+
+    got = stream_read(dev, s->buf, n);
+    if (got < 0)
+        return got;
+
+    return bladerf_resample_c16(s->rs, s->buf, got, samples);
+}
+
+/* Send the whole transfers held, keeping the rest */
+static int resampler_drain(struct bladerf *dev, struct stream_resampler *s)
+{
+    ssize_t ret;
+
+    while (s->held >= BLADERF_SAMPLES_PER_XFER) {
+        ret = stream_write(dev, s->buf, s->held);
+        if (ret < 0)
+            return ret;
+
+        s->held -= ret;
+        memmove(s->buf, s->buf + 2 * ret, s->held * 2 * sizeof(int16_t));
+    }
+
+    return 0;
+}
+
+ssize_t resampler_write(struct bladerf *dev, struct stream_resampler *s,
+                        const int16_t *samples, size_t n)
+{
+    size_t done = 0, k;
+    int status;
+
+    for (;;) {
+        /* Samples already taken stay held and go out with the next send */
+        status = resampler_drain(dev, s);
+        if (status)
+            return done ? (ssize_t)done : status;
+
+        if (done == n)
+            return n;
+
+        k = input_for(s->rs, RESAMPLER_STAGE - s->held);
+        if (k > n - done)
+            k = n - done;
+
+        s->held += bladerf_resample_c16(s->rs, samples + 2 * done, k,
+                                        s->buf + 2 * s->held);
+        done += k;
+    }
+}
+
+int bladerf_resampler_attach(struct bladerf *dev, bladerf_module module,
+                             struct bladerf_resampler *rs)
+{
+    struct stream_resampler **slot, *s = NULL, *old;
+    size_t pad;
+    int status = 0;
+
+    slot = module == RX ? &dev->rx_resampler : &dev->tx_resampler;
+
+    if (rs) {
+        s = calloc(1, sizeof(*s));
+        if (!s)
+            return BLADERF_ERR_MEM;
+
+        s->rs = rs;
+        /* With room to pad the last TX samples to a transfer */
+        s->len = (RESAMPLER_STAGE + BLADERF_SAMPLES_PER_XFER) *
+                 2 * sizeof(int16_t);
+        s->buf = buf_pool_get(dev, &s->len);
+        if (!s->buf) {
+            free(s);
+            return BLADERF_ERR_MEM;
+        }
+    }
+
+    old = __atomic_exchange_n(slot, s, __ATOMIC_ACQ_REL);
+    if (!old)
+        return 0;
+
+    /* Pad what's left of the TX stream out to a transfer and send it */
+    if (old->held) {
+        pad = old->held % BLADERF_SAMPLES_PER_XFER;
+        pad = pad ? BLADERF_SAMPLES_PER_XFER - pad : 0;
+        memset(old->buf + 2 * old->held, 0, pad * 2 * sizeof(int16_t));
+        old->held += pad;
+        status = resampler_drain(dev, old);
+    }
+
+    buf_pool_put(dev, old->buf, old->len);
+    free(old);
+    return status;
+}
@@ -0,0 +1,165 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "libbladeRF.h"
+#include "bladerf_priv.h"
+#include "debug.h"
+
+#define SAMPLE_SZ       (2 * sizeof(int16_t))
+#define RING_CHUNK      (64 * 1024)         /* Max samples per device read */
+#define RING_POLL_NS    1000000             /* Consumer wait granularity */
+
+/*
+ * The producer thread is the only writer of the ring and of 'written'; it
+ * never waits on a consumer. Readers copy out of the ring and then check
+ * that the producer hasn't lapped them in the meantime.
+ */
+struct bladerf_ring {
+    struct bladerf *dev;
+    int16_t *buf;
+    size_t map_len;
+    uint64_t size;                  /* Ring capacity in samples */
+
+    uint64_t written;               /* Samples produced; atomic */
+    int error;                      /* First read error; atomic */
+    int stop;
+
+    pthread_t thread;
+};
+
+static uint64_t load_written(struct bladerf_ring *ring)
+{
+    return __atomic_load_n(&ring->written, __ATOMIC_ACQUIRE);
+}
+
+static void *ring_producer(void *arg)
+{
+    struct bladerf_ring *ring = arg;
+    uint64_t w = 0, pos, n;
+    ssize_t ret;
+
+    while (!__atomic_load_n(&ring->stop, __ATOMIC_RELAXED)) {
+        /* The capacity is a multiple of the transfer size, so reads never
+         * straddle the end of the ring */
+        pos = w % ring->size;
+        n = ring->size - pos;
+        if (n > RING_CHUNK)
+            n = RING_CHUNK;
+
+        ret = stream_read(ring->dev, ring->buf + 2 * pos, n);
+        if (ret < 0) {
+            __atomic_store_n(&ring->error, (int)ret, __ATOMIC_RELEASE);
+            break;
+        }
+
+        w += ret;
+        __atomic_store_n(&ring->written, w, __ATOMIC_RELEASE);
+    }
+
+    return NULL;
+}
+
+int bladerf_ring_open(struct bladerf *dev, uint64_t samples,
+                      struct bladerf_ring **ring_out)
+{
+    struct bladerf_ring *ring;
+    int status;
+
+    if (samples == 0)
+        return BLADERF_ERR_INVAL;
+
+    ring = calloc(1, sizeof(*ring));
+    if (!ring)
+        return BLADERF_ERR_MEM;
+
+    /* Leave room for the read in progress, which the consumer can't use */
+    samples += RING_CHUNK + BLADERF_SAMPLES_PER_XFER - 1;
+    samples -= samples % BLADERF_SAMPLES_PER_XFER;
+
+    ring->dev = dev;
+    ring->size = samples;
+    ring->map_len = samples * SAMPLE_SZ;
+    ring->buf = buf_pool_get(dev, &ring->map_len);
+    if (!ring->buf) {
+        free(ring);
+        return BLADERF_ERR_MEM;
+    }
+
+    status = pthread_create(&ring->thread, NULL, ring_producer, ring);
+    if (status) {
+        buf_pool_put(dev, ring->buf, ring->map_len);
+        free(ring);
+        return BLADERF_ERR_UNEXPECTED;
+    }
+
+    *ring_out = ring;
+    return 0;
+}
+
+void bladerf_ring_close(struct bladerf_ring *ring)
+{
+    if (ring) {
+        __atomic_store_n(&ring->stop, 1, __ATOMIC_RELAXED);
+
+        /* The producer may be blocked in a read that will never complete */
+        pthread_cancel(ring->thread);
+        pthread_join(ring->thread, NULL);
+
+        buf_pool_put(ring->dev, ring->buf, ring->map_len);
+        free(ring);
+    }
+}
+
+uint64_t bladerf_ring_trigger(struct bladerf_ring *ring)
+{
+    return load_written(ring);
+}
+
+ssize_t bladerf_ring_read(struct bladerf_ring *ring, uint64_t start,
+                          int16_t *samples, size_t n, unsigned int timeout_ms)
+{
+    const struct timespec poll = { 0, RING_POLL_NS };
+    uint64_t w, pos, avail, waited_ns = 0;
+    size_t copied = 0, len;
+    int error;
+
+    while (copied < n) {
+        w = load_written(ring);
+
+        if (start + copied >= w) {
+            error = __atomic_load_n(&ring->error, __ATOMIC_ACQUIRE);
+            if (error)
+                return copied ? (ssize_t)copied : error;
+            if (waited_ns >= timeout_ms * 1000000ULL)
+                return copied ? (ssize_t)copied : BLADERF_ERR_TIMEOUT;
+
+            nanosleep(&poll, NULL);
+            waited_ns += RING_POLL_NS;
+            continue;
+        }
+
+        pos = (start + copied) % ring->size;
+        avail = w - (start + copied);
+        len = n - copied;
+        if (len > avail)
+            len = avail;
+        if (len > ring->size - pos)
+            len = ring->size - pos;
+
+        memcpy(samples + 2 * copied, ring->buf + 2 * pos, len * SAMPLE_SZ);
+
+        /* The read the producer may have in progress overwrites the oldest
+         * RING_CHUNK samples; if we were in that span, the copy is suspect */
+        w = load_written(ring);
+        if (start + copied + ring->size < w + RING_CHUNK)
+            return copied ? (ssize_t)copied : BLADERF_ERR_RANGE;
+
+        copied += len;
+        waited_ns = 0;
+    }
+
+    return copied;
+}
@@ -0,0 +1,299 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "libbladeRF.h"
+#include "liblms.h"
+#include "bladerf_priv.h"
+#include "debug.h"
+
+#define SWEEP_DRAIN_SAMPLES (64 * 1024)     /* Per read while flushing */
+
+/* A step's samples, handed from the tuning thread to the FFT thread */
+struct sweep_slot {
+    int16_t *buf;
+    bool full;
+};
+
+/*
+ * The calling thread tunes and reads; a second thread FFTs and stitches.
+ * With two slots, the retune and reads for step k+1 overlap with the FFTs
+ * of step k.
+ */
+struct bladerf_sweep {
+    struct bladerf *dev;
+    struct bladerf_sweep_config cfg;
+    struct bladerf_psd *psd;
+
+    struct lms_freq *tune;      /* Per step; VCOCAP learned on first visit */
+    unsigned int steps;
+    size_t bins_per_step;
+    double bin_hz;
+    size_t dwell;               /* Samples read per step, whole transfers */
+
+    int16_t *scratch;           /* Discarded samples */
+    float *spectrum;            /* One step's full PSD */
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct sweep_slot slots[2];
+    bool done;
+    float *out;
+};
+
+static size_t round_xfer(size_t n)
+{
+    return (n + BLADERF_SAMPLES_PER_XFER - 1) /
+           BLADERF_SAMPLES_PER_XFER * BLADERF_SAMPLES_PER_XFER;
+}
+
+static int read_fill(struct bladerf *dev, int16_t *buf, size_t n)
+{
+    ssize_t ret;
+
+    while (n) {
+        ret = stream_read(dev, buf, n);
+        if (ret < 0)
+            return ret;
+        buf += 2 * ret;
+        n -= ret;
+    }
+
+    return 0;
+}
+
+/* Skip everything queued while the LO was moving, then let the PLL settle.
+ * The driver returns a short read once its queue is empty, which marks the
+ * point the stream has caught up with the new tuning. */
+static int sweep_flush(struct bladerf_sweep *sweep)
+{
+    size_t n;
+    ssize_t ret;
+
+    do {
+        ret = stream_read(sweep->dev, sweep->scratch, SWEEP_DRAIN_SAMPLES);
+        if (ret < 0)
+            return ret;
+    } while (ret == SWEEP_DRAIN_SAMPLES);
+
+    for (n = round_xfer(sweep->cfg.settle_samples); n; n -= ret) {
+        ret = n < SWEEP_DRAIN_SAMPLES ? n : SWEEP_DRAIN_SAMPLES;
+        ret = stream_read(sweep->dev, sweep->scratch, ret);
+        if (ret < 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+/* Keep the middle bins_per_step bins of step k. The bin at DC carries LO
+ * leakage, so it is replaced by the mean of its neighbours. */
+static void sweep_stitch(struct bladerf_sweep *sweep, unsigned int k)
+{
+    size_t bps = sweep->bins_per_step;
+    float *dst = sweep->out + k * bps;
+
+    memcpy(dst, sweep->spectrum + sweep->cfg.fft_size / 2 - bps / 2,
+           bps * sizeof(float));
+
+    if (bps >= 3)
+        dst[bps / 2] = 0.5f * (dst[bps / 2 - 1] + dst[bps / 2 + 1]);
+}
+
+static void *sweep_fft(void *arg)
+{
+    struct bladerf_sweep *sweep = arg;
+    struct sweep_slot *slot;
+    unsigned int k;
+
+    for (k = 0; k < sweep->steps; k++) {
+        slot = &sweep->slots[k & 1];
+
+        pthread_mutex_lock(&sweep->lock);
+        while (!slot->full && !sweep->done)
+            pthread_cond_wait(&sweep->cond, &sweep->lock);
+        pthread_mutex_unlock(&sweep->lock);
+
+        if (!slot->full)
+            break;
+
+        /* All of a step's frames go in one batch, so the result is their
+         * plain mean */
+        bladerf_psd_reset(sweep->psd);
+        bladerf_psd_process(sweep->psd, slot->buf,
+                            (size_t)sweep->cfg.frames * sweep->cfg.fft_size);
+        bladerf_psd_get(sweep->psd, sweep->spectrum);
+        sweep_stitch(sweep, k);
+
+        pthread_mutex_lock(&sweep->lock);
+        slot->full = false;
+        pthread_cond_broadcast(&sweep->cond);
+        pthread_mutex_unlock(&sweep->lock);
+    }
+
+    return NULL;
+}
+
+int bladerf_sweep_create(struct bladerf *dev,
+                         const struct bladerf_sweep_config *cfg,
+                         struct bladerf_sweep **sweep_out)
+{
+    struct bladerf_sweep *sweep;
+    struct bladerf_psd_config psd_cfg;
+    unsigned int k, actual;
+    double span, center;
+    int status;
+
+    if (!cfg || cfg->samplerate == 0 || cfg->frames == 0 ||
+            cfg->start >= cfg->stop)
+        return BLADERF_ERR_INVAL;
+
+    sweep = calloc(1, sizeof(*sweep));
+    if (!sweep)
+        return BLADERF_ERR_MEM;
+
+    sweep->dev = dev;
+    sweep->cfg = *cfg;
+    pthread_mutex_init(&sweep->lock, NULL);
+    pthread_cond_init(&sweep->cond, NULL);
+
+    memset(&psd_cfg, 0, sizeof(psd_cfg));
+    psd_cfg.fft_size = cfg->fft_size;
+    psd_cfg.avg = BLADERF_PSD_AVG_EXP;
+    psd_cfg.alpha = 1.0;
+    psd_cfg.threads = cfg->threads;
+
+    status = bladerf_psd_create(&psd_cfg, &sweep->psd);
+    if (status)
+        goto error;
+
+    /* Steps are a whole number of bins apart, so the stitched bins are
+     * evenly spaced */
+    sweep->bin_hz = (double)cfg->samplerate / cfg->fft_size;
+    sweep->bins_per_step = cfg->step / sweep->bin_hz;
+    if (sweep->bins_per_step == 0 || sweep->bins_per_step > cfg->fft_size) {
+        status = BLADERF_ERR_INVAL;
+        goto error;
+    }
+
+    span = sweep->bins_per_step * sweep->bin_hz;
+    sweep->steps = ceil((cfg->stop - cfg->start) / span);
+
+    sweep->tune = calloc(sweep->steps, sizeof(sweep->tune[0]));
+    if (!sweep->tune) {
+        status = BLADERF_ERR_MEM;
+        goto error;
+    }
+
+    for (k = 0; k < sweep->steps; k++) {
+        center = cfg->start +
+                 (k * sweep->bins_per_step + sweep->bins_per_step / 2) *
+                 sweep->bin_hz;
+        if (center < LMS_FREQ_MIN || center > LMS_FREQ_MAX) {
+            status = BLADERF_ERR_RANGE;
+            goto error;
+        }
+        lms_calculate_tuning_params((uint32_t)(center + 0.5), &sweep->tune[k]);
+    }
+
+    sweep->dwell = round_xfer((size_t)cfg->frames * cfg->fft_size);
+    sweep->scratch = malloc(SWEEP_DRAIN_SAMPLES * 2 * sizeof(int16_t));
+    sweep->spectrum = malloc(cfg->fft_size * sizeof(float));
+    sweep->slots[0].buf = malloc(sweep->dwell * 2 * sizeof(int16_t));
+    sweep->slots[1].buf = malloc(sweep->dwell * 2 * sizeof(int16_t));
+    if (!sweep->scratch || !sweep->spectrum || !sweep->slots[0].buf ||
+            !sweep->slots[1].buf) {
+        status = BLADERF_ERR_MEM;
+        goto error;
+    }
+
+    status = bladerf_set_sample_rate(dev, RX, cfg->samplerate, &actual);
+    if (status == 0)
+        status = bladerf_set_bandwidth(dev, RX, span, &actual);
+    if (status) {
+        dbg_printf("Failed to configure RX for sweep: %d\n", status);
+        status = BLADERF_ERR_IO;
+        goto error;
+    }
+
+    *sweep_out = sweep;
+    return 0;
+
+error:
+    bladerf_sweep_destroy(sweep);
+    return status;
+}
+
+void bladerf_sweep_destroy(struct bladerf_sweep *sweep)
+{
+    if (sweep) {
+        bladerf_psd_destroy(sweep->psd);
+        free(sweep->tune);
+        free(sweep->scratch);
+        free(sweep->spectrum);
+        free(sweep->slots[0].buf);
+        free(sweep->slots[1].buf);
+        pthread_mutex_destroy(&sweep->lock);
+        pthread_cond_destroy(&sweep->cond);
+        free(sweep);
+    }
+}
+
+size_t bladerf_sweep_get_bins(struct bladerf_sweep *sweep, double *bin_hz)
+{
+    if (bin_hz)
+        *bin_hz = sweep->bin_hz;
+
+    return sweep->steps * sweep->bins_per_step;
+}
+
+int bladerf_sweep_run(struct bladerf_sweep *sweep, float *psd_db)
+{
+    struct sweep_slot *slot;
+    pthread_t fft;
+    unsigned int k;
+    int status = 0;
+
+    sweep->out = psd_db;
+    sweep->done = false;
+    sweep->slots[0].full = sweep->slots[1].full = false;
+
+    if (pthread_create(&fft, NULL, sweep_fft, sweep))
+        return BLADERF_ERR_UNEXPECTED;
+
+    for (k = 0; k < sweep->steps; k++) {
+        ctrl_lock(sweep->dev);
+        lms_set_precalculated_frequency(sweep->dev, RX, &sweep->tune[k]);
+        ctrl_unlock(sweep->dev);
+
+        status = sweep_flush(sweep);
+        if (status)
+            break;
+
+        slot = &sweep->slots[k & 1];
+
+        pthread_mutex_lock(&sweep->lock);
+        while (slot->full)
+            pthread_cond_wait(&sweep->cond, &sweep->lock);
+        pthread_mutex_unlock(&sweep->lock);
+
+        status = read_fill(sweep->dev, slot->buf, sweep->dwell);
+        if (status)
+            break;
+
+        pthread_mutex_lock(&sweep->lock);
+        slot->full = true;
+        pthread_cond_broadcast(&sweep->cond);
+        pthread_mutex_unlock(&sweep->lock);
+    }
+
+    pthread_mutex_lock(&sweep->lock);
+    sweep->done = true;
+    pthread_cond_broadcast(&sweep->cond);
+    pthread_mutex_unlock(&sweep->lock);
+
+    pthread_join(fft, NULL);
+
+    return status;
+}
@@ -0,0 +1,52 @@
+#ifndef CHECK_H_
+#define CHECK_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Helpers for the check programs run by `make check`. Each program takes
+ * the directory holding the reference vectors as its only argument, prints
+ * a line per failed check, and exits non-zero if any failed.
+ */
+static int check_failures;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("%s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        check_failures++; \
+    } \
+} while (0)
+
+/* Stop comparing vectors after this many failures */
+#define CHECK_MAX_FAILURES  20
+
+static inline int check_done(const char *name)
+{
+    printf("%-12s %s\n", name, check_failures ? "FAILED" : "ok");
+    return check_failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static inline FILE *check_open(int argc, char *argv[], const char *name)
+{
+    char path[4096];
+    FILE *f;
+
+    snprintf(path, sizeof(path), "%s/%s", argc > 1 ? argv[1] : ".", name);
+    f = fopen(path, "r");
+    if (!f)
+        printf("Failed to open %s\n", path);
+
+    return f;
+}
+
+/* Deterministic noise, so that failures reproduce */
+static inline double check_noise(unsigned int *state)
+{
+    *state = *state * 1103515245 + 12345;
+    return ((*state >> 8) & 0xffff) / 32768.0 - 1.0;
+}
+
+#endif
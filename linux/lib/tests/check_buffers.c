@@ -0,0 +1,52 @@
+/*
+ * Sample buffers stay valid after the device is closed, and are freed once
+ * the last set is returned
+ */
+#include <stdint.h>
+#include <string.h>
+
+#include "libbladeRF.h"
+#include "bladerf_priv.h"
+#include "check.h"
+
+#define NUM_BUFS        4
+#define BUF_SAMPLES     4096
+
+int main(int argc, char *argv[])
+{
+    struct bladerf dev;
+    int16_t **a = NULL, **b = NULL;
+    size_t i;
+    int status;
+
+    memset(&dev, 0, sizeof(dev));
+    if (buf_pool_create(&dev)) {
+        CHECK(0, "Failed to create pool");
+        return check_done("buffers");
+    }
+
+    status = bladerf_alloc_buffers(&dev, NUM_BUFS, BUF_SAMPLES, &a);
+    CHECK(status == 0, "First allocation failed: %d", status);
+    status = bladerf_alloc_buffers(&dev, NUM_BUFS, BUF_SAMPLES, &b);
+    CHECK(status == 0, "Second allocation failed: %d", status);
+    if (check_failures)
+        return check_done("buffers");
+
+    /* A returned set goes back to the pool while the device is open */
+    bladerf_free_buffers(&dev, b);
+
+    /* As bladerf_close() does, with 'a' still out */
+    buf_pool_destroy(&dev);
+    CHECK(dev.pool == NULL, "Pool still attached to the device");
+
+    for (i = 0; i < NUM_BUFS; i++)
+        memset(a[i], 0x5a, BUF_SAMPLES * 2 * sizeof(int16_t));
+    for (i = 0; i < NUM_BUFS; i++)
+        CHECK(a[i][0] == 0x5a5a && a[i][2 * BUF_SAMPLES - 1] == 0x5a5a,
+              "Buffer %zu lost after close", i);
+
+    /* The device is gone; the set still knows its pool */
+    bladerf_free_buffers(NULL, a);
+
+    return check_done("buffers");
+}
@@ -0,0 +1,90 @@
+/*
+ * bladerf_burst_align() against a known delay, with a socket standing in
+ * for the driver and a thread looping TX back to RX behind a run of zeros
+ */
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include "libbladeRF.h"
+#include "bladerf_priv.h"
+#include "check.h"
+
+#define LOOP_DELAY      12345           /* Samples */
+#define XFER_BYTES      (BLADERF_SAMPLES_PER_XFER * 2 * sizeof(int16_t))
+#define ALIGN_SAMPLES   (256 * 1024)
+
+/* Like the driver, each read and write is whole transfers */
+static void *loopback(void *arg)
+{
+    static char q[LOOP_DELAY * 4 + 2 * XFER_BYTES];
+    size_t held = LOOP_DELAY * 4;
+    int fd = *(int *)arg;
+    ssize_t ret;
+
+    for (;;) {
+        ret = read(fd, q + held, XFER_BYTES);
+        if (ret <= 0)
+            break;
+
+        for (held += ret; held >= XFER_BYTES; held -= XFER_BYTES) {
+            if (write(fd, q, XFER_BYTES) != (ssize_t)XFER_BYTES)
+                return NULL;
+            memmove(q, q + XFER_BYTES, held - XFER_BYTES);
+        }
+    }
+
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    struct bladerf dev;
+    pthread_t thread;
+    int64_t correction = 0;
+    int sv[2], status;
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv)) {
+        CHECK(0, "Failed to create socket pair");
+        return check_done("burst");
+    }
+
+    memset(&dev, 0, sizeof(dev));
+    dev.fd = sv[0];
+    if (buf_pool_create(&dev) ||
+            pthread_create(&thread, NULL, loopback, &sv[1])) {
+        CHECK(0, "Failed to set up");
+        return check_done("burst");
+    }
+
+    CHECK(bladerf_burst_align(&dev, ALIGN_SAMPLES, NULL) == BLADERF_ERR_INVAL,
+          "Aligned without a scheduler");
+
+    status = bladerf_burst_start(&dev, 0);
+    CHECK(status == 0, "Failed to start: %d", status);
+
+    status = bladerf_burst_align(&dev, ALIGN_SAMPLES, &correction);
+    CHECK(status == 0, "First alignment failed: %d", status);
+    CHECK(correction == LOOP_DELAY, "First correction %lld, expected %d",
+          (long long)correction, LOOP_DELAY);
+
+    /* Once corrected, the marker turns up where it is expected */
+    status = bladerf_burst_align(&dev, ALIGN_SAMPLES, &correction);
+    CHECK(status == 0, "Second alignment failed: %d", status);
+    CHECK(correction == 0, "Second correction %lld, expected 0",
+          (long long)correction);
+
+    /* Nothing reads RX any more, so unblock both threads' writes first */
+    signal(SIGPIPE, SIG_IGN);
+    shutdown(sv[0], SHUT_RDWR);
+    bladerf_burst_stop(&dev);
+    pthread_join(thread, NULL);
+    close(sv[0]);
+    close(sv[1]);
+    buf_pool_destroy(&dev);
+
+    return check_done("burst");
+}
@@ -0,0 +1,155 @@
+/*
+ * The channelizer on tones at channel centers, and its threaded, split and
+ * back-pressured runs against a plain one
+ */
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "libbladeRF.h"
+#include "check.h"
+
+#define CH_CHANNELS     16
+#define CH_TAPS         12
+#define CH_BLOCKS       256
+#define CH_SAMPLES      (CH_CHANNELS * CH_BLOCKS)
+#define CH_AMP          8000.0
+#define CH_SMALL_QUEUE  37
+
+static int16_t in[2 * CH_SAMPLES];
+static int16_t ref[CH_CHANNELS][2 * CH_BLOCKS], got[CH_CHANNELS][2 * CH_BLOCKS];
+
+static struct bladerf_channelizer *create(unsigned int threads,
+                                          size_t queue_len)
+{
+    struct bladerf_channelizer_config cfg = { CH_CHANNELS, CH_TAPS, threads,
+                                              queue_len };
+    struct bladerf_channelizer *chan;
+
+    if (bladerf_channelizer_create(&cfg, &chan)) {
+        CHECK(0, "Failed to create channelizer");
+        return NULL;
+    }
+
+    return chan;
+}
+
+/* Run 'in' through in calls of 'step' samples, draining the queues into
+ * out whenever they fill. Returns the samples per channel. */
+static size_t run(struct bladerf_channelizer *chan, size_t step,
+                  int16_t out[][2 * CH_BLOCKS])
+{
+    size_t i, k, done = 0, n;
+    unsigned int c;
+
+    for (i = 0; i < CH_SAMPLES; i += k) {
+        k = step < CH_SAMPLES - i ? step : CH_SAMPLES - i;
+        k = bladerf_channelizer_process(chan, in + 2 * i, k);
+
+        for (c = 0, n = 0; c < CH_CHANNELS; c++)
+            n = bladerf_channelizer_read(chan, c, out[c] + 2 * done,
+                                         CH_BLOCKS - done);
+        done += n;
+    }
+
+    return done;
+}
+
+/*
+ * A tone 'offset' channel widths from a channel's center comes out of it
+ * at that frequency, and is filtered out of the others
+ */
+static void check_tone(unsigned int tone, double offset)
+{
+    struct bladerf_channelizer *chan = create(0, CH_BLOCKS);
+    double ph, mag, leak = 0, err = 0;
+    size_t i, n;
+    unsigned int c;
+
+    if (!chan)
+        return;
+
+    for (i = 0; i < CH_SAMPLES; i++) {
+        ph = 2 * M_PI * ((double)tone - CH_CHANNELS / 2 + offset) * i /
+             CH_CHANNELS;
+        in[2 * i] = lrint(CH_AMP * cos(ph));
+        in[2 * i + 1] = lrint(CH_AMP * sin(ph));
+    }
+
+    n = run(chan, CH_SAMPLES, ref);
+    CHECK(n == CH_BLOCKS, "%zu samples per channel, expected %d",
+          n, CH_BLOCKS);
+
+    /* After the filter has filled */
+    for (c = 0; c < CH_CHANNELS; c++) {
+        for (i = CH_TAPS; i < n; i++) {
+            mag = hypot(ref[c][2 * i], ref[c][2 * i + 1]);
+            if (c == tone)
+                err = fmax(err, fabs(mag - CH_AMP));
+            else
+                leak = fmax(leak, mag);
+        }
+    }
+
+    CHECK(err < 0.01 * CH_AMP, "Channel %u: tone off by %g", tone, err);
+    CHECK(leak < 1e-3 * CH_AMP, "Channel %u: tone leaks %g into others",
+          tone, leak);
+
+    bladerf_channelizer_destroy(chan);
+}
+
+static void compare(const char *what, size_t n)
+{
+    unsigned int c;
+
+    CHECK(n == CH_BLOCKS, "%s: %zu samples per channel", what, n);
+    for (c = 0; c < CH_CHANNELS; c++)
+        CHECK(!memcmp(ref[c], got[c], sizeof(ref[c])),
+              "%s: channel %u differs", what, c);
+}
+
+static void check_runs(void)
+{
+    struct bladerf_channelizer *chan;
+    unsigned int seed = 9;
+    size_t i;
+
+    for (i = 0; i < 2 * CH_SAMPLES; i++)
+        in[i] = check_noise(&seed) * 16000;
+
+    chan = create(0, CH_BLOCKS);
+    if (!chan)
+        return;
+    run(chan, CH_SAMPLES, ref);
+
+    /* Partial blocks are carried over */
+    bladerf_channelizer_reset(chan);
+    compare("Split", run(chan, 7, got));
+    bladerf_channelizer_destroy(chan);
+
+    chan = create(4, CH_BLOCKS);
+    if (chan) {
+        compare("Threaded", run(chan, CH_SAMPLES, got));
+        bladerf_channelizer_destroy(chan);
+    }
+
+    /* Full queues stop processing until they are read */
+    chan = create(4, CH_SMALL_QUEUE);
+    if (chan) {
+        compare("Small queue", run(chan, CH_SAMPLES, got));
+        bladerf_channelizer_destroy(chan);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    check_tone(0, 0);
+    check_tone(3, 0.25);
+    check_tone(CH_CHANNELS / 2, 0);
+    check_tone(CH_CHANNELS / 2, -0.25);
+    check_tone(CH_CHANNELS - 1, 0.1);
+
+    check_runs();
+
+    return check_done("channelizer");
+}
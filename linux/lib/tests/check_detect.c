@@ -0,0 +1,111 @@
+/*
+ * The power detector on a tone burst in noise
+ */
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "libbladeRF.h"
+#include "check.h"
+
+#define DET_BLOCK       256
+#define DET_SAMPLES     (120 * DET_BLOCK)
+#define DET_ON          (40 * DET_BLOCK)
+#define DET_OFF         (80 * DET_BLOCK)
+#define DET_TONE_DB     -10.0
+#define DET_NOISE       30.0            /* LSB, about -60 dBFS */
+#define DET_MAX_EVENTS  8
+
+struct events {
+    struct bladerf_detector_event ev[DET_MAX_EVENTS];
+    size_t n;
+};
+
+static int16_t in[2 * DET_SAMPLES];
+
+static void record(const struct bladerf_detector_event *ev, void *user_data)
+{
+    struct events *e = user_data;
+
+    if (e->n < DET_MAX_EVENTS)
+        e->ev[e->n] = *ev;
+    e->n++;
+}
+
+static void run(bool use_peak, size_t step, struct events *e)
+{
+    struct bladerf_detector_config cfg = { DET_BLOCK, use_peak, true,
+                                           20.0f, 6.0f, 0.05f };
+    struct bladerf_detector *det;
+    size_t i, k;
+
+    memset(e, 0, sizeof(*e));
+    if (bladerf_detector_create(&cfg, record, e, &det)) {
+        CHECK(0, "Failed to create detector");
+        return;
+    }
+
+    for (i = 0; i < DET_SAMPLES; i += k) {
+        k = step < DET_SAMPLES - i ? step : DET_SAMPLES - i;
+        bladerf_detector_process(det, in + 2 * i, k);
+    }
+
+    bladerf_detector_destroy(det);
+}
+
+static void check_events(const char *what, const struct events *e)
+{
+    CHECK(e->n == 2, "%s: %zu events, expected 2", what, e->n);
+    if (e->n != 2)
+        return;
+
+    CHECK(e->ev[0].rising && e->ev[0].sample == DET_ON,
+          "%s: detection began at %llu", what,
+          (unsigned long long)e->ev[0].sample);
+    CHECK(!e->ev[1].rising && e->ev[1].sample == DET_OFF,
+          "%s: detection ended at %llu", what,
+          (unsigned long long)e->ev[1].sample);
+    CHECK(fabs(e->ev[0].avg_db - DET_TONE_DB) < 0.1,
+          "%s: tone read %.2f dBFS", what, e->ev[0].avg_db);
+    CHECK(e->ev[0].floor_db > -70 && e->ev[0].floor_db < -50,
+          "%s: noise floor %.1f dBFS", what, e->ev[0].floor_db);
+}
+
+int main(int argc, char *argv[])
+{
+    struct events one, split;
+    const double amp = 32767 * pow(10, DET_TONE_DB / 20);
+    unsigned int seed = 11;
+    double ph;
+    size_t i;
+
+    for (i = 0; i < DET_SAMPLES; i++) {
+        ph = 2 * M_PI * 0.0371 * i;
+        in[2 * i] = lrint(DET_NOISE * check_noise(&seed));
+        in[2 * i + 1] = lrint(DET_NOISE * check_noise(&seed));
+        if (i >= DET_ON && i < DET_OFF) {
+            in[2 * i] += lrint(amp * cos(ph));
+            in[2 * i + 1] += lrint(amp * sin(ph));
+        }
+    }
+
+    run(false, DET_SAMPLES, &one);
+    check_events("Average", &one);
+
+    /* Blocks spanning calls make no difference */
+    run(false, 97, &split);
+    CHECK(split.n == one.n, "Split calls give %zu events", split.n);
+    for (i = 0; i < split.n && i < one.n && i < DET_MAX_EVENTS; i++) {
+        CHECK(split.ev[i].sample == one.ev[i].sample &&
+              split.ev[i].rising == one.ev[i].rising &&
+              split.ev[i].avg_db == one.ev[i].avg_db &&
+              split.ev[i].peak_db == one.ev[i].peak_db &&
+              split.ev[i].floor_db == one.ev[i].floor_db,
+              "Split calls give a different event %zu", i);
+    }
+
+    run(true, DET_SAMPLES, &one);
+    check_events("Peak", &one);
+
+    return check_done("detect");
+}
@@ -0,0 +1,65 @@
+/*
+ * bladerf_fsk_demod_process() against vectors from a model of
+ * fsk_demodulator.vhd, in one call and split across many
+ */
+#include <stdint.h>
+#include <string.h>
+
+#include "libbladeRF.h"
+#include "check.h"
+
+#define FSK_VECTORS     8192
+
+static int16_t in[2 * FSK_VECTORS], expect[FSK_VECTORS], out[FSK_VECTORS];
+
+static void compare(const char *how, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n && check_failures < CHECK_MAX_FAILURES; i++) {
+        CHECK(out[i] == expect[i], "%s, sample %zu: got %d, expected %d",
+              how, i, out[i], expect[i]);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    struct bladerf_fsk_demod *demod;
+    FILE *f = check_open(argc, argv, "fsk.txt");
+    int re, im, ssd;
+    size_t n = 0, i, k;
+
+    if (!f) {
+        check_failures++;
+        return check_done("fsk");
+    }
+
+    while (n < FSK_VECTORS && fscanf(f, "%d %d %d", &re, &im, &ssd) == 3) {
+        in[2 * n] = re;
+        in[2 * n + 1] = im;
+        expect[n] = ssd;
+        n++;
+    }
+    fclose(f);
+    CHECK(n > 0, "No FSK vectors");
+
+    if (bladerf_fsk_demod_create(&demod)) {
+        CHECK(0, "Failed to create demodulator");
+        return check_done("fsk");
+    }
+
+    bladerf_fsk_demod_process(demod, in, out, n);
+    compare("One call", n);
+
+    /* Odd-sized calls exercise the scalar tail and the carried state */
+    bladerf_fsk_demod_reset(demod);
+    memset(out, 0, sizeof(out));
+    for (i = 0, k = 1; i < n; i += k, k = k % 13 + 1) {
+        k = k < n - i ? k : n - i;
+        bladerf_fsk_demod_process(demod, in + 2 * i, out + i, k);
+    }
+    compare("Split calls", n);
+
+    bladerf_fsk_demod_destroy(demod);
+    return check_done("fsk");
+}
@@ -0,0 +1,81 @@
+/*
+ * bladerf_iqcorr_process() on a tone with known DC offsets and IQ
+ * imbalance
+ */
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "libbladeRF.h"
+#include "check.h"
+
+#define IQ_BLOCK        1024
+#define IQ_SAMPLES      (256 * IQ_BLOCK)
+#define IQ_FREQ         (13.0 / IQ_BLOCK) /* Whole cycles per block */
+#define IQ_AMP          1000.0
+#define IQ_DC_I         -37.0
+#define IQ_DC_Q         52.0
+#define IQ_GAIN         1.08
+#define IQ_PHASE        4.0             /* Degrees */
+
+static int16_t raw[2 * IQ_SAMPLES], out[2 * IQ_SAMPLES];
+
+static int16_t to_int16(double v)
+{
+    return (int16_t)lrint(v);
+}
+
+int main(int argc, char *argv[])
+{
+    struct bladerf_iqcorr_config cfg = { IQ_BLOCK, 0.1f, true, NULL, 0 };
+    struct bladerf_iqcorr_stats stats;
+    struct bladerf_iqcorr *corr;
+    const double phi = IQ_PHASE * M_PI / 180;
+    unsigned int seed = 5;
+    double t, err = 0;
+    size_t i, k;
+
+    for (i = 0; i < IQ_SAMPLES; i++) {
+        t = 2 * M_PI * IQ_FREQ * i;
+        raw[2 * i] = to_int16(IQ_AMP * cos(t) + IQ_DC_I +
+                              check_noise(&seed));
+        raw[2 * i + 1] = to_int16(IQ_GAIN * IQ_AMP * sin(t + phi) + IQ_DC_Q +
+                                  check_noise(&seed));
+    }
+
+    if (bladerf_iqcorr_create(&cfg, &corr)) {
+        CHECK(0, "Failed to create corrector");
+        return check_done("iqcorr");
+    }
+
+    memcpy(out, raw, sizeof(raw));
+    bladerf_iqcorr_process(corr, out, IQ_SAMPLES);
+    bladerf_iqcorr_get_stats(corr, &stats);
+
+    CHECK(fabs(stats.dc_i - IQ_DC_I) < 0.5 && fabs(stats.dc_q - IQ_DC_Q) < 0.5,
+          "DC estimated at (%.2f, %.2f)", stats.dc_i, stats.dc_q);
+    CHECK(fabs(stats.gain - IQ_GAIN) < 1e-3, "Gain estimated at %.4f",
+          stats.gain);
+    CHECK(fabs(stats.phase - IQ_PHASE) < 0.05, "Phase estimated at %.3f",
+          stats.phase);
+
+    /* Once settled, the output is the clean tone */
+    for (i = IQ_SAMPLES / 2; i < IQ_SAMPLES; i++) {
+        t = 2 * M_PI * IQ_FREQ * i;
+        err = fmax(err, fabs(out[2 * i] - IQ_AMP * cos(t)));
+        err = fmax(err, fabs(out[2 * i + 1] - IQ_AMP * sin(t)));
+    }
+    CHECK(err < 4, "Corrected output off by %.2f LSB", err);
+
+    /* Calls split anywhere, across blocks and the vector loop's tails,
+     * correct the same */
+    bladerf_iqcorr_reset(corr);
+    for (i = 0, k = 1; i < IQ_SAMPLES; i += k, k = k * 5 % 1543) {
+        k = k < IQ_SAMPLES - i ? k : IQ_SAMPLES - i;
+        bladerf_iqcorr_process(corr, raw + 2 * i, k);
+    }
+    CHECK(!memcmp(raw, out, sizeof(out)), "Split calls differ");
+
+    bladerf_iqcorr_destroy(corr);
+    return check_done("iqcorr");
+}
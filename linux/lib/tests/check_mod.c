@@ -0,0 +1,194 @@
+/*
+ * bladerf_mod_process() against the root raised cosine pulse and each
+ * constellation, recovered with a matched filter
+ */
+#include <stdint.h>
+#include <string.h>
+#include <complex.h>
+#include <math.h>
+
+#include "libbladeRF.h"
+#include "check.h"
+
+#define MOD_SPS         4
+#define MOD_SPAN        16
+#define MOD_ROLLOFF     0.35
+#define MOD_PULSE       (MOD_SPAN * MOD_SPS + 1)
+#define MOD_BITS        4800            /* Whole symbols at 1 to 4 bits */
+#define MOD_SYMS_MAX    MOD_BITS
+#define MOD_SAMPLES     ((MOD_SYMS_MAX + MOD_SPAN) * MOD_SPS)
+
+static double pulse[MOD_PULSE];
+
+/* Written out from the textbook form, independent of mod.c */
+static void make_pulse(void)
+{
+    const double b = MOD_ROLLOFF;
+    double t;
+    int k;
+
+    for (k = 0; k < MOD_PULSE; k++) {
+        t = (k - (MOD_PULSE - 1) / 2.0) / MOD_SPS;
+        if (t == 0)
+            pulse[k] = 1 - b + 4 * b / M_PI;
+        else if (fabs(fabs(t) - 1 / (4 * b)) < 1e-9)
+            pulse[k] = b / M_SQRT2 * ((1 + 2 / M_PI) * sin(M_PI / (4 * b)) +
+                                      (1 - 2 / M_PI) * cos(M_PI / (4 * b)));
+        else
+            pulse[k] = (sin(M_PI * t * (1 - b)) +
+                        4 * b * t * cos(M_PI * t * (1 + b))) /
+                       (M_PI * t * (1 - 16 * b * b * t * t));
+    }
+}
+
+/* The constellations as documented in libbladeRF.h */
+static double complex point(bladerf_modulation m, unsigned int v)
+{
+    static const double level[4] = { -3, -1, 3, 1 };
+    unsigned int i;
+
+    switch (m) {
+        case BLADERF_MOD_BPSK:
+            return v ? -1 : 1;
+        case BLADERF_MOD_QPSK:
+            return ((v & 2 ? -1 : 1) + I * (v & 1 ? -1 : 1)) * M_SQRT1_2;
+        case BLADERF_MOD_8PSK:
+            /* Inverse Gray code */
+            for (i = v; v >>= 1; i ^= v);
+            return cexp(I * 2 * M_PI * i / 8);
+        default:
+            return level[v >> 2] + I * level[v & 3];
+    }
+}
+
+static int create(bladerf_modulation m, float amplitude,
+                  struct bladerf_mod **mod)
+{
+    struct bladerf_mod_config cfg = { m, MOD_SPS, MOD_SPAN, MOD_ROLLOFF,
+                                      amplitude };
+
+    if (bladerf_mod_create(&cfg, mod)) {
+        CHECK(0, "Failed to create modulator %d", m);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* One symbol, then the filter run out, is the pulse itself */
+static void check_pulse(void)
+{
+    static int16_t out[2 * (MOD_SPAN + 1) * MOD_SPS];
+    const uint8_t zero = 0;
+    struct bladerf_mod *mod;
+    double err = 0, g;
+    size_t n, k;
+
+    if (create(BLADERF_MOD_BPSK, 1.0, &mod))
+        return;
+
+    n = bladerf_mod_process(mod, &zero, 1, out);
+    CHECK(n == MOD_SPS, "One symbol gave %zu samples", n);
+    n += bladerf_mod_flush(mod, out + 2 * n);
+    CHECK(n == (MOD_SPAN + 1) * MOD_SPS, "Flush gave %zu samples in all", n);
+
+    g = out[MOD_PULSE - 1] / pulse[(MOD_PULSE - 1) / 2];
+    for (k = 0; k < n; k++) {
+        err = fmax(err, fabs(out[2 * k] - (k < MOD_PULSE ? g * pulse[k] : 0)));
+        err = fmax(err, abs(out[2 * k + 1]));
+    }
+    CHECK(err <= 1, "Pulse error %g LSB", err);
+
+    bladerf_mod_destroy(mod);
+}
+
+/* Bits b to b + n - 1 of 'bits', repacked from the first bit of 'out' */
+static void take_bits(const uint8_t *bits, size_t b, size_t n, uint8_t *out)
+{
+    size_t i;
+
+    memset(out, 0, (n + 7) / 8);
+    for (i = 0; i < n; i++, b++) {
+        if ((bits[b / 8] >> (7 - b % 8)) & 1)
+            out[i / 8] |= 0x80 >> (i % 8);
+    }
+}
+
+static void check_constellation(bladerf_modulation m, unsigned int bps,
+                                double half_distance)
+{
+    static uint8_t bits[MOD_BITS / 8], tmp[1];   /* Calls of up to 7 bits */
+    static int16_t out[2 * MOD_SAMPLES], split[2 * MOD_SAMPLES];
+    static double complex sym[MOD_SYMS_MAX], rx[MOD_SYMS_MAX];
+    const size_t nsyms = MOD_BITS / bps;
+    struct bladerf_mod *mod;
+    unsigned int seed = 7, v;
+    double complex num = 0, g;
+    double den = 0, err = 0, peak = 0;
+    size_t i, b, k, n, done;
+
+    if (create(m, 0.9, &mod))
+        return;
+
+    for (i = 0; i < sizeof(bits); i++)
+        bits[i] = (check_noise(&seed) + 1) * 128;
+
+    for (i = 0, b = 0; i < nsyms; i++) {
+        for (v = 0; b < (i + 1) * bps; b++)
+            v = v << 1 | ((bits[b / 8] >> (7 - b % 8)) & 1);
+        sym[i] = point(m, v);
+    }
+
+    n = bladerf_mod_process(mod, bits, MOD_BITS, out);
+    CHECK(n == nsyms * MOD_SPS, "%zu samples for %zu symbols", n, nsyms);
+    n += bladerf_mod_flush(mod, out + 2 * n);
+
+    for (i = 0; i < 2 * n; i++)
+        peak = fmax(peak, abs(out[i]));
+    CHECK(peak <= 0.9 * 32767 + 1, "Peak %g exceeds the amplitude", peak);
+
+    /* Partial symbols carry across calls of 1 to 7 bits */
+    bladerf_mod_reset(mod);
+    for (b = 0, k = 1, done = 0; b < MOD_BITS; b += k, k = k % 7 + 1) {
+        k = k < MOD_BITS - b ? k : MOD_BITS - b;
+        take_bits(bits, b, k, tmp);
+        done += bladerf_mod_process(mod, tmp, k, split + 2 * done);
+    }
+    done += bladerf_mod_flush(mod, split + 2 * done);
+    CHECK(done == n && !memcmp(out, split, 2 * n * sizeof(int16_t)),
+          "Split calls differ for modulation %d", m);
+
+    /* Matched filter, sampled at each symbol's peak */
+    for (i = 0; i < nsyms; i++) {
+        rx[i] = 0;
+        for (k = 0; k < MOD_PULSE; k++) {
+            b = i * MOD_SPS + MOD_PULSE - 1 - k;
+            rx[i] += (out[2 * b] + I * out[2 * b + 1]) * pulse[k];
+        }
+        num += rx[i] * conj(sym[i]);
+        den += creal(sym[i] * conj(sym[i]));
+    }
+
+    /* Each symbol must land well inside its decision region */
+    g = num / den;
+    CHECK(fabs(carg(g)) < 1e-3, "Modulation %d rotated by %g rad",
+          m, carg(g));
+    for (i = 0; i < nsyms; i++)
+        err = fmax(err, cabs(rx[i] / g - sym[i]) / half_distance);
+    CHECK(err < 0.05, "Modulation %d symbol error %.3f of the decision "
+          "distance", m, err);
+
+    bladerf_mod_destroy(mod);
+}
+
+int main(int argc, char *argv[])
+{
+    make_pulse();
+    check_pulse();
+    check_constellation(BLADERF_MOD_BPSK, 1, 1);
+    check_constellation(BLADERF_MOD_QPSK, 2, M_SQRT1_2);
+    check_constellation(BLADERF_MOD_8PSK, 3, sin(M_PI / 8));
+    check_constellation(BLADERF_MOD_16QAM, 4, 1);
+
+    return check_done("mod");
+}
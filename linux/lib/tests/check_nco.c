@@ -0,0 +1,156 @@
+/*
+ * bladerf_nco_generate() against vectors from a model of nco.vhd, and the
+ * mixers against the exact oscillator
+ */
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "libbladeRF.h"
+#include "check.h"
+
+#define NCO_VECTORS     8192
+#define MIX_SAMPLES     1003
+#define MIX_RATIO       0.1234567
+
+static int16_t vec[NCO_VECTORS][3];
+
+static void check_vectors(FILE *f)
+{
+    struct bladerf_nco *nco;
+    int16_t out[2 * NCO_VECTORS];
+    int d, re, im;
+    size_t n = 0, i, j;
+
+    while (n < NCO_VECTORS && fscanf(f, "%d %d %d", &d, &re, &im) == 3) {
+        vec[n][0] = d;
+        vec[n][1] = re;
+        vec[n][2] = im;
+        n++;
+    }
+    CHECK(n > 0, "No NCO vectors");
+
+    if (bladerf_nco_create(0, &nco)) {
+        CHECK(0, "Failed to create NCO");
+        return;
+    }
+
+    /* Runs of equal increments go through in one call */
+    for (i = 0; i < n; i = j) {
+        for (j = i + 1; j < n && vec[j][0] == vec[i][0]; j++);
+
+        bladerf_nco_set_dphase(nco, vec[i][0]);
+        bladerf_nco_generate(nco, out + 2 * i, j - i);
+    }
+
+    for (i = 0; i < n && check_failures < CHECK_MAX_FAILURES; i++) {
+        CHECK(out[2 * i] == vec[i][1] && out[2 * i + 1] == vec[i][2],
+              "Sample %zu: got (%d, %d), expected (%d, %d)", i,
+              out[2 * i], out[2 * i + 1], vec[i][1], vec[i][2]);
+    }
+
+    bladerf_nco_destroy(nco);
+}
+
+static void check_mixers(void)
+{
+    struct bladerf_nco *nco;
+    static float f[2 * MIX_SAMPLES], f2[2 * MIX_SAMPLES];
+    static int16_t s[2 * MIX_SAMPLES], s2[2 * MIX_SAMPLES];
+    double ph, err_f = 0, err_s = 0;
+    size_t i, k;
+
+    if (bladerf_nco_create(0, &nco)) {
+        CHECK(0, "Failed to create NCO");
+        return;
+    }
+
+    CHECK(bladerf_nco_set_frequency(nco, 0.6) == BLADERF_ERR_RANGE,
+          "Out of range frequency accepted");
+    CHECK(bladerf_nco_set_dphase(nco, BLADERF_NCO_PI + 1) == BLADERF_ERR_RANGE,
+          "Out of range dphase accepted");
+    CHECK(bladerf_nco_set_frequency(nco, MIX_RATIO) == 0,
+          "Failed to set frequency");
+
+    for (i = 0; i < MIX_SAMPLES; i++) {
+        f[2 * i] = 1;
+        f[2 * i + 1] = 0;
+        s[2 * i] = 16384;
+        s[2 * i + 1] = 0;
+    }
+    memcpy(f2, f, sizeof(f));
+    memcpy(s2, s, sizeof(s));
+
+    bladerf_nco_mix_cf32(nco, f, MIX_SAMPLES);
+    bladerf_nco_reset(nco);
+    bladerf_nco_mix_c16(nco, s, MIX_SAMPLES);
+
+    for (i = 0; i < MIX_SAMPLES; i++) {
+        ph = 2 * M_PI * fmod(MIX_RATIO * i, 1.0);
+        err_f = fmax(err_f, fabs(f[2 * i] - cos(ph)));
+        err_f = fmax(err_f, fabs(f[2 * i + 1] - sin(ph)));
+        err_s = fmax(err_s, fabs(s[2 * i] - 16384 * cos(ph)));
+        err_s = fmax(err_s, fabs(s[2 * i + 1] - 16384 * sin(ph)));
+    }
+
+    CHECK(err_f < 1e-5, "cf32 mixer error %g", err_f);
+    CHECK(err_s < 2.5, "c16 mixer error %g LSB", err_s);
+
+    /* Odd-sized calls exercise the scalar tails and phase carry-over */
+    bladerf_nco_reset(nco);
+    for (i = 0, k = 1; i < MIX_SAMPLES; i += k, k = k % 7 + 1) {
+        k = k < MIX_SAMPLES - i ? k : MIX_SAMPLES - i;
+        bladerf_nco_mix_cf32(nco, f2 + 2 * i, k);
+    }
+    bladerf_nco_reset(nco);
+    for (i = 0, k = 1; i < MIX_SAMPLES; i += k, k = k % 7 + 1) {
+        k = k < MIX_SAMPLES - i ? k : MIX_SAMPLES - i;
+        bladerf_nco_mix_c16(nco, s2 + 2 * i, k);
+    }
+
+    for (i = 0; i < 2 * MIX_SAMPLES; i++) {
+        CHECK(fabs(f[i] - f2[i]) < 1e-6, "cf32 split mismatch at %zu", i / 2);
+        CHECK(s[i] == s2[i], "c16 split mismatch at %zu", i / 2);
+        if (check_failures >= CHECK_MAX_FAILURES)
+            break;
+    }
+
+    bladerf_nco_destroy(nco);
+}
+
+/* The 16-bit increments are the top bits of the 32-bit ones */
+static void check_resolution(void)
+{
+    struct bladerf_nco *a, *b;
+    int16_t oa[2 * 64], ob[2 * 64];
+
+    if (bladerf_nco_create(-100, &a) || bladerf_nco_create(0, &b)) {
+        CHECK(0, "Failed to create NCO");
+        return;
+    }
+
+    bladerf_nco_set_frequency(b, -100.0 / (2 * BLADERF_NCO_PI));
+    bladerf_nco_generate(a, oa, 64);
+    bladerf_nco_generate(b, ob, 64);
+    CHECK(!memcmp(oa, ob, sizeof(oa)), "Increments disagree");
+
+    bladerf_nco_destroy(a);
+    bladerf_nco_destroy(b);
+}
+
+int main(int argc, char *argv[])
+{
+    FILE *f = check_open(argc, argv, "nco.txt");
+
+    if (f) {
+        check_vectors(f);
+        fclose(f);
+    } else {
+        check_failures++;
+    }
+
+    check_mixers();
+    check_resolution();
+
+    return check_done("nco");
+}
@@ -0,0 +1,132 @@
+/*
+ * The FFT against a direct DFT, and the PSD estimator's scaling and
+ * threading
+ */
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "libbladeRF.h"
+#include "fft.h"
+#include "check.h"
+
+#define DFT_MAX         1024
+#define PSD_SIZE        1024
+#define PSD_FRAMES      8
+#define PSD_TONE_BIN    100
+
+/* Sizes with odd and even log2 take the radix-2 first pass or not */
+static void check_fft(size_t n, unsigned int *seed)
+{
+    static float re[DFT_MAX], im[DFT_MAX], xre[DFT_MAX], xim[DFT_MAX];
+    struct fft *f = fft_create(n);
+    double sr, si, a, err = 0, peak = 0;
+    size_t i, k;
+
+    if (!f) {
+        CHECK(0, "Failed to create %zu-point FFT", n);
+        return;
+    }
+
+    for (i = 0; i < n; i++) {
+        xre[i] = check_noise(seed);
+        xim[i] = check_noise(seed);
+        re[f->bitrev[i]] = xre[i];
+        im[f->bitrev[i]] = xim[i];
+    }
+
+    fft_execute(f, re, im);
+
+    for (k = 0; k < n; k++) {
+        sr = si = 0;
+        for (i = 0; i < n; i++) {
+            a = -2 * M_PI * (double)((i * k) % n) / n;
+            sr += xre[i] * cos(a) - xim[i] * sin(a);
+            si += xre[i] * sin(a) + xim[i] * cos(a);
+        }
+        err = fmax(err, hypot(re[k] - sr, im[k] - si));
+        peak = fmax(peak, hypot(sr, si));
+    }
+
+    CHECK(err < 1e-5 * peak, "%zu-point FFT error %g of %g", n, err, peak);
+    fft_destroy(f);
+}
+
+static void run_psd(unsigned int threads, const int16_t *s, float *db)
+{
+    struct bladerf_psd_config cfg = { PSD_SIZE, BLADERF_PSD_AVG_EXP, 0.5f,
+                                      threads };
+    struct bladerf_psd *psd;
+    uint64_t frames = 0;
+    size_t i, k;
+
+    if (bladerf_psd_create(&cfg, &psd)) {
+        CHECK(0, "Failed to create PSD with %u threads", threads);
+        return;
+    }
+
+    CHECK(bladerf_psd_get(psd, db) == BLADERF_ERR_INVAL,
+          "Got a spectrum before any frame");
+
+    /* Frames span calls of awkward sizes */
+    for (i = 0, k = 1; i < PSD_SIZE * PSD_FRAMES; i += k, k = k * 3 % 1531) {
+        k = k < PSD_SIZE * PSD_FRAMES - i ? k : PSD_SIZE * PSD_FRAMES - i;
+        frames += bladerf_psd_process(psd, s + 2 * i, k);
+    }
+
+    CHECK(frames == PSD_FRAMES, "%u threads: %llu frames, expected %d",
+          threads, (unsigned long long)frames, PSD_FRAMES);
+    CHECK(bladerf_psd_get(psd, db) == 0, "Failed to get spectrum");
+
+    bladerf_psd_destroy(psd);
+}
+
+static void check_psd(void)
+{
+    static int16_t s[2 * PSD_SIZE * PSD_FRAMES];
+    static float db[PSD_SIZE], db4[PSD_SIZE];
+    double ph;
+    float far = -1000;
+    size_t i, tone = PSD_SIZE / 2 + PSD_TONE_BIN;
+
+    for (i = 0; i < PSD_SIZE * PSD_FRAMES; i++) {
+        ph = 2 * M_PI * PSD_TONE_BIN * (double)i / PSD_SIZE;
+        s[2 * i] = lrint(32767 * cos(ph));
+        s[2 * i + 1] = lrint(32767 * sin(ph));
+    }
+
+    run_psd(0, s, db);
+    run_psd(4, s, db4);
+
+    CHECK(fabsf(db[tone]) < 0.01f, "Full-scale tone at %.3f dBFS",
+          db[tone]);
+
+    /* Beyond the Hann window's main lobe */
+    for (i = 0; i < PSD_SIZE; i++) {
+        if (i + 2 < tone || i > tone + 2)
+            far = fmaxf(far, db[i]);
+    }
+    CHECK(far < -90, "Leakage at %.1f dBFS", far);
+
+    for (i = 0; i < PSD_SIZE; i++) {
+        CHECK(db[i] == db4[i], "Bin %zu differs with threads: %g, %g",
+              i, db[i], db4[i]);
+        if (check_failures >= CHECK_MAX_FAILURES)
+            break;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int seed = 1;
+    size_t n;
+
+    CHECK(fft_create(48) == NULL, "Created a 48-point FFT");
+
+    for (n = 4; n <= DFT_MAX; n *= 2)
+        check_fft(n, &seed);
+
+    check_psd();
+
+    return check_done("psd");
+}
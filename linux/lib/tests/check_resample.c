@@ -0,0 +1,303 @@
+/*
+ * The polyphase resampler against a direct convolution on the interpolated
+ * grid, and through a stream with a socket standing in for the driver
+ */
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <math.h>
+
+#include "libbladeRF.h"
+#include "bladerf_priv.h"
+#include "filter.h"
+#include "check.h"
+
+#define RS_TAPS         16
+#define RS_CUTOFF       0.9f
+#define RS_INPUT        3000
+#define RS_MAX_INTERP   160             /* Of the ratios checked */
+#define RS_OUTPUT_MAX   (5 * RS_INPUT + 2)
+#define RS_LEVEL        20000.0
+
+#define XFER_BYTES      (BLADERF_SAMPLES_PER_XFER * 2 * sizeof(int16_t))
+#define STREAM_XFERS    48
+#define STREAM_SAMPLES  (STREAM_XFERS * BLADERF_SAMPLES_PER_XFER)
+
+static float in_f[2 * RS_INPUT];
+static int16_t in_s[2 * RS_INPUT];
+
+static int create(unsigned int interp, unsigned int decim,
+                  struct bladerf_resampler **rs)
+{
+    struct bladerf_resampler_config cfg = { interp, decim, RS_TAPS,
+                                            RS_CUTOFF };
+
+    if (bladerf_resampler_create(&cfg, rs)) {
+        CHECK(0, "Failed to create %u/%u resampler", interp, decim);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Output k is at k * decim on the grid upsampled by interp, where input m
+ * sits at m * interp. 'interp' and 'decim' are in lowest terms.
+ */
+static void check_ratio(unsigned int interp, unsigned int decim,
+                        unsigned int g)
+{
+    static double h[RS_TAPS * RS_MAX_INTERP];
+    static float out_f[2 * RS_OUTPUT_MAX];
+    static int16_t out_s[2 * RS_OUTPUT_MAX], split[2 * RS_OUTPUT_MAX];
+    const size_t len = RS_TAPS * interp;
+    const size_t expect = (RS_INPUT * interp + decim - 1) / decim;
+    struct bladerf_resampler *rs;
+    double sum, yr, yi, err_f = 0, err_s = 0;
+    size_t n, ns, k, m, i, j, t;
+
+    if (create(interp * g, decim * g, &rs))
+        return;
+
+    sum = filter_kaiser_sinc(h, len, RS_CUTOFF * 0.5 /
+                             (interp > decim ? interp : decim), 8.0);
+
+    n = bladerf_resample_cf32(rs, in_f, RS_INPUT, out_f);
+    CHECK(n == expect, "%u/%u: %zu outputs, expected %zu",
+          interp, decim, n, expect);
+    CHECK(n <= bladerf_resampler_max_output(rs, RS_INPUT),
+          "%u/%u: more output than the documented bound", interp, decim);
+
+    bladerf_resampler_reset(rs);
+    ns = bladerf_resample_c16(rs, in_s, RS_INPUT, out_s);
+    CHECK(ns == n, "%u/%u: c16 gave %zu outputs, cf32 %zu",
+          interp, decim, ns, n);
+
+    for (k = 0; k < n && k < ns; k++) {
+        yr = yi = 0;
+        for (m = k * decim / interp; ; m--) {
+            t = k * decim - m * interp;
+            if (t >= len)
+                break;
+            yr += in_f[2 * m] * h[t];
+            yi += in_f[2 * m + 1] * h[t];
+            if (m == 0)
+                break;
+        }
+        yr *= interp / sum;
+        yi *= interp / sum;
+
+        err_f = fmax(err_f, fmax(fabs(out_f[2 * k] - yr),
+                                 fabs(out_f[2 * k + 1] - yi)));
+        err_s = fmax(err_s, fmax(fabs(out_s[2 * k] - RS_LEVEL * yr),
+                                 fabs(out_s[2 * k + 1] - RS_LEVEL * yi)));
+    }
+
+    CHECK(err_f < 1e-5, "%u/%u: cf32 error %g", interp, decim, err_f);
+    /* Coefficients are Q14 */
+    CHECK(err_s < 8, "%u/%u: c16 error %g LSB", interp, decim, err_s);
+
+    /* The stream may be split anywhere */
+    bladerf_resampler_reset(rs);
+    for (i = 0, j = 1, ns = 0; i < RS_INPUT; i += j, j = j * 5 % 97) {
+        j = j < RS_INPUT - i ? j : RS_INPUT - i;
+        ns += bladerf_resample_c16(rs, in_s + 2 * i, j, split + 2 * ns);
+    }
+    CHECK(ns == n && !memcmp(out_s, split, 2 * n * sizeof(int16_t)),
+          "%u/%u: split calls differ", interp, decim);
+
+    bladerf_resampler_destroy(rs);
+}
+
+/* Unity gain: a constant input settles to the same constant */
+static void check_dc(unsigned int interp, unsigned int decim)
+{
+    static int16_t dc[2 * RS_INPUT], out[2 * RS_OUTPUT_MAX];
+    struct bladerf_resampler *rs;
+    double err = 0;
+    size_t i, n;
+
+    if (create(interp, decim, &rs))
+        return;
+
+    for (i = 0; i < RS_INPUT; i++) {
+        dc[2 * i] = 10000;
+        dc[2 * i + 1] = -10000;
+    }
+
+    n = bladerf_resample_c16(rs, dc, RS_INPUT, out);
+    for (i = n / 2; i < n; i++) {
+        err = fmax(err, fabs(out[2 * i] - 10000.0));
+        err = fmax(err, fabs(out[2 * i + 1] + 10000.0));
+    }
+    CHECK(err <= 2, "%u/%u: DC off by %g LSB", interp, decim, err);
+
+    bladerf_resampler_destroy(rs);
+}
+
+/* The far end of the socket, in whole transfers like the driver */
+struct far_end {
+    int fd;
+    int16_t *samples;
+    size_t n;
+};
+
+static void *rx_source(void *arg)
+{
+    struct far_end *f = arg;
+    size_t i;
+
+    for (i = 0; i < f->n; i += BLADERF_SAMPLES_PER_XFER) {
+        if (write(f->fd, f->samples + 2 * i, XFER_BYTES) != XFER_BYTES)
+            break;
+    }
+
+    return NULL;
+}
+
+/* Sends may be many transfers at once, so TX goes over a byte stream */
+static void *tx_sink(void *arg)
+{
+    struct far_end *f = arg;
+    size_t bytes = 0;
+    ssize_t ret;
+
+    for (;;) {
+        ret = read(f->fd, (char *)f->samples + bytes, XFER_BYTES);
+        if (ret <= 0)
+            break;
+        bytes += ret;
+    }
+
+    f->n = bytes / (2 * sizeof(int16_t));
+
+    return NULL;
+}
+
+/*
+ * RX at 2/3 of the device's rate and TX at 3/2 of the application's, each
+ * against the same resampler run standalone
+ */
+static void check_stream(void)
+{
+    static int16_t dev_s[2 * (STREAM_SAMPLES * 3 / 2 + 2 *
+                              BLADERF_SAMPLES_PER_XFER)];
+    static int16_t app_s[2 * STREAM_SAMPLES], ref[2 * STREAM_SAMPLES * 2];
+    struct bladerf_resampler *rs, *ref_rs;
+    struct far_end far;
+    struct bladerf dev;
+    pthread_t thread;
+    unsigned int seed = 3;
+    size_t i, n, k, got;
+    ssize_t ret;
+    int sv[2], tv[2];
+
+    memset(&dev, 0, sizeof(dev));
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) ||
+            socketpair(AF_UNIX, SOCK_STREAM, 0, tv) || buf_pool_create(&dev)) {
+        CHECK(0, "Failed to set up");
+        return;
+    }
+    dev.fd = sv[0];
+
+    for (i = 0; i < 2 * STREAM_SAMPLES; i++)
+        app_s[i] = check_noise(&seed) * 16384;
+
+    /* RX */
+    far = (struct far_end){ sv[1], app_s, STREAM_SAMPLES };
+    if (create(2, 3, &rs) || create(2, 3, &ref_rs) ||
+            bladerf_resampler_attach(&dev, RX, rs) ||
+            pthread_create(&thread, NULL, rx_source, &far)) {
+        CHECK(0, "Failed to start RX");
+        return;
+    }
+
+    n = bladerf_resample_c16(ref_rs, app_s, STREAM_SAMPLES, ref);
+    /* Reads too small for a whole transfer are refused */
+    for (got = 0, k = 1; got < n; k = k * 7 % 4001) {
+        ret = bladerf_read_c16(&dev, dev_s + 2 * got, k + 1024);
+        if (ret >= 0) {
+            got += ret;
+        } else if (ret != BLADERF_ERR_INVAL) {
+            CHECK(0, "RX read failed: %zd", ret);
+            break;
+        }
+    }
+    pthread_join(thread, NULL);
+
+    CHECK(got == n, "RX gave %zu samples, expected %zu", got, n);
+    CHECK(!memcmp(dev_s, ref, 2 * n * sizeof(int16_t)),
+          "RX differs from the standalone resampler");
+
+    bladerf_resampler_attach(&dev, RX, NULL);
+    bladerf_resampler_destroy(rs);
+    bladerf_resampler_destroy(ref_rs);
+
+    /* TX, including the samples padded out by detaching */
+    dev.fd = tv[0];
+    far = (struct far_end){ tv[1], dev_s, 0 };
+    if (create(3, 2, &rs) || create(3, 2, &ref_rs) ||
+            bladerf_resampler_attach(&dev, TX, rs) ||
+            pthread_create(&thread, NULL, tx_sink, &far)) {
+        CHECK(0, "Failed to start TX");
+        return;
+    }
+
+    for (i = 0, k = 1; i < STREAM_SAMPLES; i += k, k = k * 7 % 4001) {
+        k = k < STREAM_SAMPLES - i ? k : STREAM_SAMPLES - i;
+        ret = bladerf_send_c16(&dev, app_s + 2 * i, k);
+        CHECK(ret == (ssize_t)k, "TX sent %zd of %zu", ret, k);
+    }
+
+    CHECK(bladerf_resampler_attach(&dev, TX, NULL) == 0, "TX detach failed");
+    shutdown(tv[0], SHUT_WR);
+    pthread_join(thread, NULL);
+
+    n = bladerf_resample_c16(ref_rs, app_s, STREAM_SAMPLES, ref);
+    CHECK(far.n % BLADERF_SAMPLES_PER_XFER == 0 &&
+          far.n >= n && far.n - n < BLADERF_SAMPLES_PER_XFER,
+          "TX sent %zu samples for %zu", far.n, n);
+    CHECK(!memcmp(dev_s, ref, 2 * n * sizeof(int16_t)),
+          "TX differs from the standalone resampler");
+    for (i = 2 * n; i < 2 * far.n; i++) {
+        CHECK(dev_s[i] == 0, "TX padding not zero");
+        if (dev_s[i])
+            break;
+    }
+
+    bladerf_resampler_destroy(rs);
+    bladerf_resampler_destroy(ref_rs);
+    close(sv[0]);
+    close(sv[1]);
+    close(tv[0]);
+    close(tv[1]);
+    buf_pool_destroy(&dev);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int seed = 1;
+    size_t i;
+
+    for (i = 0; i < 2 * RS_INPUT; i++) {
+        in_f[i] = check_noise(&seed);
+        in_s[i] = lrint(RS_LEVEL * in_f[i]);
+        in_f[i] = in_s[i] / RS_LEVEL;
+    }
+
+    check_ratio(3, 2, 1);
+    check_ratio(2, 3, 2);       /* Created as 4/6 */
+    check_ratio(160, 147, 1);
+    check_ratio(1, 4, 1);
+    check_ratio(5, 1, 1);
+
+    check_dc(1, 1);
+    check_dc(160, 147);
+    check_dc(1, 4);
+
+    check_stream();
+
+    return check_done("resample");
+}
@@ -0,0 +1,321 @@
+/*
+ * Clock-by-clock model of the FPGA's DSP blocks in
+ * hdl/fpga/ip/nuand/synthesis, used to generate the reference vectors in
+ * this directory. Each process is a function of the registers before the
+ * clock edge, as in the VHDL, and input valid is deasserted now and then so
+ * the pipelines see bubbles like in the testbenches.
+ *
+ * This is kept apart from the library on purpose: it follows the VHDL
+ * signal by signal rather than sample by sample, so the vectors check the
+ * library's shortcuts instead of repeating them.
+ *
+ * Rebuild the vectors with `make vectors`.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define NUM_STAGES      12
+#define NCO_SAMPLES     5120
+#define NCO_RAMP        4096
+#define FSK_SAMPLES     4096
+#define FSK_SYMBOL      8
+
+/* numeric_std arithmetic on signed(15 downto 0) wraps */
+#define S16(v)          ((int16_t)(v))
+
+/* cordic_p */
+enum cordic_mode {
+    CORDIC_ROTATION,
+    CORDIC_VECTORING
+};
+
+struct cordic_xyz {
+    int16_t x, y, z;
+    int valid;
+};
+
+/* cordic.vhd */
+struct cordic {
+    enum cordic_mode mode;
+    struct cordic_xyz xyzs[NUM_STAGES];
+    struct cordic_xyz outputs;
+};
+
+static int K[NUM_STAGES];
+
+static void cordic_table(void)
+{
+    int i;
+
+    /* integer(round(...)) rounds halves away from zero, as round() does */
+    for (i = 0; i < NUM_STAGES; i++)
+        K[i] = (int)round(pow(2, NUM_STAGES) * atan(pow(2, -i)) / M_PI);
+}
+
+static void cordic_reset(struct cordic *c, enum cordic_mode mode)
+{
+    memset(c, 0, sizeof(*c));
+    c->mode = mode;
+}
+
+static void cordic_clock(struct cordic *c, struct cordic_xyz inputs)
+{
+    struct cordic_xyz next[NUM_STAGES], *n;
+    const struct cordic_xyz *s;
+    int i;
+
+    memcpy(next, c->xyzs, sizeof(next));
+
+    next[0].valid = inputs.valid;
+    if (inputs.valid) {
+        n = &next[0];
+        if (c->mode == CORDIC_ROTATION) {
+            if (inputs.z > (1 << (NUM_STAGES - 1))) {
+                n->x = S16(-inputs.x);
+                n->y = S16(-inputs.y);
+                n->z = S16(inputs.z - (1 << NUM_STAGES));
+            } else if (inputs.z < -(1 << (NUM_STAGES - 1))) {
+                n->x = S16(-inputs.x);
+                n->y = S16(-inputs.y);
+                n->z = S16(inputs.z + (1 << NUM_STAGES));
+            } else {
+                n->x = inputs.x;
+                n->y = inputs.y;
+                n->z = inputs.z;
+            }
+        } else {
+            if (inputs.x < 0 && inputs.y < 0) {
+                n->x = S16(-inputs.x);
+                n->y = S16(-inputs.y);
+                n->z = S16(inputs.z - (1 << NUM_STAGES));
+            } else if (inputs.x < 0) {
+                n->x = S16(-inputs.x);
+                n->y = S16(-inputs.y);
+                n->z = S16(inputs.z + (1 << NUM_STAGES));
+            } else {
+                n->x = inputs.x;
+                n->y = inputs.y;
+                n->z = inputs.z;
+            }
+        }
+    }
+
+    for (i = 0; i < NUM_STAGES - 1; i++) {
+        s = &c->xyzs[i];
+        n = &next[i + 1];
+        n->valid = s->valid;
+        if (!s->valid)
+            continue;
+
+        if (c->mode == CORDIC_ROTATION) {
+            if (s->z < 0) {
+                n->x = S16(s->x + (s->y >> i));
+                n->y = S16(s->y - (s->x >> i));
+                n->z = S16(s->z + K[i]);
+            } else {
+                n->x = S16(s->x - (s->y >> i));
+                n->y = S16(s->y + (s->x >> i));
+                n->z = S16(s->z - K[i]);
+            }
+        } else {
+            if (s->y < 0) {
+                n->x = S16(s->x - (s->y >> i));
+                n->y = S16(s->y + (s->x >> i));
+                n->z = S16(s->z - K[i]);
+            } else {
+                n->x = S16(s->x + (s->y >> i));
+                n->y = S16(s->y - (s->x >> i));
+                n->z = S16(s->z + K[i]);
+            }
+        }
+    }
+
+    c->outputs = c->xyzs[NUM_STAGES - 1];
+    memcpy(c->xyzs, next, sizeof(next));
+}
+
+/* Pseudo-random valid pattern and stimulus, the same on every host */
+static uint32_t lcg_state = 1;
+
+static uint32_t lcg(void)
+{
+    lcg_state = lcg_state * 1103515245 + 12345;
+    return (lcg_state >> 16) & 0x7fff;
+}
+
+/* nco.vhd */
+struct nco {
+    int16_t phase;
+    struct cordic cordic;
+};
+
+static void nco_clock(struct nco *nco, int16_t dphase, int valid)
+{
+    struct cordic_xyz cordic_inputs = { 1234, 0, nco->phase, valid };
+    int16_t temp;
+
+    cordic_clock(&nco->cordic, cordic_inputs);
+
+    if (valid) {
+        temp = S16(nco->phase + dphase);
+        if (temp > 4096)
+            temp -= 8192;
+        else if (temp < -4096)
+            temp += 8192;
+        nco->phase = temp;
+    }
+}
+
+/*
+ * One line per sample: the dphase presented with it, then re and im. As in
+ * nco_tb.vhd the increment ramps up and down between -4096 and 4096, here
+ * in steps of 3, followed by a stretch at a constant increment.
+ */
+static void gen_nco(void)
+{
+    static int16_t dphase[NCO_SAMPLES];
+    struct nco nco;
+    int n = 0, out = 0, d = -4096, step = 3;
+    int16_t in = 0;
+    int valid;
+
+    cordic_reset(&nco.cordic, CORDIC_ROTATION);
+    nco.phase = 0;
+
+    while (out < NCO_SAMPLES) {
+        valid = n < NCO_SAMPLES && lcg() % 8 != 0;
+        if (valid) {
+            in = n < NCO_RAMP ? d : 1234;
+            dphase[n++] = in;
+
+            if (d + step > 4096 || d + step < -4096)
+                step = -step;
+            d += step;
+        }
+
+        nco_clock(&nco, in, valid);
+
+        if (nco.cordic.outputs.valid) {
+            printf("%d %d %d\n", dphase[out], nco.cordic.outputs.x,
+                   nco.cordic.outputs.y);
+            out++;
+        }
+    }
+}
+
+/* fsk_demodulator.vhd */
+struct fsk {
+    struct cordic cordic;
+    int16_t prev_z, delta_z, unwrapped_z, out_ssd;
+    int delta_z_valid, unwrapped_valid, out_valid;
+};
+
+static void fsk_clock(struct fsk *fsk, int16_t in_real, int16_t in_imag,
+                      int in_valid)
+{
+    struct cordic_xyz cordic_inputs = { in_real, in_imag, 0, in_valid };
+    struct cordic_xyz z = fsk->cordic.outputs;
+    int16_t delta_z = fsk->delta_z;
+    int delta_z_valid = fsk->delta_z_valid;
+    int16_t unwrapped_z = fsk->unwrapped_z;
+    int unwrapped_valid = fsk->unwrapped_valid;
+
+    cordic_clock(&fsk->cordic, cordic_inputs);
+
+    /* find_derivative */
+    fsk->delta_z_valid = z.valid;
+    if (z.valid) {
+        fsk->delta_z = S16(z.z - fsk->prev_z);
+        fsk->prev_z = z.z;
+    }
+
+    /* unwrap */
+    fsk->unwrapped_valid = delta_z_valid;
+    if (delta_z > 4096)
+        fsk->unwrapped_z = S16(delta_z - 8192);
+    else if (delta_z < -4096)
+        fsk->unwrapped_z = S16(delta_z + 8192);
+    else
+        fsk->unwrapped_z = delta_z;
+
+    /* out_ssd and out_valid */
+    if (unwrapped_valid)
+        fsk->out_ssd = S16(fsk->out_ssd - (fsk->out_ssd >> 4) + unwrapped_z);
+    fsk->out_valid = unwrapped_valid;
+}
+
+static int16_t clamp16(double v)
+{
+    long l = lrint(v);
+    return l > INT16_MAX ? INT16_MAX : (l < INT16_MIN ? INT16_MIN : l);
+}
+
+/*
+ * One line per sample: in_real, in_imag, then out_ssd. The input is noisy
+ * FSK at two deviations with a slowly swept amplitude, then a few samples at
+ * the corners of the 16-bit range where negation wraps.
+ */
+static void gen_fsk(void)
+{
+    static int16_t in[FSK_SAMPLES][2];
+    static const int16_t corners[][2] = {
+        { 0, 0 }, { -32768, -32768 }, { -32768, 0 }, { 0, -32768 },
+        { 32767, -32768 }, { -32768, 32767 }, { 32767, 32767 }, { -1, -1 },
+    };
+    const int ncorners = sizeof(corners) / sizeof(corners[0]);
+    struct fsk fsk;
+    double ph = 0, f = 0, amp, noise;
+    int n = 0, out = 0, i, valid;
+
+    for (i = 0; i < FSK_SAMPLES - ncorners; i++) {
+        if (i % FSK_SYMBOL == 0)
+            f = (lcg() & 1 ? 1 : -1) * (i < FSK_SAMPLES / 2 ? 0.05 : 0.2);
+
+        amp = 30000.0 * pow(10, -3.0 * (i % 1024) / 1024);
+        noise = amp / 20;
+
+        ph += 2 * M_PI * f;
+        in[i][0] = clamp16(amp * cos(ph) +
+                           noise * ((int)lcg() - 16384) / 16384);
+        in[i][1] = clamp16(amp * sin(ph) +
+                           noise * ((int)lcg() - 16384) / 16384);
+    }
+    memcpy(in[i], corners, sizeof(corners));
+
+    memset(&fsk, 0, sizeof(fsk));
+    cordic_reset(&fsk.cordic, CORDIC_VECTORING);
+
+    while (out < FSK_SAMPLES) {
+        valid = n < FSK_SAMPLES && lcg() % 8 != 0;
+        if (valid) {
+            fsk_clock(&fsk, in[n][0], in[n][1], 1);
+            n++;
+        } else {
+            fsk_clock(&fsk, 0, 0, 0);
+        }
+
+        if (fsk.out_valid) {
+            printf("%d %d %d\n", in[out][0], in[out][1], fsk.out_ssd);
+            out++;
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    cordic_table();
+
+    if (argc == 2 && !strcmp(argv[1], "nco")) {
+        gen_nco();
+    } else if (argc == 2 && !strcmp(argv[1], "fsk")) {
+        gen_fsk();
+    } else {
+        fprintf(stderr, "Usage: %s <nco|fsk>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    return 0;
+}